@@ -0,0 +1,43 @@
+/*********************************************************************************
+
+ Copyright 2006-2009 MakingThings
+
+ Licensed under the Apache License, 
+ Version 2.0 (the "License"); you may not use this file except in compliance 
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0 
+ 
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+/*
+  at91sam7.h - host stand-in for the AT91SAM7X register definitions.
+  The peripheral structs are placeholders so pointers to them can be declared.
+*/
+
+#ifndef HOST_AT91SAM7_H
+#define HOST_AT91SAM7_H
+
+#include <stdint.h>
+
+typedef struct _AT91S_PIO {
+  volatile uint32_t PIO_PDSR;
+} AT91S_PIO;
+
+typedef struct _AT91S_SPI {
+  volatile uint32_t SPI_SR;
+} AT91S_SPI;
+
+#define AT91C_BASE_PIOA ((AT91S_PIO*)0)
+#define AT91C_BASE_PIOB ((AT91S_PIO*)0)
+#define AT91C_BASE_SPI0 ((AT91S_SPI*)0)
+#define AT91C_BASE_SPI1 ((AT91S_SPI*)0)
+
+#define AT91C_PB18_EF100 (1 << 18)
+
+#endif // HOST_AT91SAM7_H
@@ -0,0 +1,117 @@
+/*********************************************************************************
+
+ Copyright 2006-2009 MakingThings
+
+ Licensed under the Apache License, 
+ Version 2.0 (the "License"); you may not use this file except in compliance 
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0 
+ 
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+/*
+  ch.h - host stand-in for the ChibiOS/RT kernel API.
+
+  Just enough of ChibiOS for the core to build on a desktop machine, so we can
+  benchmark things like the OSC system off-board.  Put this directory ahead of
+  the ChibiOS include paths - see projects/oscbench/Makefile.
+*/
+
+#ifndef HOST_CH_H
+#define HOST_CH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// core.h defines random() before it gets to stdlib.h, which glibc doesn't like.
+// Let stdlib.h declare the real thing first, then put the macro back.
+#ifdef random
+#undef random
+#include <stdlib.h>
+#define random() rand()
+#endif
+
+// newlib's integer-only printf family
+#define siprintf sprintf
+#define sniprintf snprintf
+
+typedef int32_t bool_t;
+typedef int32_t msg_t;
+typedef uint32_t systime_t;
+typedef uint32_t tprio_t;
+typedef msg_t (*tfunc_t)(void *);
+
+#define CH_FREQUENCY    1000
+#define MS2ST(msec)     ((systime_t)(msec))
+#define S2ST(sec)       ((systime_t)((sec) * CH_FREQUENCY))
+#define TIME_IMMEDIATE  ((systime_t)0)
+#define TIME_INFINITE   ((systime_t)-1)
+
+#define RDY_OK          0
+#define RDY_TIMEOUT     -1
+#define RDY_RESET       -2
+
+#define LOWPRIO         2
+#define NORMALPRIO      64
+#define HIGHPRIO        127
+
+// threads run on their own pthread stacks, so working areas are just placeholders
+#define WORKING_AREA(s, n) uint32_t s[((n) + 3) / 4]
+
+typedef struct HostThread_t Thread;
+
+typedef struct Mutex_t {
+  void* impl;           // lazily created pthread mutex, so static Mutexes work
+  struct Mutex_t* next; // this thread's stack of held mutexes - chMtxUnlock() pops it
+} Mutex;
+
+typedef struct Semaphore_t {
+  void* impl;
+  int32_t count;
+} Semaphore;
+
+typedef struct GenericQueue_t {
+  void* impl;
+} GenericQueue, InputQueue, OutputQueue;
+
+typedef void (*vtfunc_t)(void *);
+typedef struct VirtualTimer_t {
+  void* impl;
+} VirtualTimer;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  Thread* chThdCreateStatic(void* wsp, size_t size, tprio_t prio, tfunc_t pf, void* arg);
+  Thread* chThdSelf(void);
+  void    chThdTerminate(Thread* tp);
+  bool_t  chThdShouldTerminate(void);
+  msg_t   chThdWait(Thread* tp);
+  void    chThdSleep(systime_t time);
+  void    chThdSleepMilliseconds(uint32_t msec);
+  void    chThdYield(void);
+  systime_t chTimeNow(void);
+
+  void    chMtxInit(Mutex* mp);
+  void    chMtxLock(Mutex* mp);
+  bool_t  chMtxTryLock(Mutex* mp);
+  Mutex*  chMtxUnlock(void);
+
+  void    chSemInit(Semaphore* sp, int32_t n);
+  msg_t   chSemWait(Semaphore* sp);
+  msg_t   chSemWaitTimeout(Semaphore* sp, systime_t time);
+  void    chSemSignal(Semaphore* sp);
+
+  void    chSysLock(void);
+  void    chSysUnlock(void);
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_CH_H
@@ -0,0 +1,50 @@
+/*********************************************************************************
+
+ Copyright 2006-2009 MakingThings
+
+ Licensed under the Apache License, 
+ Version 2.0 (the "License"); you may not use this file except in compliance 
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0 
+ 
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+/*
+  hal.h - host stand-in for the ChibiOS HAL.
+
+  Only the types and constants the MakingThings headers refer to.  Nothing
+  here drives real hardware - code that touches pins, serial ports and so on
+  isn't part of the host build.
+*/
+
+#ifndef HOST_HAL_H
+#define HOST_HAL_H
+
+#include "ch.h"
+#include "board.h"
+
+#define PAL_MODE_RESET            0
+#define PAL_MODE_UNCONNECTED      1
+#define PAL_MODE_INPUT            2
+#define PAL_MODE_INPUT_PULLUP     3
+#define PAL_MODE_INPUT_PULLDOWN   4
+#define PAL_MODE_INPUT_ANALOG     5
+#define PAL_MODE_OUTPUT_PUSHPULL  6
+#define PAL_MODE_OUTPUT_OPENDRAIN 7
+
+#define IOPORT1 AT91C_BASE_PIOA
+#define IOPORT2 AT91C_BASE_PIOB
+
+typedef struct SerialDriver_t {
+  void* impl;
+} SerialDriver;
+
+extern SerialDriver SD1, SD2, SD3;
+
+#endif // HOST_HAL_H
@@ -0,0 +1,522 @@
+/*********************************************************************************
+
+ Copyright 2006-2010 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+/*
+  host.c - pthread implementation of the host shim.
+
+  Threads, mutexes, semaphores and time for ch.h, plus stand-ins for the
+  peripherals the OSC system talks to:
+  - EEPROM is a block of memory, erased to 0xFF like a fresh chip.
+  - UDP and USB serial pass whole packets through in-process queues.
+    host.h has the calls for the other end of them.
+
+  Thread priorities are ignored - everything runs under the normal host scheduler,
+  so measure throughput & latency here, not real-time behaviour.
+*/
+
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "types.h"
+#include "eeprom.h"
+#include "udpsocket.h"
+#include "usbserial.h"
+#include "host.h"
+
+// how long the board side blocks in a read before checking whether its thread should quit
+#define HOST_READ_TIMEOUT 100
+
+SerialDriver SD1, SD2, SD3;
+
+/*****************************************************************************
+  Threads
+*****************************************************************************/
+
+struct HostThread_t {
+  pthread_t id;
+  tfunc_t func;
+  void* arg;
+  msg_t result;
+  volatile bool_t terminate;
+  Mutex* held; // most recently locked mutex - see chMtxUnlock()
+};
+
+static __thread Thread* hostSelf;
+static pthread_mutex_t hostInitLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void* hostThreadMain(void* arg)
+{
+  Thread* tp = (Thread*)arg;
+  hostSelf = tp;
+  tp->result = tp->func(tp->arg);
+  return 0;
+}
+
+// the working area is ignored - each thread gets a normal pthread stack
+Thread* chThdCreateStatic(void* wsp, size_t size, tprio_t prio, tfunc_t pf, void* arg)
+{
+  (void)wsp;
+  (void)size;
+  (void)prio;
+  Thread* tp = calloc(1, sizeof(Thread));
+  if (tp == 0)
+    return 0;
+  tp->func = pf;
+  tp->arg = arg;
+  if (pthread_create(&tp->id, 0, hostThreadMain, tp) != 0) {
+    free(tp);
+    return 0;
+  }
+  return tp;
+}
+
+// threads we didn't create, like main(), get a record the first time they ask
+Thread* chThdSelf()
+{
+  if (hostSelf == 0) {
+    hostSelf = calloc(1, sizeof(Thread));
+    hostSelf->id = pthread_self();
+  }
+  return hostSelf;
+}
+
+void chThdTerminate(Thread* tp)
+{
+  tp->terminate = 1;
+}
+
+bool_t chThdShouldTerminate()
+{
+  return chThdSelf()->terminate;
+}
+
+msg_t chThdWait(Thread* tp)
+{
+  pthread_join(tp->id, 0);
+  msg_t result = tp->result;
+  free(tp);
+  return result;
+}
+
+static struct timespec hostStart;
+
+static void hostTimespec(struct timespec* ts, uint32_t msec)
+{
+  clock_gettime(CLOCK_REALTIME, ts);
+  ts->tv_sec += msec / 1000;
+  ts->tv_nsec += (msec % 1000) * 1000000L;
+  if (ts->tv_nsec >= 1000000000L) {
+    ts->tv_sec++;
+    ts->tv_nsec -= 1000000000L;
+  }
+}
+
+void chThdSleep(systime_t time)
+{
+  struct timespec ts;
+  ts.tv_sec = time / CH_FREQUENCY;
+  ts.tv_nsec = (time % CH_FREQUENCY) * (1000000000L / CH_FREQUENCY);
+  while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+    ;
+}
+
+void chThdSleepMilliseconds(uint32_t msec)
+{
+  chThdSleep(MS2ST(msec));
+}
+
+void chThdYield()
+{
+  sched_yield();
+}
+
+systime_t chTimeNow()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  pthread_mutex_lock(&hostInitLock);
+  if (hostStart.tv_sec == 0 && hostStart.tv_nsec == 0)
+    hostStart = now;
+  pthread_mutex_unlock(&hostInitLock);
+  return (systime_t)((now.tv_sec - hostStart.tv_sec) * CH_FREQUENCY +
+                     (now.tv_nsec - hostStart.tv_nsec) / (1000000000L / CH_FREQUENCY));
+}
+
+/*****************************************************************************
+  Mutexes
+*****************************************************************************/
+
+// Mutexes are often static & zeroed, so create the pthread side on first use
+static pthread_mutex_t* hostMutex(Mutex* mp)
+{
+  if (mp->impl == 0) {
+    pthread_mutex_lock(&hostInitLock);
+    if (mp->impl == 0) {
+      pthread_mutex_t* m = malloc(sizeof(pthread_mutex_t));
+      pthread_mutex_init(m, 0);
+      mp->impl = m;
+    }
+    pthread_mutex_unlock(&hostInitLock);
+  }
+  return (pthread_mutex_t*)mp->impl;
+}
+
+void chMtxInit(Mutex* mp)
+{
+  hostMutex(mp);
+  mp->next = 0;
+}
+
+void chMtxLock(Mutex* mp)
+{
+  pthread_mutex_lock(hostMutex(mp));
+  Thread* self = chThdSelf();
+  mp->next = self->held;
+  self->held = mp;
+}
+
+bool_t chMtxTryLock(Mutex* mp)
+{
+  if (pthread_mutex_trylock(hostMutex(mp)) != 0)
+    return 0;
+  Thread* self = chThdSelf();
+  mp->next = self->held;
+  self->held = mp;
+  return 1;
+}
+
+// like ChibiOS, unlock whichever mutex this thread locked most recently
+Mutex* chMtxUnlock()
+{
+  Thread* self = chThdSelf();
+  Mutex* mp = self->held;
+  if (mp != 0) {
+    self->held = mp->next;
+    mp->next = 0;
+    pthread_mutex_unlock((pthread_mutex_t*)mp->impl);
+  }
+  return mp;
+}
+
+/*****************************************************************************
+  Semaphores
+*****************************************************************************/
+
+typedef struct HostSemaphore_t {
+  pthread_mutex_t lock;
+  pthread_cond_t signal;
+} HostSemaphore;
+
+static HostSemaphore* hostSemaphore(Semaphore* sp)
+{
+  if (sp->impl == 0) {
+    pthread_mutex_lock(&hostInitLock);
+    if (sp->impl == 0) {
+      HostSemaphore* s = malloc(sizeof(HostSemaphore));
+      pthread_mutex_init(&s->lock, 0);
+      pthread_cond_init(&s->signal, 0);
+      sp->impl = s;
+    }
+    pthread_mutex_unlock(&hostInitLock);
+  }
+  return (HostSemaphore*)sp->impl;
+}
+
+void chSemInit(Semaphore* sp, int32_t n)
+{
+  hostSemaphore(sp);
+  sp->count = n;
+}
+
+msg_t chSemWaitTimeout(Semaphore* sp, systime_t time)
+{
+  HostSemaphore* s = hostSemaphore(sp);
+  msg_t rv = RDY_OK;
+  struct timespec until;
+  if (time != TIME_INFINITE)
+    hostTimespec(&until, time * 1000 / CH_FREQUENCY);
+  pthread_mutex_lock(&s->lock);
+  while (sp->count <= 0 && rv == RDY_OK) {
+    if (time == TIME_IMMEDIATE)
+      rv = RDY_TIMEOUT;
+    else if (time == TIME_INFINITE)
+      pthread_cond_wait(&s->signal, &s->lock);
+    else if (pthread_cond_timedwait(&s->signal, &s->lock, &until) == ETIMEDOUT)
+      rv = RDY_TIMEOUT;
+  }
+  if (rv == RDY_OK)
+    sp->count--;
+  pthread_mutex_unlock(&s->lock);
+  return rv;
+}
+
+msg_t chSemWait(Semaphore* sp)
+{
+  return chSemWaitTimeout(sp, TIME_INFINITE);
+}
+
+void chSemSignal(Semaphore* sp)
+{
+  HostSemaphore* s = hostSemaphore(sp);
+  pthread_mutex_lock(&s->lock);
+  sp->count++;
+  pthread_cond_signal(&s->signal);
+  pthread_mutex_unlock(&s->lock);
+}
+
+/*****************************************************************************
+  System lock
+*****************************************************************************/
+
+static pthread_mutex_t hostSysLock = PTHREAD_MUTEX_INITIALIZER;
+
+void chSysLock()
+{
+  pthread_mutex_lock(&hostSysLock);
+}
+
+void chSysUnlock()
+{
+  pthread_mutex_unlock(&hostSysLock);
+}
+
+/*****************************************************************************
+  EEPROM
+*****************************************************************************/
+
+static uint8_t hostEeprom[EEPROM_SIZE];
+static bool hostEepromErased = false;
+
+static void hostEepromErase()
+{
+  if (!hostEepromErased) {
+    memset(hostEeprom, 0xFF, sizeof(hostEeprom));
+    hostEepromErased = true;
+  }
+}
+
+void eepromInit()
+{
+  hostEepromErase();
+}
+
+int eepromReadBlock(int address, uint8_t* data, int length)
+{
+  if (address < 0 || address + length > EEPROM_SIZE)
+    return -1;
+  pthread_mutex_lock(&hostInitLock);
+  hostEepromErase();
+  memcpy(data, hostEeprom + address, length);
+  pthread_mutex_unlock(&hostInitLock);
+  return 0;
+}
+
+int eepromWriteBlock(int address, uint8_t* data, int length)
+{
+  if (address < 0 || address + length > EEPROM_SIZE)
+    return -1;
+  pthread_mutex_lock(&hostInitLock);
+  hostEepromErase();
+  memcpy(hostEeprom + address, data, length);
+  pthread_mutex_unlock(&hostInitLock);
+  return 0;
+}
+
+int eepromRead(int address)
+{
+  int val;
+  if (eepromReadBlock(address, (uint8_t*)&val, 4) < 0)
+    return -1;
+  return val;
+}
+
+void eepromWrite(int address, int value)
+{
+  eepromWriteBlock(address, (uint8_t*)&value, 4);
+}
+
+/*****************************************************************************
+  Packet queues
+*****************************************************************************/
+
+typedef struct HostPacket_t {
+  int length;
+  int address;
+  int port;
+  char data[HOST_MAX_PACKET];
+} HostPacket;
+
+typedef struct HostQueue_t {
+  pthread_mutex_t lock;
+  pthread_cond_t notEmpty;
+  pthread_cond_t notFull;
+  int head;
+  int count;
+  HostPacket packets[HOST_QUEUE_PACKETS];
+} HostQueue;
+
+#define HOST_QUEUE_INITIALIZER { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, {{0, 0, 0, {0}}} }
+
+// one queue in each direction for each transport
+static HostQueue udpToBoard = HOST_QUEUE_INITIALIZER;
+static HostQueue udpFromBoard = HOST_QUEUE_INITIALIZER;
+static HostQueue usbToBoard = HOST_QUEUE_INITIALIZER;
+static HostQueue usbFromBoard = HOST_QUEUE_INITIALIZER;
+static int hostDropped = 0;
+
+/*
+  Add a packet to a queue.  The board side doesn't wait for room - like a real
+  network it just drops the packet - but the host side does, so load generators
+  get pushed back on instead of losing messages.
+*/
+static bool hostQueuePut(HostQueue* q, const char* data, int length, int address, int port, bool wait)
+{
+  if (length < 0 || length > HOST_MAX_PACKET)
+    return false;
+  pthread_mutex_lock(&q->lock);
+  while (q->count == HOST_QUEUE_PACKETS) {
+    if (!wait) {
+      __sync_fetch_and_add(&hostDropped, 1);
+      pthread_mutex_unlock(&q->lock);
+      return false;
+    }
+    pthread_cond_wait(&q->notFull, &q->lock);
+  }
+  HostPacket* p = &q->packets[(q->head + q->count) % HOST_QUEUE_PACKETS];
+  memcpy(p->data, data, length);
+  p->length = length;
+  p->address = address;
+  p->port = port;
+  q->count++;
+  pthread_cond_signal(&q->notEmpty);
+  pthread_mutex_unlock(&q->lock);
+  return true;
+}
+
+/*
+  Take the next packet off a queue, waiting up to timeout milliseconds for one.
+  Returns its length, 0 if nothing arrived, or -1 if it didn't fit in data.
+*/
+static int hostQueueGet(HostQueue* q, char* data, int length, int* address, int* port, int timeout)
+{
+  struct timespec until;
+  hostTimespec(&until, timeout);
+  pthread_mutex_lock(&q->lock);
+  while (q->count == 0) {
+    if (pthread_cond_timedwait(&q->notEmpty, &q->lock, &until) == ETIMEDOUT) {
+      pthread_mutex_unlock(&q->lock);
+      return 0;
+    }
+  }
+  HostPacket* p = &q->packets[q->head];
+  int got = p->length;
+  if (got <= length)
+    memcpy(data, p->data, got);
+  else
+    got = -1;
+  if (address)
+    *address = p->address;
+  if (port)
+    *port = p->port;
+  q->head = (q->head + 1) % HOST_QUEUE_PACKETS;
+  q->count--;
+  pthread_cond_signal(&q->notFull);
+  pthread_mutex_unlock(&q->lock);
+  return got;
+}
+
+int hostDroppedPackets()
+{
+  return hostDropped;
+}
+
+/*****************************************************************************
+  UDP - there's only the one socket
+*****************************************************************************/
+
+int udpOpen()
+{
+  return 0;
+}
+
+void udpClose(int socket)
+{
+  (void)socket;
+}
+
+bool udpBind(int socket, int port)
+{
+  (void)socket;
+  (void)port;
+  return true;
+}
+
+int udpRead(int socket, char* data, int length, int* src_address, int* src_port)
+{
+  (void)socket;
+  return hostQueueGet(&udpToBoard, data, length, src_address, src_port, HOST_READ_TIMEOUT);
+}
+
+int udpWrite(int socket, const char* data, int length, int address, int port)
+{
+  (void)socket;
+  return hostQueuePut(&udpFromBoard, data, length, address, port, false) ? length : 0;
+}
+
+bool hostUdpSend(const char* data, int length, int address, int port)
+{
+  return hostQueuePut(&udpToBoard, data, length, address, port, true);
+}
+
+int hostUdpReceive(char* data, int length, int timeout)
+{
+  return hostQueueGet(&udpFromBoard, data, length, 0, 0, timeout);
+}
+
+/*****************************************************************************
+  USB serial - SLIP framing is left out, each packet is already a whole frame
+*****************************************************************************/
+
+bool usbserialIsActive()
+{
+  return true;
+}
+
+int usbserialReadSlip(char* buffer, int length)
+{
+  return hostQueueGet(&usbToBoard, buffer, length, 0, 0, HOST_READ_TIMEOUT);
+}
+
+int usbserialWriteSlip(const char* buffer, int length)
+{
+  return hostQueuePut(&usbFromBoard, buffer, length, 0, 0, false) ? length : 0;
+}
+
+bool hostUsbSend(const char* data, int length)
+{
+  return hostQueuePut(&usbToBoard, data, length, 0, 0, true);
+}
+
+int hostUsbReceive(char* data, int length, int timeout)
+{
+  return hostQueueGet(&usbFromBoard, data, length, 0, 0, timeout);
+}
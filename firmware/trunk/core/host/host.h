@@ -0,0 +1,54 @@
+/*********************************************************************************
+
+ Copyright 2006-2010 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+/*
+  host.h - the other end of the host shim's UDP & USB stand-ins.
+
+  On the host, udpRead()/udpWrite() and usbserialReadSlip()/usbserialWriteSlip()
+  move whole packets through in-process queues instead of real hardware.
+  Benchmarks and load generators use these calls to act as the computer on the
+  other side - send packets to the board code, and collect its replies.
+*/
+
+#ifndef HOST_H
+#define HOST_H
+
+#include "types.h"
+
+// biggest packet the queues will carry
+#ifndef HOST_MAX_PACKET
+#define HOST_MAX_PACKET 1536
+#endif
+
+// how many packets can be waiting in each direction
+#ifndef HOST_QUEUE_PACKETS
+#define HOST_QUEUE_PACKETS 256
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+bool hostUdpSend(const char* data, int length, int address, int port);
+int  hostUdpReceive(char* data, int length, int timeout);
+bool hostUsbSend(const char* data, int length);
+int  hostUsbReceive(char* data, int length, int timeout);
+int  hostDroppedPackets(void);
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_H
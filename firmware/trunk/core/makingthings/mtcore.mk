@@ -20,5 +20,6 @@ MTCORESRC = ${MT}/board.c \
 						${MT}/tcpserver.c \
 						${MT}/osc.c \
 						${MT}/osc_data.c \
-						${MT}/osc_patternmatch.c
+						${MT}/osc_patternmatch.c \
+						${MT}/osc_index.c
 
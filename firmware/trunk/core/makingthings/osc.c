@@ -6,6 +6,7 @@
 
 #include "osc.h"
 #include "osc_patternmatch.h"
+#include "osc_index.h"
 #include "osc_data.h"
 #include <string.h>
 #include <stdio.h>
@@ -22,6 +23,14 @@
 #define OSC_MAX_DATA_ITEMS 20
 #endif
 
+// how many segments of an address get their patterns compiled - at least as deep as the namespace
+#ifndef OSC_MAX_ADDRESS_DEPTH
+#define OSC_MAX_ADDRESS_DEPTH 4
+#endif
+#if OSC_MAX_ADDRESS_DEPTH > 32
+#error "OSC_MAX_ADDRESS_DEPTH can be 32 at most"
+#endif
+
 #ifndef OSC_AUTOSEND_STACK_SIZE
 #define OSC_AUTOSEND_STACK_SIZE 512
 #endif
@@ -38,6 +47,11 @@
 #define OSC_AUTOSEND_DEFAULT_INTERVAL 10
 #endif
 
+// latency probes from mchelper - answered here, without a trip through the namespace
+#ifndef OSC_ECHO_ADDRESS
+#define OSC_ECHO_ADDRESS "/system/echo"
+#endif
+
 typedef int (*OscSendMsg)(const char* data, int len);
 
 typedef struct OscChannelData_t {
@@ -47,6 +61,8 @@ typedef struct OscChannelData_t {
   char* outBufPtr;
   char outBuf[OSC_MAX_MSG_OUT];
   char inBuf[OSC_MAX_MSG_IN];
+  OscPattern patterns[OSC_MAX_ADDRESS_DEPTH]; // each segment of the address being dispatched
+  uint32_t compiledPatterns;                  // a bit for each one that's been compiled
   OscSendMsg sendMessage;
 } OscChannelData;
 
@@ -73,9 +89,12 @@ static void oscReceiveMessage(OscChannel ch, char* data, uint32_t len);
 static void oscResetChannel(OscChannelData* ch);
 static OscChannelData* oscGetChannelByType(OscChannel ct);
 static uint32_t oscExtractData(char* buf, uint32_t len, OscData data[], int maxdata);
-static bool oscDispatchNode(OscChannel ch, char* addr, char* fulladdr,
-                              const OscNode* node, OscData d[], int datalen);
-static bool oscNameSpaceQuery(OscChannel ch, char* addr, char *fulladdr, const OscNode* node);
+static bool oscDispatchNode(OscChannel ch, OscChannelData* chd, char* addr, char* fulladdr,
+                              const OscNode* node, int depth, OscData d[], int datalen);
+static const OscPattern* oscSegmentPattern(OscChannelData* chd, int depth, char* segment);
+static bool oscNameSpaceQuery(OscChannel ch, OscChannelData* chd, char* addr, char *fulladdr,
+                              const OscNode* node, int depth);
+static const OscNode* oscNextChild(const OscNode* node, const OscPattern* pattern, int* pos);
 
 static Osc osc;
 extern const OscNode oscRoot; // must be defined by the user
@@ -109,6 +128,7 @@ static msg_t OscUsbSerialThread(void *arg)
 bool oscUsbEnable(bool on)
 {
   if (on && osc.usbThd == 0) {
+    oscIndexBuild(&oscRoot);
     chMtxInit(&osc.usb.lock);
     osc.usb.sendMessage = usbserialWriteSlip;
     osc.usbThd = chThdCreateStatic(waUsbThd, sizeof(waUsbThd), NORMALPRIO, OscUsbSerialThread, NULL);
@@ -160,6 +180,7 @@ static int oscSendMessageUDP(const char* data, int len)
 bool oscUdpEnable(bool on)
 {
   if (on && osc.udpThd == 0) {
+    oscIndexBuild(&oscRoot);
     osc.udpListenPort = OSC_UDP_DEFAULT_PORT;
     oscUdpReplyPort();
     osc.udp.sendMessage = oscSendMessageUDP;
@@ -368,9 +389,14 @@ void oscReceivePacket(OscChannel ch, char* data, uint32_t len)
 */
 void oscReceiveMessage(OscChannel ch, char* data, uint32_t len)
 {
+  OscChannelData* chd = oscGetChannelByType(ch);
+  if (chd == 0)
+    return;
+  chd->compiledPatterns = 0; // a new address
+
   // if the last char is a /, treat it as a namespace query
   if (data[strlen(data) - 1] == '/') {
-    oscNameSpaceQuery(ch, data + 1, data, &oscRoot);
+    oscNameSpaceQuery(ch, chd, data + 1, data, &oscRoot, 0);
     return;
   }
 
@@ -384,7 +410,10 @@ void oscReceiveMessage(OscChannel ch, char* data, uint32_t len)
     return;
   OscData d[datalen];
   if (datalen == oscExtractData(data + length, len, d, datalen)) {
-    oscDispatchNode(ch, data + 1, data, &oscRoot, d, datalen);
+    if (strcmp(data, OSC_ECHO_ADDRESS) == 0)
+      oscCreateMessage(ch, data, d, datalen); // straight back, so the round trip is all transport
+    else
+      oscDispatchNode(ch, chd, data + 1, data, &oscRoot, 0, d, datalen);
   }
 }
 
@@ -394,9 +423,10 @@ void oscReceiveMessage(OscChannel ch, char* data, uint32_t len)
  * a matching handler & trigger it.  Otherwise, descend looking for a
  * child with a matching handler by name only.
  */
-bool oscDispatchNode(OscChannel ch, char* addr, char* fulladdr, const OscNode* node, OscData data[], int datalen)
+bool oscDispatchNode(OscChannel ch, OscChannelData* chd, char* addr, char* fulladdr,
+                     const OscNode* node, int depth, OscData data[], int datalen)
 {
-  char* nextPattern = strchr(addr, '/');
+  char* nextPattern = (addr != 0) ? strchr(addr, '/') : 0; // no addr once we're past the last segment
   if (nextPattern != 0)
     *nextPattern++ = 0;
 
@@ -405,13 +435,16 @@ bool oscDispatchNode(OscChannel ch, char* addr, char* fulladdr, const OscNode* n
     return true;
   }
 
-  uint8_t i;
+  int pos;
+  const OscNode* child;
+  const OscPattern* pattern;
   if (node->range > 0) {
     // as part of our cheat, ranges can only be the second to last node.
     // we jump down a level here since we are planning on getting to the handler
     // without traversing the tree any further
-    for (i = 0; node->children[i] != 0; i++) {
-      if (node->children[i]->handler && oscPatternMatch(nextPattern, node->children[i]->name)) {
+    pattern = (nextPattern != 0) ? oscSegmentPattern(chd, depth + 1, nextPattern) : 0;
+    for (pos = -1; pattern != 0 && (child = oscNextChild(node, pattern, &pos)) != 0; ) {
+      if (child->handler) {
         OscRange r;
         if (oscNumberMatch(addr, node->rangeOffset, node->range, &r)) {
           *(addr - 1) = 0;
@@ -420,28 +453,72 @@ bool oscDispatchNode(OscChannel ch, char* addr, char* fulladdr, const OscNode* n
             int idx = oscRangeNext(&r);
             // recreate an address specific to this index, in the case that we got here
             // through a pattern match
-            siprintf(endofaddr, "/%d/%s", idx, node->children[i]->name);
-            node->children[i]->handler(ch, fulladdr, idx, data, datalen);
+            siprintf(endofaddr, "/%d/%s", idx, child->name);
+            child->handler(ch, fulladdr, idx, data, datalen);
           }
           return true;
         }
       }
     }
     // replace the nulls we stuck in the address string
-    *--addr = '/';
-    *(nextPattern - 1) = '/';
+    if (nextPattern != 0) {
+      *--addr = '/';
+      *(nextPattern - 1) = '/';
+    }
+    return false; // a range's children are only reached through an index, above
   }
   // otherwise, go down to the next level and try some more
-  for (i = 0; node->children[i] != 0; ++i) {
-    if (oscPatternMatch(addr, node->children[i]->name)) {
+  pattern = (addr != 0) ? oscSegmentPattern(chd, depth, addr) : 0;
+  for (pos = -1; pattern != 0 && (child = oscNextChild(node, pattern, &pos)) != 0; ) {
+    if (nextPattern != 0)
       *(nextPattern - 1) = '/'; // replace this - we nulled it earlier
-      if (oscDispatchNode(ch, nextPattern, fulladdr, node->children[i], data, datalen))
-        return true;
-    }
+    if (oscDispatchNode(ch, chd, nextPattern, fulladdr, child, depth + 1, data, datalen))
+      return true;
   }
   return false;
 }
 
+/*
+  The compiled pattern for segment depth of the address being dispatched on chd
+  (or queried, by oscNameSpaceQuery()).
+  Every node at the same depth is checked against the same segment, so it only
+  gets compiled the first time - not once per node, on the stack of each level
+  of oscDispatchNode()'s recursion.  0 if the address goes deeper than
+  OSC_MAX_ADDRESS_DEPTH.
+*/
+const OscPattern* oscSegmentPattern(OscChannelData* chd, int depth, char* segment)
+{
+  if (depth >= OSC_MAX_ADDRESS_DEPTH)
+    return 0;
+  OscPattern* p = &chd->patterns[depth];
+  if ((chd->compiledPatterns & (1UL << depth)) == 0) {
+    char* end = strchr(segment, '/'); // just this segment, whatever follows it
+    if (end != 0)
+      *end = 0;
+    oscPatternCompile(p, segment);
+    if (end != 0)
+      *end = '/';
+    chd->compiledPatterns |= 1UL << depth;
+  }
+  return p;
+}
+
+/*
+  Step through the children of node that match pattern - start with *pos at -1.
+  Literal patterns get looked up in the namespace index, if it's been built.
+  Anything else gets checked against each of the children in turn.
+*/
+const OscNode* oscNextChild(const OscNode* node, const OscPattern* pattern, int* pos)
+{
+  if (oscPatternIsLiteral(pattern) && oscIndexReady())
+    return oscIndexFind(node, pattern->source, pattern->length, pos);
+  while (node->children[++*pos] != 0) {
+    if (oscPatternMatchCompiled(pattern, node->children[*pos]->name))
+      return node->children[*pos];
+  }
+  return 0;
+}
+
 static void oscNameSpaceQueryEndpoint(OscChannel ch, char *fulladdr, const OscNode* node)
 {
   uint8_t i;
@@ -471,7 +548,8 @@ static void oscNameSpaceQueryRangeEndpoint(OscChannel ch, char *fulladdr, const
   A msg with an address ending in / came in.  Treat it as a namespace query,
   and return any OscNodes under the requested namespace.
 */
-bool oscNameSpaceQuery(OscChannel ch, char* addr, char *fulladdr, const OscNode* node)
+bool oscNameSpaceQuery(OscChannel ch, OscChannelData* chd, char* addr, char *fulladdr,
+                       const OscNode* node, int depth)
 {
   char* nextpattern = strchr(addr, '/');
   if (nextpattern != 0) {
@@ -495,13 +573,13 @@ bool oscNameSpaceQuery(OscChannel ch, char* addr, char *fulladdr, const OscNode*
   }
 
   // or try the next level down
-  uint8_t i;
-  for (i = 0; node->children[i] != 0; i++) {
-    if (oscPatternMatch(addr, node->children[i]->name)) {
-      *(nextpattern - 1) = '/'; // replace this - we nulled it earlier
-      if (oscNameSpaceQuery(ch, addr, fulladdr, node->children[i]))
-        return true;
-    }
+  int pos;
+  const OscNode* child;
+  const OscPattern* pattern = oscSegmentPattern(chd, depth, addr);
+  for (pos = -1; pattern != 0 && (child = oscNextChild(node, pattern, &pos)) != 0; ) {
+    *(nextpattern - 1) = '/'; // replace this - we nulled it earlier
+    if (oscNameSpaceQuery(ch, chd, addr, fulladdr, child, depth + 1))
+      return true;
   }
   return false;
 }
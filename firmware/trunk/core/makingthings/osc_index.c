@@ -0,0 +1,138 @@
+
+#include "core.h"
+#ifdef OSC
+#include "osc_index.h"
+#include <string.h>
+
+/*
+  Index of the OSC namespace, so literal address segments can go straight to
+  the child they name instead of being checked against each of the children.
+
+  Every parent/child link in the tree gets a slot in an open addressed hash table,
+  keyed on the parent and the child's name.  The tree is const, so we only need to
+  build this once - oscIndexBuild() does it the first time a channel is enabled.
+  If the namespace is too big for the table, the index stays off and dispatch
+  falls back to scanning the children.
+
+  Slots are found by linear probing and never removed, so children with the same
+  name under the same parent come back in the order they appear in children[],
+  same as a scan would find them.
+*/
+
+// must be a power of 2, and should be comfortably bigger than
+// the number of nodes in the namespace
+#ifndef OSC_INDEX_SLOTS
+#define OSC_INDEX_SLOTS 128
+#endif
+
+#if (OSC_INDEX_SLOTS & (OSC_INDEX_SLOTS - 1)) != 0
+#error OSC_INDEX_SLOTS must be a power of 2
+#endif
+
+// don't fill the table more than 3/4 full, so probes stay short
+#define OSC_INDEX_MAX_ENTRIES ((OSC_INDEX_SLOTS / 4) * 3)
+
+typedef struct OscIndexSlot_t {
+  const OscNode* parent; // 0 if the slot is empty
+  const OscNode* child;
+} OscIndexSlot;
+
+typedef struct OscIndex_t {
+  OscIndexSlot slots[OSC_INDEX_SLOTS];
+  int count;
+  bool ready;
+} OscIndex;
+
+static OscIndex oscIndex;
+
+static uint32_t oscIndexHash(const OscNode* parent, const char* name, int len)
+{
+  uint32_t h = 2166136261U ^ (uint32_t)(uintptr_t)parent; // FNV-1a, seeded with the parent
+  while (len--) {
+    h ^= (uint8_t)*name++;
+    h *= 16777619U;
+  }
+  return h ^ (h >> 16);
+}
+
+/*
+  Has node's own list of children been indexed already?  Nodes can be children of
+  more than one parent, but their subtree only needs to go in once.  Not for
+  leaves - nodes with handlers don't necessarily have a children[] at all.
+*/
+static bool oscIndexHasChildren(const OscNode* node)
+{
+  int i, pos = -1;
+  for (i = 0; node->children[i] != 0; i++) {
+    const char* name = node->children[i]->name;
+    if (name != NULL)
+      return oscIndexFind(node, name, strlen(name), &pos) != 0;
+  }
+  return false; // nothing to index under it anyway
+}
+
+static bool oscIndexAdd(const OscNode* parent)
+{
+  int i;
+  // nodes with handlers are leaves - dispatch never looks at their children
+  if (parent->handler != NULL)
+    return true;
+  for (i = 0; parent->children[i] != 0; i++) {
+    const OscNode* child = parent->children[i];
+    if (child->name == NULL)
+      continue;
+    if (oscIndex.count >= OSC_INDEX_MAX_ENTRIES)
+      return false;
+    int slot = oscIndexHash(parent, child->name, strlen(child->name)) & (OSC_INDEX_SLOTS - 1);
+    while (oscIndex.slots[slot].parent != 0)
+      slot = (slot + 1) & (OSC_INDEX_SLOTS - 1);
+    oscIndex.slots[slot].parent = parent;
+    oscIndex.slots[slot].child = child;
+    oscIndex.count++;
+    if (child->handler == NULL && !oscIndexHasChildren(child) && !oscIndexAdd(child))
+      return false;
+  }
+  return true;
+}
+
+/*
+  Index the namespace under root.  Only does any work the first time it's called.
+  Returns whether the index is usable.
+*/
+bool oscIndexBuild(const OscNode* root)
+{
+  if (!oscIndex.ready && oscIndex.count == 0) {
+    if (oscIndexAdd(root))
+      oscIndex.ready = true;
+    else
+      oscIndex.count = -1; // too big - don't try again
+  }
+  return oscIndex.ready;
+}
+
+bool oscIndexReady()
+{
+  return oscIndex.ready;
+}
+
+/*
+  Find the next child of parent called name - len is the length of name,
+  which doesn't need to be null terminated.
+  Set *pos to -1 for the first lookup, and pass it back in unchanged to get any
+  further children with the same name.  Returns 0 when there are no more.
+*/
+const OscNode* oscIndexFind(const OscNode* parent, const char* name, int len, int* pos)
+{
+  int slot = (*pos < 0) ? (int)(oscIndexHash(parent, name, len) & (OSC_INDEX_SLOTS - 1)) : (*pos + 1) & (OSC_INDEX_SLOTS - 1);
+  for (;; slot = (slot + 1) & (OSC_INDEX_SLOTS - 1)) {
+    const OscIndexSlot* s = &oscIndex.slots[slot];
+    if (s->parent == 0)
+      return 0;
+    if (s->parent == parent && strncmp(s->child->name, name, len) == 0 && s->child->name[len] == 0) {
+      *pos = slot;
+      return s->child;
+    }
+  }
+}
+
+#endif // OSC
@@ -0,0 +1,17 @@
+
+
+#ifndef OSC_INDEX_H
+#define OSC_INDEX_H
+
+#include "osc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+bool oscIndexBuild(const OscNode* root);
+bool oscIndexReady(void);
+const OscNode* oscIndexFind(const OscNode* parent, const char* name, int len, int* pos);
+#ifdef __cplusplus
+}
+#endif
+#endif // OSC_INDEX_H
@@ -27,10 +27,12 @@
 
 #include "osc_patternmatch.h"
 #include <stdio.h>
+#include <string.h>
 #include <ctype.h>
 
 static bool oscMatchBrackets (const char *pattern, const char *test);
 static bool oscMatchList (const char *pattern, const char *test);
+static bool oscBracketAccepts(const char* pattern, char c);
 /*
 static bool oscIsSpecialChar(char c)
 {
@@ -90,7 +92,8 @@ bool oscPatternMatch(const char *  pattern, const char * test)
       }
     default:
       // TODO - this recurses for *each* character...should
-      // iterate unless it's a special osc character
+      // iterate unless it's a special osc character.
+      // oscPatternCompile() / oscPatternMatchCompiled() below don't.
       if (pattern[0] == test[0])
       	return oscPatternMatch(pattern+1,test+1);
       else
@@ -102,48 +105,39 @@ bool oscPatternMatch(const char *  pattern, const char * test)
 /* we know that pattern[0] == '[' and test[0] != 0 */
 static bool oscMatchBrackets (const char *pattern, const char *test)
 {
-  bool result;
+  const char *end = strchr(pattern + 1, ']');
+  if (end == 0)
+    return false; // unterminated [ in pattern
+  if (!oscBracketAccepts(pattern, test[0]))
+    return false;
+  return oscPatternMatch(end + 1, test + 1);
+}
+
+/*
+  Does the [...] set starting at pattern accept c?
+  We know the set is terminated.  Shared by the recursive and the compiled
+  matchers, so the two can't disagree about what's in a set.
+*/
+static bool oscBracketAccepts(const char* pattern, char c)
+{
   bool negated = false;
   const char *p = pattern;
 
-  if (pattern[1] == 0)
-    return false; // unterminated [ in pattern
-
   if (pattern[1] == '!')  {
     negated = true;
     p++;
   }
 
   while (*p != ']') {
-    if (*p == 0)
-      return false; // unterminated [ in pattern
     if (p[1] == '-' && p[2] != 0)  {
-      if (test[0] >= p[0] && test[0] <= p[2])  {
-	      result = !negated;
-	      goto advance;
-      }
-    }
-    if (p[0] == test[0]) {
-      result = !negated;
-      goto advance;
+      if (c >= p[0] && c <= p[2])
+	      return !negated;
     }
+    if (p[0] == c)
+      return !negated;
     p++;
   }
-
-  result = negated;
-
-advance:
-
-  if (!result)
-    return false;
-
-  while (*p != ']') {
-    if (*p == 0)
-      return false; // unterminated [ in pattern
-    p++;
-  }
-
-  return oscPatternMatch(p + 1, test + 1);
+  return negated;
 }
 
 static bool oscMatchList (const char *pattern, const char *test)
@@ -181,12 +175,254 @@ static bool oscMatchList (const char *pattern, const char *test)
            pattern++;
           if (*pattern == ',')
             pattern++;
+          else
+            return false; // none of the alternatives matched - we used to carry on as if one were empty, so {foo}x matched x
+        }
+      }
+    }
+  }
+}
+
+/*
+  Compiled patterns.
+
+  A pattern is turned into a small position automaton (one state per character
+  the pattern can consume), and matching keeps a bit per state rather than
+  backtracking.  A test string is scanned exactly once, without recursion, no
+  matter how many *s or {,} lists the pattern has.
+
+  Patterns with no special characters at all are flagged as literal and just
+  strcmp()'d, and patterns that are nothing but *s match anything.  The few
+  that don't fit - too many states, or {} lists with empty alternatives - fall
+  back on oscPatternMatch().
+*/
+
+#define OSC_PATTERN_LITERAL  0
+#define OSC_PATTERN_NFA      1
+#define OSC_PATTERN_NEVER    2
+#define OSC_PATTERN_FALLBACK 3
+#define OSC_PATTERN_ANYTHING 4 // nothing but *s
+
+#define OSC_STATE_CHAR 0 // arg is the char to match
+#define OSC_STATE_ANY  1 // ? and *
+#define OSC_STATE_SET  2 // arg is the offset of the [ in the pattern
+
+#define OSC_STATE(n) ((OscStateSet)1 << (n))
+
+// index of the lowest bit set in a state set
+static int oscLowestState(OscStateSet states)
+{
+  static const uint8_t debruijn[32] = {
+    0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+    31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9 };
+  uint32_t lowest = (uint32_t)states & -(uint32_t)states;
+  return debruijn[(lowest * 0x077CB531U) >> 27];
+}
+
+static int oscPatternAddState(OscPattern* p, uint8_t op, int arg)
+{
+  if (p->count >= OSC_PATTERN_MAX_STATES || arg > 0xFF)
+    return -1;
+  int s = p->count++;
+  p->op[s] = op;
+  p->arg[s] = arg;
+  p->follow[s] = 0;
+  return s;
+}
+
+/*
+  Compile pattern into p.  pattern is referred to, not copied, so
+  it needs to stick around as long as p does - though what comes after
+  it in the buffer can change, as oscDispatchNode() does with its '/'s.
+*/
+void oscPatternCompile(OscPattern* p, const char* pattern)
+{
+  const char* c = pattern;
+  p->source = pattern;
+  p->length = strlen(pattern);
+  p->count = 0;
+  p->first = 0;
+  p->last = 0;
+  p->nullable = true;
+
+  if (strpbrk(pattern, "?*[]{}\\") == 0) {
+    p->kind = OSC_PATTERN_LITERAL;
+    return;
+  }
+  p->kind = OSC_PATTERN_NFA;
+
+  while (*c) {
+    // build the next piece of the pattern...
+    OscStateSet first = 0, last = 0;
+    bool nullable = false;
+    int s = 0;
+    switch (*c) {
+      case '*':
+        s = oscPatternAddState(p, OSC_STATE_ANY, 0);
+        if (s >= 0)
+          p->follow[s] = OSC_STATE(s);
+        nullable = true;
+        c++;
+        break;
+      case '?':
+        s = oscPatternAddState(p, OSC_STATE_ANY, 0);
+        c++;
+        break;
+      case '[': {
+        const char* end = strchr(c + 1, ']');
+        if (end == 0) {
+          p->kind = OSC_PATTERN_NEVER; // unterminated [ in pattern
+          return;
         }
+        s = oscPatternAddState(p, OSC_STATE_SET, c - pattern);
+        c = end + 1;
+        break;
       }
+      case '{': {
+        const char* end = strchr(c, '}');
+        if (end == 0) {
+          p->kind = OSC_PATTERN_NEVER; // unterminated { in pattern
+          return;
+        }
+        // each alternative is a chain of literal chars
+        for (c++; c <= end && s >= 0; c++) {
+          if (*c == ',' || *c == '}') {
+            p->kind = OSC_PATTERN_FALLBACK; // empty alternative
+            return;
+          }
+          int prev = oscPatternAddState(p, OSC_STATE_CHAR, (uint8_t)*c);
+          if (prev < 0) {
+            s = -1;
+            break;
+          }
+          first |= OSC_STATE(prev);
+          for (c++; *c != ',' && *c != '}' && prev >= 0; c++) {
+            s = oscPatternAddState(p, OSC_STATE_CHAR, (uint8_t)*c);
+            if (s >= 0)
+              p->follow[prev] = OSC_STATE(s);
+            prev = s;
+          }
+          s = prev;
+          if (s >= 0)
+            last |= OSC_STATE(s);
+        }
+        break;
+      }
+      case ']':
+      case '}':
+        p->kind = OSC_PATTERN_NEVER; // spurious closing bracket
+        return;
+      case '\\':
+        if (c[1] == 0) {
+          p->kind = OSC_PATTERN_NEVER;
+          return;
+        }
+        s = oscPatternAddState(p, OSC_STATE_CHAR, (uint8_t)c[1]);
+        c += 2;
+        break;
+      default:
+        s = oscPatternAddState(p, OSC_STATE_CHAR, (uint8_t)*c);
+        c++;
+        break;
     }
+    if (s < 0) {
+      p->kind = OSC_PATTERN_FALLBACK; // too big for us
+      return;
+    }
+    if (first == 0)
+      first = last = OSC_STATE(s);
+
+    // ...then tack it onto the end of what we've got so far
+    OscStateSet ends = p->last;
+    while (ends != 0) {
+      p->follow[oscLowestState(ends)] |= first;
+      ends &= ends - 1;
+    }
+    if (p->nullable)
+      p->first |= first;
+    p->last = nullable ? (p->last | last) : last;
+    p->nullable = p->nullable && nullable;
+  }
+
+  if (strspn(pattern, "*") == p->length)
+    p->kind = OSC_PATTERN_ANYTHING;
+}
+
+// does state i take c?
+static bool oscStateAccepts(const OscPattern* p, int i, char c)
+{
+  switch (p->op[i]) {
+    case OSC_STATE_CHAR:
+      return (char)p->arg[i] == c;
+    case OSC_STATE_SET:
+      return oscBracketAccepts(p->source + p->arg[i], c);
+    default:
+      return true;
   }
 }
 
+// which of the states in candidates will take c?
+static OscStateSet oscPatternStep(const OscPattern* p, OscStateSet candidates, char c)
+{
+  OscStateSet accepted = 0;
+  while (candidates != 0) {
+    int i = oscLowestState(candidates);
+    candidates &= candidates - 1;
+    if (oscStateAccepts(p, i, c))
+      accepted |= OSC_STATE(i);
+  }
+  return accepted;
+}
+
+/*
+  Match test against a pattern compiled by oscPatternCompile().
+  Gives the same answers as oscPatternMatch(p->source, test).
+*/
+bool oscPatternMatchCompiled(const OscPattern* p, const char* test)
+{
+  switch (p->kind) {
+    case OSC_PATTERN_LITERAL:
+      return strncmp(p->source, test, p->length) == 0 && test[p->length] == 0;
+    case OSC_PATTERN_ANYTHING:
+      return true;
+    case OSC_PATTERN_NEVER:
+      return false;
+    case OSC_PATTERN_FALLBACK:
+      return oscPatternMatch(p->source, test);
+  }
+
+  if (*test == 0)
+    return p->nullable;
+
+  OscStateSet active = oscPatternStep(p, p->first, *test++);
+  while (active != 0 && *test != 0) {
+    OscStateSet next;
+    if ((active & (active - 1)) == 0) { // only one state - the usual case in a run of literal chars
+      int i = oscLowestState(active);
+      next = p->follow[i];
+      if ((next & (next - 1)) == 0) {
+        i = oscLowestState(next);
+        active = (next != 0 && oscStateAccepts(p, i, *test++)) ? next : 0;
+        continue;
+      }
+    }
+    else {
+      next = 0;
+      while (active != 0) {
+        next |= p->follow[oscLowestState(active)];
+        active &= active - 1;
+      }
+    }
+    active = oscPatternStep(p, next, *test++);
+  }
+  return (active & p->last) != 0;
+}
+
+bool oscPatternIsLiteral(const OscPattern* p)
+{
+  return p->kind == OSC_PATTERN_LITERAL;
+}
+
 /*
  * Match a range element in an address pattern, and populate an
  * OscRange object accordingly - the range object can either represent
@@ -31,6 +31,9 @@ The OpenSound Control WWW page is
     OSC-pattern-match.h
 */
 
+#ifndef OSC_PATTERNMATCH_H
+#define OSC_PATTERNMATCH_H
+
 #include "types.h"
 
 typedef enum OscRangeState_t {
@@ -45,8 +48,44 @@ typedef struct OscRange_t {
   OscRangeState state; // which mode we're in
 } OscRange;
 
+#ifndef OSC_PATTERN_MAX_STATES
+#define OSC_PATTERN_MAX_STATES 16
+#endif
+#if OSC_PATTERN_MAX_STATES > 32
+#error "OSC_PATTERN_MAX_STATES can be 32 at most - a state set is a 32-bit mask"
+#endif
+
+#if OSC_PATTERN_MAX_STATES <= 16
+typedef uint16_t OscStateSet;
+#else
+typedef uint32_t OscStateSet;
+#endif
+
+/*
+  A pattern compiled by oscPatternCompile() - see osc_patternmatch.c.
+  88 bytes with the default OSC_PATTERN_MAX_STATES on a 64-bit host (patternbench
+  prints it), 80 with the board's 4-byte pointers.  osc.c keeps one for each
+  segment of the address it's dispatching, per channel.
+*/
+typedef struct OscPattern_t {
+  const char* source;                         // the pattern we were compiled from
+  uint8_t kind;                               // literal, automaton, or one of the special cases
+  uint8_t count;                              // how many states we're using
+  uint16_t length;                            // strlen(source) when we were compiled
+  bool nullable;                              // do we match an empty string?
+  OscStateSet first;                          // states that can take the first char
+  OscStateSet last;                           // states we can finish in
+  OscStateSet follow[OSC_PATTERN_MAX_STATES]; // states that can come after each state
+  uint8_t op[OSC_PATTERN_MAX_STATES];         // what each state matches
+  uint8_t arg[OSC_PATTERN_MAX_STATES];        // a char, or the offset of a [ in source
+} OscPattern;
+
 bool oscPatternMatch (const char *pattern, const char *test);
+void oscPatternCompile(OscPattern* p, const char* pattern);
+bool oscPatternMatchCompiled(const OscPattern* p, const char* test);
+bool oscPatternIsLiteral(const OscPattern* p);
 bool oscNumberMatch(const char* pattern, int offset, int count, OscRange* r);
 bool oscRangeHasNext(OscRange* r);
 int  oscRangeNext(OscRange* r);
 
+#endif // OSC_PATTERNMATCH_H
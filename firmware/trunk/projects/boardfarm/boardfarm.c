@@ -0,0 +1,275 @@
+/*
+  boardfarm.c
+  MakingThings
+
+  A farm of virtual Make Controllers, for load-testing mchelper with more boards
+  than anyone has on their desk.  Each one is virtualboard.c in a process of its
+  own, answering /network/find & /system/info like a real board and autosending
+  its analogins at whatever rate we ask for.
+
+    boardfarm [-n boards] [-t udp|usb] [-r packets/s] [-c channels] [-d seconds]
+              [-a address] [-l port] [-h address] [-p port] [-i ms] [-m pid]
+
+  - UDP: board n gets address -a plus n (127.0.1.1 on up - all of 127/8 is
+    loopback on Linux) and listens on port -l, sending to mchelper at -h:-p.
+    mchelper's socket is bound to every address, so the boards' more specific
+    ones get their own packets.  If the OS won't share the port, use another
+    with -l and start mchelperd with --udp-send to match.
+  - USB: each board is a pty.  We print the other ends - hand them to mchelperd
+    with --usb-port.
+
+  Every second we print the packets that went to & from the boards, how many the
+  boards had to drop - no room in the board's queues, or nobody reading its pty -
+  and, given mchelper's pid with -m, how much CPU it used.  The line at the end
+  is the averages for the whole run.  Packets that got to the boards' sockets
+  but not to mchelper aren't ours to see - compare from boards/s with
+  mchelper_board_packets_in_total from mchelperd --metrics-port.  Put clients
+  on mchelper's XML or binary ports alongside, and vary boards x rate x clients.
+
+  Linux only.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <termios.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "virtualboard.h"
+
+static volatile sig_atomic_t stopping = 0;
+
+static void stop(int sig)
+{
+  (void)sig;
+  stopping = 1;
+}
+
+static void usage(void)
+{
+  printf("usage: boardfarm [options]\n"
+         "  -n boards     how many boards (default 16)\n"
+         "  -t udp|usb    how they're connected (default udp)\n"
+         "  -r packets/s  how often each board autosends, 0 for never (default 10)\n"
+         "  -c channels   how many analogins each board autosends (default 8)\n"
+         "  -d seconds    stop after this long (default: when interrupted)\n"
+         "  -a address    the first board's address (default 127.0.1.1)\n"
+         "  -l port       the port boards listen on - mchelper's send port (default 10000)\n"
+         "  -h address    where mchelper is (default 127.0.0.1)\n"
+         "  -p port       mchelper's listen port (default 10000)\n"
+         "  -i ms         a board that's sent nothing for this long tells mchelper it's there (default 1000)\n"
+         "  -m pid        report this process's CPU use - mchelper's\n");
+}
+
+static int parseAddress(const char* s)
+{
+  struct in_addr a;
+  return inet_aton(s, &a) ? (int)ntohl(a.s_addr) : 0;
+}
+
+static int openUdp(int address, int port)
+{
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  struct sockaddr_in a;
+  memset(&a, 0, sizeof(a));
+  a.sin_family = AF_INET;
+  a.sin_addr.s_addr = htonl(address);
+  a.sin_port = htons(port);
+  if (fd < 0 || bind(fd, (struct sockaddr*)&a, sizeof(a)) < 0) {
+    perror("can't bind a board's socket");
+    return -1;
+  }
+  return fd;
+}
+
+// the board keeps the master side - the slave's name goes in name
+static int openPty(char* name, int size)
+{
+  int fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0) {
+    perror("can't open a pty");
+    return -1;
+  }
+  struct termios t;
+  tcgetattr(fd, &t);
+  cfmakeraw(&t);
+  tcsetattr(fd, TCSANOW, &t);
+  snprintf(name, size, "%s", ptsname(fd));
+  return fd;
+}
+
+// user + system time in clock ticks, from /proc/<pid>/stat
+static long long cpuTicks(int pid)
+{
+  char path[32], stat[1024];
+  snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+  FILE* f = fopen(path, "r");
+  if (f == NULL)
+    return -1;
+  int got = fread(stat, 1, sizeof(stat) - 1, f);
+  fclose(f);
+  stat[got > 0 ? got : 0] = 0;
+  char* p = strrchr(stat, ')'); // the name can have anything in it
+  unsigned long long utime, stime;
+  if (p == NULL || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2)
+    return -1;
+  return utime + stime;
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void total(const FarmCounters* counters, int boards, long long* to, long long* from, long long* dropped)
+{
+  int i;
+  *to = *from = *dropped = 0;
+  for (i = 0; i < boards; i++) {
+    *to += counters[i].toBoard;
+    *from += counters[i].fromBoard;
+    *dropped += counters[i].dropped;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  int boards = 16, usb = 0, rate = 10, channels = 8, duration = 0;
+  int address = parseAddress("127.0.1.1"), listenPort = 10000;
+  int hostAddress = parseAddress("127.0.0.1"), hostPort = 10000;
+  int announceMs = 1000, mchelperPid = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:t:r:c:d:a:l:h:p:i:m:")) != -1) {
+    switch (opt) {
+      case 'n': boards = atoi(optarg); break;
+      case 't': usb = (strcmp(optarg, "usb") == 0); break;
+      case 'r': rate = atoi(optarg); break;
+      case 'c': channels = atoi(optarg); break;
+      case 'd': duration = atoi(optarg); break;
+      case 'a': address = parseAddress(optarg); break;
+      case 'l': listenPort = atoi(optarg); break;
+      case 'h': hostAddress = parseAddress(optarg); break;
+      case 'p': hostPort = atoi(optarg); break;
+      case 'i': announceMs = atoi(optarg); break;
+      case 'm': mchelperPid = atoi(optarg); break;
+      default: usage(); return 1;
+    }
+  }
+  if (boards <= 0 || rate < 0 || rate > 500 || channels < 0 || address == 0 || hostAddress == 0) {
+    usage();
+    return 1;
+  }
+
+  FarmCounters* counters = mmap(NULL, boards * sizeof(FarmCounters), PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  VirtualBoard* farm = calloc(boards, sizeof(VirtualBoard));
+  pid_t* pids = calloc(boards, sizeof(pid_t));
+  if (counters == MAP_FAILED || farm == NULL || pids == NULL) {
+    printf("out of memory\n");
+    return 1;
+  }
+
+  int i;
+  if (usb)
+    printf("mchelperd");
+  for (i = 0; i < boards; i++) {
+    VirtualBoard* b = &farm[i];
+    char name[64];
+    b->index = i;
+    b->usb = usb;
+    b->address = usb ? 0 : address + i;
+    b->listenPort = listenPort;
+    b->hostAddress = hostAddress;
+    b->hostPort = hostPort;
+    b->rate = rate;
+    b->channels = channels;
+    b->announceMs = announceMs;
+    b->counters = &counters[i];
+    b->fd = usb ? openPty(name, sizeof(name)) : openUdp(b->address, listenPort);
+    if (b->fd < 0)
+      return 1;
+    if (usb)
+      printf(" --usb-port %s", name);
+  }
+  if (usb)
+    printf("\n");
+  fflush(stdout); // or the children print it again
+
+  for (i = 0; i < boards; i++) {
+    pids[i] = fork();
+    if (pids[i] == 0) {
+      virtualBoardRun(&farm[i]);
+      _exit(0);
+    }
+    if (pids[i] < 0) {
+      perror("can't start a board");
+      boards = i;
+      stopping = 1;
+      break;
+    }
+    close(farm[i].fd);
+  }
+
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+
+  printf("%d %s boards, autosending %d packets/s\n", boards, usb ? "usb" : "udp", rate);
+  printf("%6s %12s %12s %10s %10s\n", "secs", "to boards/s", "from boards/s", "dropped", "mchelper");
+  long long lastTo = 0, lastFrom = 0, lastDropped = 0;
+  long long cpuStart = mchelperPid ? cpuTicks(mchelperPid) : -1, lastCpu = cpuStart;
+  double clockTicks = sysconf(_SC_CLK_TCK);
+  double start = now(), last = start;
+  while (!stopping && (duration == 0 || now() - start < duration)) {
+    usleep(1000000);
+    long long to, from, dropped;
+    total(counters, boards, &to, &from, &dropped);
+    double t = now();
+    char cpu[16] = "";
+    long long ticks = mchelperPid ? cpuTicks(mchelperPid) : -1;
+    if (ticks >= 0 && lastCpu >= 0)
+      snprintf(cpu, sizeof(cpu), "%.1f%%", 100.0 * (ticks - lastCpu) / clockTicks / (t - last));
+    printf("%6.0f %12.0f %12.0f %10lld %10s\n", t - start, (to - lastTo) / (t - last), (from - lastFrom) / (t - last),
+           dropped - lastDropped, cpu);
+    fflush(stdout);
+    lastTo = to;
+    lastFrom = from;
+    lastDropped = dropped;
+    lastCpu = ticks;
+    last = t;
+
+    int status;
+    pid_t gone;
+    while ((gone = waitpid(-1, &status, WNOHANG)) > 0)
+      printf("board process %d exited\n", (int)gone);
+  }
+
+  double elapsed = now() - start;
+  long long to, from, dropped;
+  total(counters, boards, &to, &from, &dropped);
+  long long ticks = mchelperPid ? cpuTicks(mchelperPid) : -1;
+  printf("%d %s boards at %d packets/s for %.0fs: %.0f to boards/s, %.0f from boards/s, %lld dropped (%.2f%%)",
+         boards, usb ? "usb" : "udp", rate, elapsed, to / elapsed, from / elapsed, dropped,
+         (from + dropped) ? 100.0 * dropped / (from + dropped) : 0.0);
+  if (ticks >= 0 && cpuStart >= 0)
+    printf(", mchelper %.1f%% cpu", 100.0 * (ticks - cpuStart) / clockTicks / elapsed);
+  printf("\n");
+
+  for (i = 0; i < boards; i++)
+    kill(pids[i], SIGTERM);
+  while (wait(NULL) > 0)
+    ;
+  return 0;
+}
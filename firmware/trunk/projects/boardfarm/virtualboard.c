@@ -0,0 +1,427 @@
+/*
+  virtualboard.c
+  MakingThings
+
+  One virtual Make Controller, running on the host shim in core/host.
+
+  osc.c runs just like it does on the board, with a namespace that looks like a
+  real board's to mchelper - /network/find, /system/info, the analogins,
+  digitalins & appleds - and sensors that never sit still, so autosend always
+  has something to send.  We sit between the shim's queues and the real world:
+  - UDP: packets for the board's socket go on its queue, and what it sends goes
+    out that socket to mchelper.
+  - USB: the board is the master side of a pty.  We SLIP decode what mchelper
+    writes to the other side and SLIP encode what the board sends back, like
+    the real board's USB serial does.
+
+  osc.c keeps its state in globals, so it's one board per process - boardfarm.c
+  forks one of these for each.
+*/
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <pthread.h>
+#include "core.h"
+#include "osc.h"
+#include "osc_data.h"
+#include "host.h"
+#include "virtualboard.h"
+
+#define ANALOGIN_CHANNELS  8
+#define DIGITALIN_CHANNELS 8
+#define APPLED_CHANNELS    4
+#define WAIT_MS            100 // longest we wait on the board before checking whether to announce
+
+#define SLIP_END     0300
+#define SLIP_ESC     0333
+#define SLIP_ESC_END 0334
+#define SLIP_ESC_ESC 0335
+
+static const VirtualBoard* board;
+static char boardName[32];
+static int sendDropped = 0;
+
+/*****************************************************************************
+  The namespace
+*****************************************************************************/
+
+static int analoginPhase[ANALOGIN_CHANNELS];
+static int analoginSent[ANALOGIN_CHANNELS];
+static int analoginAutosendChannels;
+static int appledValues[APPLED_CHANNELS];
+
+// stands in for the real one - a sensor that never sits still, each reading is different
+int analoginValue(int idx)
+{
+  analoginPhase[idx] = (analoginPhase[idx] + 1 + (board->index + idx) % 31) & 1023;
+  return analoginPhase[idx];
+}
+
+static void addressToString(char* s, int address)
+{
+  siprintf(s, "%d.%d.%d.%d", (address >> 24) & 0xFF, (address >> 16) & 0xFF, (address >> 8) & 0xFF, address & 0xFF);
+}
+
+static void analoginOscHandler(OscChannel ch, char* address, int idx, OscData d[], int datalen)
+{
+  UNUSED(d);
+  if (datalen == 0) {
+    OscData d = { .type = INT, .value.i = analoginValue(idx) };
+    oscCreateMessage(ch, address, &d, 1);
+  }
+}
+
+static void analoginAutosendHandler(OscChannel ch, char* address, int idx, OscData d[], int datalen)
+{
+  if (datalen == 0) {
+    OscData d = { .type = INT, .value.i = (analoginAutosendChannels & (1 << idx)) ? 1 : 0 };
+    oscCreateMessage(ch, address, &d, 1);
+  }
+  else if (datalen == 1 && d[0].type == INT) {
+    if (d[0].value.i)
+      analoginAutosendChannels |= (1 << idx);
+    else
+      analoginAutosendChannels &= ~(1 << idx);
+  }
+}
+
+// like the real one, only what's changed
+static void analoginOscAutosender(OscChannel ch)
+{
+  OscData d = { .type = INT };
+  char addr[19];
+  int i;
+  for (i = 0; i < ANALOGIN_CHANNELS; i++) {
+    if (analoginAutosendChannels & (1 << i)) {
+      d.value.i = analoginValue(i);
+      if (analoginSent[i] != d.value.i) {
+        analoginSent[i] = d.value.i;
+        sniprintf(addr, sizeof(addr), "/analogin/%d/value", i);
+        oscCreateMessage(ch, addr, &d, 1);
+      }
+    }
+  }
+}
+
+static void digitalinOscHandler(OscChannel ch, char* address, int idx, OscData d[], int datalen)
+{
+  UNUSED(d);
+  if (datalen == 0) {
+    OscData d = { .type = INT, .value.i = (analoginValue(idx) > 512) ? 1 : 0 };
+    oscCreateMessage(ch, address, &d, 1);
+  }
+}
+
+static void appledOscHandler(OscChannel ch, char* address, int idx, OscData d[], int datalen)
+{
+  if (datalen == 0) {
+    OscData d = { .type = INT, .value.i = appledValues[idx] };
+    oscCreateMessage(ch, address, &d, 1);
+  }
+  else if (datalen == 1 && d[0].type == INT) {
+    appledValues[idx] = d[0].value.i ? 1 : 0;
+  }
+}
+
+static void systemNameOsc(OscChannel ch, char* address, int idx, OscData d[], int datalen)
+{
+  UNUSED(idx);
+  if (datalen == 1 && d[0].type == STRING) {
+    strncpy(boardName, d[0].value.s, sizeof(boardName) - 1);
+  }
+  else if (datalen == 0) {
+    OscData d = { .type = STRING, .value.s = boardName };
+    oscCreateMessage(ch, address, &d, 1);
+  }
+}
+
+static void systemSerialNumOsc(OscChannel ch, char* address, int idx, OscData d[], int datalen)
+{
+  UNUSED(idx); UNUSED(d);
+  if (datalen == 0) {
+    OscData d = { .type = INT, .value.i = 1000 + board->index };
+    oscCreateMessage(ch, address, &d, 1);
+  }
+}
+
+// the same two replies as system.c's, which is what mchelper looks for
+static void systemInfoOsc(OscChannel ch, char* address, int idx, OscData d[], int datalen)
+{
+  UNUSED(idx); UNUSED(d);
+  if (datalen == 0) {
+    char *endofaddr = address + strlen(address);
+    char verStr[30];
+    char ipaddr[16];
+    addressToString(ipaddr, board->address);
+    sniprintf(verStr, sizeof(verStr), "%s %d.%d.%d", FIRMWARE_NAME, FIRMWARE_MAJOR_VERSION, FIRMWARE_MINOR_VERSION, FIRMWARE_BUILD_NUMBER);
+    OscData a[5] = {
+      { .type = STRING, .value.s = boardName },
+      { .type = INT, .value.i = 1000 + board->index },
+      { .type = STRING, .value.s = ipaddr },
+      { .type = STRING, .value.s = verStr },
+      { .type = INT, .value.i = 0 }
+    };
+    siprintf(endofaddr, "-a");
+    oscCreateMessage(ch, address, a, 5);
+
+    OscData b[6] = {
+      { .type = INT, .value.i = 0 },
+      { .type = INT, .value.i = 0 },
+      { .type = STRING, .value.s = "0.0.0.0" },
+      { .type = STRING, .value.s = "255.0.0.0" },
+      { .type = INT, .value.i = oscUdpListenPort() },
+      { .type = INT, .value.i = oscUdpReplyPort() }
+    };
+    siprintf(endofaddr, "-b");
+    oscCreateMessage(ch, address, b, 6);
+  }
+}
+
+static void networkOscFindHandler(OscChannel ch, char* address, int idx, OscData data[], int datalen)
+{
+  UNUSED(idx); UNUSED(datalen); UNUSED(data);
+  char addrbuf[16];
+  addressToString(addrbuf, board->address);
+  OscData d[4] = {
+    { .type = STRING, .value.s = addrbuf },
+    { .type = INT,    .value.i = oscUdpListenPort() },
+    { .type = INT,    .value.i = oscUdpReplyPort() },
+    { .type = STRING, .value.s = boardName }
+  };
+  oscCreateMessage(ch, address, d, 4);
+}
+
+static const OscNode analoginValueNode = { .name = "value", .handler = analoginOscHandler };
+static const OscNode analoginAutosendNode = { .name = "autosend", .handler = analoginAutosendHandler };
+const OscNode analoginOsc = {
+  .name = "analogin",
+  .range = ANALOGIN_CHANNELS,
+  .children = { &analoginValueNode, &analoginAutosendNode, 0 },
+  .autosender = analoginOscAutosender
+};
+
+static const OscNode digitalinValueNode = { .name = "value", .handler = digitalinOscHandler };
+static const OscNode digitalinOsc = {
+  .name = "digitalin",
+  .range = DIGITALIN_CHANNELS,
+  .children = { &digitalinValueNode, 0 }
+};
+
+static const OscNode appledValueNode = { .name = "value", .handler = appledOscHandler };
+static const OscNode appledOsc = {
+  .name = "appled",
+  .range = APPLED_CHANNELS,
+  .children = { &appledValueNode, 0 }
+};
+
+static const OscNode systemNameNode = { .name = "name", .handler = systemNameOsc };
+static const OscNode systemSerialNumNode = { .name = "serialnumber", .handler = systemSerialNumOsc };
+static const OscNode systemInfoNode = { .name = "info", .handler = systemInfoOsc };
+static const OscNode systemInfoInternalNode = { .name = "info-internal", .handler = systemInfoOsc };
+const OscNode systemOsc = {
+  .name = "system",
+  .children = { &systemNameNode, &systemSerialNumNode, &systemInfoNode, &systemInfoInternalNode, 0 }
+};
+
+static const OscNode networkFindNode = { .name = "find", .handler = networkOscFindHandler };
+const OscNode networkOsc = {
+  .name = "network",
+  .children = { &networkFindNode, 0 }
+};
+
+const OscNode oscRoot = {
+  .children = {
+    &analoginOsc,
+    &digitalinOsc,
+    &appledOsc,
+    &systemOsc,
+    &networkOsc,
+    0
+  }
+};
+
+/*****************************************************************************
+  Into the board
+*****************************************************************************/
+
+static void toBoard(const char* packet, int length, int address, int port)
+{
+  if (board->usb)
+    hostUsbSend(packet, length);
+  else
+    hostUdpSend(packet, length, address, port);
+  __sync_fetch_and_add(&board->counters->toBoard, 1);
+}
+
+static void udpInbound(void)
+{
+  char packet[HOST_MAX_PACKET];
+  struct sockaddr_in from;
+  while (true) {
+    socklen_t fromlen = sizeof(from);
+    int got = recvfrom(board->fd, packet, sizeof(packet), 0, (struct sockaddr*)&from, &fromlen);
+    if (got > 0)
+      toBoard(packet, got, ntohl(from.sin_addr.s_addr), ntohs(from.sin_port));
+  }
+}
+
+// undo what mchelper's SLIP encoding did, a read at a time
+static void usbInbound(void)
+{
+  char buf[512];
+  char packet[HOST_MAX_PACKET];
+  int length = 0;
+  bool escaped = false, overflowed = false;
+  struct pollfd p = { .fd = board->fd, .events = POLLIN };
+  while (true) {
+    poll(&p, 1, -1);
+    int got = read(board->fd, buf, sizeof(buf));
+    if (got <= 0) {
+      if (got < 0 && errno != EAGAIN && errno != EINTR)
+        usleep(WAIT_MS * 1000); // nobody has the other side open
+      continue;
+    }
+    int i;
+    for (i = 0; i < got; i++) {
+      uint8_t c = buf[i];
+      if (c == SLIP_END) {
+        if (length > 0 && !overflowed)
+          toBoard(packet, length, 0, 0);
+        length = 0;
+        escaped = overflowed = false;
+        continue;
+      }
+      if (c == SLIP_ESC) {
+        escaped = true;
+        continue;
+      }
+      if (escaped) {
+        c = (c == SLIP_ESC_END) ? SLIP_END : (c == SLIP_ESC_ESC) ? SLIP_ESC : c;
+        escaped = false;
+      }
+      if (length < HOST_MAX_PACKET)
+        packet[length++] = c;
+      else
+        overflowed = true;
+    }
+  }
+}
+
+static void* inboundThread(void* arg)
+{
+  UNUSED(arg);
+  if (board->usb)
+    usbInbound();
+  else
+    udpInbound();
+  return 0;
+}
+
+/*****************************************************************************
+  Out of the board
+*****************************************************************************/
+
+static bool udpOutbound(const char* packet, int length)
+{
+  struct sockaddr_in to;
+  memset(&to, 0, sizeof(to));
+  to.sin_family = AF_INET;
+  to.sin_addr.s_addr = htonl(board->hostAddress);
+  to.sin_port = htons(board->hostPort);
+  return sendto(board->fd, packet, length, 0, (struct sockaddr*)&to, sizeof(to)) == length;
+}
+
+/*
+  Like usbserialWriteSlip() - END on both ends, so whatever's at the other end
+  can pick up again after anything that got lost.  If nobody's reading the pty
+  and its buffer is full, the packet goes the way it would on a real board.
+*/
+static bool usbOutbound(const char* packet, int length)
+{
+  char frame[2 * HOST_MAX_PACKET + 2];
+  int framelen = 0, i;
+  frame[framelen++] = SLIP_END;
+  for (i = 0; i < length; i++) {
+    uint8_t c = packet[i];
+    if (c == SLIP_END || c == SLIP_ESC) {
+      frame[framelen++] = SLIP_ESC;
+      frame[framelen++] = (c == SLIP_END) ? SLIP_ESC_END : SLIP_ESC_ESC;
+    }
+    else
+      frame[framelen++] = c;
+  }
+  frame[framelen++] = SLIP_END;
+
+  int written = 0;
+  struct pollfd p = { .fd = board->fd, .events = POLLOUT };
+  while (written < framelen) {
+    int n = write(board->fd, frame + written, framelen - written);
+    if (n > 0)
+      written += n;
+    else if (n < 0 && errno != EAGAIN && errno != EINTR)
+      return false;
+    else if (poll(&p, 1, WAIT_MS) <= 0)
+      return false;
+  }
+  return true;
+}
+
+// what mchelper sends to find boards - we send it to ourselves when we've been quiet
+static int findRequest(char* buf, int size)
+{
+  uint32_t remaining = size;
+  char* p = oscEncodeString(buf, &remaining, "/network/find");
+  p = oscEncodeString(p, &remaining, ",");
+  return p - buf;
+}
+
+void virtualBoardRun(const VirtualBoard* b)
+{
+  board = b;
+  siprintf(boardName, "Virtual Board %d", board->index);
+  analoginAutosendChannels = (1 << MIN(board->channels, ANALOGIN_CHANNELS)) - 1;
+
+  if (board->usb) {
+    oscUsbEnable(YES);
+  }
+  else {
+    oscUdpSetListenPort(board->listenPort);
+    oscUdpSetReplyPort(board->hostPort);
+    oscUdpEnable(YES);
+  }
+  if (board->rate > 0) {
+    oscSetAutosendInterval(MAX(1000 / board->rate, 2));
+    oscSetAutosendDestination(board->usb ? USB : UDP);
+    oscAutosendEnable(YES);
+  }
+
+  pthread_t inbound;
+  pthread_create(&inbound, 0, inboundThread, 0);
+
+  char packet[HOST_MAX_PACKET];
+  char find[64];
+  int findlen = findRequest(find, sizeof(find));
+  systime_t lastSent = chTimeNow();
+  while (true) {
+    int got = board->usb ? hostUsbReceive(packet, sizeof(packet), WAIT_MS)
+                         : hostUdpReceive(packet, sizeof(packet), WAIT_MS);
+    if (got > 0) {
+      if (board->usb ? usbOutbound(packet, got) : udpOutbound(packet, got)) {
+        __sync_fetch_and_add(&board->counters->fromBoard, 1);
+        lastSent = chTimeNow();
+      }
+      else
+        sendDropped++;
+    }
+
+    // mchelper's pings are broadcasts, which don't make it to a board on a loopback address
+    if (!board->usb && board->announceMs > 0 && chTimeNow() - lastSent >= MS2ST(board->announceMs)) {
+      hostUdpSend(find, findlen, board->hostAddress, board->hostPort);
+      lastSent = chTimeNow();
+    }
+    board->counters->dropped = hostDroppedPackets() + sendDropped;
+  }
+}
@@ -0,0 +1,35 @@
+/*
+  virtualboard.h
+  MakingThings
+
+  One virtual board - see virtualboard.c.  Kept free of core.h so boardfarm.c
+  can use the system's process & signal calls alongside it.
+*/
+
+#ifndef VIRTUALBOARD_H
+#define VIRTUALBOARD_H
+
+// what each board has done - shared with the farm, which adds them up
+typedef struct FarmCounters_t {
+  volatile int toBoard;    // packets from mchelper
+  volatile int fromBoard;  // packets to mchelper
+  volatile int dropped;    // packets the board had no room for
+} FarmCounters;
+
+typedef struct VirtualBoard_t {
+  int index;
+  int usb;          // a pty speaking SLIP, or a UDP socket
+  int fd;           // the pty's master side, or the board's bound socket
+  int address;      // the board's own address, host byte order - UDP only
+  int listenPort;   // the port its socket is bound to - UDP only
+  int hostAddress;  // where mchelper is listening - UDP only
+  int hostPort;
+  int rate;         // autosend packets/sec, 0 for none
+  int channels;     // how many analogins autosend
+  int announceMs;   // tell mchelper we're here after this long with nothing sent - UDP only
+  FarmCounters* counters;
+} VirtualBoard;
+
+void virtualBoardRun(const VirtualBoard* board); // doesn't return
+
+#endif // VIRTUALBOARD_H
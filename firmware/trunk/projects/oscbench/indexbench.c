@@ -0,0 +1,203 @@
+/*
+  indexbench.c
+  MakingThings
+
+  Host benchmark for the OSC namespace index in osc_index.c.
+
+  Builds a made up namespace with a few hundred nodes, shaped like a bigger
+  version of the heavy project's - a wide root, some subsystems with a flat list
+  of properties and some with another level of groups underneath.
+  First checks that the index finds the same children, in the same order, as
+  scanning them with the pattern matcher does.  Then times resolving full literal
+  addresses each way.
+*/
+
+#include "core.h"
+#include "osc_patternmatch.h"
+#include "osc_index.h"
+#include <stdlib.h>
+#include <time.h>
+
+#define FLAT_SUBSYSTEMS  16
+#define FLAT_PROPERTIES  12
+#define DEEP_SUBSYSTEMS  8
+#define DEEP_GROUPS      8
+#define DEEP_PROPERTIES  6
+#define MAX_PATHS        1024
+#define MAX_DEPTH        3
+
+static void leafHandler(OscChannel ch, char* address, int idx, OscData data[], int datalen)
+{
+  UNUSED(ch);
+  UNUSED(address);
+  UNUSED(idx);
+  UNUSED(data);
+  UNUSED(datalen);
+}
+
+static const OscNode* allNodes[MAX_PATHS * 2];
+static int nodeCount = 0;
+static char paths[MAX_PATHS][48];
+static int pathCount = 0;
+
+static OscNode* newNode(const char* name, int children)
+{
+  OscNode* n = calloc(1, sizeof(OscNode) + (children + 1) * sizeof(OscNode*));
+  n->name = name ? strdup(name) : 0;
+  if (children == 0)
+    n->handler = leafHandler;
+  allNodes[nodeCount++] = n;
+  return n;
+}
+
+static OscNode* buildNamespace(void)
+{
+  static const char* props[] = { "value", "active", "state", "speed", "direction", "position",
+                                 "min", "max", "invert", "autosend", "threshold", "duty" };
+  char name[32];
+  int s, g, p, r = 0;
+  OscNode* root = newNode(0, FLAT_SUBSYSTEMS + DEEP_SUBSYSTEMS + 1);
+
+  for (s = 0; s < FLAT_SUBSYSTEMS; s++) {
+    sprintf(name, "subsystem%02d", s);
+    OscNode* sub = newNode(name, FLAT_PROPERTIES);
+    root->children[r++] = sub;
+    for (p = 0; p < FLAT_PROPERTIES; p++) {
+      sub->children[p] = newNode(props[p], 0);
+      sprintf(paths[pathCount++], "/%s/%s", sub->name, props[p]);
+    }
+  }
+  for (s = 0; s < DEEP_SUBSYSTEMS; s++) {
+    sprintf(name, "device%02d", s);
+    OscNode* sub = newNode(name, DEEP_GROUPS);
+    root->children[r++] = sub;
+    for (g = 0; g < DEEP_GROUPS; g++) {
+      sprintf(name, "group%d", g);
+      OscNode* group = newNode(name, DEEP_PROPERTIES);
+      sub->children[g] = group;
+      for (p = 0; p < DEEP_PROPERTIES; p++) {
+        group->children[p] = newNode(props[p], 0);
+        sprintf(paths[pathCount++], "/%s/%s/%s", sub->name, group->name, props[p]);
+      }
+    }
+  }
+  // a second node with the same name, to check we keep the order of children[]
+  root->children[r++] = newNode("subsystem03", 0);
+  return root;
+}
+
+static const OscNode* scanNext(const OscNode* node, const OscPattern* pattern, int* pos)
+{
+  while (node->children[++*pos] != 0) {
+    if (oscPatternMatchCompiled(pattern, node->children[*pos]->name))
+      return node->children[*pos];
+  }
+  return 0;
+}
+
+/*
+  Walk a literal address down to its node, the way oscDispatchNode() does,
+  either scanning the children at each level or looking them up in the index.
+*/
+static const OscNode* resolve(const OscNode* root, const char* path, bool indexed)
+{
+  char buf[48];
+  char* segment = strcpy(buf, path) + 1;
+  const OscNode* node = root;
+  while (node != 0 && segment != 0) {
+    char* next = strchr(segment, '/');
+    if (next != 0)
+      *next++ = 0;
+    OscPattern pattern;
+    oscPatternCompile(&pattern, segment);
+    int pos = -1;
+    node = indexed ? oscIndexFind(node, segment, pattern.length, &pos) : scanNext(node, &pattern, &pos);
+    segment = next;
+  }
+  return node;
+}
+
+static int mismatches = 0;
+
+static void compareChildren(const OscNode* parent, const char* name)
+{
+  OscPattern pattern;
+  oscPatternCompile(&pattern, name);
+  int scanPos = -1, indexPos = -1;
+  const OscNode* scanned;
+  const OscNode* found;
+  do {
+    scanned = scanNext(parent, &pattern, &scanPos);
+    found = oscIndexFind(parent, name, strlen(name), &indexPos);
+    if (scanned != found && mismatches++ < 20)
+      printf("mismatch: \"%s\" under \"%s\"\n", name, parent->name ? parent->name : "/");
+  } while (scanned != 0 && found != 0);
+}
+
+static void differential(const OscNode* root)
+{
+  static const char* missing[] = { "", "valu", "values", "subsystem", "group10", "Value", 0 };
+  int n, i, checked = 0;
+  for (n = 0; n < nodeCount; n++) {
+    const OscNode* parent = allNodes[n];
+    if (parent->handler)
+      continue;
+    for (i = 0; parent->children[i] != 0; i++, checked++)
+      compareChildren(parent, parent->children[i]->name);
+    for (i = 0; missing[i] != 0; i++, checked++)
+      compareChildren(parent, missing[i]);
+  }
+  for (i = 0; i < pathCount; i++, checked++) {
+    if (resolve(root, paths[i], false) != resolve(root, paths[i], true) && mismatches++ < 20)
+      printf("mismatch resolving %s\n", paths[i]);
+  }
+  printf("differential: %d lookups checked, %d mismatches\n", checked, mismatches);
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void timing(const OscNode* root)
+{
+  volatile int hits = 0;
+  const int iterations = 2000;
+  int i, j;
+
+  double t = now();
+  for (i = 0; i < iterations; i++) {
+    for (j = 0; j < pathCount; j++)
+      hits += resolve(root, paths[j], false) != 0;
+  }
+  double scanned = now() - t;
+
+  t = now();
+  for (i = 0; i < iterations; i++) {
+    for (j = 0; j < pathCount; j++)
+      hits += resolve(root, paths[j], true) != 0;
+  }
+  double indexed = now() - t;
+
+  int lookups = iterations * pathCount;
+  printf("%d nodes, %d leaf addresses\n", nodeCount, pathCount);
+  printf("%-10s %14s\n", "lookup", "ns/address");
+  printf("%-10s %14.1f\n", "scan", scanned * 1e9 / lookups);
+  printf("%-10s %14.1f\n", "index", indexed * 1e9 / lookups);
+}
+
+int main(void)
+{
+  const OscNode* root = buildNamespace();
+  if (!oscIndexBuild(root)) {
+    printf("namespace didn't fit in the index - raise OSC_INDEX_SLOTS\n");
+    return 1;
+  }
+  differential(root);
+  if (mismatches)
+    return 1;
+  timing(root);
+  return 0;
+}
@@ -0,0 +1,303 @@
+/*
+  loadgen.c
+  MakingThings
+
+  Load generator for the OSC system, running on the host shim in core/host.
+
+  osc.c runs just like it does on the board - its UDP & USB threads pull packets
+  off the shim's queues, dispatch them, and send back whatever the handlers reply
+  with.  We play the computer on the other end: send messages in, wait for the
+  replies, and measure messages/sec and how long each round trip took through
+  receive -> dispatch -> reply.
+
+  Runs of note:
+  - one message in flight at a time, for latency
+  - mchelper's latency probe, which osc.c answers itself, next to the same
+    echo through the namespace
+  - a window of messages in flight, for throughput
+  - bundles of queries & a wildcard query, which make oscDoCreateMessage() pack
+    a bundle of replies
+  - the autosend thread, pointed at UDP
+*/
+
+#include "core.h"
+#include "osc.h"
+#include "osc_data.h"
+#include "host.h"
+#include <time.h>
+
+#define CHANNELS    16
+#define MAX_RUN     200000
+#define TIMEOUT     2000 // ms to wait for a reply before giving up
+#define HOST_ADDRESS 0x7F000001
+#define BOARD_PORT   10000
+
+/*****************************************************************************
+  The namespace we're serving - /echo sends back whatever it gets, and
+  /bench/n/value is a range of ints like most of the real subsystems.
+*****************************************************************************/
+
+static int benchValues[CHANNELS];
+
+static void echoOscHandler(OscChannel ch, char* address, int idx, OscData data[], int datalen)
+{
+  UNUSED(idx);
+  oscCreateMessage(ch, address, data, datalen);
+}
+
+static void benchOscHandler(OscChannel ch, char* address, int idx, OscData data[], int datalen)
+{
+  if (datalen == 1 && data[0].type == INT) {
+    benchValues[idx] = data[0].value.i;
+  }
+  else {
+    OscData d = { .type = INT, .value.i = benchValues[idx] };
+    oscCreateMessage(ch, address, &d, 1);
+  }
+}
+
+static int autosendMessages = 0;
+
+static void benchAutosender(OscChannel ch)
+{
+  char address[32];
+  int i;
+  for (i = 0; i < CHANNELS; i++) {
+    OscData d = { .type = INT, .value.i = benchValues[i] };
+    siprintf(address, "/bench/%d/value", i);
+    oscCreateMessage(ch, address, &d, 1);
+    autosendMessages++;
+  }
+}
+
+static const OscNode echoOsc = { .name = "echo", .handler = echoOscHandler };
+static const OscNode benchValue = { .name = "value", .handler = benchOscHandler };
+static const OscNode benchOsc = {
+  .name = "bench",
+  .range = CHANNELS,
+  .autosender = benchAutosender,
+  .children = {
+    &benchValue, 0
+  }
+};
+
+const OscNode oscRoot = {
+  .children = {
+    &echoOsc,
+    &benchOsc,
+    0
+  }
+};
+
+/*****************************************************************************
+  The computer's side
+*****************************************************************************/
+
+typedef struct Transport_t {
+  const char* name;
+  bool (*send)(const char* data, int length);
+  int (*receive)(char* data, int length, int timeout);
+} Transport;
+
+static bool udpSend(const char* data, int length)
+{
+  return hostUdpSend(data, length, HOST_ADDRESS, BOARD_PORT);
+}
+
+static const Transport udp = { "udp", udpSend, hostUdpReceive };
+static const Transport usb = { "usb", hostUsbSend, hostUsbReceive };
+
+// fills in buf with request number n, returns its length
+typedef int (*RequestBuilder)(char* buf, int n);
+
+static int buildMessage(char* buf, uint32_t size, const char* address, bool hasValue, int value)
+{
+  uint32_t remaining = size;
+  char* p = oscEncodeString(buf, &remaining, address);
+  p = oscEncodeString(p, &remaining, hasValue ? ",i" : ",");
+  if (hasValue)
+    p = oscEncodeInt32(p, &remaining, value);
+  return p - buf;
+}
+
+static int echoRequest(char* buf, int n)
+{
+  return buildMessage(buf, HOST_MAX_PACKET, "/echo", true, n);
+}
+
+static int probeRequest(char* buf, int n)
+{
+  return buildMessage(buf, HOST_MAX_PACKET, "/system/echo", true, n);
+}
+
+static int wildcardRequest(char* buf, int n)
+{
+  UNUSED(n);
+  return buildMessage(buf, HOST_MAX_PACKET, "/bench/*/value", false, 0);
+}
+
+static int bundleRequest(char* buf, int n)
+{
+  UNUSED(n);
+  uint32_t remaining = HOST_MAX_PACKET;
+  char address[32];
+  int i;
+  char* p = oscEncodeString(buf, &remaining, "#bundle");
+  p = oscEncodeInt32(p, &remaining, 0); // timetag
+  p = oscEncodeInt32(p, &remaining, 0);
+  for (i = 0; i < CHANNELS; i++) {
+    siprintf(address, "/bench/%d/value", i);
+    int len = buildMessage(p + 4, remaining - 4, address, false, 0);
+    p = oscEncodeInt32(p, &remaining, len);
+    p += len;
+    remaining -= len;
+  }
+  return p - buf;
+}
+
+/*
+  How many messages are in a reply packet.  If it's a single /echo or probe, stick
+  the value it came back with in *echoed, so we can check replies come back in order.
+*/
+static int countMessages(char* packet, int length, int* echoed)
+{
+  if (length <= 0)
+    return 0;
+  if (packet[0] == '#') {
+    uint32_t remaining = length - 16;
+    char* p = packet + 16;
+    int count = 0;
+    int msglen;
+    while (remaining > 0 && (p = oscDecodeInt32(p, &remaining, &msglen)) != 0) {
+      if (msglen <= 0 || (uint32_t)msglen > remaining)
+        break;
+      p += msglen;
+      remaining -= msglen;
+      count++;
+    }
+    return count;
+  }
+  if (strcmp(packet, "/echo") == 0 || strcmp(packet, "/system/echo") == 0) {
+    uint32_t remaining = length - oscPaddedStrlen(packet);
+    char* typetag;
+    char* p = oscDecodeString(packet + oscPaddedStrlen(packet), &remaining, &typetag);
+    if (p != 0 && strcmp(typetag, ",i") == 0)
+      oscDecodeInt32(p, &remaining, echoed);
+  }
+  return 1;
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compareDoubles(const void* a, const void* b)
+{
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+static double sent[MAX_RUN];
+static double roundTrips[MAX_RUN];
+
+/*
+  Send count requests, keeping up to window of them waiting for replies.
+  The board handles a channel's packets one at a time, so replies come back in
+  the order the requests went out - reply n goes with request n.
+*/
+static bool run(const Transport* t, const char* name, RequestBuilder build, int count, int window, int expected)
+{
+  char request[HOST_MAX_PACKET];
+  char reply[HOST_MAX_PACKET];
+  int sentCount = 0, received = 0, messages = 0, errors = 0;
+
+  double start = now();
+  while (received < count) {
+    while (sentCount < count && sentCount - received < window) {
+      int len = build(request, sentCount);
+      sent[sentCount] = now();
+      t->send(request, len);
+      sentCount++;
+    }
+    int echoed = -1;
+    int len = t->receive(reply, sizeof(reply), TIMEOUT);
+    if (len <= 0) {
+      printf("%s %s: no reply to request %d\n", t->name, name, received);
+      return false;
+    }
+    roundTrips[received] = now() - sent[received];
+    int got = countMessages(reply, len, &echoed);
+    if (got != expected || ((build == echoRequest || build == probeRequest) && echoed != received))
+      errors++;
+    messages += got;
+    received++;
+  }
+  double elapsed = now() - start;
+
+  qsort(roundTrips, count, sizeof(double), compareDoubles);
+  double total = 0;
+  int i;
+  for (i = 0; i < count; i++)
+    total += roundTrips[i];
+  printf("%-4s %-18s %6d %11.0f %11.0f %8.1f %8.1f %8.1f %8.1f %6d\n", t->name, name, window,
+         count / elapsed, messages / elapsed,
+         total / count * 1e6, roundTrips[count / 2] * 1e6,
+         roundTrips[(int)(count * 0.99)] * 1e6, roundTrips[count - 1] * 1e6, errors);
+  return errors == 0;
+}
+
+static bool runTransport(const Transport* t)
+{
+  bool ok = true;
+  ok &= run(t, "echo", echoRequest, 20000, 1, 1);
+  ok &= run(t, "echo", echoRequest, MAX_RUN, 32, 1);
+  ok &= run(t, "probe", probeRequest, 20000, 1, 1);
+  ok &= run(t, "bundle of queries", bundleRequest, 20000, 1, CHANNELS);
+  ok &= run(t, "bundle of queries", bundleRequest, 50000, 32, CHANNELS);
+  ok &= run(t, "wildcard query", wildcardRequest, 20000, 1, CHANNELS);
+  ok &= run(t, "wildcard query", wildcardRequest, 50000, 32, CHANNELS);
+  return ok;
+}
+
+static void autosend(void)
+{
+  char reply[HOST_MAX_PACKET];
+  int packets = 0;
+  oscSetAutosendInterval(2);
+  oscSetAutosendDestination(UDP);
+  oscAutosendEnable(YES);
+  while (hostUdpReceive(reply, sizeof(reply), TIMEOUT) <= 0) // wait for the thread to get going
+    ;
+  int startMessages = autosendMessages;
+  double start = now();
+  while (now() - start < 1.0) {
+    if (hostUdpReceive(reply, sizeof(reply), TIMEOUT) > 0)
+      packets++;
+  }
+  double elapsed = now() - start;
+  oscAutosendEnable(NO);
+  printf("autosend every %dms: %.0f packets/sec, %.0f msgs/sec\n", (int)oscAutosendInterval(),
+         packets / elapsed, (autosendMessages - startMessages) / elapsed);
+}
+
+int main(void)
+{
+  bool ok = true;
+  oscUsbEnable(YES);
+  oscUdpEnable(YES);
+
+  printf("%-4s %-18s %6s %11s %11s %8s %8s %8s %8s %6s\n", "", "", "window",
+         "packets/s", "msgs/s", "mean us", "p50 us", "p99 us", "max us", "errors");
+  ok &= runTransport(&udp);
+  ok &= runTransport(&usb);
+  autosend();
+
+  if (hostDroppedPackets() > 0) {
+    printf("%d packets dropped\n", hostDroppedPackets());
+    ok = false;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,167 @@
+/*
+  patternbench.c
+  MakingThings
+
+  Host benchmark for the OSC pattern matchers in osc_patternmatch.c.
+
+  First checks that oscPatternMatchCompiled() agrees with oscPatternMatch() on a
+  list of hand-picked cases plus a big batch of random patterns & names, and that
+  both give the pinned answers for a few cases where oscPatternMatch() used to
+  differ - it bails out if any of them are off.  Then times both on the kinds of patterns that show
+  up in real traffic, and a couple that the recursive matcher handles badly.
+*/
+
+#include "core.h"
+#include "osc_patternmatch.h"
+#include <time.h>
+
+#define RANDOM_CASES 2000000
+
+static uint32_t seed = 12345;
+static uint32_t nextRandom(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) & 0x7FFF;
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int mismatches = 0;
+static int checked = 0;
+
+static void check(const char* pattern, const char* name)
+{
+  OscPattern p;
+  oscPatternCompile(&p, pattern);
+  bool expected = oscPatternMatch(pattern, name);
+  checked++;
+  if (oscPatternMatchCompiled(&p, name) != expected) {
+    if (mismatches++ < 20)
+      printf("mismatch: pattern \"%s\" name \"%s\" - oscPatternMatch says %d\n", pattern, name, expected);
+  }
+}
+
+/*
+  Cases with a fixed answer from both matchers.  oscMatchList() used to fall
+  through to the rest of the pattern when none of a {} list's alternatives
+  matched, as if every list had an empty alternative too - so {foo}x matched x.
+*/
+static void pinned(const char* pattern, const char* name, bool expected)
+{
+  OscPattern p;
+  oscPatternCompile(&p, pattern);
+  checked++;
+  if (oscPatternMatch(pattern, name) != expected || oscPatternMatchCompiled(&p, name) != expected) {
+    if (mismatches++ < 20)
+      printf("mismatch: pattern \"%s\" name \"%s\" should be %d\n", pattern, name, expected);
+  }
+}
+
+static void randomString(char* buf, int maxlen, const char* alphabet)
+{
+  int len = nextRandom() % (maxlen + 1);
+  int n = strlen(alphabet);
+  int i;
+  for (i = 0; i < len; i++)
+    buf[i] = alphabet[nextRandom() % n];
+  buf[len] = 0;
+}
+
+static void differential(void)
+{
+  static const char* patterns[] = {
+    "", "*", "**", "?", "value", "val*", "*ue", "v*l*e", "[a-z]alue", "[!a-u]alue",
+    "[]", "[!]", "[-z]", "[a-]", "[", "a[", "{a,b}", "{value,active}", "{a,ab}c", "{ab,a}",
+    "{a}b", "{,a}", "{}", "{", "a}", "]", "\\", "a\\", "\\*", "\\{a", "*{a,b}", "{a*,b}",
+    "?*?", "*[0-9]", "{0,1,2,3}", "a*b*c*d*e*f*g*h*i*j*k*l*m*n*o*p*q", 0 };
+  static const char* names[] = {
+    "", "a", "b", "ab", "abc", "value", "active", "vaaalue", "Value", "[", "!", "-", "]",
+    "z", "{", "}", ",", "\\", "*", "0", "7", "12", "abcdefghijklmnopq", 0 };
+  int i, j;
+  pinned("{foo}x", "x", false);
+  pinned("{foo}x", "foox", true);
+  pinned("{a,b}c", "c", false);
+  pinned("{a,b}c", "bc", true);
+  pinned("{,a}b", "b", true); // an empty alternative that's really there
+  for (i = 0; patterns[i] != 0; i++) {
+    for (j = 0; names[j] != 0; j++)
+      check(patterns[i], names[j]);
+  }
+
+  char pattern[24], name[24];
+  for (i = 0; i < RANDOM_CASES; i++) {
+    randomString(pattern, 12, "ab-!?*[]{},\\");
+    randomString(name, 10, "ab-![{,");
+    check(pattern, name);
+  }
+  printf("differential: %d pattern/name pairs checked, %d mismatches\n", checked, mismatches);
+}
+
+typedef struct {
+  const char* pattern;
+  const char* const* names;
+} BenchCase;
+
+// what a typical range node and a typical subsystem level look like
+static const char* const appledNames[] = { "value", "state", "active", 0 };
+static const char* const rootNames[] = { "appled", "analogin", "system", "network", "dipswitch",
+                                         "pin", "digitalin", "digitalout", "pwmout", "motor", 0 };
+static const char* const longNames[] = { "aaaaaaaaaaaaaaaaaaaaaaaaaa", 0 };
+
+static const BenchCase cases[] = {
+  { "value", appledNames },
+  { "digitalout", rootNames },
+  { "*", rootNames },
+  { "{value,active}", appledNames },
+  { "[a-d]*", rootNames },
+  { "*a*a*a*a*b", longNames },
+};
+
+static void timing(void)
+{
+  volatile int hits = 0;
+  unsigned int c;
+  printf("OscPattern is %d bytes\n", (int)sizeof(OscPattern));
+  printf("%-16s %14s %14s\n", "pattern", "recursive ns", "compiled ns");
+  for (c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+    const BenchCase* bc = &cases[c];
+    int names = 0, i, j;
+    while (bc->names[names])
+      names++;
+    int iterations = (c == 5) ? 200 : 200000;
+
+    double t = now();
+    for (i = 0; i < iterations; i++) {
+      for (j = 0; j < names; j++)
+        hits += oscPatternMatch(bc->pattern, bc->names[j]);
+    }
+    double recursive = now() - t;
+
+    // compile once per level, the way oscDispatchNode() uses it
+    t = now();
+    for (i = 0; i < iterations; i++) {
+      OscPattern p;
+      oscPatternCompile(&p, bc->pattern);
+      for (j = 0; j < names; j++)
+        hits += oscPatternMatchCompiled(&p, bc->names[j]);
+    }
+    double compiled = now() - t;
+
+    printf("%-16s %14.1f %14.1f\n", bc->pattern,
+           recursive * 1e9 / (iterations * names), compiled * 1e9 / (iterations * names));
+  }
+}
+
+int main(void)
+{
+  differential();
+  if (mismatches)
+    return 1;
+  timing();
+  return 0;
+}
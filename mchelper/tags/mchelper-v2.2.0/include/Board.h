@@ -18,12 +18,22 @@
 #ifndef BOARD_H_
 #define BOARD_H_
 
-#include <QListWidgetItem>
+#include <QTimer>
+#include <QMutex>
 #include "PacketReadyInterface.h"
-#include "UploaderThread.h"
 #include "PacketInterface.h"
+#include "BridgeInterface.h"
 #include "Osc.h"
-#include "OutputWindow.h"
+#include "OscBundler.h"
+#include "PacketCapture.h"
+#include "Metrics.h"
+#include "LatencyProbe.h"
+
+// mchelperd has no list to put boards in, and no uploading
+#ifndef MCHELPER_HEADLESS
+#include <QListWidgetItem>
+#include "UploaderThread.h"
+#endif
 
 class UploaderThread;
 class PacketInterface;
@@ -32,13 +42,17 @@ class OscMessage;
 
 #include <QString>
 
+#ifdef MCHELPER_HEADLESS
+class Board : public QObject, public PacketReadyInterface
+#else
 class Board : public QObject, public QListWidgetItem, public PacketReadyInterface
+#endif
 {
   Q_OBJECT
 	public:
     enum Types{ UsbSerial, UsbSamba, Udp };
     
-    Board( MessageInterface* messageInterface, McHelperWindow* mainWindow, QApplication* application );
+    Board( MessageInterface* messageInterface, BridgeInterface* bridge );
     ~Board( );
     void setPacketInterface( PacketInterface* packetInterface );
     void setUploaderThread( UploaderThread* uploaderThread );
@@ -46,9 +60,11 @@ class Board : public QObject, public QListWidgetItem, public PacketReadyInterfac
     void sendMessage( QString rawMessage );
 		void sendMessage( QList<OscMessage*> messageList );
 		void sendMessage( QStringList messageList );
+		void sendPacket( QByteArray packet );
     bool setBinFileName( char* filename );
     void flash( );
     QString locationString( );
+    QString latencyString( ) { return probe.summary( ); }
     
     QString key, location; 
     Board::Types type;
@@ -62,17 +78,37 @@ class Board : public QObject, public QListWidgetItem, public PacketReadyInterfac
 
   private:
     MessageInterface* messageInterface;
-    McHelperWindow* mainWindow;
-    QApplication* application;
+    BridgeInterface* bridge;
     PacketInterface* packetInterface;
     Osc* osc;
+    OscDecoder decoder;
+    QByteArray rxBuffer;
+    QVector<int> clientMessages; // indices of the messages in rxBuffer that go on to clients
+    BoardMetrics* metrics;
     UploaderThread* uploaderThread;
 		QStringList messagesToPost;
 		QTimer messagePostTimer;
+		OscBundler bundler;
+		QMutex bundleMutex;   // messages for the board can come from any client's thread
+		volatile int firmwareMaxIn; // OSC_MAX_MSG_IN for the firmware it's running, once we know
+		QTimer bundleTimer;
+		LatencyProbe probe;
+		QTimer probeTimer;
+		
+		void sendOut( QByteArray packet );
+		void transmit( char* packet, int size );
+		PacketCapture::Transport captureTransport( ) { return ( type == Udp ) ? PacketCapture::Udp : PacketCapture::Usb; }
+		void sendBundle( );
+		int bundleMaxSize( );
 		
-		bool extractSystemInfoA( OscMessage* msg );
-		bool extractSystemInfoB( OscMessage* msg );
-		bool extractNetworkFind( OscMessage* msg );
+		bool extractSystemInfoA( const OscMessageView& msg );
+		bool extractSystemInfoB( const OscMessageView& msg );
+		bool extractNetworkFind( const OscMessageView& msg );
+
+	private slots:
+		void startBundleWindow( );
+		void bundleWindowDone( );
+		void sendProbe( );
 };
 
 #endif /*BOARD_H_*/
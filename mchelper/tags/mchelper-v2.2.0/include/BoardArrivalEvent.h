@@ -1,43 +1,45 @@
-/*********************************************************************************
-
- Copyright 2006-2008 MakingThings
-
- Licensed under the Apache License, 
- Version 2.0 (the "License"); you may not use this file except in compliance 
- with the License. You may obtain a copy of the License at
-
- http://www.apache.org/licenses/LICENSE-2.0 
- 
- Unless required by applicable law or agreed to in writing, software distributed
- under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
- CONDITIONS OF ANY KIND, either express or implied. See the License for
- the specific language governing permissions and limitations under the License.
-
-*********************************************************************************/
-
-#ifndef BOARD_ARRIVAL_EVENT_H_
-#define BOARD_ARRIVAL_EVENT_H_
-
-#include <QString>
-#include <QEvent>
-#include <QList>
-#include "Board.h"
-#include "PacketInterface.h"
-#include "UploaderThread.h"
-
-class BoardArrivalEvent : public QEvent
-{
-  public:    
-    BoardArrivalEvent( Board::Types type ) : QEvent( (Type)10020 )
-    {
-    	this->type = type;
-    }
-    ~BoardArrivalEvent( ) {}
-    
-    QList<PacketInterface*> pInt;
-    QList<PacketUdp*> pUdp;
-    QList<UploaderThread*> uThread;
-    Board::Types type;
-};
-
-#endif // BOARD_ARRIVAL_EVENT_H_
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License, 
+ Version 2.0 (the "License"); you may not use this file except in compliance 
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0 
+ 
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#ifndef BOARD_ARRIVAL_EVENT_H_
+#define BOARD_ARRIVAL_EVENT_H_
+
+#include <QString>
+#include <QEvent>
+#include <QList>
+#include "Board.h"
+#include "PacketInterface.h"
+
+class PacketUdp;
+class UploaderThread;
+
+class BoardArrivalEvent : public QEvent
+{
+  public:    
+    BoardArrivalEvent( Board::Types type ) : QEvent( (Type)10020 )
+    {
+    	this->type = type;
+    }
+    ~BoardArrivalEvent( ) {}
+    
+    QList<PacketInterface*> pInt;
+    QList<PacketUdp*> pUdp;
+    QList<UploaderThread*> uThread;
+    Board::Types type;
+};
+
+#endif // BOARD_ARRIVAL_EVENT_H_
@@ -0,0 +1,83 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#ifndef BRIDGEINTERFACE_H
+#define BRIDGEINTERFACE_H
+
+#include <QString>
+#include <QList>
+#include <QByteArray>
+#include <QVector>
+#include "MessageInterface.h"
+
+#ifdef Q_WS_WIN
+#include "windows.h"
+#endif
+
+class QObject;
+class Board;
+class OscMessage;
+class OscDecoder;
+class OscStateCache;
+class QueryCoalescer;
+class PacketCapture;
+
+/*
+	What boards, the monitors and the XML server need from whatever's running
+	them - McHelperWindow, or McHelperDaemon when there's no UI.
+
+	notifier( ) is the QObject that emits boardInfoUpdate( Board* ),
+	boardListUpdate( QList<Board*>, bool ), xmlDocument( QByteArray ) and
+	oscFrame( QByteArray ) for the XML server's clients, and that
+	BoardArrivalEvents get posted to.
+*/
+class BridgeInterface : public MessageInterface
+{
+	public:
+		virtual QObject* notifier( ) = 0;
+		virtual QList<Board*> getConnectedBoards( ) = 0;
+		virtual void removeDeviceThreadSafe( QString key ) = 0;
+		virtual bool findNetBoardsEnabled( ) = 0;
+		virtual bool showResponses( ) = 0; // whether it's worth turning packets from boards into strings
+		virtual OscStateCache* stateCache( ) = 0;
+		virtual QueryCoalescer* queryCoalescer( ) = 0;
+		virtual int packetPort( ) = 0; // the port packets from boards are labelled with for clients
+		virtual int bundleWindow( ) = 0; // ms to collect messages for a board into one bundle - 0 sends each right away
+		virtual int bundleMaxSize( ) = 0; // bytes a bundle can grow to - 0 goes by what each board's firmware takes
+		virtual PacketCapture* packetCapture( ) = 0; // NULL unless we're recording board traffic
+		virtual int probeInterval( ) = 0; // ms between latency probes to each board - 0 for none
+
+		// from boards
+		virtual void setBoardName( QString key, QString name ) = 0;
+		virtual void updateSummaryInfo( ) = 0;
+		virtual void xmlServerBoardInfoUpdate( Board* board ) = 0;
+		virtual void sendXmlPacket( const OscDecoder& decoder, QString srcAddress ) = 0;
+		virtual void sendOscPacket( const char* packet, int size, QString srcAddress ) = 0;
+		// the messages at these indices in packet are responses worth showing - only called when showResponses( )
+		virtual void showPacket( const char* packet, int size, const QVector<int>& messages, QString from ) = 0;
+
+		// from XML server clients
+		virtual void newXmlPacketReceived( QList<OscMessage*> messageList, QString address ) = 0;
+		virtual void newOscPacketReceived( QByteArray packet, QString address ) = 0;
+
+		#ifdef Q_WS_WIN
+		virtual HWND notificationWindow( ) = 0; // for USB removal notices, or NULL if there isn't one
+		#endif
+		virtual ~BridgeInterface( ) {}
+};
+
+#endif // BRIDGEINTERFACE_H
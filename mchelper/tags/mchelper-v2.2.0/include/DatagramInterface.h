@@ -0,0 +1,34 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License, 
+ Version 2.0 (the "License"); you may not use this file except in compliance 
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0 
+ 
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#ifndef DATAGRAMINTERFACE_H
+#define DATAGRAMINTERFACE_H
+
+/*
+	What a board looks like to whoever is reading its datagrams off the socket.
+	incomingMessage( ) queues one up, and processPacket( ) gets called once a
+	batch has been read, to work through everything that's been queued.
+*/
+class DatagramInterface
+{
+	public:
+		virtual bool incomingMessage( const char* data, int length ) = 0;
+		virtual void processPacket( ) = 0;
+		virtual ~DatagramInterface( ) {}
+};
+
+#endif
@@ -0,0 +1,59 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#ifndef FIRMWAREIMAGE_H
+#define FIRMWAREIMAGE_H
+
+#include <QFile>
+#include <QByteArray>
+#include <QString>
+
+#define FIRMWARE_MAX_SIZE ( 256 * 1024 ) // all the flash on a SAM7X256
+
+/*
+	A .bin to upload, loaded and checked once and then shared, read only, by
+	however many uploads are going from it at a time.
+
+	The file is mapped rather than read where that works, so the pages come
+	straight out of the OS's cache no matter how many boards are using them.
+	Checking it means it's the right size for the flash, and that it starts
+	with an ARM reset vector - a branch or a load into the pc - so something
+	that isn't firmware at all doesn't get as far as a board.
+*/
+class FirmwareImage
+{
+	public:
+		enum Status { OK, ERROR_NOT_FOUND, ERROR_COULDNT_OPEN, ERROR_EMPTY, ERROR_TOO_BIG, ERROR_NOT_FIRMWARE };
+
+		FirmwareImage( );
+		~FirmwareImage( );
+		Status load( const QString& fileName, int maxSize = FIRMWARE_MAX_SIZE );
+		const char* data( ) const { return image; }
+		int size( ) const { return length; }
+		QString fileName( ) const { return file.fileName( ); }
+		void unload( );
+		static QString statusString( Status status );
+
+	private:
+		QFile file;
+		uchar* mapped;
+		QByteArray copy; // where we couldn't map it
+		const char* image;
+		int length;
+};
+
+#endif // FIRMWAREIMAGE_H
@@ -0,0 +1,91 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#ifndef FLASHBATCH_H
+#define FLASHBATCH_H
+
+#include <QObject>
+#include <QStringList>
+#include <QHash>
+#include <QMutex>
+#include <QTimer>
+#include <QTime>
+#include "FirmwareImage.h"
+#include "MessageInterface.h"
+
+class SambaMonitor;
+
+#define FLASH_DEFAULT_PARALLEL 4
+#define FLASH_REPORT_MS 1000
+#define FLASH_SETTLE_MS 2000 // with no UI, wait this long after the last board shows up before starting
+
+/*
+	Flashes one image to a whole set of boards in SAM-BA mode.
+
+	The image is loaded and checked once, up front, and every upload reads
+	from that same copy.  Up to parallel( ) boards are uploading at a time -
+	each on its own UploaderThread, as a single upload would be - and the next
+	one waiting starts as each finishes.  USB hubs and the host's USB stack
+	only have so much to go round, so the default is a handful rather than
+	all of them at once.
+
+	Progress for each board comes in on its uploader's thread, and gets
+	reported once a second from the main thread, along with the overall
+	progress.  At the end there's a summary with the total time and any
+	boards that failed, and done( ) is emitted.
+*/
+class FlashBatch : public QObject
+{
+	Q_OBJECT
+	public:
+		FlashBatch( SambaMonitor* monitor, MessageInterface* messageInterface, QObject* parent = 0 );
+		bool start( const QString& fileName, const QStringList& boards, int parallel = FLASH_DEFAULT_PARALLEL );
+		bool isRunning( ) { return running > 0 || !waiting.isEmpty( ); }
+		void setConsole( bool console ) { this->console = console; } // report to stdout as well
+
+		// from uploader threads
+		void progress( const QString& board, int value );
+		void finished( const QString& board, bool ok );
+
+	signals:
+		void done( int failed );
+
+	private slots:
+		void boardFinished( QString board, bool ok );
+		void report( );
+
+	private:
+		SambaMonitor* monitor;
+		MessageInterface* messageInterface;
+		FirmwareImage image;
+		QStringList waiting;
+		QStringList failed;
+		int running;
+		int succeeded;
+		int total;
+		int maxParallel;
+		bool console;
+		QTime elapsed;
+		QTimer reportTimer;
+		QHash<QString, int> progressOf; // 0 - 1000, for the ones uploading now
+		QMutex progressMutex;
+
+		void startNext( );
+		void message( const QString& text, MessageEvent::Types type = MessageEvent::Info );
+};
+
+#endif // FLASHBATCH_H
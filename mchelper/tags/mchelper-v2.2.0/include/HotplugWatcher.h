@@ -0,0 +1,60 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#ifndef HOTPLUGWATCHER_H
+#define HOTPLUGWATCHER_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QRegExp>
+
+#define HOTPLUG_POLL_MS 1000    // how often to look for boards when we can't be told
+#define HOTPLUG_RESCAN_MS 30000 // look anyway this often, even when we can, in case something got missed
+
+/*
+	Tells the USB and SAM-BA monitors when it's worth looking for boards.
+
+	On Linux, device nodes come and go in /dev as boards are plugged in,
+	reset and unplugged, so we watch the directories they show up in with
+	inotify, and wait( ) comes back as soon as anything matching one of the
+	patterns is created, deleted or has its permissions changed - udev
+	usually makes the node first and then sets who can open it, so the
+	attribute change is when it's actually ready.
+
+	Anywhere else, or if inotify isn't there, wait( ) just sleeps for
+	HOTPLUG_POLL_MS, which is what the monitors always used to do.  Either way
+	the monitors scan the same as they did before after it returns - this
+	only changes when.
+*/
+class HotplugWatcher
+{
+	public:
+		HotplugWatcher( const QStringList& patterns );
+		~HotplugWatcher( );
+		void watch( const QString& directory );
+		void usePolling( );  // forget about inotify
+		bool isWatching( ) { return fd >= 0; }
+		bool wait( );        // true if something we're interested in changed, false if we just timed out
+
+	private:
+		int fd;
+		QList<QRegExp> patterns;
+		bool matches( const char* name );
+};
+
+#endif // HOTPLUGWATCHER_H
@@ -0,0 +1,68 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#ifndef LATENCYPROBE_H
+#define LATENCYPROBE_H
+
+#include <QByteArray>
+#include <QString>
+#include <QMutex>
+#include "Osc.h"
+#include "Metrics.h"
+
+#define PROBE_ADDRESS "/system/echo"
+#define PROBE_TIMEOUT_MS 2000
+#define PROBE_MAX_TIMEOUTS 3          // in a row, before we stop probing the board
+#define PROBE_SEQUENCE_BASE 0x4D430000 // so our echoes don't look like a client's
+
+/*
+	Times round trips to a board, one probe at a time.
+
+	Probes go to PROBE_ADDRESS with a sequence number, which firmware that
+	knows about it sends straight back from its receive thread without looking
+	through its namespace.  Clients can send echoes of their own, so only
+	replies carrying one of our sequence numbers are ours.  Older firmware
+	doesn't answer at all (its Unknown Property error goes to the clients like
+	any other) - after PROBE_MAX_TIMEOUTS in a row we stop asking.
+
+	The board's Board sends whatever request( ) gives it, and offers every
+	message from the board to reply( ), which swallows the ones that were
+	answers to probes.  Times land in the board's round trip histogram and
+	in one for its transport.
+*/
+class LatencyProbe
+{
+	public:
+		LatencyProbe( );
+		void setBoard( BoardMetrics* metrics, bool usb );
+		QByteArray request( ); // the next probe, or nothing if the last one's still out
+		bool gaveUp( );        // the board never answers - don't bother asking
+		bool reply( const OscDecoder& decoder, const OscMessageView& msg );
+		QString summary( );   // for people
+
+	private:
+		QMutex mutex; // probes go out from the main thread, and come back on the board's
+		int sequence;
+		int timeouts; // in a row
+		qint64 sentAt; // µs, or 0 when nothing's out
+		BoardMetrics* metrics;
+		MetricHistogram* transportRoundTrip;
+
+		void received( );
+};
+
+#endif // LATENCYPROBE_H
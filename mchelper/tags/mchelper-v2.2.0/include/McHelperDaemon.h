@@ -0,0 +1,143 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#ifndef MCHELPERDAEMON_H
+#define MCHELPERDAEMON_H
+
+#include <QObject>
+#include <QHash>
+#include <QMutex>
+#include <QReadWriteLock>
+#include "BridgeInterface.h"
+#include "Board.h"
+#include "NetworkMonitor.h"
+#include "UsbMonitor.h"
+#include "OscXmlServer.h"
+#include "OscStateCache.h"
+#include "MetricsHttpServer.h"
+
+class QCoreApplication;
+
+/*
+	mchelper without the window - it just routes packets between boards and
+	XML server clients.
+
+	Nothing on the packet path goes through the main thread:
+	- from boards: datagrams are read on NetworkMonitor's receive thread, and
+	  USB on each board's own thread.  The board decodes the packet there and
+	  it gets written to every client straight from that thread.
+	- from clients: each OscXmlClient has its own thread, and looks up the board
+	  and sends to it from there.
+	The main thread only deals with boards coming and going, pings, and new
+	connections.
+
+	Output goes to stdout.  Packets only get turned into strings for it with
+	setVerbose( true ).
+*/
+class McHelperDaemon : public QObject, public BridgeInterface
+{
+	Q_OBJECT
+	public:
+		McHelperDaemon( QCoreApplication* application );
+		~McHelperDaemon( );
+		bool start( );
+		void setVerbose( bool verbose ) { this->verbose = verbose; }
+		void setPorts( int udpListen, int udpSend, int xmlListen );
+		void setCacheAge( int ms ) { cache.setMaxAge( ms ); }
+		void setBundleWindow( int ms ) { bundleWindowMs = ms; }
+		void setBundleMaxSize( int bytes ) { bundleMaxBytes = bytes; }
+		void setCaptureFile( QString file ) { captureFile = file; }
+		void setMetricsPort( int port ) { metricsPort = port; }
+		void setProbeInterval( int ms ) { probeIntervalMs = ms; }
+		void addUsbPort( QString port ) { usbPorts.append( port ); }
+		void setUsbWriteWindow( int ms ) { usbWriteWindowMs = ms; }
+
+		// from BridgeInterface
+		QObject* notifier( ) { return this; }
+		OscStateCache* stateCache( ) { return &cache; }
+		QueryCoalescer* queryCoalescer( ) { return xmlServer->queryCoalescer( ); }
+		int packetPort( ) { return udp->getListenPort( ); }
+		int bundleWindow( ) { return bundleWindowMs; }
+		int bundleMaxSize( ) { return bundleMaxBytes; }
+		PacketCapture* packetCapture( ) { return capture; }
+		int probeInterval( ) { return probeIntervalMs; }
+		QList<Board*> getConnectedBoards( );
+		void removeDeviceThreadSafe( QString key );
+		bool findNetBoardsEnabled( ) { return findEthernetBoardsAuto; }
+		bool showResponses( ) { return verbose; }
+		void setBoardName( QString key, QString name );
+		void updateSummaryInfo( ) { }
+		void xmlServerBoardInfoUpdate( Board* board );
+		void sendXmlPacket( const OscDecoder& decoder, QString srcAddress );
+		void sendOscPacket( const char* packet, int size, QString srcAddress );
+		void showPacket( const char* packet, int size, const QVector<int>& messages, QString from );
+		void newXmlPacketReceived( QList<OscMessage*> messageList, QString address );
+		void newOscPacketReceived( QByteArray packet, QString address );
+		#ifdef Q_WS_WIN
+		HWND notificationWindow( ) { return NULL; }
+		#endif
+
+		// from MessageInterface
+		void messageThreadSafe( QString string );
+		void messageThreadSafe( QString string, MessageEvent::Types type );
+		void messageThreadSafe( QString string, MessageEvent::Types type, QString from );
+		void messageThreadSafe( QStringList strings, MessageEvent::Types type, QString from );
+		void progress( int value ) { (void)value; }
+		void statusMessage( const QString & msg, int duration );
+
+	signals:
+		void boardInfoUpdate( Board* board );
+		void boardListUpdate( QList<Board*> boardList, bool added );
+		void xmlDocument( QByteArray document );
+		void oscFrame( QByteArray frame );
+
+	protected:
+		void customEvent( QEvent* event );
+
+	private:
+		QCoreApplication* application;
+		UsbMonitor* usb;
+		NetworkMonitor* udp;
+		OscXmlServer* xmlServer;
+		QHash<QString, Board*> connectedBoards;
+		OscStateCache cache;
+		QReadWriteLock boardsLock; // client threads look boards up while the main thread adds & removes them
+		QMutex outputMutex;
+		int udpListenPort;
+		int udpSendPort;
+		int xmlListenPort;
+		bool findEthernetBoardsAuto;
+		int bundleWindowMs;
+		int bundleMaxBytes;
+		QString captureFile;
+		PacketCapture* capture;
+		int metricsPort;
+		int probeIntervalMs;
+		QStringList usbPorts;
+		int usbWriteWindowMs;
+		MetricsHttpServer* metricsServer;
+		bool verbose;
+
+		void readSettings( );
+		void addBoard( Board* board, PacketInterface* packetInterface, Board::Types type );
+		void boardListChanged( QList<Board*> boardList, bool arrived );
+
+	private slots:
+		void removeDevice( QString key );
+};
+
+#endif // MCHELPERDAEMON_H
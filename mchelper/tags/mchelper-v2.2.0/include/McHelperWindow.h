@@ -32,6 +32,9 @@ the specific language governing permissions and limitations under the License.
 #include "PacketUdp.h"
 #include "OutputWindow.h"
 #include "OscXmlServer.h"
+#include "OscStateCache.h"
+#include "MetricsHttpServer.h"
+#include "FlashBatch.h"
 #include "AppUpdater.h"
 #include "McHelperPrefs.h"
 
@@ -46,7 +49,7 @@ class mchelperPrefs;
 class PacketUdp;
 
 
-class McHelperWindow : public QMainWindow, private Ui::McHelperWindow, public MessageInterface
+class McHelperWindow : public QMainWindow, private Ui::McHelperWindow, public BridgeInterface
 {
 	Q_OBJECT
 	
@@ -83,16 +86,31 @@ class McHelperWindow : public QMainWindow, private Ui::McHelperWindow, public Me
 		void updateSummaryInfo( );
 		void setBoardName( QString key, QString name );
 		void newXmlPacketReceived( QList<OscMessage*> messageList, QString address );
-		void sendXmlPacket( QList<OscMessage*> messageList, QString srcAddress );
+		void sendXmlPacket( const OscDecoder& decoder, QString srcAddress );
+		void newOscPacketReceived( QByteArray packet, QString address );
+		void sendOscPacket( const char* packet, int size, QString srcAddress );
 		void xmlServerBoardInfoUpdate( Board* board );
+		void xmlServerBoardListUpdate( QList<Board*> boardList, bool arrived );
 		bool findNetBoardsEnabled( );
+		bool showResponses( );
+		void showPacket( const char* packet, int size, const QVector<int>& messages, QString from );
+		QObject* notifier( ) { return this; }
+		OscStateCache* stateCache( ) { return &cache; }
+		QueryCoalescer* queryCoalescer( ) { return xmlServer->queryCoalescer( ); }
+		int packetPort( );
+		int bundleWindow( ) { return bundleWindowMs; }
+		int bundleMaxSize( ) { return bundleMaxBytes; }
+		PacketCapture* packetCapture( ) { return capture; }
+		int probeInterval( ) { return probeIntervalMs; }
 		
 		void setNoUI( bool val );
 		void uiLessUpload( char* filename, bool bootFlash );
+		void setFlashParallel( int boards ) { flashParallel = boards; }
 		OutputWindow* outputModel;
 		
 #ifdef Q_WS_WIN // Windows-only
 		void usbRemoved( HANDLE deviceHandle );
+		HWND notificationWindow( ) { return winId( ); }
 #endif
 		
 		// preferences window stuff
@@ -100,6 +118,15 @@ class McHelperWindow : public QMainWindow, private Ui::McHelperWindow, public Me
 		int appUdpSendPort;
 		int appXmlListenPort;
 		bool findEthernetBoardsAuto;
+		bool udpReceiveThread;
+		int bundleWindowMs;
+		int bundleMaxBytes;
+		QString captureFile;
+		int metricsHttpPort;
+		int probeIntervalMs;
+		int flashParallel;
+		QStringList usbPorts;
+		int usbWriteWindowMs;
 		int maxOutputWindowMessages;
 		
 	protected:
@@ -108,7 +135,8 @@ class McHelperWindow : public QMainWindow, private Ui::McHelperWindow, public Me
 	signals:
 		void boardInfoUpdate( Board* board );
 		void boardListUpdate( QList<Board*> boardList, bool added );
-		void xmlPacket( QList<OscMessage*> messageList, QString srcAddress, int srcPort );
+		void xmlDocument( QByteArray document );
+		void oscFrame( QByteArray frame );
 		
 	private:		
 		QApplication* application;
@@ -122,8 +150,12 @@ class McHelperWindow : public QMainWindow, private Ui::McHelperWindow, public Me
 		mchelperPrefs* prefsDialog;
 		AppUpdater* appUpdater;
 		QHash<QString, Board*> connectedBoards;
-		QList<TableEntry> outputWindowQueue;
-		QMutex outputWindowQueueMutex;
+		OscStateCache cache;
+		PacketCapture* capture;
+		MetricsHttpServer* metricsServer;
+		FlashBatch* flashBatch;
+		QString batchFile;     // to flash to every Samba board that turns up, with no UI
+		QTimer batchSettleTimer;
 		QListWidgetItem listWidgetPlaceholder;
 
 		void setSummaryTabLabelsForegroundRole( QPalette::ColorRole role );
@@ -147,6 +179,8 @@ class McHelperWindow : public QMainWindow, private Ui::McHelperWindow, public Me
 			// Uploader functions
 			void fileSelectButtonClicked();
 			void uploadButtonClicked();
+			void startBatch( );
+			void batchDone( int failed );
 			
 			void commandLineEvent( );
 			void postMessages( );
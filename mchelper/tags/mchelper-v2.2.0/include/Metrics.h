@@ -0,0 +1,138 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QString>
+#include <QList>
+#include <QHash>
+#include <QMutex>
+
+class OscMessage;
+
+/*
+	Counters, gauges and latency histograms for mchelper's own performance.
+
+	Recording is a single relaxed atomic add - nothing's locked and nothing's
+	allocated - so it's fine to leave on everywhere.  Metrics are created once
+	through Metrics::instance( ) and the pointer kept around; the registry's
+	mutex only comes into it when creating them and when reading them all out,
+	either as Prometheus text for MetricsHttpServer or as OSC messages for
+	clients asking for /mchelper/stats.
+
+	Counters are 32 bits and wrap, which Prometheus takes as a restart.
+	Nothing is ever removed - a board that comes back picks up where it was.
+*/
+class MetricCounter
+{
+	public:
+		MetricCounter( ) { }
+		void add( int n = 1 ) { value.fetchAndAddRelaxed( n ); }
+		quint32 get( ) { return (quint32)value.fetchAndAddRelaxed( 0 ); }
+	private:
+		QAtomicInt value;
+};
+
+class MetricGauge
+{
+	public:
+		MetricGauge( ) { }
+		void set( int n ) { value.fetchAndStoreRelaxed( n ); }
+		void add( int n ) { value.fetchAndAddRelaxed( n ); }
+		int get( ) { return value.fetchAndAddRelaxed( 0 ); }
+	private:
+		QAtomicInt value;
+};
+
+/*
+	Log-linear buckets, two to each power of two - 1, 2, 3, 4, 6, 8, 12 µs and
+	so on up to about 50 s - so any value is within a third of its bucket's
+	limit, at any scale.
+*/
+#define METRIC_HISTOGRAM_BUCKETS 52
+
+class MetricHistogram
+{
+	public:
+		MetricHistogram( );
+		void record( qint64 us );
+		int count( );
+		double sumSeconds( );
+		qint64 percentile( double p ); // the limit of the bucket it lands in, in µs
+		int bucketCount( int bucket ) { return buckets[ bucket ].fetchAndAddRelaxed( 0 ); }
+		static qint64 bucketLimit( int bucket ); // -1 for the last one, which takes everything bigger
+	private:
+		QAtomicInt buckets[ METRIC_HISTOGRAM_BUCKETS ];
+		QAtomicInt sumMicros;       // carried into sumKiloseconds every 1000 s
+		QAtomicInt sumKiloseconds;
+};
+
+// everything we keep for each board
+class BoardMetrics
+{
+	public:
+		BoardMetrics( const QString& key );
+		MetricCounter* packetsIn;
+		MetricCounter* bytesIn;
+		MetricCounter* packetsOut;
+		MetricCounter* bytesOut;
+		MetricCounter* decodeErrors;
+		MetricCounter* dropped;     // packets that arrived faster than we could take them
+		MetricCounter* slipErrors;  // oversized or garbled SLIP frames
+		MetricHistogram* handling;  // from reading a packet to handing it to clients
+		MetricHistogram* roundTrip; // latency probes, there and back
+		MetricCounter* probeTimeouts;
+};
+
+class Metrics
+{
+	public:
+		static Metrics* instance( );
+		static BoardMetrics* board( const QString& key );
+		static qint64 microseconds( ); // for timing - only differences mean anything
+
+		// labels are Prometheus style, already formatted - board="192.168.0.200"
+		MetricCounter* counter( const char* name, const char* help, const QString& labels = QString( ) );
+		MetricGauge* gauge( const char* name, const char* help, const QString& labels = QString( ) );
+		MetricHistogram* histogram( const char* name, const char* help, const QString& labels = QString( ) );
+
+		QByteArray prometheusText( );
+		QList<OscMessage*> oscMessages( const QString& prefix );
+
+	private:
+		enum Type { Counter, Gauge, Histogram };
+		class Entry
+		{
+			public:
+				QByteArray name;
+				QByteArray help;
+				QString labels;
+				Type type;
+				void* metric;
+		};
+		QList<Entry> entries;
+		QHash<QString, BoardMetrics*> boards;
+		QMutex mutex; // creating and listing - never recording
+
+		Metrics( ) { }
+		void* find( const char* name, const char* help, const QString& labels, Type type );
+};
+
+#endif // METRICS_H
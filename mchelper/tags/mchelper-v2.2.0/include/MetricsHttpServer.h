@@ -0,0 +1,44 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#ifndef METRICSHTTPSERVER_H
+#define METRICSHTTPSERVER_H
+
+#include <QTcpServer>
+#include "MessageInterface.h"
+
+/*
+	Serves Metrics as Prometheus text on GET /metrics, to localhost only.
+	Each scrape is one short connection, handled on the main thread - the
+	metrics are only read here, so nothing on the packet path waits for it.
+*/
+class MetricsHttpServer : public QTcpServer
+{
+	Q_OBJECT
+	public:
+		MetricsHttpServer( MessageInterface* messageInterface, QObject* parent = 0 );
+		bool setPort( int port ); // 0 to stop listening
+
+	private slots:
+		void openNewConnection( );
+		void readRequest( );
+
+	private:
+		MessageInterface* messageInterface;
+};
+
+#endif // METRICSHTTPSERVER_H
@@ -25,45 +25,76 @@
 #include <QtNetwork>
 #include <QHostInfo>
 #include <QMutex>
-#include "McHelperWindow.h"
+#include "BridgeInterface.h"
 #include "PacketUdp.h"
+#include "UdpReceiver.h"
 #include "MonitorInterface.h"
+#include "TimingWheel.h"
 
 class PacketUdp;
-class McHelperWindow;
-
+class QCoreApplication;
+
+/*
+	Finds boards on the network, and notices when they go away.
+
+	Every NETWORK_TICK_MS, the wheel moves on a tick.  Each board has a Timer
+	in it, but packets coming in don't touch it - they just note the tick
+	they came in on, from whichever thread they were read on.  When a board's
+	Timer comes up we look at when we last heard from it: if it's been
+	BOARD_TIMEOUT_MS, it's gone, and otherwise the Timer's started again from
+	then.  So each board costs something about once a second, however much
+	it's sending.
+
+	Boards that have gone quiet for PING_AFTER_MS need a /network/find to
+	prove they're still there, and so does finding new ones.  While all the
+	boards we know about are sending anyway, the pings back off, doubling up
+	to PING_MAX_INTERVAL_MS, and go back to every PING_INTERVAL_MS as soon as
+	one goes quiet or a board comes or goes.
+*/
 class NetworkMonitor : public QObject, public MonitorInterface
 {
   Q_OBJECT
   public:
   	NetworkMonitor( int listenPort, int sendPort );
-  	~NetworkMonitor( ) {}
+  	~NetworkMonitor( );
+  	void setReceiveThread( bool enabled );
   	void start( );
   	Status scan( QList<PacketUdp*>* arrived );
-  	void setInterfaces( MessageInterface* messageInterface, McHelperWindow* mainWindow, QApplication* application );
+  	void setInterfaces( MessageInterface* messageInterface, BridgeInterface* bridge, QCoreApplication* application );
   	void deviceRemoved( QString key );
 		bool changeListenPort( int port );
 		void changeSendPort( int port );
 		int getSendPort( ) { return sendPort; }
 		int getListenPort( ) { return listenPort; }
+		quint32 tick( ) { return (quint32)ticks.fetchAndAddRelaxed( 0 ); } // safe from the receive thread
   	
   private:
-		QHash<QString, PacketUdp*> connectedDevices; // our internal list
+		QHash<quint32, PacketUdp*> connectedDevices; // our internal list, by IPv4 address
 		MessageInterface* messageInterface;
-		McHelperWindow* mainWindow;
-		QApplication* application;
-		QTimer pingTimer;
+		BridgeInterface* bridge;
+		QCoreApplication* application;
+		QTimer tickTimer;
+		TimingWheel liveness; // main thread only
+		QAtomicInt ticks;     // liveness.now( ), for the receive thread to read
+		bool quietBoards;     // one's gone long enough without a packet that it needs a ping
+		int pingInterval;     // ticks, backing off while every board's sending anyway
+		quint32 lastPing;
 		QUdpSocket socket;
+		UdpReceiver* receiver; // reads on its own thread instead of socket, if we're using it
 		QByteArray broadcastPing;
+		QByteArray datagram; // reused for each read - only ever grows
 		QHostAddress localBroadcastAddress;
 		int listenPort;
 		int sendPort;
 		bool sendLocal;
+		PacketUdp* addDevice( const QHostAddress& sender );
 	
   private slots:
 		void processPendingDatagrams( );
 		void sendPing( );
+		void advance( );
 		void lookedUp( const QHostInfo &host );
+		void newSender( quint32 address );
 };
 
 #endif // NETWORK_MONITOR_H_
@@ -18,10 +18,14 @@
 #ifndef OSC_H
 #define OSC_H
 
-#include "MessageInterface.h"
-#include "McHelperWindow.h"
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QList>
+#include <QVector>
+#include <string.h>
 
-class McHelperWindow;
+#include "MessageInterface.h"
 
 class OscMessageData
 {
@@ -68,7 +72,7 @@ class Osc
 		void setInterfaces( MessageInterface* messageInterface );
     void setPreamble( QString preamble ) { this->preamble = preamble; }
     QString getPreamble( );
-		bool createMessage( QString msg, OscMessage *msg );
+		bool createMessage( QString msg, OscMessage *oscMsg );
 	  		
 	private:
 		char* findDataTag( char* message, int length );
@@ -81,6 +85,65 @@ class Osc
 		QString preamble;
 };
 
+/*
+	Non-owning views onto a received OSC packet.  Nothing is copied out of the
+	packet, so a view is only good until the buffer it came from is reused.
+*/
+class OscArgView
+{
+	public:
+		char type;         // the typetag character - 'i', 'f', 's' or 'b'
+		const char* data;  // the big-endian int/float, the string, or the blob contents
+		int size;          // 4 for ints and floats, otherwise the string or blob length
+		int toInt( ) const;
+		float toFloat( ) const;
+		QString toString( ) const;
+};
+
+class OscMessageView
+{
+	public:
+		const char* address;
+		const char* typetag;  // starts with the ','
+		const char* raw;      // the whole message as it appeared in the packet
+		int rawSize;
+		int argCount;
+		int firstArg;         // index of this message's first argument in the decoder
+		bool addressIs( const char* str ) const { return strcmp( address, str ) == 0; }
+};
+
+/*
+	Decodes packets into OscMessageViews without allocating.  The message and argument
+	lists are kept between calls and only ever grow, so once they've reached the size of
+	the biggest bundle we've seen, decode( ) doesn't touch the heap at all.
+*/
+class OscDecoder
+{
+	public:
+		enum Status { OK, ERROR_UNKNOWN_PACKET, ERROR_NO_TYPE_TAG, ERROR_BAD_DATA };
+
+		OscDecoder( );
+		int decode( const char* packet, int length );
+		int messageCount( ) const { return msgCount; }
+		const OscMessageView& message( int index ) const { return messages.at( index ); }
+		const OscArgView& arg( const OscMessageView& msg, int index ) const { return args.at( msg.firstArg + index ); }
+		Status status( ) const { return lastStatus; }
+		QString errorString( ) const;
+		QString messageString( int index ) const;
+		OscMessage* createOscMessage( int index ) const;
+
+	private:
+		void decodePacket( const char* packet, int length, int depth );
+		bool decodeMessage( const char* msg, int length );
+		void setError( Status status );
+
+		QVector<OscMessageView> messages;
+		QVector<OscArgView> args;
+		int msgCount;
+		int argCount;
+		Status lastStatus;
+};
+
 #endif	
 
 
@@ -0,0 +1,58 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License, 
+ Version 2.0 (the "License"); you may not use this file except in compliance 
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0 
+ 
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#ifndef OSC_BINARY_FRAME_H
+#define OSC_BINARY_FRAME_H
+
+#include <QByteArray>
+#include <QString>
+
+/*
+	The binary alternative to the XML bridge.  A client that sends
+	OSC_BINARY_HANDSHAKE as the very first byte on its connection gets the same
+	byte back, and from then on both directions are frames of raw OSC packets:
+
+	  4 bytes  length of everything after this field
+	  8 bytes  timestamp - ms since the epoch that the packet arrived (0 from clients)
+	  2 bytes  UDP port the packet came in on, or 0
+	  1 byte   length of the board key
+	  n bytes  board key - its IP address or USB port, same as the XML ADDRESS attribute
+	  ...      the OSC packet, exactly as it came from (or goes to) the board
+
+	All big-endian.  Frames from a client go to the board its key names.
+*/
+#define OSC_BINARY_HANDSHAKE 0xB1     // can't start an XML document - it's not even valid leading UTF-8
+#define OSC_BINARY_HEADER_SIZE 15     // up to the key
+#define OSC_BINARY_MAX_FRAME 65536    // anything bigger than this is garbage
+
+class OscBinaryFrame
+{
+	public:
+		const char* key;
+		int keyLength;
+		int port;
+		qint64 time;
+		const char* packet;
+		int packetSize;
+
+		static void append( QByteArray* out, const char* packet, int size, const QByteArray& key, int port, qint64 time );
+		static QByteArray create( const char* packet, int size, const QByteArray& key, int port, qint64 time );
+		static int parse( const char* data, int length, OscBinaryFrame* frame );
+		static qint64 now( );
+};
+
+#endif // OSC_BINARY_FRAME_H
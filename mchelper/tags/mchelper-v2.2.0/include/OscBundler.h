@@ -0,0 +1,58 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#ifndef OSCBUNDLER_H
+#define OSCBUNDLER_H
+
+#include <QByteArray>
+
+// the most a board takes in one packet - OSC_MAX_MSG_IN in the firmware's osc.c
+#define OSC_MAX_MSG_IN_1X 200 // 1.x, and what we assume until a board says what it's running
+#define OSC_MAX_MSG_IN_2X 512
+#define UDP_MAX_PAYLOAD 1472  // a 1500 byte Ethernet frame, less the IP & UDP headers
+
+/*
+	Collects outgoing packets into one bundle, until the next one won't fit
+	in maxSize( ) bytes.  Messages go in as elements.  Bundles to be handled
+	right away (a timetag of 0 or 1) have their elements copied in rather
+	than being nested - ones for later are nested whole, to keep their time.
+
+	Nothing here knows about time - whoever owns it decides when to take( )
+	what's waiting and send it.
+*/
+class OscBundler
+{
+	public:
+		OscBundler( int maxSize = OSC_MAX_MSG_IN_1X );
+		void setMaxSize( int size ) { maxBytes = size; }
+		int maxSize( ) const { return maxBytes; }
+
+		// false if the packet won't fit with what's already waiting - take( ) that first.
+		// If it's still false with nothing waiting, the packet's too big to bundle at all,
+		// or it's a bundle whose element sizes don't add up.
+		bool add( const char* packet, int size );
+		QByteArray take( ); // everything waiting, as a single message or a bundle
+		bool isEmpty( ) const { return count == 0; }
+		int messageCount( ) const { return count; }
+
+	private:
+		QByteArray elements; // each preceded by its int32 size, as they'll appear in the bundle
+		int count;
+		int maxBytes;
+};
+
+#endif // OSCBUNDLER_H
@@ -0,0 +1,71 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#ifndef OSCSTATECACHE_H
+#define OSCSTATECACHE_H
+
+#include <QByteArray>
+#include <QString>
+#include <QHash>
+#include <QList>
+#include <QVector>
+#include <QReadWriteLock>
+
+class OscDecoder;
+
+/*
+	The last message we got from each board at each OSC address, and when.
+
+	Boards fill it in from their own threads as packets arrive, autosend
+	included.  When a client asks a board for something - a message with no
+	arguments - and every address it's asking about has come in within
+	maxAge( ) ms, the client gets answered from here and the board never hears
+	about it.  Writing to an address throws out what we had for it, so the
+	next read goes to the board.
+
+	A maxAge( ) of 0 turns it off, and then it doesn't store anything either.
+*/
+class OscStateCache
+{
+	public:
+		OscStateCache( );
+		void setMaxAge( int ms ) { maxAgeMs = ms; }
+		int maxAge( ) const { return maxAgeMs; }
+
+		// from boards
+		void store( const QString& board, const OscDecoder& decoder, const QVector<int>& messages );
+		void removeBoard( const QString& board );
+
+		// from clients
+		QByteArray answer( const QString& board, const QList<QByteArray>& addresses );
+		void invalidate( const QString& board, const QByteArray& address );
+
+	private:
+		class Value
+		{
+			public:
+				QByteArray message; // the whole message, as the board sent it
+				qint64 time;
+		};
+		typedef QHash<QByteArray, Value> BoardValues;
+
+		QHash<QString, BoardValues> boards;
+		QReadWriteLock lock;
+		volatile int maxAgeMs;
+};
+
+#endif // OSCSTATECACHE_H
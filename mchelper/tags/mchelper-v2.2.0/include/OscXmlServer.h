@@ -22,13 +22,17 @@
 #include <QTcpSocket>
 #include <QXmlSimpleReader>
 #include <QXmlDefaultHandler>
-#include <QDomDocument>
 #include <QMutex>
+#include <QThread>
+#include <QTimer>
 
-#include "McHelperWindow.h"
+#include "BridgeInterface.h"
 #include "MessageEvent.h"
 #include "Board.h"
 #include "Osc.h"
+#include "OscBinaryFrame.h"
+#include "QueryCoalescer.h"
+#include "Metrics.h"
 
 class OscXmlServer;
 class OscXmlClient;
@@ -39,7 +43,7 @@ class XmlHandler : public QObject, public QXmlDefaultHandler
 {
 	Q_OBJECT
 	public:
-		XmlHandler( McHelperWindow *mainWindow, OscXmlClient *xmlClient );
+		XmlHandler( BridgeInterface *bridge, OscXmlClient *xmlClient );
 		bool endElement( const QString & namespaceURI, const QString & localName, const QString & qName );
 		bool startElement( const QString & namespaceURI, const QString & localName, 
 												const QString & qName, const QXmlAttributes & atts );
@@ -50,7 +54,7 @@ class XmlHandler : public QObject, public QXmlDefaultHandler
 		void newMessage( QStringList strings, MessageEvent::Types type, QString from );
 												
 	private:
-		McHelperWindow *mainWindow;
+		BridgeInterface *bridge;
 		OscXmlClient *xmlClient;
 		OscMessage* currentMessage;
 		QString currentDestination;
@@ -62,20 +66,24 @@ class OscXmlClient : public QThread
 {
 	Q_OBJECT
 	public:
-		OscXmlClient( QTcpSocket *socket, McHelperWindow *mainWindow, QObject *parent = 0 );
+		OscXmlClient( QTcpSocket *socket, BridgeInterface *bridge, QObject *parent = 0 );
 		~OscXmlClient( ) { }
     void run();
 		void resetParser( );
+		static QByteArray boardListDocument( QList<Board*> boardList, bool arrived );
+		bool answerLocally( const QString& board, const QList<OscMessage*>& messages );
+		bool isBinary( ) { return binary; }
 	
 	public slots:
 		void boardListUpdate( QList<Board*> boardList, bool arrived );
 		void boardInfoUpdate( Board* board );
 		void wroteBytes( qint64 bytes );
-		void sendXmlPacket( QList<OscMessage*> messageList, QString srcAddress, int srcPort );
+		void sendXmlDocument( QByteArray document );
+		void sendOscFrame( QByteArray frame );
 
 	private:
     int socketDescriptor;
-		McHelperWindow *mainWindow;
+		BridgeInterface *bridge;
 		bool lastParseComplete;
 		QXmlSimpleReader xml;
 		QXmlInputSource xmlInput;
@@ -85,29 +93,51 @@ class OscXmlClient : public QThread
 		QMutex msgMutex;
 		QString peerAddress;
 		bool shuttingDown;
+		volatile bool firstRead; // the first thing a client sends decides whether it wants binary
+		volatile bool binary; // raw OSC packets in frames instead of XML, both ways
+		QByteArray binaryInput; // any partial frame left over from the last read
+		OscDecoder decoder;     // for packets from binary clients, and cached answers for XML ones
+		MetricGauge* clientsGauge;
+		MetricGauge* queuedGauge; // everybody's bytes waiting to be written
+		MetricCounter* cacheAnswers;
+		QAtomicInt queued;        // our share of it, as of our last write
 		
 		bool isConnected( );
-		void writeXmlDoc( QDomDocument doc );
+		void processBinary( const QByteArray& data );
+		bool answerLocally( const QString& board, const char* packet, int size );
+		bool answerQueries( const QString& board, const QList<QByteArray>& queries );
+		static QByteArray queryPacket( const QList<QByteArray>& queries );
+		void answerStats( const QString& board, const QList<QByteArray>& queries );
+		void sendAnswer( const QString& board, const QByteArray& packet );
+		void updateQueued( );
+		void modeDecided( );
+		void sendBoardFrame( Board* board, const char* address, QString arg1, QString arg2 = QString( ) );
 	
 	private slots:
 		void processData( );
 		void disconnected( );
+		void handshakeTimedOut( );
 };
 
 class OscXmlServer : public QTcpServer
 {
 	Q_OBJECT
 	public:
-		OscXmlServer( McHelperWindow *mainWindow, int port, QObject *parent = 0 );
+		OscXmlServer( BridgeInterface *bridge, int port, QObject *parent = 0 );
 		void run( );
 		bool changeListenPort( int port );
+		QueryCoalescer* queryCoalescer( ) { return &coalescer; }
 	
 	private slots:
 		void openNewConnection( );
+		void reportQueryStats( );
 				
 	private:
-		McHelperWindow *mainWindow;
+		BridgeInterface *bridge;
 		int listenPort;
+		QueryCoalescer coalescer;
+		QTimer queryStatsTimer;
+		int lastQueries, lastMerged;
 };
 
 #endif // OSC_XML_SERVER_H
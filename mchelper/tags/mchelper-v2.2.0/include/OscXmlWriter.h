@@ -0,0 +1,43 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License, 
+ Version 2.0 (the "License"); you may not use this file except in compliance 
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0 
+ 
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#ifndef OSC_XML_WRITER_H
+#define OSC_XML_WRITER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+
+#include "Osc.h"
+
+/*
+	Writes the documents the XML server sends, straight into a QByteArray
+	with a streaming writer - no DOM.  Each one comes back with the \0 that
+	Flash wants after it, ready to be written to the socket as is.
+
+	They're written once per event, not once per client: QByteArray is
+	implicitly shared, so every client's write gets the same buffer.
+*/
+class OscXmlWriter
+{
+	public:
+		static QByteArray packet( const OscDecoder& decoder, const QString& srcAddress, int srcPort );
+		static QByteArray boardList( bool arrived, const QStringList& keys, const QStringList& types );
+		static QByteArray boardInfo( const QString& key, const QString& name, const QString& serialNumber );
+};
+
+#endif // OSC_XML_WRITER_H
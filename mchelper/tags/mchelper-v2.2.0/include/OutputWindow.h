@@ -19,24 +19,38 @@
 #define OUTPUTWINDOW_H
 
 #include <QAbstractItemModel>
+#include <QVector>
+#include <QHash>
+#include <QStringList>
+#include <QMutex>
 #include "MessageEvent.h"
+#include "Osc.h"
 
+/*
+	One row in the output window, kept raw - it only gets turned into strings
+	when the view asks for it.  Responses from boards hold onto the packet they
+	came in, shared by every message in it, and which message they are.
+*/
 class TableEntry
 {
 	public:
-		TableEntry( QString msg, MessageEvent::Types type, QString tofrom, QString time )
-		{
-			this->msg = msg;
-			this->type = type;
-			this->tofrom = tofrom;
-			this->timestamp = time;
-		}
-		~TableEntry( ) { }
-
-		QString msg, tofrom, timestamp;
+		TableEntry( ) { }
+
+		int time;          // ms since midnight
 		MessageEvent::Types type;
+		int from;          // index into the model's source names
+		int message;       // which message in packet, or -1 if it's just text
+		QByteArray packet;
+		QString text;
 };
 
+/*
+	Rows live in a ring that's maxMsgs long, so old ones fall off the front
+	without shuffling anything around.  Anybody can add rows from any thread -
+	they're queued up and land in the model in one go when flush( ) gets called
+	from the GUI thread.  If more than a window's worth pile up between flushes,
+	the rest are dropped and counted instead, and show up as a single row.
+*/
 class OutputWindow : public QAbstractItemModel
 {
     Q_OBJECT
@@ -50,27 +64,38 @@ class OutputWindow : public QAbstractItemModel
     QModelIndex parent(const QModelIndex &index) const;
     int rowCount(const QModelIndex &parent = QModelIndex()) const;
     int columnCount(const QModelIndex &parent = QModelIndex()) const;
-		void newRows( QList<TableEntry> entries );
 		bool hasChildren( const QModelIndex & parent = QModelIndex() );
 		void setMaxMsgs( int newMaxMsgs );
+
+		// thread safe
+		void append( const QStringList& strings, MessageEvent::Types type, const QString& from );
+		void appendPacket( const QByteArray& packet, const QVector<int>& messages, const QString& from );
+		// GUI thread only - returns whether any rows were added
+		bool flush( );
 		
 	public slots:
 		void clear( );
 
 	private:
     int maxMsgs;
-		QList<TableEntry> tableEntries;
+		QVector<TableEntry> ring;
+		int head;
+		int count;
+		QStringList sourceNames;       // GUI thread's copy
+
+		QMutex queueMutex;             // everything below here
+		QVector<TableEntry> queue;
+		int suppressed;
+		int queueMax;
+		QHash<QString, int> sourceIds;
+		QStringList newSourceNames;
+
+		const TableEntry& entry( int row ) const { return ring.at( ( head + row ) % maxMsgs ); }
+		int sourceId( const QString& from );
+		void removeOldest( int rows );
+		QString messageText( const TableEntry& e ) const;
+		mutable QByteArray decodedPacket; // the last packet data( ) had to decode
+		mutable OscDecoder decoder;
 };
 
 #endif // OUTPUTWINDOW_H
-
-
-
-
-
-
-
-
-
-
-
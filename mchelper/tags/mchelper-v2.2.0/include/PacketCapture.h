@@ -0,0 +1,95 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#ifndef PACKETCAPTURE_H
+#define PACKETCAPTURE_H
+
+#include <QThread>
+#include <QFile>
+#include <QByteArray>
+#include <QMutex>
+#include <QWaitCondition>
+
+/*
+	Records every packet to and from every board, to be looked at or replayed
+	later with tools/capreplay.
+
+	A capture file starts with the 8 bytes PACKET_CAPTURE_MAGIC, then records:
+
+	  4 bytes  length of everything after this field
+	  8 bytes  timestamp - ns since the epoch
+	  1 byte   direction - 0 from the board, 1 to it
+	  1 byte   transport - 0 UDP, 1 USB
+	  1 byte   length of the board key
+	  n bytes  board key - its IP address or USB port
+	  ...      the OSC packet, exactly as it went over the wire
+
+	All big-endian, the same layout as OscBinaryFrame.
+
+	record( ) can be called from any thread.  It only appends to a buffer -
+	the writing happens on our own thread, in big chunks.  If the disk can't
+	keep up and PACKET_CAPTURE_MAX_PENDING bytes pile up, records get dropped
+	and counted instead.
+*/
+#define PACKET_CAPTURE_MAGIC "mchcap\0\1"
+#define PACKET_CAPTURE_HEADER_SIZE 15 // up to the key
+#define PACKET_CAPTURE_MAX_PENDING ( 16 * 1024 * 1024 )
+
+class PacketCapture : public QThread
+{
+	public:
+		enum Direction { FromBoard, ToBoard };
+		enum Transport { Udp, Usb };
+
+		PacketCapture( );
+		~PacketCapture( );
+		bool open( const QString& filename );
+		void close( );
+		QString fileName( ) const { return file.fileName( ); }
+		int droppedCount( );
+
+		void record( const QByteArray& key, Direction direction, Transport transport, const char* packet, int size );
+
+		// reading one back - pointers end up pointing into data
+		class Record
+		{
+			public:
+				qint64 time;
+				Direction direction;
+				Transport transport;
+				const char* key;
+				int keyLength;
+				const char* packet;
+				int packetSize;
+		};
+		static int parse( const char* data, int length, Record* record );
+		static qint64 nanoseconds( );
+
+	protected:
+		void run( );
+
+	private:
+		QFile file;
+		QByteArray pending; // only ever grows, so swapping it back and forth never means allocating again
+		int pendingSize;    // how much of it is in use
+		QMutex mutex;
+		QWaitCondition wake;
+		bool stopping;
+		int dropped;
+};
+
+#endif // PACKETCAPTURE_H
@@ -0,0 +1,72 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#ifndef PACKETRING_H
+#define PACKETRING_H
+
+#include <QByteArray>
+#include <QVector>
+#include <QAtomicInt>
+
+/*
+	A fixed size queue of packets between one thread that writes them and one
+	that reads them.  No locks - each side only ever moves its own index, and
+	the indexes are published with release/acquire ordering.
+
+	The packet buffers are allocated up front and reused, and only grow if a
+	packet is bigger than any that's come through that slot before.  If the
+	reader falls behind and the ring fills up, new packets are dropped and
+	counted rather than overwriting ones that haven't been read yet.
+
+	The writer can fill a slot in place with beginWrite( ) / endWrite( ), to
+	skip a copy when reading from a socket.
+*/
+class PacketRing
+{
+	public:
+		PacketRing( int slots = 64, int slotSize = 2048 );
+
+		// writer side
+		char* beginWrite( int length );
+		void endWrite( int length );
+		bool write( const char* data, int length );
+
+		// reader side
+		bool isPacketWaiting( );
+		int packetsWaiting( );
+		int pendingPacketSize( );
+		int read( char* buffer, int size );
+
+		int overflowCount( ) { return (int)overflows; }
+		int packetCount( ) { return (int)packets; }
+		int highWaterMark( ) { return (int)highWater; }
+
+	private:
+		QVector<QByteArray> buffers;
+		QVector<int> lengths;
+		QByteArray* slotBuffers; // buffers.data( ) - cached so neither side can trigger a detach
+		int* slotLengths;
+		int slotCount;
+		QAtomicInt head;      // next slot to read - only the reader moves it
+		QAtomicInt tail;      // next slot to write - only the writer moves it
+		QAtomicInt overflows; // packets dropped because the ring was full
+		QAtomicInt packets;   // packets written, all told
+		QAtomicInt highWater; // most packets that have been waiting at once
+		int next( int index ) { return ( index + 1 == slotCount ) ? 0 : index + 1; }
+};
+
+#endif // PACKETRING_H
@@ -21,18 +21,25 @@
 #include <QUdpSocket>
 #include <QHostAddress>
 #include <QHostInfo>
-#include <QTimer>
 #include <QList>
 #include <QMutex>
 
 #include "PacketInterface.h"
+#include "PacketRing.h"
+#include "DatagramInterface.h"
 #include "MessageInterface.h"
 #include "PacketReadyInterface.h"
 #include "NetworkMonitor.h"
+#include "Metrics.h"
+#include "TimingWheel.h"
 
 class NetworkMonitor;
 
-class PacketUdp : public QObject, public PacketInterface
+/*
+	A board on the network.  Its Timer is the NetworkMonitor's, for keeping
+	track of whether we're still hearing from it.
+*/
+class PacketUdp : public QObject, public PacketInterface, public DatagramInterface, public TimingWheel::Timer
 {	
 	Q_OBJECT
 	
@@ -42,7 +49,8 @@ class PacketUdp : public QObject, public PacketInterface
 	  Status open( );
 		void setInterfaces( MessageInterface* messageInterface , NetworkMonitor* monitor );
 		void setPacketReadyInterface( PacketReadyInterface* packetReadyInterface );
-		void resetTimer( void );
+		void heardFrom( quint32 tick ) { heardAt.fetchAndStoreRelaxed( (int)tick ); } // in NetworkMonitor ticks
+		quint32 lastHeard( ) { return (quint32)heardAt.fetchAndAddRelaxed( 0 ); }
 		
 		// From PacketInterface
 	  Status sendPacket( char* packet, int length );
@@ -52,14 +60,14 @@ class PacketUdp : public QObject, public PacketInterface
 	  bool isOpen( );
 	  QString getKey( void );
 	  char* location( );
-	  void incomingMessage( QByteArray message );
+	  bool incomingMessage( const char* data, int length );
+	  int droppedPackets( ) { return incoming.overflowCount( ); }
 	  void setRemoteHostInfo( QHostAddress* address, quint16 port );
 	  void setKey( QString key );
 		
 	public slots:
 		Status close( );
 		void processPacket( );
-		Status pingTimedOut( );
 		
 	private:
 	  MessageInterface* messageInterface;
@@ -67,11 +75,12 @@ class PacketUdp : public QObject, public PacketInterface
 	  QUdpSocket* socket;
 	  QHostAddress remoteHostAddress;
 	  QByteArray remoteHostName;
-	  QTimer* timer;
 	  NetworkMonitor* monitor;
-	  QByteArray lastMessage;
+	  PacketRing incoming; // filled by the network monitor, drained by the board
+	  QAtomicInt heardAt;  // the monitor's tick when the last packet came in - set from the receive thread too
+	  int droppedReported;
 	  QString socketKey;
-	  QMutex msgMutex;
+	  BoardMetrics* metrics;
 	
     char* remoteAddress;
     int localPort;
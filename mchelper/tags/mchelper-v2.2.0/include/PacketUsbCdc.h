@@ -24,18 +24,35 @@
 #include <QByteArray>
 
 #include "UsbSerial.h"
+#include "SlipDecoder.h"
 #include "PacketInterface.h"
 #include "PacketReadyInterface.h"
 #include "MonitorInterface.h"
-#include "McHelperWindow.h"
+#include "BridgeInterface.h"
+#include "Metrics.h"
+#include "UsbReactor.h"
+#include "UsbWriter.h"
+
+#define USB_READ_SIZE 4096
 
 class UsbSerial;
 
-class PacketUsbCdc : public QThread, public PacketInterface
+/*
+	A board on a USB serial port.
+
+	On Mac and Windows each one is a thread of its own, checking the port for
+	anything new.  On Linux the thread isn't started - the port is handed to
+	the UsbReactor when it's opened, which calls readable( ) when there's
+	something there.
+
+	Packets going out are handed to a UsbWriter, which writes them from its
+	own thread, several to a write when they're coming thick and fast.
+*/
+class PacketUsbCdc : public QThread, public PacketInterface, public UsbReactor::Handler, public UsbWriter::Output
 {
 	Q_OBJECT
 	public:
-		PacketUsbCdc( McHelperWindow* mainWindow, QApplication* application, MonitorInterface* monitor );
+		PacketUsbCdc( BridgeInterface* bridge, MonitorInterface* monitor );
 		~PacketUsbCdc( );
 		void run( );
 		// from PacketInterface
@@ -50,6 +67,11 @@ class PacketUsbCdc : public QThread, public PacketInterface
 		char* location( void );
 		void setPortName( QString name );
 		void setPacketReadyInterface( PacketReadyInterface* packetReadyInterface);
+		void setWriteWindow( int ms ) { writer.setWindow( ms ); }
+		// from UsbReactor::Handler
+		bool readable( qint64 wokeAt );
+		// from UsbWriter::Output
+		bool writeFrames( char* data, int length );
 		#ifdef Q_WS_WIN
 		void setDeviceHandle( HANDLE deviceHandle );
 		HANDLE getDeviceHandle( void );
@@ -59,19 +81,24 @@ class PacketUsbCdc : public QThread, public PacketInterface
 		void readyRead( );
 								
 	private:
-		QByteArray currentPacket;
-		QMutex packetMutex;
-		QByteArray slipRxPacket;
+		SlipDecoder slip;
+		QByteArray readBuffer; // the last read from the port, decoded up to readPosition
+		int readPosition;
+		int readLength;
 		UsbSerial *port;
+		UsbWriter writer;
 		void sleepMs( int ms );
 
 		PacketReadyInterface* packetReadyInterface;
-		McHelperWindow *mainWindow;
-		QApplication* application;
+		BridgeInterface* bridge;
 		MonitorInterface* monitor;
-		int slipReceive( QByteArray *packet );
+		int slipReceive( );
 		int getMoreBytes( void );
+		void countSlipErrors( );
 		bool exit;
+		bool inReactor;
+		BoardMetrics* metrics; // only touched from whichever thread is reading
+		int slipErrorsReported;
 };
 
 #endif // PACKETUSBCDC_H
@@ -0,0 +1,83 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#ifndef QUERYCOALESCER_H
+#define QUERYCOALESCER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QHash>
+#include <QList>
+#include <QVector>
+#include <QMutex>
+#include "Metrics.h"
+
+class OscDecoder;
+class OscXmlClient;
+
+/*
+	Keeps track of the queries clients have sent on to boards that haven't
+	been answered yet.  If another client asks a board the same thing while
+	it's still waiting - the same address, no arguments - it gets added to the
+	list of clients waiting on it instead of sending the board another copy.
+
+	When a packet comes back from the board and everything in it answers
+	queries we're waiting on, it only goes to the clients that asked.
+	Anything else goes out to everybody, as usual.
+
+	A query that hasn't been answered in QUERY_TIMEOUT_MS is forgotten, so the
+	next one goes to the board again.
+
+	Only boards that have been added are tracked - the keys come from clients,
+	and a mistyped one shouldn't cost us anything.
+*/
+class QueryCoalescer
+{
+	public:
+		QueryCoalescer( );
+
+		// from clients - true if every query is already on its way to the board
+		bool hasBoard( const QString& board );
+		bool join( const QString& board, const QList<QByteArray>& queries, OscXmlClient* client );
+		void removeClient( OscXmlClient* client );
+
+		// from boards - true if the packet went to the clients that were waiting on it
+		bool answer( const QString& board, const OscDecoder& decoder, const QVector<int>& messages,
+									const char* packet, int size, int port );
+		void addBoard( const QString& board );
+		void removeBoard( const QString& board );
+
+		int queries( ) { return (int)queryCount->get( ); }   // all told
+		int merged( ) { return (int)mergedCount->get( ); }   // the ones that never went to a board
+
+	private:
+		class InFlight
+		{
+			public:
+				InFlight( ) { sent = 0; }
+				qint64 sent;
+				QList<OscXmlClient*> waiting;
+		};
+		typedef QHash<QByteArray, InFlight> BoardQueries;
+
+		QHash<QString, BoardQueries> boards;
+		QMutex mutex; // also held while answering, so a client can't be removed out from under us
+		MetricCounter* queryCount;
+		MetricCounter* mergedCount;
+};
+
+#endif // QUERYCOALESCER_H
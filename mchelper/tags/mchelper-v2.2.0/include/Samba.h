@@ -38,6 +38,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/select.h>
+#include <termios.h>
 
 #include <stdio.h>
 #include <string.h>
@@ -172,16 +173,19 @@ struct sam7_chip_info{
 #include "UploaderThread.h"
 #include "MessageInterface.h"
 #include "SambaMonitor.h"
+#include "SambaFlasher.h"
+#include "FirmwareImage.h"
 
 class SambaMonitor;
 class UploaderThread;
 
-class Samba
+class Samba : public SambaFlasher::Port
 {
 	public:
     enum Status { OK, ERROR_INITIALIZING, ERROR_INCORRECT_CHIP_INFO, 
     	            ERROR_COULDNT_FIND_FILE, ERROR_COULDNT_OPEN_FILE, 
-    	            ERROR_SENDING_FILE, ERROR_SETTING_BOOT_BIT, ERROR_RESETTING };
+    	            ERROR_SENDING_FILE, ERROR_SETTING_BOOT_BIT, ERROR_RESETTING,
+    	            ERROR_BAD_IMAGE, ERROR_VERIFYING };
 
 		Samba( SambaMonitor* monitor, MessageInterface* messageInterface );
 
@@ -189,19 +193,20 @@ class Samba
 		Status disconnect();		
 
 		Status flashUpload( char* bin_file );
+		Status flashUpload( const FirmwareImage& image );
 		Status bootFromFlash( );
 		Status reset( );
 		void setUploader( UploaderThread* uploader );
 		QString getDeviceKey( );
 		void setDeviceKey( QString key );
+		void setLegacyUpload( bool legacy );
+		void setDeltaUpload( bool delta );
 		int FindUsbDevices( QList<QString>* arrived );
     
   private:
 		int init( );
 		int readWord( uint32_t addr, uint32_t *value );
 		int writeWord( uint32_t addr, uint32_t value );
-		int sendFile( uint32_t addr, uint8_t *buff, int len );
-		int go( uint32_t addr );
 		int sendCommand( char *cmd, void *response, int response_len );
 		const char* at91ArchStr( int id );
 
@@ -209,13 +214,17 @@ class Samba
     int usbWrite( char* buffer, int length );
     int usbRead( char* buffer, int length );
     int usbClose( );
-      
-    void* fileOpen( char* name );
-    int fileRead( void* file_fd, char* buff, int length );
-    void fileClose( void* file_fd );
 
     void uSleep( int usecs );
 		int uploadProgress;
+		bool legacyUpload;
+		bool deltaUpload;
+
+		// SambaFlasher::Port
+		int write( const char* data, int length );
+		int read( char* data, int length );
+		void pause( int usecs );
+		void progress( int value );
     
     UploaderThread* uploader;
     MessageInterface* messageInterface;
@@ -0,0 +1,111 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#ifndef SAMBAFLASHER_H
+#define SAMBAFLASHER_H
+
+#include <QString>
+#include <QVector>
+#include <stdint.h>
+
+#define SAMBA_LOADER_ADDRESS 0x00201600 // where the loader applet runs from
+#define SAMBA_PAGE_BUFFER    0x00201400 // where it expects the page, followed by the page number
+#define SAMBA_PIPELINE_DEPTH 2          // pages sent ahead of the one being written
+#define SAMBA_FLASH_ADDRESS  0x00100000 // where flash shows up while SAM-BA is running
+#define SAMBA_READ_CHUNK     4096       // bytes of flash to ask for at a time
+
+/*
+	Writes an image to flash through the SAM-BA boot program, one page at a
+	time with the loader applet: write the page number, send the page, then
+	run the applet to program it.
+
+	SAM-BA works through its commands strictly in order, and doesn't read any
+	more from USB while the applet is busy - USB just holds the host off until
+	it's done.  So rather than sleeping after every command to give the board
+	time, each page is sent in one go, followed by a request to read back the
+	page number.  That read can only be answered once the page has been
+	programmed, so it's our acknowledgement.  Up to SAMBA_PIPELINE_DEPTH pages
+	are sent before waiting on the oldest one's acknowledgement, which keeps the
+	next page queued up behind the one being programmed.
+
+	setLegacy( true ) goes back to the old way - 64 byte chunks and a 2 ms sleep
+	after everything - in case some setup can't keep up.
+
+	setDelta( true ) reads what's in flash first, with SAM-BA's R command, and
+	only sends the pages that are different - most updates only touch a small
+	part of the image, and reading a page back is much quicker than programming
+	it.  Once they're written the whole image is read back again to check it.
+	If nothing's changed, the loader doesn't even get sent.
+*/
+class SambaFlasher
+{
+	public:
+		// how the flasher talks to the board
+		class Port
+		{
+			public:
+				virtual int write( const char* data, int length ) = 0; // all of it, or < 0
+				virtual int read( char* data, int length ) = 0;        // all of it, or < 0 if it doesn't show up
+				virtual void pause( int usecs ) = 0;
+				virtual void progress( int value ) { (void)value; }    // 0 - 1000
+				virtual ~Port( ) {}
+		};
+
+		enum Status { OK, ERROR_WRITING, ERROR_NO_ACK, ERROR_WRONG_ACK, ERROR_READING, ERROR_VERIFYING };
+
+		// where the time went, in microseconds
+		struct Timing
+		{
+			qint64 loader;   // sending the loader applet
+			qint64 sending;  // writing pages & commands
+			qint64 waiting;  // blocked on acknowledgements
+			qint64 reading;  // reading flash back, before and after - delta only
+			qint64 total;
+			int pages;       // written
+			int skipped;     // already the same in flash
+		};
+
+		SambaFlasher( Port* port, int pageSize );
+		void setLegacy( bool legacy ) { this->legacy = legacy; }
+		void setPipelineDepth( int pages ) { depth = ( pages < 1 ) ? 1 : pages; }
+		void setDelta( bool delta ) { this->delta = delta; }
+		Status upload( const uint8_t* loader, int loaderLength, const char* image, int imageLength );
+		const Timing& timing( ) const { return times; }
+		QString timingString( ) const;
+		static qint64 microseconds( );
+
+	private:
+		Port* port;
+		int pageSize;
+		int depth;
+		bool legacy;
+		bool delta;
+		Timing times;
+		char* page;
+
+		int sendFile( uint32_t addr, const char* data, int length );
+		int writeWord( uint32_t addr, uint32_t value );
+		int go( uint32_t addr );
+		int command( const char* cmd );
+		int requestAck( );
+		Status waitAck( uint32_t expected );
+		int readFlash( uint32_t offset, char* data, int length );
+		Status changedPages( const char* image, int imageLength, QVector<int>* changed );
+		Status verify( const char* image, int imageLength );
+};
+
+#endif // SAMBAFLASHER_H
@@ -0,0 +1,68 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#ifndef SLIPDECODER_H
+#define SLIPDECODER_H
+
+#include <QByteArray>
+#include <QVector>
+#include <QMutex>
+
+/*
+	Turns a stream of SLIP encoded bytes into packets.
+
+	decode( ) makes a single pass over whatever it's handed, and can be fed
+	partial packets - it picks up where it left off on the next call.  Finished
+	packets go into a fixed size queue whose buffers get reused, so once things
+	have warmed up nothing is allocated per packet.  When the queue is full,
+	decode( ) stops and says how far it got, so the caller can hand it the rest
+	once some packets have been taken out.
+
+	One thread can decode while another takes packets - only the queue itself
+	is locked, not the decoding.
+*/
+class SlipDecoder
+{
+	public:
+		SlipDecoder( int maxPackets = 32, int maxPacketSize = 8192 );
+		int decode( const char* data, int length );
+		bool isPacketWaiting( );
+		int packetsWaiting( );
+		int pendingPacketSize( );
+		int takePacket( char* buffer, int size );
+		void clear( );
+		int droppedPackets( ) { return dropped; }
+
+	private:
+		QVector<QByteArray> buffers; // ring of packet buffers - they only ever grow
+		QVector<int> lengths;
+		int head, count; // shared with whoever's taking packets - guarded by queueMutex
+		QMutex queueMutex;
+
+		// the packet being decoded, which gets built up in buffers[tail] -
+		// only the decoding thread touches these
+		int tail;
+		int partialLength;
+		bool escaped;
+		bool oversized;
+
+		int maxPacketSize;
+		int dropped;
+		bool finishPacket( );
+};
+
+#endif // SLIPDECODER_H
@@ -0,0 +1,39 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#ifndef SLIPENCODER_H
+#define SLIPENCODER_H
+
+/*
+	SLIP encodes packets into a buffer the caller owns, so the same one can be
+	reused for packet after packet, and several frames can be encoded one
+	after another and sent in a single write.
+
+	Each frame starts with an END as well as finishing with one, to flush out
+	anything half-received on the board's side - the same as we've always
+	sent.
+*/
+class SlipEncoder
+{
+	public:
+		// the most encode( ) can write for a packet this long - every byte escaped
+		static int maxEncodedSize( int length ) { return 2 * length + 2; }
+		// returns how many bytes went into out, which needs maxEncodedSize( length ) of room
+		static int encode( const char* packet, int length, char* out );
+};
+
+#endif // SLIPENCODER_H
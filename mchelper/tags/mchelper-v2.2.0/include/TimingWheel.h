@@ -0,0 +1,70 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#ifndef TIMINGWHEEL_H
+#define TIMINGWHEEL_H
+
+#include <QList>
+#include <QtGlobal>
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS ( 1 << WHEEL_BITS ) // per level - two levels covers WHEEL_SLOTS * WHEEL_SLOTS ticks
+
+/*
+	Lots of timeouts, all driven by one tick, rather than a timer each.
+
+	The first level has a slot for each of the next WHEEL_SLOTS ticks, and the
+	second a slot for each WHEEL_SLOTS ticks after that.  Each time the first
+	level comes round, the next second level slot gets spread out over it.
+	Starting and stopping a Timer is O(1), and advance( ) only touches what
+	expires plus, once every WHEEL_SLOTS ticks, what moves down a level.
+	Anything further off than the wheel goes comes back at the far end, and
+	its owner can just start it again.
+
+	The Timers belong to whoever's using the wheel - they're linked into the
+	slots, not copied.  Not thread safe - use it from one thread.
+*/
+class TimingWheel
+{
+	public:
+		class Timer
+		{
+			friend class TimingWheel;
+			public:
+				Timer( ) : next( 0 ), prev( 0 ), slot( 0 ), expires( 0 ) { }
+				virtual ~Timer( ) { }
+				bool isActive( ) const { return slot != 0; }
+			private:
+				Timer* next;
+				Timer* prev;
+				Timer** slot; // the list we're in, if we're in one
+				quint32 expires;
+		};
+
+		TimingWheel( );
+		void start( Timer* timer, int ticks ); // restarts it if it's already going
+		void stop( Timer* timer );
+		void advance( QList<Timer*>* expired ); // one tick on - what's expired is taken out of the wheel
+		quint32 now( ) const { return ticks; }
+
+	private:
+		Timer* slots[ 2 ][ WHEEL_SLOTS ];
+		quint32 ticks;
+		void place( Timer* timer );
+};
+
+#endif // TIMINGWHEEL_H
@@ -0,0 +1,100 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License, 
+ Version 2.0 (the "License"); you may not use this file except in compliance 
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0 
+ 
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#ifndef UDPRECEIVER_H
+#define UDPRECEIVER_H
+
+#include <QThread>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QByteArray>
+#include <QAtomicInt>
+
+#include "DatagramInterface.h"
+
+#define UDP_RECEIVE_BATCH 32  // most datagrams read in one go
+#define UDP_RECEIVE_SIZE 2048 // biggest datagram we'll take - anything bigger is dropped
+#define UDP_HELD_PACKETS 16   // most packets kept for a sender that isn't a board yet
+
+class QUdpSocket;
+
+/*
+	Reads board datagrams on its own thread, so they never go through the GUI
+	event loop.  On Linux it reads up to UDP_RECEIVE_BATCH at a time with
+	recvmmsg( ), elsewhere one at a time from a QUdpSocket.
+
+	Boards are looked up by their IPv4 address as an integer.  Each datagram
+	is queued on its board, and once the batch is done every board that got
+	something is asked to process it - from this thread.
+
+	Datagrams from an address that isn't a board yet are held onto, and
+	newSender( ) is emitted once for that address.  Whoever creates the board
+	hands it back with addDevice( ), and the held packets are delivered to it.
+*/
+class UdpReceiver : public QThread
+{
+	Q_OBJECT
+	public:
+		UdpReceiver( );
+		~UdpReceiver( );
+		bool open( int port );
+		void stop( );
+		void setIgnoredPacket( const QByteArray& packet );
+		void addDevice( quint32 address, DatagramInterface* device );
+		void removeDevice( quint32 address );
+
+		int datagramCount( ) { return (int)datagrams; }
+		int batchCount( ) { return (int)batches; }
+		int droppedCount( ) { return (int)dropped; }
+
+	signals:
+		void newSender( quint32 address );
+
+	protected:
+		void run( );
+
+	private:
+		QHash<quint32, DatagramInterface*> devices;
+		QHash<quint32, QList<QByteArray> > held; // packets from senders that aren't boards yet
+		QMutex devicesLock; // guards devices & held - the thread holds it while it works through a batch
+		bool releaseHeld;   // a device was added, so some held packets might have somewhere to go now
+		QByteArray ignored; // our own broadcast ping, which we'll hear too
+		volatile bool stopping;
+
+		// the last batch
+		QByteArray buffer;
+		char* data[ UDP_RECEIVE_BATCH ];
+		int lengths[ UDP_RECEIVE_BATCH ];
+		quint32 senders[ UDP_RECEIVE_BATCH ];
+
+		QAtomicInt datagrams; // handed to boards, or held for them
+		QAtomicInt batches;
+		QAtomicInt dropped;   // too big, ignored senders that never became boards, etc.
+
+		#ifdef Q_OS_LINUX
+		int fd;
+		#else
+		QUdpSocket* socket;
+		#endif
+		int receiveBatch( );
+		void closeSocket( );
+		void hold( quint32 address, const char* packet, int length );
+		void deliverHeld( );
+};
+
+#endif // UDPRECEIVER_H
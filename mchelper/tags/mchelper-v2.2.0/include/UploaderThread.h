@@ -35,6 +35,8 @@
 
 class McHelperWindow;
 class Samba;
+class FirmwareImage;
+class FlashBatch;
 
 class UploaderThread : public QThread
 {
@@ -51,6 +53,7 @@ class UploaderThread : public QThread
 		void progress( int value );
 		QString getDeviceKey( );
 		void setDeviceKey( QString key );
+		void setImage( const FirmwareImage* image, FlashBatch* batch ); // instead of a file name, for flashing a batch
 	  
 	private:
 	  QApplication* application;
@@ -61,6 +64,8 @@ class UploaderThread : public QThread
 		
 		char* bin_file;
 		bool bootFromFlash;
+		const FirmwareImage* image;
+		FlashBatch* batch;
 };
 
 class McHelperEvent : public QEvent
@@ -22,7 +22,9 @@
 #include <QList>
 #include <QHash>
 #include <QThread>
-#include "McHelperWindow.h"
+#include <QStringList>
+#include <QMutex>
+#include "BridgeInterface.h"
 #include "PacketUsbCdc.h"
 #include "MonitorInterface.h"
 #include "PacketInterface.h"
@@ -41,7 +43,7 @@
 
 class PacketUsbCdc;
 class PacketInterface;
-class McHelperWindow;
+class QCoreApplication;
 
 class UsbMonitor : public QThread, public MonitorInterface
 {
@@ -51,8 +53,10 @@ class UsbMonitor : public QThread, public MonitorInterface
   	~UsbMonitor( ) {}
   	void run( );
   	void closeAll( );
-  	void setInterfaces( MessageInterface* messageInterface, QApplication* application, McHelperWindow* mainWindow );
+  	void setInterfaces( MessageInterface* messageInterface, QCoreApplication* application, BridgeInterface* bridge );
   	void deviceRemoved( QString key );
+  	void setExtraPorts( QStringList ports ) { extraPorts = ports; }
+  	void setWriteWindow( int ms ) { writeWindowMs = ms; } // for boards found from now on
   	
   	
 	#ifdef Q_WS_WIN
@@ -61,6 +65,9 @@ class UsbMonitor : public QThread, public MonitorInterface
   	
   private:
   	QHash<QString, PacketUsbCdc*> connectedDevices;
+  	QMutex devicesMutex; // boards can be removed from the UsbReactor's thread while we're scanning
+  	QStringList extraPorts; // opened whether they look like boards or not - ptys standing in for them, say
+  	int writeWindowMs;
   	QTimer deviceScanTimer;
   	void FindUsbDevices( QList<PacketInterface*>* arrived );
 		
@@ -69,14 +76,18 @@ class UsbMonitor : public QThread, public MonitorInterface
 	bool checkFriendlyName( HDEVINFO HardwareDeviceInfo, PSP_DEVINFO_DATA deviceSpecificInfo, char* portName );
 	#endif
 	
+	#ifdef Q_WS_LINUX
+	void addLinuxDevice( QString path, QList<PacketInterface*>* arrived );
+	#endif
+	
 	#ifdef Q_WS_MAC
 	char portName[1024];
 	CFMutableDictionaryRef matchingDictionary;
 	#endif
 	
 	MessageInterface* messageInterface;
-	McHelperWindow* mainWindow;
-	QApplication* application;
+	BridgeInterface* bridge;
+	QCoreApplication* application;
 };
 
 
@@ -0,0 +1,78 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#ifndef USBREACTOR_H
+#define USBREACTOR_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QHash>
+#include "Metrics.h"
+
+/*
+	One thread that reads from every USB board at once (Linux only).
+
+	Rather than each board's thread checking its port and sleeping a
+	millisecond when there's nothing there, all the ports' file descriptors go
+	into a single poll( ), which only comes back when one of them has
+	something to read.  The handler for each one that's ready reads all of it,
+	and hands over every packet in it, before we go back to waiting.
+
+	Adding or removing a port wakes the poll( ) through a pipe, so it picks up
+	the change straight away.  Once remove( ) returns, that handler won't be
+	called again - unless it's the reactor's own thread calling it, from
+	inside the handler, in which case it's up to the handler to return false.
+
+	wakeToDelivery is the time from poll( ) coming back to each packet having
+	been handed over, so it includes waiting behind any other boards that
+	woke us up at the same time.
+*/
+class UsbReactor : public QThread
+{
+	public:
+		class Handler
+		{
+			public:
+				// there's something to read - read all of it, and return false if the port's gone
+				virtual bool readable( qint64 wokeAt ) = 0;
+				virtual ~Handler( ) { }
+		};
+
+		static UsbReactor* instance( );
+		bool add( int fd, Handler* handler );
+		void remove( Handler* handler );
+		void delivered( qint64 wokeAt ) { wakeToDelivery->record( Metrics::microseconds( ) - wokeAt ); }
+
+	protected:
+		void run( );
+
+	private:
+		UsbReactor( );
+		QHash<int, Handler*> handlers;
+		QMutex mutex;
+		QWaitCondition idle;    // for remove( ) to wait on, while the handler's busy
+		Handler* busy;          // the one being called now
+		bool changed;           // handlers has changed since the last poll( )
+		int wakePipe[ 2 ];
+		MetricCounter* wakeups;
+		MetricHistogram* wakeToDelivery;
+
+		void wake( );
+};
+
+#endif // USBREACTOR_H
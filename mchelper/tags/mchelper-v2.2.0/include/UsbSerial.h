@@ -24,9 +24,8 @@
 #include <string.h>
 
 #include <QtGlobal>
-#include "McHelperWindow.h"
+#include "BridgeInterface.h"
 #include <QMutex>
-#include <QMainWindow>
 #include "PacketUsbCdc.h"
 
 //Windows-only
@@ -68,6 +67,18 @@
 
 #endif
 
+//Linux only
+#ifdef Q_WS_LINUX
+
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <termios.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+
+#endif
+
 class PacketUsbCdc;
 
 class UsbSerial : public QObject
@@ -76,7 +87,7 @@ class UsbSerial : public QObject
 	public:
 	  enum UsbStatus { OK, ALREADY_OPEN=-1, NOT_OPEN=-2, NOTHING_AVAILABLE=-3, IO_ERROR=-4, UNKNOWN_ERROR=-5, 
 											GOT_CHAR=-6, ALLOC_ERROR=-7, ERROR_CLOSE=-8 };
-		UsbSerial( McHelperWindow* mainWindow );
+		UsbSerial( BridgeInterface* bridge );
 		
 		UsbStatus open( );
 		void close( );
@@ -85,6 +96,7 @@ class UsbSerial : public QObject
 		UsbStatus writeChar( char c );
 		int bytesAvailable( );
 		bool isOpen( );
+		int descriptor( ); // to wait on, where there is one - -1 otherwise
 		QString name( void );
 		void setPortName( QString name );
 		
@@ -96,7 +108,7 @@ class UsbSerial : public QObject
 		QMutex usbMutex;
 		bool deviceOpen;
 		QString portName;
-	  McHelperWindow* mainWindow;
+	  BridgeInterface* bridge;
 		
 		#ifdef Q_WS_WIN
 		UsbStatus openDevice( TCHAR* deviceName );
@@ -108,6 +120,10 @@ class UsbSerial : public QObject
 		int deviceHandle;
 		void createMatchingDictionary( );
 		#endif	
+		
+		#ifdef Q_WS_LINUX
+		int deviceHandle;
+		#endif
 };
 
 #endif // USBSERIAL_H
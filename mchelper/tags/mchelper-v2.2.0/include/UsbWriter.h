@@ -0,0 +1,83 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#ifndef USBWRITER_H
+#define USBWRITER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QByteArray>
+#include "Metrics.h"
+
+#define USB_WRITE_FLUSH_SIZE 4096      // don't hold onto more than this waiting for the window to be up
+#define USB_WRITE_QUEUE_MAX ( 64 * 1024 ) // senders wait once this much is queued - the board's not keeping up
+
+/*
+	Sends SLIP frames to a USB board from a thread of its own, so whoever's
+	sending doesn't make a system call per packet.
+
+	send( ) encodes the packet straight onto the end of what's waiting and
+	returns.  The thread writes everything that's waiting in one go - while
+	it's busy with a write, the next ones pile up behind it and go out
+	together.  With a window set, it also holds onto frames for up to that
+	many ms after the first one, or until there's USB_WRITE_FLUSH_SIZE
+	waiting, trading a little latency for fewer, bigger writes.
+
+	There are two buffers, swapped each time round, so once they've grown to
+	size nothing's allocated per packet.  The actual writing is up to the
+	Output - if it fails, the writer stops and send( ) returns false from
+	then on.
+*/
+class UsbWriter : public QThread
+{
+	public:
+		class Output
+		{
+			public:
+				virtual ~Output( ) { }
+				virtual bool writeFrames( char* data, int length ) = 0; // false if the board's gone
+		};
+
+		UsbWriter( Output* output );
+		~UsbWriter( );
+		bool send( const char* packet, int length );
+		void setWindow( int ms ) { windowMs = ms; }
+		void stop( ); // whatever's still waiting is dropped
+
+	protected:
+		void run( );
+
+	private:
+		Output* output;
+		QMutex queueMutex;
+		QWaitCondition queued;  // something to write, or it's time to stop
+		QWaitCondition room;    // a write's finished - senders held up by USB_WRITE_QUEUE_MAX can go again
+		QByteArray pending;     // encoded frames waiting to go, up to pendingLength
+		QByteArray writing;     // the last lot written - swapped with pending each time
+		int pendingLength;
+		int pendingFrames;
+		qint64 firstQueuedAt;
+		int windowMs;
+		bool exit;
+		bool failed;
+
+		MetricCounter* writes;
+		MetricCounter* frames;
+};
+
+#endif // USBWRITER_H
@@ -0,0 +1,107 @@
+# ------------------------------------------------------------------------------
+#
+# Copyright 2008 MakingThings
+#
+# Licensed under the Apache License,
+# Version 2.0 (the "License"); you may not use this file except in compliance
+# with the License. You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software distributed
+# under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+# CONDITIONS OF ANY KIND, either express or implied. See the License for
+# the specific language governing permissions and limitations under the License.
+#
+# ------------------------------------------------------------------------------
+
+# mchelperd - mchelper with no UI, routing between boards and XML server clients.
+# Build with qmake mchelperd.pro && make
+
+TEMPLATE = app
+CONFIG += console release
+CONFIG -= app_bundle
+QT -= gui
+QT += network xml
+DEFINES += MCHELPER_HEADLESS
+
+INCLUDEPATH += include
+HEADERS = include/McHelperDaemon.h \
+          include/BridgeInterface.h \
+          include/MessageInterface.h \
+          include/MonitorInterface.h \
+          include/PacketInterface.h \
+          include/PacketReadyInterface.h \
+          include/DatagramInterface.h \
+          include/Board.h \
+          include/BoardArrivalEvent.h \
+          include/NetworkMonitor.h \
+          include/UdpReceiver.h \
+          include/PacketUdp.h \
+          include/PacketRing.h \
+          include/TimingWheel.h \
+          include/UsbMonitor.h \
+          include/PacketUsbCdc.h \
+          include/UsbSerial.h \
+          include/SlipDecoder.h \
+          include/SlipEncoder.h \
+          include/UsbWriter.h \
+          include/Osc.h \
+          include/OscXmlServer.h \
+          include/OscXmlWriter.h \
+          include/OscBinaryFrame.h \
+          include/OscStateCache.h \
+          include/QueryCoalescer.h \
+          include/OscBundler.h \
+          include/PacketCapture.h \
+          include/Metrics.h \
+          include/MetricsHttpServer.h \
+          include/LatencyProbe.h \
+          include/UsbReactor.h \
+          include/HotplugWatcher.h \
+          include/MessageEvent.h
+
+SOURCES = source/mchelperd.cpp \
+          source/McHelperDaemon.cpp \
+          source/Board.cpp \
+          source/NetworkMonitor.cpp \
+          source/UdpReceiver.cpp \
+          source/PacketUdp.cpp \
+          source/PacketRing.cpp \
+          source/TimingWheel.cpp \
+          source/UsbMonitor.cpp \
+          source/PacketUsbCdc.cpp \
+          source/UsbSerial.cpp \
+          source/SlipDecoder.cpp \
+          source/SlipEncoder.cpp \
+          source/UsbWriter.cpp \
+          source/Osc.cpp \
+          source/OscXmlServer.cpp \
+          source/OscXmlWriter.cpp \
+          source/OscBinaryFrame.cpp \
+          source/OscStateCache.cpp \
+          source/QueryCoalescer.cpp \
+          source/OscBundler.cpp \
+          source/PacketCapture.cpp \
+          source/Metrics.cpp \
+          source/MetricsHttpServer.cpp \
+          source/LatencyProbe.cpp \
+          source/UsbReactor.cpp \
+          source/HotplugWatcher.cpp \
+          source/MessageEvent.cpp
+
+TARGET = mchelperd
+
+macx{
+  LIBS += -framework IOKit -framework CoreFoundation
+}
+
+unix:!macx{
+  LIBS += -lrt # clock_gettime( ) for PacketCapture and Metrics
+  DEFINES += Q_WS_LINUX # the USB code's Linux sections
+}
+
+win32{
+  LIBS += -lSetupapi
+  DEFINES += WINVER=0x0501
+}
@@ -18,14 +18,23 @@
 #include "Board.h"
 #include <QStringList>
 #include <QList>
+#include <QThread>
+#include <QMutexLocker>
+#include "OscStateCache.h"
+#include "QueryCoalescer.h"
 
-Board::Board( MessageInterface* messageInterface, McHelperWindow* mainWindow, QApplication* application )
+Board::Board( MessageInterface* messageInterface, BridgeInterface* bridge )
 {
   osc = new Osc( );
   this->messageInterface = messageInterface;
-  this->mainWindow = mainWindow;
-  this->application = application;
+  this->bridge = bridge;
   packetInterface = NULL;
+  metrics = NULL;
+  uploaderThread = NULL;
+  firmwareMaxIn = OSC_MAX_MSG_IN_1X;
+  bundleTimer.setSingleShot( true );
+  connect( &bundleTimer, SIGNAL( timeout() ), this, SLOT( bundleWindowDone( ) ) );
+  connect( &probeTimer, SIGNAL( timeout() ), this, SLOT( sendProbe( ) ) );
 }
 
 Board::~Board( )
@@ -36,10 +45,14 @@ Board::~Board( )
 void Board::setPacketInterface( PacketInterface* packetInterface )
 {
 	this->packetInterface = packetInterface;
+	metrics = Metrics::board( packetInterface->getKey( ) );
 	osc->setInterfaces( messageInterface );
 	osc->setPreamble( packetInterface->location( ) );
 	packetInterface->setPacketReadyInterface( this );
 	packetInterface->open( );
+	probe.setBoard( metrics, type != Udp );
+	if( bridge->probeInterval( ) > 0 )
+		probeTimer.start( bridge->probeInterval( ) );
 }
 
 void Board::setUploaderThread( UploaderThread* uploaderThread )
@@ -51,7 +64,11 @@ bool Board::setBinFileName( char* filename )
 {
 	if( type != Board::UsbSamba )
 		return false;
+	#ifndef MCHELPER_HEADLESS
 	uploaderThread->setBinFileName( filename );
+	#else
+	Q_UNUSED( filename );
+	#endif
 		return true;
 }
 
@@ -82,100 +99,151 @@ void Board::flash( )
 		return;
 	//if ( uploaderThread->isRunning() )
     	//return;
+	#ifndef MCHELPER_HEADLESS
+	uploaderThread->setImage( NULL, NULL ); // the file name, not whatever a batch left behind
 	uploaderThread->start( );
+	#endif
+}
+
+// does this address have "error" in it anywhere?
+static bool isErrorAddress( const char* address )
+{
+	for( ; *address; address++ )
+	{
+		if( qstrnicmp( address, "error", 5 ) == 0 )
+			return true;
+	}
+	return false;
 }
 
 void Board::packetWaiting( )
 {
-	QStringList messageList;
-	QByteArray packet;
-	packet.resize( packetInterface->pendingPacketSize( ) );
-	packetInterface->receivePacket( packet.data( ), packet.size( ) );
-	QList<OscMessage*> oscMessageList = osc->processPacket( packet.data(), packet.size() );
-	
-	int messageCount = oscMessageList.size( ), i;
+	qint64 start = Metrics::microseconds( );
+	int size = packetInterface->pendingPacketSize( );
+	if( rxBuffer.size( ) < size ) // only ever grows, so we're not allocating for every packet
+		rxBuffer.resize( size );
+	size = packetInterface->receivePacket( rxBuffer.data( ), size );
+	metrics->packetsIn->add( );
+	metrics->bytesIn->add( size );
+	PacketCapture* capture = bridge->packetCapture( );
+	if( capture != NULL )
+		capture->record( key.toAscii( ), PacketCapture::FromBoard, captureTransport( ), rxBuffer.constData( ), size );
+	int messageCount = decoder.decode( rxBuffer.constData( ), size );
+	if( decoder.status( ) != OscDecoder::OK )
+	{
+		metrics->decodeErrors->add( );
+		messageInterface->messageThreadSafe( decoder.errorString( ), MessageEvent::Error, packetInterface->location( ) );
+	}
+
+	clientMessages.clear( );
+	bool showResponses = bridge->showResponses( );
 	bool newSysInfo = false;
+	int i;
 	
 	for( i = 0; i < messageCount; i++ )
 	{
-		OscMessage *msg = oscMessageList.at(i);
-		if( msg->addressPattern == QString( "/system/info-internal-a" ) )
-      newSysInfo = extractSystemInfoA( oscMessageList.at(i) );
+		const OscMessageView& msg = decoder.message( i );
+		if( msg.addressIs( "/system/info-internal-a" ) )
+			newSysInfo = extractSystemInfoA( msg );
 			
-		else if( msg->addressPattern == QString( "/system/info-internal-b" ) )
-			newSysInfo = extractSystemInfoB( oscMessageList.at(i) );
+		else if( msg.addressIs( "/system/info-internal-b" ) )
+			newSysInfo = extractSystemInfoB( msg );
 			
-		else if( msg->addressPattern == QString( "/network/find" ) )
-			newSysInfo = extractNetworkFind( oscMessageList.at(i) );
+		else if( msg.addressIs( "/network/find" ) )
+			newSysInfo = extractNetworkFind( msg );
 			
-		else if( msg->addressPattern.contains( "error", Qt::CaseInsensitive ) )
-			messageInterface->messageThreadSafe( msg->toString( ), MessageEvent::Warning, locationString( ) );
+		else if( qstrncmp( msg.address, "/system/", 8 ) == 0 && probe.reply( decoder, msg ) )
+			continue; // the answer to a latency probe - nobody else wants it
+
+		else if( isErrorAddress( msg.address ) )
+			messageInterface->messageThreadSafe( decoder.messageString( i ), MessageEvent::Warning, locationString( ) );
 		else
-			messageList.append( msg->toString( ) );
+		{
+			clientMessages.append( i );
+		}
 	}
-	if( messageList.count( ) > 0 )
+	if( clientMessages.size( ) > 0 )
 	{
-		mainWindow->sendXmlPacket( oscMessageList, key );
-		messageInterface->messageThreadSafe( messageList, MessageEvent::Response, locationString( ) );
+		bridge->stateCache( )->store( key, decoder, clientMessages );
+		// answers to queries go to whoever asked, everything else to everybody
+		if( !bridge->queryCoalescer( )->answer( key, decoder, clientMessages, rxBuffer.constData( ), size, bridge->packetPort( ) ) )
+		{
+			bridge->sendXmlPacket( decoder, key );
+			bridge->sendOscPacket( rxBuffer.constData( ), size, key ); // binary clients get it as is
+		}
+		if( showResponses ) // the raw packet - it only gets turned into strings if somebody looks at it
+			bridge->showPacket( rxBuffer.constData( ), size, clientMessages, locationString( ) );
+		metrics->handling->record( Metrics::microseconds( ) - start );
 	}
 		
 	if( newSysInfo )
 	{
-		mainWindow->setBoardName( key, QString( "%1 : %2" ).arg(name).arg(locationString()) );
-		mainWindow->updateSummaryInfo( );
-		mainWindow->xmlServerBoardInfoUpdate( this );
+		bridge->setBoardName( key, QString( "%1 : %2" ).arg(name).arg(locationString()) );
+		bridge->updateSummaryInfo( );
+		bridge->xmlServerBoardInfoUpdate( this );
 	}
-	qDeleteAll( oscMessageList );
 }
 
-bool Board::extractSystemInfoA( OscMessage* msg )
+// pull a string arg out of msg, or return false if that's not what's there
+static bool stringArg( const OscDecoder& decoder, const OscMessageView& msg, int index, QString* str )
+{
+	const OscArgView& arg = decoder.arg( msg, index );
+	if( arg.type != 's' )
+		return false;
+	*str = QString::fromAscii( arg.data, arg.size );
+	return true;
+}
+
+static QString intArg( const OscDecoder& decoder, const OscMessageView& msg, int index )
+{
+	return QString::number( decoder.arg( msg, index ).toInt( ) );
+}
+
+bool Board::extractSystemInfoA( const OscMessageView& msg )
 {
-	QList<OscMessageData*> msgData = msg->data;
-	int dataCount = msg->data.count( );
-	int i;
 	bool newInfo = false;
+	QString s;
 	
-	for( i = 0; i < dataCount; i++ )
+	for( int i = 0; i < msg.argCount; i++ )
 	{
-		if( msgData.at( i ) == 0 )
-			break;
 		switch( i ) // we're counting on the board to send the pieces of data in this order
 		{
 			case 0:
-				if( msgData.at( i )->s == 0 ) break;
-				if( name != QString( msgData.at( i )->s ) )
+				if( stringArg( decoder, msg, i, &s ) && name != s )
 				{
-					name = QString( msgData.at( i )->s ); //name
+					name = s; //name
 					newInfo = true;
 				}
 				break;
 			case 1:
-				if( serialNumber != QString::number( msgData.at( i )->i ) )
+				s = intArg( decoder, msg, i );
+				if( serialNumber != s )
 				{
-					serialNumber = QString::number( msgData.at( i )->i ); // serial number
+					serialNumber = s; // serial number
 					newInfo = true; 
 				}
 				break;
 			case 2:
-				if( msgData.at( i )->s == 0 ) break;
-				if( ip_address != QString( msgData.at( i )->s ) )
+				if( stringArg( decoder, msg, i, &s ) && ip_address != s )
 				{
-					ip_address = QString( msgData.at( i )->s ); // IP address
+					ip_address = s; // IP address
 					newInfo = true;
 				}
 				break;
 			case 3:
-				if( msgData.at( i )->s == 0 ) break;
-				if( firmwareVersion != QString( msgData.at( i )->s ) )
+				if( stringArg( decoder, msg, i, &s ) && firmwareVersion != s )
 				{
-					firmwareVersion = QString( msgData.at( i )->s );
+					firmwareVersion = s;
+					// "<name> <major>.<minor>.<build>" - 2.0 made room for bigger packets
+					firmwareMaxIn = ( s.section( ' ', -1 ).section( '.', 0, 0 ).toInt( ) >= 2 ) ? OSC_MAX_MSG_IN_2X : OSC_MAX_MSG_IN_1X;
 					newInfo = true;
 				}
 				break;
 			case 4:
-				if( freeMemory != QString::number( msgData.at( i )->i ) )
+				s = intArg( decoder, msg, i );
+				if( freeMemory != s )
 				{
-					freeMemory = QString::number( msgData.at( i )->i );
+					freeMemory = s;
 					newInfo = true;
 				}
 				break;
@@ -184,60 +252,62 @@ bool Board::extractSystemInfoA( OscMessage* msg )
 	return newInfo;
 }
 
-bool Board::extractSystemInfoB( OscMessage* msg )
+bool Board::extractSystemInfoB( const OscMessageView& msg )
 {
-	QList<OscMessageData*> msgData = msg->data;
-	int dataCount = msg->data.count( );
-	int j;
 	bool newInfo = false;
+	QString s;
 	
-	for( j = 0; j < dataCount; j++ )
+	for( int j = 0; j < msg.argCount; j++ )
 	{
-		if( msgData.at( j ) == 0 )
-			break;
 		switch( j ) // we're counting on the board to send the pieces of data in this order
 		{
 			case 0:
-				if( dhcp != msgData.at( j )->i )
+			{
+				bool val = decoder.arg( msg, j ).toInt( );
+				if( dhcp != val )
 				{
-					dhcp = msgData.at( j )->i;
+					dhcp = val;
 					newInfo = true;
 				}
 				break;
+			}
 			case 1:
-				if( webserver != msgData.at( j )->i )
+			{
+				bool val = decoder.arg( msg, j ).toInt( );
+				if( webserver != val )
 				{
-					webserver = msgData.at( j )->i;
+					webserver = val;
 					newInfo = true;
 				}
 				break;
+			}
 			case 2:
-				if( msgData.at( j )->s == 0 ) break;
-				if( gateway != QString( msgData.at( j )->s ) )
+				if( stringArg( decoder, msg, j, &s ) && gateway != s )
 				{
-					gateway = QString( msgData.at( j )->s );
+					gateway = s;
 					newInfo = true;
 				}
 				break;
 			case 3:
-				if( msgData.at( j )->s == 0 ) break;
-				if( netMask != QString( msgData.at( j )->s ) )
+				if( stringArg( decoder, msg, j, &s ) && netMask != s )
 				{
-					netMask = QString( msgData.at( j )->s );
+					netMask = s;
 					newInfo = true;
 				}
 				break;
 			case 4:
-				if( udp_listen_port != QString::number( msgData.at( j )->i ) )
+				s = intArg( decoder, msg, j );
+				if( udp_listen_port != s )
 				{
-					udp_listen_port = QString::number( msgData.at( j )->i );
+					udp_listen_port = s;
 					newInfo = true;
 				}
 				break;
 			case 5:
-				if( udp_send_port != QString::number( msgData.at( j )->i ) )
+				s = intArg( decoder, msg, j );
+				if( udp_send_port != s )
 				{
-					udp_send_port = QString::number( msgData.at( j )->i );
+					udp_send_port = s;
 					newInfo = true;
 				}
 				break;
@@ -246,45 +316,42 @@ bool Board::extractSystemInfoB( OscMessage* msg )
 	return newInfo;
 }
 
-bool Board::extractNetworkFind( OscMessage* msg )
+bool Board::extractNetworkFind( const OscMessageView& msg )
 {
-	QList<OscMessageData*> msgData = msg->data;
-	int dataCount = msg->data.count( );
 	bool newInfo = false;
+	QString s;
 	
-	for( int j = 0; j < dataCount; j++ )
+	for( int j = 0; j < msg.argCount; j++ )
 	{
-		if( msgData.at( j ) == 0 )
-			break;
 		switch( j ) // we're counting on the board to send the pieces of data in this order
 		{
 			case 0:
-				if( msgData.at( j )->s == 0 ) break;
-				if( ip_address != QString( msgData.at( j )->s ) )
+				if( stringArg( decoder, msg, j, &s ) && ip_address != s )
 				{
-					ip_address = QString( msgData.at( j )->s ); // IP address
+					ip_address = s; // IP address
 					newInfo = true;
 				}
 				break;
 			case 1:
-				if( udp_listen_port != QString::number( msgData.at( j )->i ) )
+				s = intArg( decoder, msg, j );
+				if( udp_listen_port != s )
 				{
-					udp_listen_port = QString::number( msgData.at( j )->i );
+					udp_listen_port = s;
 					newInfo = true;
 				}
 				break;
 			case 2:
-				if( udp_send_port != QString::number( msgData.at( j )->i ) )
+				s = intArg( decoder, msg, j );
+				if( udp_send_port != s )
 				{
-					udp_send_port = QString::number( msgData.at( j )->i );
+					udp_send_port = s;
 					newInfo = true;
 				}
 				break;
 			case 3:
-				if( msgData.at( j )->s == 0 ) break;
-				if( name != QString( msgData.at( j )->s ) )
+				if( stringArg( decoder, msg, j, &s ) && name != s )
 				{
-					name = QString( msgData.at( j )->s );
+					name = s;
 					newInfo = true;
 				}
 				break;
@@ -301,7 +368,7 @@ void Board::sendMessage( QString rawMessage )
 	{		
 		QByteArray packet = osc->createPacket( rawMessage );
 		if( !packet.isEmpty( ) )
-			packetInterface->sendPacket( packet.data( ), packet.size( ) );
+			sendOut( packet );
 	}
 }
 
@@ -313,7 +380,7 @@ void Board::sendMessage( QList<OscMessage*> messageList )
 	{		
 		QByteArray packet = osc->createPacket( messageList );
 		if( !packet.isEmpty( ) )
-			packetInterface->sendPacket( packet.data( ), packet.size( ) );
+			sendOut( packet );
 	}
 }
 
@@ -325,7 +392,109 @@ void Board::sendMessage( QStringList messageList )
 	{		
 		QByteArray packet = osc->createPacket( messageList );
 		if( !packet.isEmpty( ) )
-			packetInterface->sendPacket( packet.data( ), packet.size( ) );
+			sendOut( packet );
+	}
+}
+
+
+// an OSC packet that's ready to go, as is
+void Board::sendPacket( QByteArray packet )
+{
+	if( packetInterface == NULL || !packetInterface->isOpen( ) || packet.isEmpty( ) )
+		return;
+	sendOut( packet );
+}
+
+/*
+	Everything for the board goes through here.  With a bundle window set,
+	packets are held onto and go out together as one bundle once the window's
+	up, or sooner if the next one wouldn't fit in what the board can take in
+	one go.  Trades a little latency for a lot fewer packets when something's
+	setting a bunch of outputs at once.
+*/
+void Board::sendOut( QByteArray packet )
+{
+	if( bridge->bundleWindow( ) <= 0 && bundler.isEmpty( ) )
+	{
+		transmit( packet.data( ), packet.size( ) );
+		return;
+	}
+
+	QMutexLocker locker( &bundleMutex );
+	bundler.setMaxSize( bundleMaxSize( ) );
+	bool newBundle = bundler.isEmpty( );
+	if( !bundler.add( packet.constData( ), packet.size( ) ) )
+	{
+		sendBundle( );
+		if( !bundler.add( packet.constData( ), packet.size( ) ) ) // too big to go in a bundle at all
+		{
+			transmit( packet.data( ), packet.size( ) );
+			return;
+		}
+		newBundle = true;
+	}
+	if( newBundle ) // the timer lives in our thread, and this might not be it
+	{
+		if( QThread::currentThread( ) == thread( ) )
+			startBundleWindow( );
+		else
+			QMetaObject::invokeMethod( this, "startBundleWindow", Qt::QueuedConnection );
+	}
+}
+
+/*
+	As much as the board takes in one packet - OSC_MAX_MSG_IN in its firmware,
+	unless the bundleMaxSize setting says otherwise.  Over UDP it has to fit in
+	one datagram as well.
+*/
+int Board::bundleMaxSize( )
+{
+	int size = ( bridge->bundleMaxSize( ) > 0 ) ? bridge->bundleMaxSize( ) : firmwareMaxIn;
+	return ( type == Udp ) ? qMin( size, UDP_MAX_PAYLOAD ) : size;
+}
+
+// bundleMutex needs to be locked
+void Board::sendBundle( )
+{
+	QByteArray bundle = bundler.take( );
+	if( !bundle.isEmpty( ) && packetInterface != NULL && packetInterface->isOpen( ) )
+		transmit( bundle.data( ), bundle.size( ) );
+}
+
+// out over the wire, and into the capture if there is one
+void Board::transmit( char* packet, int size )
+{
+	PacketCapture* capture = bridge->packetCapture( );
+	if( capture != NULL )
+		capture->record( key.toAscii( ), PacketCapture::ToBoard, captureTransport( ), packet, size );
+	metrics->packetsOut->add( );
+	metrics->bytesOut->add( size );
+	packetInterface->sendPacket( packet, size );
+}
+
+// straight out, rather than waiting in a bundle and throwing the time off
+void Board::sendProbe( )
+{
+	if( packetInterface == NULL || !packetInterface->isOpen( ) )
+		return;
+	QByteArray packet = probe.request( );
+	if( !packet.isEmpty( ) )
+		transmit( packet.data( ), packet.size( ) );
+	else if( probe.gaveUp( ) )
+	{
+		probeTimer.stop( );
+		messageInterface->messageThreadSafe( "No answer to latency probes - this firmware may not know " PROBE_ADDRESS ", so we've stopped asking.",
+																					MessageEvent::Warning, locationString( ) );
 	}
 }
 
+void Board::startBundleWindow( )
+{
+	bundleTimer.start( qMax( bridge->bundleWindow( ), 0 ) );
+}
+
+void Board::bundleWindowDone( )
+{
+	QMutexLocker locker( &bundleMutex );
+	sendBundle( );
+}
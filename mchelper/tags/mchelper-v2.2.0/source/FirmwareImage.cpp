@@ -0,0 +1,97 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#include "FirmwareImage.h"
+#include <QtEndian>
+
+FirmwareImage::FirmwareImage( )
+{
+	mapped = NULL;
+	image = NULL;
+	length = 0;
+}
+
+FirmwareImage::~FirmwareImage( )
+{
+	unload( );
+}
+
+void FirmwareImage::unload( )
+{
+	if( mapped != NULL )
+		file.unmap( mapped );
+	mapped = NULL;
+	copy.clear( );
+	if( file.isOpen( ) )
+		file.close( );
+	image = NULL;
+	length = 0;
+}
+
+FirmwareImage::Status FirmwareImage::load( const QString& fileName, int maxSize )
+{
+	unload( );
+	file.setFileName( fileName );
+	if( !file.exists( ) )
+		return ERROR_NOT_FOUND;
+	if( !file.open( QIODevice::ReadOnly ) )
+		return ERROR_COULDNT_OPEN;
+	qint64 fileSize = file.size( );
+	if( fileSize == 0 || fileSize > maxSize )
+	{
+		file.close( );
+		return ( fileSize == 0 ) ? ERROR_EMPTY : ERROR_TOO_BIG;
+	}
+
+	mapped = file.map( 0, fileSize );
+	if( mapped != NULL )
+		image = (const char*)mapped;
+	else
+	{
+		copy = file.readAll( );
+		if( copy.size( ) != fileSize )
+		{
+			unload( );
+			return ERROR_COULDNT_OPEN;
+		}
+		image = copy.constData( );
+	}
+	length = (int)fileSize;
+
+	// b <reset handler>, or ldr pc, [pc, #n]
+	quint32 reset = ( length >= 4 ) ? qFromLittleEndian<quint32>( (const uchar*)image ) : 0;
+	if( ( reset & 0xFF000000 ) != 0xEA000000 && ( reset & 0xFFFFF000 ) != 0xE59FF000 )
+	{
+		unload( );
+		return ERROR_NOT_FIRMWARE;
+	}
+	return OK;
+}
+
+QString FirmwareImage::statusString( Status status )
+{
+	switch( status )
+	{
+		case OK: return "OK";
+		case ERROR_NOT_FOUND: return "couldn't find the file";
+		case ERROR_COULDNT_OPEN: return "couldn't read the file";
+		case ERROR_EMPTY: return "the file is empty";
+		case ERROR_TOO_BIG: return QString( "it's bigger than the board's %1 KB of flash" ).arg( FIRMWARE_MAX_SIZE / 1024 );
+		case ERROR_NOT_FIRMWARE: return "it doesn't start with an ARM reset vector - is it really firmware?";
+	}
+	return QString( );
+}
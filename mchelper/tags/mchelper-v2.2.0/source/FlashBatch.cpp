@@ -0,0 +1,153 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#include "FlashBatch.h"
+#include <QMutexLocker>
+#include <stdio.h>
+#include "SambaMonitor.h"
+
+#define FROM_STRING "Flash"
+
+FlashBatch::FlashBatch( SambaMonitor* monitor, MessageInterface* messageInterface, QObject* parent ) : QObject( parent )
+{
+	this->monitor = monitor;
+	this->messageInterface = messageInterface;
+	running = succeeded = total = 0;
+	maxParallel = FLASH_DEFAULT_PARALLEL;
+	console = false;
+	connect( &reportTimer, SIGNAL( timeout() ), this, SLOT( report( ) ) );
+}
+
+bool FlashBatch::start( const QString& fileName, const QStringList& boards, int parallel )
+{
+	if( isRunning( ) )
+	{
+		message( "Already flashing - wait for it to finish first.", MessageEvent::Warning );
+		return false;
+	}
+	FirmwareImage::Status status = image.load( fileName );
+	if( status != FirmwareImage::OK )
+	{
+		message( QString( "Can't flash %1 - %2." ).arg( fileName ).arg( FirmwareImage::statusString( status ) ), MessageEvent::Error );
+		return false;
+	}
+
+	waiting = boards;
+	failed.clear( );
+	progressOf.clear( );
+	running = succeeded = 0;
+	total = boards.size( );
+	maxParallel = qMax( parallel, 1 );
+	message( QString( "Flashing %1 (%2 KB) to %3 boards, %4 at a time." )
+						.arg( fileName ).arg( ( image.size( ) + 1023 ) / 1024 ).arg( total ).arg( qMin( maxParallel, total ) ) );
+	elapsed.start( );
+	reportTimer.start( FLASH_REPORT_MS );
+	startNext( );
+	return true;
+}
+
+void FlashBatch::startNext( )
+{
+	while( running < maxParallel && !waiting.isEmpty( ) )
+	{
+		QString board = waiting.takeFirst( );
+		{
+			QMutexLocker locker( &progressMutex );
+			progressOf.insert( board, 0 );
+		}
+		if( monitor->startUpload( board, &image, this ) )
+			running++;
+		else
+		{
+			message( QString( "%1 has gone away, or is busy - skipping it." ).arg( board ), MessageEvent::Warning );
+			QMutexLocker locker( &progressMutex );
+			progressOf.remove( board );
+			failed.append( board );
+		}
+	}
+
+	if( running == 0 && waiting.isEmpty( ) ) // all done
+	{
+		reportTimer.stop( );
+		double seconds = elapsed.elapsed( ) / 1000.0;
+		message( QString( "Flashed %1 of %2 boards in %3 s." ).arg( succeeded ).arg( total ).arg( seconds, 0, 'f', 1 ),
+							failed.isEmpty( ) ? MessageEvent::Info : MessageEvent::Warning );
+		if( !failed.isEmpty( ) )
+			message( QString( "Failed: %1" ).arg( failed.join( ", " ) ), MessageEvent::Error );
+		messageInterface->progress( 0 );
+		image.unload( );
+		emit done( failed.size( ) );
+	}
+}
+
+void FlashBatch::progress( const QString& board, int value )
+{
+	QMutexLocker locker( &progressMutex );
+	progressOf.insert( board, value );
+}
+
+void FlashBatch::finished( const QString& board, bool ok )
+{
+	QMetaObject::invokeMethod( this, "boardFinished", Qt::QueuedConnection, Q_ARG( QString, board ), Q_ARG( bool, ok ) );
+}
+
+void FlashBatch::boardFinished( QString board, bool ok )
+{
+	{
+		QMutexLocker locker( &progressMutex );
+		progressOf.remove( board );
+	}
+	running--;
+	if( ok )
+		succeeded++;
+	else
+		failed.append( board );
+	message( QString( "%1 %2 after %3 s." ).arg( board ).arg( ok ? "flashed" : "failed" ).arg( elapsed.elapsed( ) / 1000.0, 0, 'f', 1 ),
+						ok ? MessageEvent::Info : MessageEvent::Error );
+	startNext( );
+}
+
+// where each board that's uploading has got to, and how far along the whole batch is
+void FlashBatch::report( )
+{
+	QStringList boards;
+	int sum = 0;
+	{
+		QMutexLocker locker( &progressMutex );
+		QHash<QString, int>::const_iterator i;
+		for( i = progressOf.constBegin( ); i != progressOf.constEnd( ); ++i )
+		{
+			boards.append( QString( "%1 %2%" ).arg( i.key( ) ).arg( i.value( ) / 10 ) );
+			sum += i.value( );
+		}
+	}
+	int finishedCount = succeeded + failed.size( );
+	if( total > 0 )
+		messageInterface->progress( ( finishedCount * 1000 + sum ) / total );
+	message( QString( "%1 of %2 done, %3 waiting - %4" ).arg( finishedCount ).arg( total ).arg( waiting.size( ) )
+						.arg( boards.isEmpty( ) ? QString( "starting" ) : boards.join( ", " ) ) );
+}
+
+void FlashBatch::message( const QString& text, MessageEvent::Types type )
+{
+	messageInterface->messageThreadSafe( text, type, FROM_STRING );
+	if( console )
+	{
+		printf( "%s\n", text.toLocal8Bit( ).constData( ) );
+		fflush( stdout );
+	}
+}
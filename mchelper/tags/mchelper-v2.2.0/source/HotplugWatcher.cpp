@@ -0,0 +1,125 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#include "HotplugWatcher.h"
+#include <QThread>
+
+#ifdef Q_WS_LINUX
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include "Metrics.h"
+#endif
+
+// just so we can sleep from whichever thread we're waiting on
+class HotplugSleep : public QThread
+{
+	public:
+		static void ms( int ms ) { QThread::msleep( ms ); }
+};
+
+HotplugWatcher::HotplugWatcher( const QStringList& patterns )
+{
+	for( int i = 0; i < patterns.size( ); i++ )
+		this->patterns.append( QRegExp( patterns.at( i ), Qt::CaseSensitive, QRegExp::Wildcard ) );
+	fd = -1;
+	#ifdef Q_WS_LINUX
+	fd = inotify_init( );
+	#endif
+}
+
+HotplugWatcher::~HotplugWatcher( )
+{
+	usePolling( );
+}
+
+void HotplugWatcher::watch( const QString& directory )
+{
+	#ifdef Q_WS_LINUX
+	if( fd >= 0 && inotify_add_watch( fd, directory.toLocal8Bit( ).constData( ),
+				IN_CREATE | IN_DELETE | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO ) < 0 )
+		usePolling( ); // no point watching some of them and not others
+	#else
+	(void)directory;
+	#endif
+}
+
+void HotplugWatcher::usePolling( )
+{
+	#ifdef Q_WS_LINUX
+	if( fd >= 0 )
+		close( fd );
+	#endif
+	fd = -1;
+}
+
+bool HotplugWatcher::matches( const char* name )
+{
+	QString n( name );
+	for( int i = 0; i < patterns.size( ); i++ )
+	{
+		if( patterns.at( i ).exactMatch( n ) )
+			return true;
+	}
+	return false;
+}
+
+/*
+	Wait until one of ours changes, ignoring everything else in the
+	directories, or until it's time to look again anyway.
+*/
+bool HotplugWatcher::wait( )
+{
+	#ifdef Q_WS_LINUX
+	if( fd >= 0 )
+	{
+		qint64 until = Metrics::microseconds( ) + HOTPLUG_RESCAN_MS * 1000;
+		char events[ 16 * ( sizeof( struct inotify_event ) + NAME_MAX + 1 ) ]
+				__attribute__ ( ( aligned( __alignof__( struct inotify_event ) ) ) );
+		while( true )
+		{
+			int left = (int)( ( until - Metrics::microseconds( ) ) / 1000 );
+			struct pollfd p = { fd, POLLIN, 0 };
+			int ready = poll( &p, 1, qMax( left, 0 ) );
+			if( ready == 0 )
+				return false;
+			if( ready < 0 && errno != EINTR )
+				break; // something's wrong with it - fall back to polling
+			int length = ( ready > 0 ) ? read( fd, events, sizeof( events ) ) : 0;
+			if( length < 0 && errno != EINTR )
+				break;
+			bool ours = false;
+			for( char* e = events; e < events + length; )
+			{
+				struct inotify_event* event = (struct inotify_event*)e;
+				if( event->len > 0 && matches( event->name ) )
+					ours = true;
+				if( event->mask & IN_Q_OVERFLOW ) // lost track - have a look to be sure
+					ours = true;
+				e += sizeof( struct inotify_event ) + event->len;
+			}
+			if( ours )
+				return true;
+		}
+		usePolling( );
+	}
+	#endif
+	HotplugSleep::ms( HOTPLUG_POLL_MS );
+	return false;
+}
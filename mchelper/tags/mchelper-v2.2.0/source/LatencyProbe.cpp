@@ -0,0 +1,103 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#include "LatencyProbe.h"
+#include <QMutexLocker>
+
+LatencyProbe::LatencyProbe( )
+{
+	sequence = PROBE_SEQUENCE_BASE;
+	timeouts = 0;
+	sentAt = 0;
+	metrics = NULL;
+	transportRoundTrip = NULL;
+}
+
+void LatencyProbe::setBoard( BoardMetrics* metrics, bool usb )
+{
+	QMutexLocker locker( &mutex );
+	this->metrics = metrics;
+	transportRoundTrip = Metrics::instance( )->histogram( "mchelper_round_trip_seconds", "Round trip time of latency probes to boards",
+																												usb ? "transport=\"usb\"" : "transport=\"udp\"" );
+}
+
+QByteArray LatencyProbe::request( )
+{
+	QMutexLocker locker( &mutex );
+	if( metrics == NULL || timeouts >= PROBE_MAX_TIMEOUTS )
+		return QByteArray( );
+	qint64 now = Metrics::microseconds( );
+	if( sentAt != 0 )
+	{
+		if( now - sentAt < PROBE_TIMEOUT_MS * 1000 )
+			return QByteArray( );
+		metrics->probeTimeouts->add( );
+		if( ++timeouts >= PROBE_MAX_TIMEOUTS )
+		{
+			sentAt = 0;
+			return QByteArray( );
+		}
+	}
+	sentAt = now;
+	OscMessage msg;
+	msg.addressPattern = PROBE_ADDRESS;
+	msg.data.append( new OscMessageData( ++sequence ) );
+	return msg.toByteArray( );
+}
+
+bool LatencyProbe::gaveUp( )
+{
+	QMutexLocker locker( &mutex );
+	return timeouts >= PROBE_MAX_TIMEOUTS;
+}
+
+bool LatencyProbe::reply( const OscDecoder& decoder, const OscMessageView& msg )
+{
+	QMutexLocker locker( &mutex );
+	if( !msg.addressIs( PROBE_ADDRESS ) || msg.argCount != 1 )
+		return false;
+	int n = decoder.arg( msg, 0 ).toInt( );
+	if( n <= PROBE_SEQUENCE_BASE || n > sequence )
+		return false; // somebody else's echo
+	// an older one is the answer to a probe we've given up on
+	if( sentAt != 0 && n == sequence )
+	{
+		timeouts = 0;
+		received( );
+	}
+	return true;
+}
+
+void LatencyProbe::received( )
+{
+	qint64 roundTrip = Metrics::microseconds( ) - sentAt;
+	sentAt = 0;
+	metrics->roundTrip->record( roundTrip );
+	transportRoundTrip->record( roundTrip );
+}
+
+QString LatencyProbe::summary( )
+{
+	QMutexLocker locker( &mutex );
+	if( metrics == NULL || metrics->roundTrip->count( ) == 0 )
+		return QString( );
+	MetricHistogram* h = metrics->roundTrip;
+	return QString( "Round trip: %1 ms typical, %2 ms at worst for 99%, %3 ms max" )
+						.arg( h->percentile( 0.5 ) / 1000.0, 0, 'f', 1 )
+						.arg( h->percentile( 0.99 ) / 1000.0, 0, 'f', 1 )
+						.arg( h->percentile( 1.0 ) / 1000.0, 0, 'f', 1 );
+}
@@ -0,0 +1,287 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#include "McHelperDaemon.h"
+
+#include <QCoreApplication>
+#include <QSettings>
+#include <QTime>
+#include <QMutexLocker>
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <stdio.h>
+#include "Osc.h"
+#include "OscBinaryFrame.h"
+#include "OscXmlWriter.h"
+#include "BoardArrivalEvent.h"
+
+// the same defaults as the GUI
+#define DEFAULT_UDP_LISTEN_PORT 10000
+#define DEFAULT_UDP_SEND_PORT 10000
+#define DEFAULT_XML_LISTEN_PORT 11000
+
+McHelperDaemon::McHelperDaemon( QCoreApplication* application ) : QObject( )
+{
+	this->application = application;
+	usb = NULL;
+	udp = NULL;
+	xmlServer = NULL;
+	capture = NULL;
+	metricsServer = NULL;
+	verbose = false;
+	readSettings( );
+}
+
+McHelperDaemon::~McHelperDaemon( )
+{
+	if( usb != NULL )
+		usb->closeAll( );
+	delete metricsServer;
+	delete xmlServer;
+	delete udp;
+	delete capture; // writes out what's left
+}
+
+// anything given on the command line wins over what's in the settings
+void McHelperDaemon::setPorts( int udpListen, int udpSend, int xmlListen )
+{
+	if( udpListen > 0 )
+		udpListenPort = udpListen;
+	if( udpSend > 0 )
+		udpSendPort = udpSend;
+	if( xmlListen > 0 )
+		xmlListenPort = xmlListen;
+}
+
+bool McHelperDaemon::start( )
+{
+	if( !captureFile.isEmpty( ) )
+	{
+		capture = new PacketCapture( );
+		if( !capture->open( captureFile ) )
+		{
+			messageThreadSafe( QString( "can't record board traffic to %1" ).arg( captureFile ), MessageEvent::Error );
+			return false;
+		}
+		messageThreadSafe( QString( "Recording board traffic to %1" ).arg( captureFile ) );
+	}
+	udp = new NetworkMonitor( udpListenPort, udpSendPort );
+	usb = new UsbMonitor( );
+	xmlServer = new OscXmlServer( this, xmlListenPort );
+
+	udp->setInterfaces( this, this, application );
+	udp->setReceiveThread( true ); // always - this is what keeps datagrams off the main thread
+	usb->setInterfaces( this, application, this );
+	usb->setExtraPorts( usbPorts );
+	usb->setWriteWindow( usbWriteWindowMs );
+
+	metricsServer = new MetricsHttpServer( this );
+	if( !metricsServer->setPort( metricsPort ) )
+		return false;
+
+	usb->start( );
+	udp->start( );
+	return xmlServer->changeListenPort( xmlListenPort );
+}
+
+// the same settings the GUI uses, so both find the same boards in the same places
+void McHelperDaemon::readSettings( )
+{
+	QSettings settings("MakingThings", "mchelper");
+	udpListenPort = settings.value( "appUdpListenPort", DEFAULT_UDP_LISTEN_PORT ).toInt( );
+	udpSendPort = settings.value( "appUdpSendPort", DEFAULT_UDP_SEND_PORT ).toInt( );
+	xmlListenPort = settings.value( "appXmlListenPort", DEFAULT_XML_LISTEN_PORT ).toInt( );
+	findEthernetBoardsAuto = settings.value( "findEthernetBoardsAuto", true ).toBool( );
+	cache.setMaxAge( settings.value( "stateCacheMaxAge", 0 ).toInt( ) );
+	bundleWindowMs = settings.value( "bundleWindowMs", 0 ).toInt( );
+	bundleMaxBytes = settings.value( "bundleMaxSize", 0 ).toInt( );
+	captureFile = settings.value( "captureFile", "" ).toString( );
+	metricsPort = settings.value( "metricsHttpPort", 0 ).toInt( );
+	probeIntervalMs = settings.value( "probeIntervalMs", 0 ).toInt( );
+	usbPorts = settings.value( "usbPorts" ).toStringList( );
+	usbWriteWindowMs = settings.value( "usbWriteWindowMs", 0 ).toInt( );
+}
+
+QList<Board*> McHelperDaemon::getConnectedBoards( )
+{
+	QReadLocker locker( &boardsLock );
+	return connectedBoards.values( );
+}
+
+void McHelperDaemon::addBoard( Board* board, PacketInterface* packetInterface, Board::Types type )
+{
+	board->key = packetInterface->getKey( );
+	board->type = type;
+	board->location = QString( packetInterface->location( ) );
+	board->setPacketInterface( packetInterface );
+	xmlServer->queryCoalescer( )->addBoard( board->key );
+	QWriteLocker locker( &boardsLock );
+	connectedBoards.insert( board->key, board );
+}
+
+void McHelperDaemon::customEvent( QEvent* event )
+{
+	if( event->type( ) != 10020 ) // only new boards come this way
+		return;
+
+	BoardArrivalEvent* arrivalEvent = (BoardArrivalEvent*)event;
+	QList<Board*> boardList;
+	switch( arrivalEvent->type )
+	{
+		case Board::UsbSerial:
+			for( int i = 0; i < arrivalEvent->pInt.count( ); i++ )
+			{
+				Board* board = new Board( this, this );
+				addBoard( board, arrivalEvent->pInt.at( i ), Board::UsbSerial );
+				boardList.append( board );
+			}
+			break;
+		case Board::Udp:
+			for( int i = 0; i < arrivalEvent->pUdp.count( ); i++ )
+			{
+				Board* board = new Board( this, this );
+				addBoard( board, arrivalEvent->pUdp.at( i ), Board::Udp );
+				board->sendMessage( "/system/info-internal" );
+				boardList.append( board );
+			}
+			break;
+		default: // no uploading here
+			break;
+	}
+	for( int i = 0; i < boardList.count( ); i++ )
+		messageThreadSafe( QString( "New board at %1" ).arg( boardList.at( i )->locationString( ) ),
+												MessageEvent::Info, boardList.at( i )->key );
+	if( boardList.count( ) )
+		boardListChanged( boardList, true );
+}
+
+void McHelperDaemon::removeDeviceThreadSafe( QString key )
+{
+	QMetaObject::invokeMethod( this, "removeDevice", Qt::QueuedConnection, Q_ARG( QString, key ) );
+}
+
+void McHelperDaemon::removeDevice( QString key )
+{
+	Board* removed;
+	{
+		QWriteLocker locker( &boardsLock );
+		removed = connectedBoards.take( key );
+	}
+	if( removed == NULL )
+		return;
+	messageThreadSafe( QString( "Board removed" ), MessageEvent::Info, key );
+	QList<Board*> boardList;
+	boardList.append( removed );
+	boardListChanged( boardList, false );
+	cache.removeBoard( key );
+	xmlServer->queryCoalescer( )->removeBoard( key );
+	delete removed;
+}
+
+void McHelperDaemon::boardListChanged( QList<Board*> boardList, bool arrived )
+{
+	emit boardListUpdate( boardList, arrived );
+	if( receivers( SIGNAL( xmlDocument( QByteArray ) ) ) > 0 )
+		emit xmlDocument( OscXmlClient::boardListDocument( boardList, arrived ) );
+}
+
+void McHelperDaemon::setBoardName( QString key, QString name )
+{
+	messageThreadSafe( QString( "Board is %1" ).arg( name ), MessageEvent::Info, key );
+}
+
+void McHelperDaemon::xmlServerBoardInfoUpdate( Board* board )
+{
+	emit boardInfoUpdate( board );
+	if( receivers( SIGNAL( xmlDocument( QByteArray ) ) ) > 0 )
+		emit xmlDocument( OscXmlWriter::boardInfo( board->key, board->name, board->serialNumber ) );
+}
+
+void McHelperDaemon::sendXmlPacket( const OscDecoder& decoder, QString srcAddress )
+{
+	if( receivers( SIGNAL( xmlDocument( QByteArray ) ) ) > 0 )
+		emit xmlDocument( OscXmlWriter::packet( decoder, srcAddress, udp->getListenPort( ) ) );
+}
+
+void McHelperDaemon::sendOscPacket( const char* packet, int size, QString srcAddress )
+{
+	if( receivers( SIGNAL( oscFrame( QByteArray ) ) ) > 0 )
+		emit oscFrame( OscBinaryFrame::create( packet, size, srcAddress.toAscii( ), udp->getListenPort( ), OscBinaryFrame::now( ) ) );
+}
+
+// only with -v, so not worth keeping a decoder around for
+void McHelperDaemon::showPacket( const char* packet, int size, const QVector<int>& messages, QString from )
+{
+	OscDecoder decoder;
+	decoder.decode( packet, size );
+	QStringList strings;
+	for( int i = 0; i < messages.size( ); i++ )
+		strings.append( decoder.messageString( messages.at( i ) ) );
+	messageThreadSafe( strings, MessageEvent::Response, from );
+}
+
+// from a client's thread - hold onto the board until we're done sending to it
+void McHelperDaemon::newXmlPacketReceived( QList<OscMessage*> messageList, QString address )
+{
+	QReadLocker locker( &boardsLock );
+	Board* board = connectedBoards.value( address );
+	if( board != NULL )
+		board->sendMessage( messageList );
+}
+
+void McHelperDaemon::newOscPacketReceived( QByteArray packet, QString address )
+{
+	QReadLocker locker( &boardsLock );
+	Board* board = connectedBoards.value( address );
+	if( board != NULL )
+		board->sendPacket( packet );
+}
+
+void McHelperDaemon::statusMessage( const QString & msg, int duration )
+{
+	(void)duration;
+	messageThreadSafe( msg, MessageEvent::Info );
+}
+
+void McHelperDaemon::messageThreadSafe( QString string )
+{
+	messageThreadSafe( QStringList( string ), MessageEvent::Info, QString( "mchelperd" ) );
+}
+
+void McHelperDaemon::messageThreadSafe( QString string, MessageEvent::Types type )
+{
+	messageThreadSafe( QStringList( string ), type, QString( "mchelperd" ) );
+}
+
+void McHelperDaemon::messageThreadSafe( QString string, MessageEvent::Types type, QString from )
+{
+	messageThreadSafe( QStringList( string ), type, from );
+}
+
+void McHelperDaemon::messageThreadSafe( QStringList strings, MessageEvent::Types type, QString from )
+{
+	if( !verbose && ( type == MessageEvent::Response || type == MessageEvent::XMLMessage ) )
+		return;
+
+	QByteArray time = QTime::currentTime( ).toString( ).toAscii( );
+	QByteArray source = from.toLocal8Bit( );
+	const char* prefix = ( type == MessageEvent::Error ) ? "error: " : ( type == MessageEvent::Warning ) ? "warning: " : "";
+	QMutexLocker locker( &outputMutex );
+	for( int i = 0; i < strings.size( ); i++ )
+		printf( "%s  %-16s %s%s\n", time.constData( ), source.constData( ), prefix, strings.at( i ).toLocal8Bit( ).constData( ) );
+	fflush( stdout );
+}
@@ -25,6 +25,8 @@
 #include <QDesktopServices>
 #include <QSizePolicy>
 #include "Osc.h"
+#include "OscBinaryFrame.h"
+#include "OscXmlWriter.h"
 #include "BoardArrivalEvent.h"
 
 #ifdef Q_WS_MAC
@@ -40,11 +42,17 @@
 #define DEFAULT_UDP_SEND_PORT 10000
 #define DEFAULT_XML_LISTEN_PORT 11000
 
-McHelperWindow::McHelperWindow( McHelperApp* application ) : QMainWindow( 0 )
+McHelperWindow::McHelperWindow( McHelperApp* application ) : QMainWindow( 0 ), outputModel( NULL )
 {
 	this->application = application;
 	setupUi(this);
 	readSettings( );
+	
+	// first, so everything after this can post messages
+	outputModel = new OutputWindow( maxOutputWindowMessages );
+	treeView->setModel( outputModel );
+  setupOutputWindow();
+	
 	aboutDialog = new aboutMchelper( );
 	prefsDialog = new mchelperPrefs( this );
 	appUpdater = new AppUpdater( );
@@ -65,19 +73,38 @@ McHelperWindow::McHelperWindow( McHelperApp* application ) : QMainWindow( 0 )
 	samba = new SambaMonitor( application, this );
 	usb = new UsbMonitor( );
 	xmlServer = new OscXmlServer( this, appXmlListenPort );
+	flashBatch = new FlashBatch( samba, this, this );
+	connect( flashBatch, SIGNAL( done(int) ), this, SLOT( batchDone(int) ) );
+	batchSettleTimer.setSingleShot( true );
+	connect( &batchSettleTimer, SIGNAL( timeout() ), this, SLOT( startBatch( ) ) );
 	 
 	udp->setInterfaces( this, this, application );
+	udp->setReceiveThread( udpReceiveThread );
 	usb->setInterfaces( this, application, this );
+	usb->setExtraPorts( usbPorts );
+	usb->setWriteWindow( usbWriteWindowMs );
 	
-	outputModel = new OutputWindow( maxOutputWindowMessages );
-	treeView->setModel( outputModel );
-  
-  setupOutputWindow();
+	metricsServer = new MetricsHttpServer( this, this );
+	metricsServer->setPort( metricsHttpPort );
+	capture = NULL;
+	if( !captureFile.isEmpty( ) )
+	{
+		capture = new PacketCapture( );
+		if( capture->open( captureFile ) )
+			messageThreadSafe( QString( "Recording board traffic to %1" ).arg( captureFile ) );
+		else
+		{
+			messageThreadSafe( QString( "Error - can't record board traffic to %1" ).arg( captureFile ), MessageEvent::Error );
+			delete capture;
+			capture = NULL;
+		}
+	}
 
   // Wire up the selection changed signal from the model to be handled here
 	qRegisterMetaType<QModelIndex>("QModelIndex");
   connect( listWidget->selectionModel(), SIGNAL(currentChanged(const QModelIndex &, const QModelIndex &)),
            this, SLOT(deviceSelectionChanged(const QModelIndex &, const QModelIndex &)));
+  listWidget->setSelectionMode( QAbstractItemView::ExtendedSelection ); // select several Samba boards to flash them all
   
   ////////////////////////////////////////////////////////////////////////////
 	
@@ -141,17 +168,18 @@ void McHelperWindow::usbBoardsArrived( QList<PacketInterface*> arrived )
 	int i;
 	for( i=0; i<arrived.count( ); i++ )
 	{
-	  board = new Board( this, this, application );
+	  board = new Board( this, this );
     board->key = arrived.at(i)->getKey();
     board->type = Board::UsbSerial;
     board->setPacketInterface( arrived.at(i) );
     board->location = QString( arrived.at(i)->location( ) );
     board->setText( QString( board->locationString() ) );
     connectedBoards.insert( board->key, board );
+    xmlServer->queryCoalescer( )->addBoard( board->key );
     listWidget->addItem( board );
 		boardList.append( board );
 	}
-	emit boardListUpdate( boardList, true );
+	xmlServerBoardListUpdate( boardList, true );
 }
 
 void McHelperWindow::udpBoardsArrived( QList<PacketUdp*> arrived )
@@ -161,18 +189,19 @@ void McHelperWindow::udpBoardsArrived( QList<PacketUdp*> arrived )
 	int i;
 	for( i=0; i<arrived.count( ); i++ )
 	{
-	  board = new Board( this, this, application );
+	  board = new Board( this, this );
+    board->type = Board::Udp; // before setPacketInterface( ), so it knows how to time round trips
 	  board->setPacketInterface( arrived.at(i) );
 	  board->key = arrived.at(i)->getKey();
 		board->location = QString( arrived.at(i)->location( ) );
-    board->type = Board::Udp;
     connectedBoards.insert( board->key, board );
+    xmlServer->queryCoalescer( )->addBoard( board->key );
     board->setText( QString( board->locationString() ) );
     listWidget->addItem( board );
     board->sendMessage( "/system/info-internal" );
 		boardList.append( board );
 	}
-	emit boardListUpdate( boardList, true );
+	xmlServerBoardListUpdate( boardList, true );
 }
 
 void McHelperWindow::sambaBoardsArrived( QList<UploaderThread*> arrived )
@@ -181,7 +210,7 @@ void McHelperWindow::sambaBoardsArrived( QList<UploaderThread*> arrived )
 	int i;
 	for( i=0; i<arrived.count( ); i++ )
 	{
-	  board = new Board( this, this, application );
+	  board = new Board( this, this );
   	board->key = arrived.at(i)->getDeviceKey();
     board->name = "Samba Board";
     board->type = Board::UsbSamba;
@@ -190,6 +219,8 @@ void McHelperWindow::sambaBoardsArrived( QList<UploaderThread*> arrived )
     board->setText( board->name );
     listWidget->addItem( board );
 	}
+	if( !batchFile.isEmpty( ) && !flashBatch->isRunning( ) )
+		batchSettleTimer.start( FLASH_SETTLE_MS ); // give the rest of them a chance to show up too
 }
 
 void McHelperWindow::setBoardName( QString key, QString name )
@@ -240,7 +271,9 @@ void McHelperWindow::removeDevice( QString key )
 		Board* removed = (Board*)listWidget->takeItem( row );
 		QList<Board*> boardList;
 		boardList.append( removed );
-		emit boardListUpdate( boardList, false );
+		xmlServerBoardListUpdate( boardList, false );
+		cache.removeBoard( key );
+		xmlServer->queryCoalescer( )->removeBoard( key );
 		delete removed;
 		
 		// if no boards are left, put the placeholder back in
@@ -328,6 +361,12 @@ void McHelperWindow::updateSummaryInfoInternal( )
 	Qt::CheckState boardWebServerState = (board->webserver) ? Qt::Checked : Qt::Unchecked;
 	if( webserverCheckBox->checkState( ) != boardWebServerState )
 		webserverCheckBox->setCheckState( boardWebServerState );
+
+	// there's no spot for it on the form, so it goes in the status bar while the summary's up
+	QString latency = board->latencyString( );
+	tabWidget->setTabToolTip( 1, latency );
+	if( tabWidget->currentIndex( ) == 1 && !latency.isEmpty( ) )
+		statusBar()->showMessage( latency, SUMMARY_MESSAGE_FREQ * 2 );
 }
 
 void McHelperWindow::tabIndexChanged(int index)
@@ -362,6 +401,8 @@ void McHelperWindow::closeEvent( QCloseEvent *qcloseevent )
 {
 	(void)qcloseevent;
 	usb->closeAll( );
+	if( capture != NULL )
+		capture->close( ); // get the last of it onto the disk
 	QSettings settings("MakingThings", "mchelper");
 	settings.setValue("mainWindowSize", size() );
 	QList<QVariant> splitterSettings;
@@ -393,6 +434,21 @@ void McHelperWindow::uploadButtonClicked( )
 	else
 		strcpy( fileNameBuffer, fileSelectText->currentText().toAscii().constData() );
 	
+	// more than one Samba board selected - flash them all together
+	QStringList sambaBoards;
+	QList<QListWidgetItem*> selected = listWidget->selectedItems( );
+	for( int i = 0; i < selected.size( ); i++ )
+	{
+		if( selected.at( i ) != &listWidgetPlaceholder && ((Board*)selected.at( i ))->type == Board::UsbSamba )
+			sambaBoards.append( ((Board*)selected.at( i ))->key );
+	}
+	if( sambaBoards.size( ) > 1 )
+	{
+		flashBatch->start( QString( fileNameBuffer ), sambaBoards, flashParallel );
+		writeFileSettings();
+		return;
+	}
+
 	Board* board = getCurrentBoard( );
 	if( board == NULL )
 		return;
@@ -447,14 +503,49 @@ void McHelperWindow::newXmlPacketReceived( QList<OscMessage*> messageList, QStri
 	}
 }
 
-void McHelperWindow::sendXmlPacket( QList<OscMessage*> messageList, QString srcAddress )
+// serialized once here, and every XML client writes the same copy
+void McHelperWindow::sendXmlPacket( const OscDecoder& decoder, QString srcAddress )
 {
-	emit xmlPacket( messageList, srcAddress, udp->getListenPort( ) );
+	if( receivers( SIGNAL( xmlDocument( QByteArray ) ) ) > 0 )
+		emit xmlDocument( OscXmlWriter::packet( decoder, srcAddress, udp->getListenPort( ) ) );
+}
+
+// a packet from a binary client, for the board at address
+void McHelperWindow::newOscPacketReceived( QByteArray packet, QString address )
+{
+	Board *board;
+	QList<Board*> boardList = getConnectedBoards( );
+	for( int i = 0; i < boardList.count( ); i++ )
+	{
+		board = boardList.at( i );
+		if( board->key == address )
+			board->sendPacket( packet );
+	}
+}
+
+int McHelperWindow::packetPort( )
+{
+	return udp->getListenPort( );
+}
+
+// frame it once here, and every binary client writes the same copy
+void McHelperWindow::sendOscPacket( const char* packet, int size, QString srcAddress )
+{
+	emit oscFrame( OscBinaryFrame::create( packet, size, srcAddress.toAscii( ), udp->getListenPort( ), OscBinaryFrame::now( ) ) );
 }
 
 void McHelperWindow::xmlServerBoardInfoUpdate( Board* board )
 {
 	emit boardInfoUpdate( board );
+	if( receivers( SIGNAL( xmlDocument( QByteArray ) ) ) > 0 )
+		emit xmlDocument( OscXmlWriter::boardInfo( board->key, board->name, board->serialNumber ) );
+}
+
+void McHelperWindow::xmlServerBoardListUpdate( QList<Board*> boardList, bool arrived )
+{
+	emit boardListUpdate( boardList, arrived );
+	if( receivers( SIGNAL( xmlDocument( QByteArray ) ) ) > 0 )
+		emit xmlDocument( OscXmlClient::boardListDocument( boardList, arrived ) );
 }
 
 void McHelperWindow::customEvent( QEvent* event )
@@ -579,13 +670,17 @@ void McHelperWindow::messageThreadSafe( QStringList strings, MessageEvent::Types
 		if( type == MessageEvent::Response || type == MessageEvent::XMLMessage || type == MessageEvent::Error )
 			return;
 	}
-  
-	QMutexLocker locker(&outputWindowQueueMutex);
-	QString time = QTime::currentTime().toString();
-	for( int i = 0; i < strings.size(); i++ )
-		outputWindowQueue.append( TableEntry( strings.at(i), type, from, time ) );
+  if( outputModel != NULL ) // not yet, in the constructor
+    outputModel->append( strings, type, from );
 }	
 
+void McHelperWindow::showPacket( const char* packet, int size, const QVector<int>& messages, QString from )
+{
+	if( hideOSCMessages || outputModel == NULL )
+		return;
+	outputModel->appendPacket( QByteArray( packet, size ), messages, from );
+}
+
 void McHelperWindow::progress( int value )
 {
 	if( value < 0 )
@@ -601,13 +696,8 @@ void McHelperWindow::progress( int value )
 
 void McHelperWindow::postMessages( )
 {
-	QMutexLocker locker(&outputWindowQueueMutex);
-	if( outputWindowQueue.size( ) )
-	{
-		outputModel->newRows( outputWindowQueue );
+	if( outputModel->flush( ) )
 		treeView->scrollToBottom( );
-		outputWindowQueue.clear( );
-	}
 }
 
 void McHelperWindow::setupOutputWindow( )
@@ -632,6 +722,16 @@ void McHelperWindow::readSettings()
 	appUdpSendPort = settings.value( "appUdpSendPort", DEFAULT_UDP_SEND_PORT ).toInt( );
 	appXmlListenPort = settings.value( "appXmlListenPort", DEFAULT_XML_LISTEN_PORT ).toInt( );
 	findEthernetBoardsAuto = settings.value( "findEthernetBoardsAuto", true ).toBool( );
+	udpReceiveThread = settings.value( "udpReceiveThread", false ).toBool( );
+	cache.setMaxAge( settings.value( "stateCacheMaxAge", 0 ).toInt( ) ); // ms - 0 sends every query on to the board
+	bundleWindowMs = settings.value( "bundleWindowMs", 0 ).toInt( );
+	bundleMaxBytes = settings.value( "bundleMaxSize", 0 ).toInt( ); // 0 - as big as each board's firmware takes
+	captureFile = settings.value( "captureFile", "" ).toString( ); // record board traffic here, if it's set
+	metricsHttpPort = settings.value( "metricsHttpPort", 0 ).toInt( ); // serve Prometheus metrics on localhost, if it's set
+	probeIntervalMs = settings.value( "probeIntervalMs", 0 ).toInt( );
+	flashParallel = settings.value( "flashParallel", FLASH_DEFAULT_PARALLEL ).toInt( ); // boards to flash at once in a batch
+	usbPorts = settings.value( "usbPorts" ).toStringList( ); // serial ports to treat as boards, on top of the ones we find
+	usbWriteWindowMs = settings.value( "usbWriteWindowMs", 0 ).toInt( ); // ms to hold frames for a USB board, to write more at once
 	
 	hideOSCMessages = settings.value( "hideOSCMessages", false ).toBool( );
 	actionHide_OSC_Messages->setChecked( hideOSCMessages );
@@ -689,10 +789,39 @@ void McHelperWindow::setNoUI( bool val )
 		noUI = false;
 }
 
+/*
+	mchelper file.bin - flash every board that's in SAM-BA mode, without
+	showing the window.  Boards are flashed as a batch once no more have turned
+	up for FLASH_SETTLE_MS, and we quit when it's done.
+*/
 void McHelperWindow::uiLessUpload( char* filename, bool bootFlash )
 {
-	(void)filename;
-	(void)bootFlash;
+	(void)bootFlash; // uploads always set the board to boot from flash
+	batchFile = QString( filename );
+	flashBatch->setConsole( true );
+	printf( "Waiting for boards in SAM-BA mode to flash %s to...\n", filename );
+	fflush( stdout );
+}
+
+void McHelperWindow::startBatch( )
+{
+	QStringList sambaBoards;
+	QList<Board*> boards = getConnectedBoards( );
+	for( int i = 0; i < boards.size( ); i++ )
+	{
+		if( boards.at( i )->type == Board::UsbSamba )
+			sambaBoards.append( boards.at( i )->key );
+	}
+	if( !sambaBoards.isEmpty( ) && !flashBatch->start( batchFile, sambaBoards, flashParallel ) && noUI )
+		application->exit( 1 );
+}
+
+void McHelperWindow::batchDone( int failed )
+{
+	if( noUI )
+		application->exit( failed ? 1 : 0 );
+	else
+		progressBar->reset( );
 }
 
 void McHelperWindow::openMchelperHelp( )
@@ -810,6 +939,11 @@ void McHelperWindow::setNewPrefs( )
 	}
 }
 
+bool McHelperWindow::showResponses( )
+{
+	return !hideOSCMessages;
+}
+
 bool McHelperWindow::findNetBoardsEnabled( )
 {
 	return findEthernetBoardsAuto;
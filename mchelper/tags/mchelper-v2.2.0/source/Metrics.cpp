@@ -0,0 +1,295 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#include "Metrics.h"
+#include <QMutexLocker>
+#include <QMap>
+#include <QTime>
+#include "Osc.h"
+#ifndef Q_WS_WIN
+#include <time.h>
+#include <sys/time.h>
+#endif
+
+/************************************************************************************
+																		
+																		MetricHistogram
+																		
+************************************************************************************/
+
+MetricHistogram::MetricHistogram( )
+{
+}
+
+qint64 MetricHistogram::bucketLimit( int bucket )
+{
+	if( bucket >= METRIC_HISTOGRAM_BUCKETS - 1 )
+		return -1;
+	if( bucket == 0 )
+		return 1;
+	if( bucket & 1 )
+		return (qint64)1 << ( ( bucket + 1 ) / 2 );   // 2, 4, 8...
+	return (qint64)3 << ( bucket / 2 - 1 );         // 3, 6, 12...
+}
+
+void MetricHistogram::record( qint64 us )
+{
+	int bucket;
+	if( us <= 1 )
+		bucket = 0;
+	else
+	{
+		int k = 0; // us is somewhere in [ 2^k, 2^(k+1) )
+		while( ( us >> ( k + 1 ) ) != 0 )
+			k++;
+		if( us == ( (qint64)1 << k ) )
+			bucket = 2 * k - 1;
+		else if( us <= ( (qint64)3 << ( k - 1 ) ) )
+			bucket = 2 * k;
+		else
+			bucket = 2 * k + 1;
+		bucket = qMin( bucket, METRIC_HISTOGRAM_BUCKETS - 1 );
+	}
+	buckets[ bucket ].fetchAndAddRelaxed( 1 );
+
+	int micros = (int)qMin( us, (qint64)1000000000 );
+	if( sumMicros.fetchAndAddRelaxed( micros ) + micros >= 1000000000 ) // we took it over - carry
+	{
+		sumMicros.fetchAndAddRelaxed( -1000000000 );
+		sumKiloseconds.fetchAndAddRelaxed( 1 );
+	}
+}
+
+int MetricHistogram::count( )
+{
+	int total = 0;
+	for( int i = 0; i < METRIC_HISTOGRAM_BUCKETS; i++ )
+		total += bucketCount( i );
+	return total;
+}
+
+double MetricHistogram::sumSeconds( )
+{
+	return sumKiloseconds.fetchAndAddRelaxed( 0 ) * 1000.0 + sumMicros.fetchAndAddRelaxed( 0 ) / 1e6;
+}
+
+qint64 MetricHistogram::percentile( double p )
+{
+	int total = count( );
+	if( total == 0 )
+		return 0;
+	int wanted = (int)( p * total + 0.5 );
+	int seen = 0;
+	for( int i = 0; i < METRIC_HISTOGRAM_BUCKETS - 1; i++ )
+	{
+		seen += bucketCount( i );
+		if( seen >= wanted )
+			return bucketLimit( i );
+	}
+	return bucketLimit( METRIC_HISTOGRAM_BUCKETS - 2 ); // somewhere off the end
+}
+
+/************************************************************************************
+																		
+																		BoardMetrics
+																		
+************************************************************************************/
+
+BoardMetrics::BoardMetrics( const QString& key )
+{
+	Metrics* m = Metrics::instance( );
+	QString label = QString( "board=\"%1\"" ).arg( key );
+	packetsIn = m->counter( "mchelper_board_packets_in_total", "Packets from the board", label );
+	bytesIn = m->counter( "mchelper_board_bytes_in_total", "Bytes from the board", label );
+	packetsOut = m->counter( "mchelper_board_packets_out_total", "Packets sent to the board", label );
+	bytesOut = m->counter( "mchelper_board_bytes_out_total", "Bytes sent to the board", label );
+	decodeErrors = m->counter( "mchelper_board_decode_errors_total", "Packets from the board that weren't valid OSC", label );
+	dropped = m->counter( "mchelper_board_dropped_total", "Packets from the board dropped because they came in faster than they could be handled", label );
+	slipErrors = m->counter( "mchelper_board_slip_errors_total", "Oversized or garbled SLIP frames from the board", label );
+	handling = m->histogram( "mchelper_board_handling_seconds", "Time from reading a packet from the board to handing it to clients", label );
+	roundTrip = m->histogram( "mchelper_board_round_trip_seconds", "Round trip time of latency probes to the board", label );
+	probeTimeouts = m->counter( "mchelper_board_probe_timeouts_total", "Latency probes the board never answered", label );
+}
+
+/************************************************************************************
+																		
+																		Metrics
+																		
+************************************************************************************/
+
+Metrics* Metrics::instance( )
+{
+	static Metrics metrics;
+	return &metrics;
+}
+
+BoardMetrics* Metrics::board( const QString& key )
+{
+	Metrics* m = instance( );
+	{
+		QMutexLocker locker( &m->mutex );
+		BoardMetrics* b = m->boards.value( key );
+		if( b != NULL )
+			return b;
+	}
+	BoardMetrics* b = new BoardMetrics( key ); // takes the lock itself, for each metric
+	QMutexLocker locker( &m->mutex );
+	if( m->boards.contains( key ) ) // somebody beat us to it - theirs and ours point at the same metrics anyway
+	{
+		delete b;
+		return m->boards.value( key );
+	}
+	m->boards.insert( key, b );
+	return b;
+}
+
+qint64 Metrics::microseconds( )
+{
+#if defined( Q_WS_WIN )
+	return (qint64)QTime( 0, 0 ).msecsTo( QTime::currentTime( ) ) * 1000;
+#elif defined( CLOCK_MONOTONIC )
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (qint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+	struct timeval tv;
+	gettimeofday( &tv, NULL );
+	return (qint64)tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+void* Metrics::find( const char* name, const char* help, const QString& labels, Type type )
+{
+	QMutexLocker locker( &mutex );
+	for( int i = 0; i < entries.size( ); i++ )
+	{
+		if( entries.at( i ).type == type && entries.at( i ).name == name && entries.at( i ).labels == labels )
+			return entries.at( i ).metric;
+	}
+	Entry e;
+	e.name = name;
+	e.help = help;
+	e.labels = labels;
+	e.type = type;
+	switch( type )
+	{
+		case Counter: e.metric = new MetricCounter( ); break;
+		case Gauge: e.metric = new MetricGauge( ); break;
+		case Histogram: e.metric = new MetricHistogram( ); break;
+	}
+	entries.append( e );
+	return e.metric;
+}
+
+MetricCounter* Metrics::counter( const char* name, const char* help, const QString& labels )
+{
+	return (MetricCounter*)find( name, help, labels, Counter );
+}
+
+MetricGauge* Metrics::gauge( const char* name, const char* help, const QString& labels )
+{
+	return (MetricGauge*)find( name, help, labels, Gauge );
+}
+
+MetricHistogram* Metrics::histogram( const char* name, const char* help, const QString& labels )
+{
+	return (MetricHistogram*)find( name, help, labels, Histogram );
+}
+
+// the text exposition format, version 0.0.4
+QByteArray Metrics::prometheusText( )
+{
+	QMutexLocker locker( &mutex );
+	QMap<QByteArray, QList<int> > byName; // all the series for a name have to be together
+	for( int i = 0; i < entries.size( ); i++ )
+		byName[ entries.at( i ).name ].append( i );
+
+	QByteArray out;
+	QMap<QByteArray, QList<int> >::const_iterator it;
+	for( it = byName.constBegin( ); it != byName.constEnd( ); ++it )
+	{
+		const Entry& first = entries.at( it.value( ).first( ) );
+		static const char* typeNames[] = { "counter", "gauge", "histogram" };
+		out += "# HELP " + first.name + " " + first.help + "\n";
+		out += "# TYPE " + first.name + " " + typeNames[ first.type ] + "\n";
+		for( int j = 0; j < it.value( ).size( ); j++ )
+		{
+			const Entry& e = entries.at( it.value( ).at( j ) );
+			QByteArray labels = e.labels.toUtf8( );
+			QByteArray braces = labels.isEmpty( ) ? QByteArray( ) : "{" + labels + "}";
+			if( e.type == Counter )
+				out += e.name + braces + " " + QByteArray::number( ( (MetricCounter*)e.metric )->get( ) ) + "\n";
+			else if( e.type == Gauge )
+				out += e.name + braces + " " + QByteArray::number( ( (MetricGauge*)e.metric )->get( ) ) + "\n";
+			else
+			{
+				MetricHistogram* h = (MetricHistogram*)e.metric;
+				QByteArray comma = labels.isEmpty( ) ? QByteArray( ) : labels + ",";
+				int cumulative = 0;
+				for( int b = 0; b < METRIC_HISTOGRAM_BUCKETS; b++ )
+				{
+					int n = h->bucketCount( b );
+					cumulative += n;
+					if( n == 0 && b < METRIC_HISTOGRAM_BUCKETS - 1 )
+						continue; // empty buckets don't need to be listed
+					qint64 limit = MetricHistogram::bucketLimit( b );
+					QByteArray le = ( limit < 0 ) ? QByteArray( "+Inf" ) : QByteArray::number( limit / 1e6, 'g', 6 );
+					out += e.name + "_bucket{" + comma + "le=\"" + le + "\"} " + QByteArray::number( cumulative ) + "\n";
+				}
+				out += e.name + "_sum" + braces + " " + QByteArray::number( h->sumSeconds( ), 'f', 6 ) + "\n";
+				out += e.name + "_count" + braces + " " + QByteArray::number( cumulative ) + "\n";
+			}
+		}
+	}
+	return out;
+}
+
+/*
+	The same numbers as OSC, for /mchelper/stats and anything under it - the
+	address is the metric's name without mchelper_ in front.  The first argument
+	is always the labels, then the value, or for histograms the count and the
+	50th, 99th and 100th percentiles in µs.
+*/
+QList<OscMessage*> Metrics::oscMessages( const QString& prefix )
+{
+	QMutexLocker locker( &mutex );
+	QList<OscMessage*> messages;
+	for( int i = 0; i < entries.size( ); i++ )
+	{
+		const Entry& e = entries.at( i );
+		QString address = "/mchelper/stats/" + QString( e.name ).remove( 0, qstrlen( "mchelper_" ) );
+		if( !address.startsWith( prefix ) )
+			continue;
+		OscMessage* msg = new OscMessage( );
+		msg->addressPattern = address;
+		msg->data.append( new OscMessageData( e.labels ) );
+		if( e.type == Counter )
+			msg->data.append( new OscMessageData( (int)( (MetricCounter*)e.metric )->get( ) ) );
+		else if( e.type == Gauge )
+			msg->data.append( new OscMessageData( ( (MetricGauge*)e.metric )->get( ) ) );
+		else
+		{
+			MetricHistogram* h = (MetricHistogram*)e.metric;
+			msg->data.append( new OscMessageData( h->count( ) ) );
+			msg->data.append( new OscMessageData( (int)h->percentile( 0.5 ) ) );
+			msg->data.append( new OscMessageData( (int)h->percentile( 0.99 ) ) );
+			msg->data.append( new OscMessageData( (int)h->percentile( 1.0 ) ) );
+		}
+		messages.append( msg );
+	}
+	return messages;
+}
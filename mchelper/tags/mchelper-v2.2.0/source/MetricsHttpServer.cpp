@@ -0,0 +1,104 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#include "MetricsHttpServer.h"
+#include <QTcpSocket>
+#include "Metrics.h"
+
+#define FROM_STRING "Metrics"
+#define MAX_REQUEST_SIZE 8192
+
+MetricsHttpServer::MetricsHttpServer( MessageInterface* messageInterface, QObject* parent ) : QTcpServer( parent )
+{
+	this->messageInterface = messageInterface;
+	connect( this, SIGNAL( newConnection() ), this, SLOT( openNewConnection( ) ) );
+}
+
+bool MetricsHttpServer::setPort( int port )
+{
+	close( );
+	if( port <= 0 )
+		return true;
+	if( !listen( QHostAddress::LocalHost, port ) )
+	{
+		messageInterface->messageThreadSafe( QString( "Error - can't serve metrics on port %1.  Make sure it's available." ).arg( port ),
+																					MessageEvent::Error, FROM_STRING );
+		return false;
+	}
+	messageInterface->messageThreadSafe( QString( "Serving metrics at http://localhost:%1/metrics" ).arg( port ),
+																				MessageEvent::Info, FROM_STRING );
+	return true;
+}
+
+void MetricsHttpServer::openNewConnection( )
+{
+	while( hasPendingConnections( ) )
+	{
+		QTcpSocket* socket = nextPendingConnection( );
+		connect( socket, SIGNAL( readyRead() ), this, SLOT( readRequest( ) ) );
+		connect( socket, SIGNAL( disconnected() ), socket, SLOT( deleteLater( ) ) );
+	}
+}
+
+/*
+	All we need from the request is its first line - the rest is headers, which
+	we read past until the blank line that ends them, and then answer.
+*/
+void MetricsHttpServer::readRequest( )
+{
+	QTcpSocket* socket = qobject_cast<QTcpSocket*>( sender( ) );
+	if( socket == NULL )
+		return;
+	while( socket->canReadLine( ) )
+	{
+		QByteArray line = socket->readLine( );
+		if( socket->property( "request" ).isNull( ) )
+		{
+			socket->setProperty( "request", line.trimmed( ) );
+			continue;
+		}
+		if( line != "\r\n" && line != "\n" )
+			continue;
+
+		QList<QByteArray> request = socket->property( "request" ).toByteArray( ).split( ' ' );
+		QByteArray status, body;
+		if( request.size( ) < 2 || request.at( 0 ) != "GET" )
+		{
+			status = "405 Method Not Allowed";
+			body = "only GET\n";
+		}
+		else if( request.at( 1 ) != "/metrics" && request.at( 1 ) != "/" )
+		{
+			status = "404 Not Found";
+			body = "try /metrics\n";
+		}
+		else
+		{
+			status = "200 OK";
+			body = Metrics::instance( )->prometheusText( );
+		}
+		QByteArray response = "HTTP/1.0 " + status + "\r\n"
+												"Content-Type: text/plain; version=0.0.4\r\n"
+												"Content-Length: " + QByteArray::number( body.size( ) ) + "\r\n"
+												"Connection: close\r\n\r\n";
+		socket->write( response + body );
+		socket->disconnectFromHost( );
+		return;
+	}
+	if( socket->bytesAvailable( ) > MAX_REQUEST_SIZE ) // a line that never ends
+		socket->abort( );
+}
@@ -16,10 +16,17 @@
 *********************************************************************************/
 
 #include "NetworkMonitor.h"
+#include <QCoreApplication>
 #include "Osc.h"
 #include "BoardArrivalEvent.h"
 
-#define PING_FREQUENCY 1000
+#define NETWORK_TICK_MS 250
+#define BOARD_TIMEOUT_MS 3000     // nothing from a board for this long, and it's gone
+#define PING_AFTER_MS 1000        // nothing for this long, and the board needs a ping to be sure
+#define PING_INTERVAL_MS 1000
+#define PING_MAX_INTERVAL_MS 8000 // how far pings back off while all the boards are busy sending
+
+#define TICKS( ms ) ( ( ms ) / NETWORK_TICK_MS )
 
 NetworkMonitor::NetworkMonitor( int listenPort, int sendPort )
 {
@@ -28,25 +35,92 @@ NetworkMonitor::NetworkMonitor( int listenPort, int sendPort )
 	sendLocal = false;
 	QHostInfo::lookupHost( QHostInfo::localHostName(), this, SLOT(lookedUp(QHostInfo))); 
 	connect( &socket, SIGNAL(readyRead()), this, SLOT( processPendingDatagrams() ) );
-	connect( &pingTimer, SIGNAL( timeout() ), this, SLOT( sendPing() ) );
+	connect( &tickTimer, SIGNAL( timeout() ), this, SLOT( advance() ) );
+	quietBoards = false;
+	pingInterval = TICKS( PING_INTERVAL_MS );
+	lastPing = 0;
 	broadcastPing = Osc::createOneRequest( "/network/find" ); // our constant OSC ping
+	receiver = NULL;
+}
+
+NetworkMonitor::~NetworkMonitor( )
+{
+	delete receiver;
+}
+
+/*
+	Read datagrams on a thread of their own rather than in the event loop.
+	Boards then process their packets on that thread too.  Call before start( ).
+*/
+void NetworkMonitor::setReceiveThread( bool enabled )
+{
+	if( enabled && receiver == NULL )
+	{
+		receiver = new UdpReceiver( );
+		receiver->setIgnoredPacket( broadcastPing );
+		connect( receiver, SIGNAL( newSender( quint32 ) ), this, SLOT( newSender( quint32 ) ), Qt::QueuedConnection );
+	}
+	else if( !enabled && receiver != NULL )
+	{
+		delete receiver;
+		receiver = NULL;
+	}
 }
 
 void NetworkMonitor::start( )
 {
-	if ( !socket.bind( listenPort ) )
+	bool bound = ( receiver != NULL ) ? receiver->open( listenPort ) : socket.bind( listenPort );
+	if ( !bound )
 	{
 	  socket.close();
-	  mainWindow->messageThreadSafe( QString( "Error: Can't listen on port %1 - make sure it's not already in use.").arg( listenPort ), MessageEvent::Error, "Ethernet" );
+	  bridge->messageThreadSafe( QString( "Error: Can't listen on port %1 - make sure it's not already in use.").arg( listenPort ), MessageEvent::Error, "Ethernet" );
+	}
+	tickTimer.start( NETWORK_TICK_MS );
+}
+
+/*
+	Each tick - check on the boards whose Timers are up, and ping if it's time.
+*/
+void NetworkMonitor::advance( )
+{
+	QList<TimingWheel::Timer*> expired;
+	liveness.advance( &expired );
+	quint32 now = liveness.now( );
+	ticks.fetchAndStoreRelaxed( (int)now );
+
+	for( int i = 0; i < expired.size( ); i++ )
+	{
+		PacketUdp* device = static_cast<PacketUdp*>( expired.at( i ) );
+		quint32 quiet = now - device->lastHeard( );
+		if( quiet >= (quint32)TICKS( BOARD_TIMEOUT_MS ) )
+			deviceRemoved( device->getKey( ) );
+		else if( quiet >= (quint32)TICKS( PING_AFTER_MS ) ) // check back when it would time out
+		{
+			quietBoards = true;
+			liveness.start( device, TICKS( BOARD_TIMEOUT_MS ) - quiet );
+		}
+		else
+			liveness.start( device, TICKS( PING_AFTER_MS ) - quiet );
+	}
+
+	if( quietBoards || connectedDevices.isEmpty( ) )
+		pingInterval = TICKS( PING_INTERVAL_MS );
+	if( now - lastPing >= (quint32)pingInterval )
+	{
+		sendPing( );
+		lastPing = now;
+		if( !quietBoards && !connectedDevices.isEmpty( ) )
+			pingInterval = qMin( pingInterval * 2, TICKS( PING_MAX_INTERVAL_MS ) );
+		quietBoards = false;
 	}
-	pingTimer.start( PING_FREQUENCY );
 }
 
 void NetworkMonitor::sendPing( )
 {
-	if( mainWindow->findNetBoardsEnabled( ) )
+	if( bridge->findNetBoardsEnabled( ) )
 	{
-		if( socket.state( ) != QAbstractSocket::BoundState )
+		// with the receive thread, socket only sends - the receiver's got the listen port
+		if( receiver == NULL && socket.state( ) != QAbstractSocket::BoundState )
 			socket.bind( listenPort, QUdpSocket::ShareAddress );
 			
 		// normally we'll be set to send on QHostAddress::Broadcast, but if that fails, just try
@@ -63,15 +137,16 @@ void NetworkMonitor::sendPing( )
 bool NetworkMonitor::changeListenPort( int port )
 {
 	socket.close( );
-	if( !socket.bind( port, QUdpSocket::ShareAddress ) )
+	bool bound = ( receiver != NULL ) ? receiver->open( port ) : socket.bind( port, QUdpSocket::ShareAddress );
+	if( !bound )
 	{
-		mainWindow->messageThreadSafe( QString( "Error: Can't listen on port %1 - make sure it's not already in use.").arg( port ), MessageEvent::Error, "Ethernet" );
+		bridge->messageThreadSafe( QString( "Error: Can't listen on port %1 - make sure it's not already in use.").arg( port ), MessageEvent::Error, "Ethernet" );
 		return false;
 	}
 	else
 	{
 		listenPort = port;
-		mainWindow->messageThreadSafe( QString( "Now listening on port %1 for messages.").arg( listenPort ), MessageEvent::Info, "Ethernet" );
+		bridge->messageThreadSafe( QString( "Now listening on port %1 for messages.").arg( listenPort ), MessageEvent::Info, "Ethernet" );
 		return true;
 	}
 }
@@ -79,7 +154,7 @@ bool NetworkMonitor::changeListenPort( int port )
 void NetworkMonitor::changeSendPort( int port )
 {
 	sendPort = port;
-	mainWindow->messageThreadSafe( QString( "Now sending messages on port %1.").arg( sendPort ), MessageEvent::Info, "Ethernet" );
+	bridge->messageThreadSafe( QString( "Now sending messages on port %1.").arg( sendPort ), MessageEvent::Info, "Ethernet" );
 }
 
 NetworkMonitor::Status NetworkMonitor::scan( QList<PacketUdp*>* arrived )
@@ -91,39 +166,66 @@ NetworkMonitor::Status NetworkMonitor::scan( QList<PacketUdp*>* arrived )
 
 void NetworkMonitor::processPendingDatagrams()
 {
+  QList<PacketUdp*> ready;
   while( socket.hasPendingDatagrams() )
   {
-    QByteArray datagram;
     QHostAddress sender;
-    datagram.resize( socket.pendingDatagramSize() );
-    socket.readDatagram( datagram.data(), datagram.size(), &sender );
+    int size = socket.pendingDatagramSize();
+    if( datagram.size() < size )
+      datagram.resize( size );
+    size = socket.readDatagram( datagram.data(), size, &sender );
+    if( size < 0 )
+      break;
 		
-		if( QString( datagram.data() ) == QString( broadcastPing.data() ) && datagram.size() == broadcastPing.size() )
-			break;
+		if( size == broadcastPing.size() && memcmp( datagram.constData(), broadcastPing.constData(), size ) == 0 )
+			continue; // our own ping - there may be more from the boards behind it
 		
-    QString socketKey = sender.toString( );
-    if( !connectedDevices.contains( socketKey ) )
-    {
-    	PacketUdp* device = new PacketUdp( );
-    	connectedDevices.insert( socketKey, device );  // stick it in our own list of boards we know about
-    	
-    	device->setRemoteHostInfo( &sender, listenPort );
-    	device->setKey( socketKey );
-    	device->setInterfaces( messageInterface, this );
-    	device->open( );
-    	
-    	// post it to the UI
-    	BoardArrivalEvent* event = new BoardArrivalEvent( Board::Udp );
-			event->pUdp.append( device );
-			application->postEvent( mainWindow, event );
-    }
-    if( connectedDevices.contains( socketKey ) ) // pass the packet through to the packet interface
-    {
-    	connectedDevices.value( socketKey )->incomingMessage( datagram );
-    	connectedDevices.value( socketKey )->processPacket( );
-    	connectedDevices.value( socketKey )->resetTimer( );
-    }
+    PacketUdp* device = connectedDevices.value( sender.toIPv4Address( ) );
+    if( device == NULL )
+    	device = addDevice( sender );
+    device->incomingMessage( datagram.constData(), size ); // queue the packet up for the packet interface
+    if( !ready.contains( device ) )
+    	ready.append( device );
   }
+  // then let each board work through everything it got
+  for( int i = 0; i < ready.size( ); i++ )
+  	ready.at( i )->processPacket( );
+}
+
+// a new board - set it up and tell the UI about it
+PacketUdp* NetworkMonitor::addDevice( const QHostAddress& sender )
+{
+	QHostAddress address = sender;
+	PacketUdp* device = new PacketUdp( );
+	connectedDevices.insert( address.toIPv4Address( ), device );  // stick it in our own list of boards we know about
+	
+	device->setRemoteHostInfo( &address, listenPort );
+	device->setKey( address.toString( ) );
+	device->setInterfaces( messageInterface, this );
+	device->open( );
+	device->heardFrom( liveness.now( ) );
+	liveness.start( device, TICKS( PING_AFTER_MS ) );
+	pingInterval = TICKS( PING_INTERVAL_MS ); // there may be more where that came from
+	
+	// post it to the UI
+	BoardArrivalEvent* event = new BoardArrivalEvent( Board::Udp );
+	event->pUdp.append( device );
+	application->postEvent( bridge->notifier( ), event );
+	return device;
+}
+
+/*
+	The receive thread heard from an address it doesn't know.
+	Make a board for it and hand it back - the receiver's been holding onto its packets.
+*/
+void NetworkMonitor::newSender( quint32 address )
+{
+	if( receiver == NULL )
+		return;
+	PacketUdp* device = connectedDevices.value( address );
+	if( device == NULL )
+		device = addDevice( QHostAddress( address ) );
+	receiver->addDevice( address, device );
 }
 
 void NetworkMonitor::lookedUp(const QHostInfo &host) 
@@ -140,19 +242,24 @@ void NetworkMonitor::lookedUp(const QHostInfo &host)
 
 void NetworkMonitor::deviceRemoved( QString key )
 {
-	if( connectedDevices.contains( key ) )
+	quint32 address = QHostAddress( key ).toIPv4Address( );
+	if( connectedDevices.contains( address ) )
 	{
-		PacketUdp* udp = connectedDevices.take( key );
+		if( receiver != NULL )
+			receiver->removeDevice( address ); // make sure the receive thread is done with it first
+		PacketUdp* udp = connectedDevices.take( address );
+		liveness.stop( udp );
+		pingInterval = TICKS( PING_INTERVAL_MS );
 		if( udp->isOpen() )
 			udp->close( );
-		mainWindow->removeDeviceThreadSafe( key );
+		bridge->removeDeviceThreadSafe( key );
 	}
 }
 
-void NetworkMonitor::setInterfaces( MessageInterface* messageInterface, McHelperWindow* mainWindow, QApplication* application )
+void NetworkMonitor::setInterfaces( MessageInterface* messageInterface, BridgeInterface* bridge, QCoreApplication* application )
 {
 	this->messageInterface = messageInterface;
-	this->mainWindow = mainWindow;
+	this->bridge = bridge;
 	this->application = application;
 }
 
@@ -16,6 +16,7 @@
 *********************************************************************************/
 
 #include "Osc.h"
+#include <QtEndian>
 
 QString OscMessage::toString( )
 {
@@ -507,3 +508,271 @@ bool Osc::createMessage( QString msg, OscMessage *oscMsg )
 
 
 
+
+#define OSC_MAX_BUNDLE_DEPTH 8
+
+static int oscPaddedLength( int length )
+{
+	return ( length + 4 ) & ~3; // count the terminating null, then round up to the next 4 bytes
+}
+
+static int oscReadInt( const char* data )
+{
+	const uchar* d = (const uchar*)data;
+	return ( d[0] << 24 ) | ( d[1] << 16 ) | ( d[2] << 8 ) | d[3];
+}
+
+int OscArgView::toInt( ) const
+{
+	return ( type == 'i' || type == 'f' ) ? oscReadInt( data ) : 0;
+}
+
+float OscArgView::toFloat( ) const
+{
+	int i = oscReadInt( data );
+	if( type == 'i' )
+		return (float)i;
+	if( type != 'f' )
+		return 0;
+	return *(float*)&i;
+}
+
+QString OscArgView::toString( ) const
+{
+	switch( type )
+	{
+		case 'i':
+			return QString::number( toInt( ) );
+		case 'f':
+			return QString::number( toFloat( ) );
+		case 's':
+			return QString::fromAscii( data, size );
+		case 'b':
+		{
+			QString blobString( "[ " );
+			for( int i = 0; i < size; i++ )
+				blobString.append( QString::number( (uchar)data[i], 16 ) ).append( ' ' );
+			blobString.append( "]" );
+			return blobString;
+		}
+	}
+	return QString( );
+}
+
+OscDecoder::OscDecoder( )
+{
+	msgCount = 0;
+	argCount = 0;
+	lastStatus = OK;
+}
+
+/*
+	Decode a packet, replacing whatever was decoded last time.
+	Returns the number of well-formed messages found - anything malformed is skipped,
+	and status( ) reports the last problem we ran into.
+*/
+int OscDecoder::decode( const char* packet, int length )
+{
+	msgCount = 0;
+	argCount = 0;
+	lastStatus = OK;
+	if( packet != NULL && length > 0 )
+		decodePacket( packet, length, 0 );
+	return msgCount;
+}
+
+void OscDecoder::decodePacket( const char* packet, int length, int depth )
+{
+	switch( *packet )
+	{
+		case '/':
+			decodeMessage( packet, length );
+			break;
+		case '#':
+		{
+			if( length < 16 || memcmp( packet, "#bundle", 8 ) != 0 || depth >= OSC_MAX_BUNDLE_DEPTH )
+			{
+				setError( ERROR_UNKNOWN_PACKET );
+				break;
+			}
+			// skip bundle text and timetag
+			packet += 16;
+			length -= 16;
+			while( length >= 4 )
+			{
+				int elementLength = oscReadInt( packet );
+				packet += 4;
+				length -= 4;
+				if( elementLength <= 0 || elementLength > length )
+				{
+					setError( ERROR_BAD_DATA );
+					break;
+				}
+				decodePacket( packet, elementLength, depth + 1 );
+				packet += elementLength;
+				length -= elementLength;
+			}
+			break;
+		}
+		default:
+			setError( ERROR_UNKNOWN_PACKET );
+	}
+}
+
+bool OscDecoder::decodeMessage( const char* msg, int length )
+{
+	const char* end = msg + length;
+	const char* nul = (const char*)memchr( msg, 0, length );
+	if( nul == NULL )
+	{
+		setError( ERROR_BAD_DATA );
+		return false;
+	}
+
+	const char* typetag = msg + oscPaddedLength( nul - msg );
+	if( typetag >= end || *typetag != ',' )
+	{
+		setError( ERROR_NO_TYPE_TAG );
+		return false;
+	}
+	nul = (const char*)memchr( typetag, 0, end - typetag );
+	if( nul == NULL )
+	{
+		setError( ERROR_BAD_DATA );
+		return false;
+	}
+
+	// make sure there's room for this message's args before we start filling them in
+	int tagCount = nul - typetag - 1;
+	if( args.size( ) < argCount + tagCount )
+		args.resize( qMax( args.size( ) * 2, argCount + tagCount ) );
+
+	const char* data = typetag + oscPaddedLength( tagCount + 1 );
+	int first = argCount;
+	for( const char* tp = typetag + 1; tp < nul; tp++ )
+	{
+		OscArgView* arg = &args[ argCount ];
+		arg->type = *tp;
+		switch( *tp )
+		{
+			case 'i':
+			case 'f':
+				arg->data = data;
+				arg->size = 4;
+				data += 4;
+				break;
+			case 's':
+			{
+				const char* strEnd = ( data < end ) ? (const char*)memchr( data, 0, end - data ) : NULL;
+				if( strEnd == NULL )
+					data = end + 1; // flag the overrun below
+				else
+				{
+					arg->data = data;
+					arg->size = strEnd - data;
+					data += oscPaddedLength( arg->size );
+				}
+				break;
+			}
+			case 'b':
+			{
+				if( data + 4 > end )
+				{
+					data = end + 1;
+					break;
+				}
+				arg->size = oscReadInt( data );
+				arg->data = data + 4;
+				if( arg->size < 0 || arg->size > end - arg->data )
+					data = end + 1;
+				else
+					data += 4 + ( ( arg->size + 3 ) & ~3 );
+				break;
+			}
+			default: // type tag doesn't correspond to any data we know about
+				data = end + 1;
+		}
+		if( data > end )
+		{
+			argCount = first;
+			setError( ERROR_BAD_DATA );
+			return false;
+		}
+		argCount++;
+	}
+
+	if( messages.size( ) <= msgCount )
+		messages.resize( qMax( messages.size( ) * 2, 16 ) );
+	OscMessageView* view = &messages[ msgCount++ ];
+	view->address = msg;
+	view->typetag = typetag;
+	view->raw = msg;
+	view->rawSize = length;
+	view->argCount = argCount - first;
+	view->firstArg = first;
+	return true;
+}
+
+void OscDecoder::setError( Status status )
+{
+	lastStatus = status;
+}
+
+QString OscDecoder::errorString( ) const
+{
+	switch( lastStatus )
+	{
+		case ERROR_UNKNOWN_PACKET:
+			return QString( "Error - Osc packets must start with either a '/' (message) or '#' (bundle)." );
+		case ERROR_NO_TYPE_TAG:
+			return QString( "Error - No type tag." );
+		case ERROR_BAD_DATA:
+			return QString( "Error extracting data from packet - type tag doesn't correspond to data included." );
+		default:
+			return QString( );
+	}
+}
+
+// same format as OscMessage::toString( )
+QString OscDecoder::messageString( int index ) const
+{
+	const OscMessageView& msg = messages.at( index );
+	QString msgString( msg.address );
+	for( int i = 0; i < msg.argCount; i++ )
+	{
+		msgString.append( " " );
+		msgString.append( arg( msg, i ).toString( ) );
+	}
+	return msgString;
+}
+
+/*
+	Build an old style OscMessage for the places that still want one.
+	Unlike the views, this copies everything so it can outlive the packet.
+*/
+OscMessage* OscDecoder::createOscMessage( int index ) const
+{
+	const OscMessageView& msg = messages.at( index );
+	OscMessage* oscMessage = new OscMessage( );
+	oscMessage->addressPattern = QString( msg.address );
+	for( int i = 0; i < msg.argCount; i++ )
+	{
+		const OscArgView& a = arg( msg, i );
+		switch( a.type )
+		{
+			case 'i':
+				oscMessage->data.append( new OscMessageData( a.toInt( ) ) );
+				break;
+			case 'f':
+				oscMessage->data.append( new OscMessageData( a.toFloat( ) ) );
+				break;
+			case 's':
+				oscMessage->data.append( new OscMessageData( QString::fromAscii( a.data, a.size ) ) );
+				break;
+			case 'b': // OscMessageData blobs carry their length prefix along with them
+				oscMessage->data.append( new OscMessageData( QByteArray( a.data - 4, a.size + 4 ) ) );
+				break;
+		}
+	}
+	return oscMessage;
+}
@@ -0,0 +1,78 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License, 
+ Version 2.0 (the "License"); you may not use this file except in compliance 
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0 
+ 
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#include "OscBinaryFrame.h"
+#include <QDateTime>
+#include <QtEndian>
+#include <string.h>
+
+/*
+	Frame a packet onto the end of out.  Keys longer than 255 bytes are cut short.
+*/
+void OscBinaryFrame::append( QByteArray* out, const char* packet, int size, const QByteArray& key, int port, qint64 time )
+{
+	int keyLength = qMin( key.size( ), 255 );
+	int start = out->size( );
+	out->resize( start + OSC_BINARY_HEADER_SIZE + keyLength + size );
+	uchar* p = (uchar*)out->data( ) + start;
+	qToBigEndian( (quint32)( OSC_BINARY_HEADER_SIZE - 4 + keyLength + size ), p );
+	qToBigEndian( (quint64)time, p + 4 );
+	qToBigEndian( (quint16)port, p + 12 );
+	p[14] = (uchar)keyLength;
+	memcpy( p + OSC_BINARY_HEADER_SIZE, key.constData( ), keyLength );
+	memcpy( p + OSC_BINARY_HEADER_SIZE + keyLength, packet, size );
+}
+
+QByteArray OscBinaryFrame::create( const char* packet, int size, const QByteArray& key, int port, qint64 time )
+{
+	QByteArray frame;
+	append( &frame, packet, size, key, port, time );
+	return frame;
+}
+
+/*
+	Pick the frame at the front of data apart.  frame ends up pointing into data.
+	Returns how many bytes it took up, 0 if it's not all there yet, or -1 if
+	it's not a frame at all - in which case there's no finding the next one either.
+*/
+int OscBinaryFrame::parse( const char* data, int length, OscBinaryFrame* frame )
+{
+	if( length < OSC_BINARY_HEADER_SIZE )
+		return 0;
+	const uchar* p = (const uchar*)data;
+	int frameLength = (int)qFromBigEndian<quint32>( p ) + 4;
+	int keyLength = p[14];
+	if( frameLength > OSC_BINARY_MAX_FRAME || frameLength < OSC_BINARY_HEADER_SIZE + keyLength )
+		return -1;
+	if( length < frameLength )
+		return 0;
+
+	frame->time = (qint64)qFromBigEndian<quint64>( p + 4 );
+	frame->port = qFromBigEndian<quint16>( p + 12 );
+	frame->key = data + OSC_BINARY_HEADER_SIZE;
+	frame->keyLength = keyLength;
+	frame->packet = frame->key + keyLength;
+	frame->packetSize = frameLength - OSC_BINARY_HEADER_SIZE - keyLength;
+	return frameLength;
+}
+
+// ms since the epoch, UTC
+qint64 OscBinaryFrame::now( )
+{
+	QDateTime t = QDateTime::currentDateTime( ).toUTC( );
+	return (qint64)t.toTime_t( ) * 1000 + t.time( ).msec( );
+}
@@ -0,0 +1,97 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#include "OscBundler.h"
+#include <QtEndian>
+#include <string.h>
+
+#define BUNDLE_HEADER_SIZE 16 // "#bundle" padded to 8, then the timetag
+
+OscBundler::OscBundler( int maxSize )
+{
+	maxBytes = maxSize;
+	count = 0;
+}
+
+// how many elements a bundle has, or -1 if their sizes don't fit the packet
+static int countElements( const char* packet, int size )
+{
+	const char* p = packet + BUNDLE_HEADER_SIZE;
+	const char* end = packet + size;
+	int elements = 0;
+	while( p < end )
+	{
+		if( end - p < 4 )
+			return -1;
+		qint32 length = qFromBigEndian<qint32>( (const uchar*)p );
+		if( length < 0 || length % 4 || length > end - p - 4 )
+			return -1;
+		p += 4 + length;
+		elements++;
+	}
+	return elements;
+}
+
+// a timetag of 0, or 1 as the spec has it, means right away
+static bool isImmediate( const char* bundle )
+{
+	return qFromBigEndian<quint32>( (const uchar*)bundle + 8 ) == 0 &&
+				 qFromBigEndian<quint32>( (const uchar*)bundle + 12 ) <= 1;
+}
+
+bool OscBundler::add( const char* packet, int size )
+{
+	bool isBundle = ( size >= BUNDLE_HEADER_SIZE && strcmp( packet, "#bundle" ) == 0 );
+	int elementCount = 1;
+	if( isBundle && ( elementCount = countElements( packet, size ) ) < 0 )
+		return false;
+	bool flatten = isBundle && isImmediate( packet );
+	int extra = flatten ? size - BUNDLE_HEADER_SIZE : size + 4;
+	if( BUNDLE_HEADER_SIZE + elements.size( ) + extra > maxBytes )
+		return false;
+
+	if( flatten ) // its elements are already size-prefixed
+	{
+		elements.append( packet + BUNDLE_HEADER_SIZE, extra );
+		count += elementCount;
+	}
+	else
+	{
+		char length[ 4 ];
+		qToBigEndian( (qint32)size, (uchar*)length );
+		elements.append( length, 4 );
+		elements.append( packet, size );
+		count++;
+	}
+	return true;
+}
+
+QByteArray OscBundler::take( )
+{
+	QByteArray packet;
+	if( count == 1 ) // not worth a bundle
+		packet = elements.mid( 4 );
+	else if( count > 1 )
+	{
+		packet.reserve( BUNDLE_HEADER_SIZE + elements.size( ) );
+		packet.append( "#bundle\0\0\0\0\0\0\0\0\0", BUNDLE_HEADER_SIZE ); // timetag 0, same as Osc::createPacket( )
+		packet.append( elements );
+	}
+	elements.clear( );
+	count = 0;
+	return packet;
+}
@@ -0,0 +1,103 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#include "OscStateCache.h"
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <QtEndian>
+#include <string.h>
+#include "Osc.h"
+#include "OscBinaryFrame.h"
+
+OscStateCache::OscStateCache( )
+{
+	maxAgeMs = 0;
+}
+
+void OscStateCache::store( const QString& board, const OscDecoder& decoder, const QVector<int>& messages )
+{
+	if( maxAgeMs <= 0 || messages.isEmpty( ) )
+		return;
+	qint64 now = OscBinaryFrame::now( );
+	QWriteLocker locker( &lock );
+	BoardValues& values = boards[ board ];
+	for( int i = 0; i < messages.size( ); i++ )
+	{
+		const OscMessageView& msg = decoder.message( messages.at( i ) );
+		// look up without copying the address, and only copy it the first time we see it
+		BoardValues::iterator it = values.find( QByteArray::fromRawData( msg.address, strlen( msg.address ) ) );
+		if( it == values.end( ) )
+			it = values.insert( QByteArray( msg.address ), Value( ) );
+		Value& v = it.value( );
+		v.message.resize( msg.rawSize ); // reuses the old storage when it's the same size
+		memcpy( v.message.data( ), msg.raw, msg.rawSize );
+		v.time = now;
+	}
+}
+
+void OscStateCache::removeBoard( const QString& board )
+{
+	QWriteLocker locker( &lock );
+	boards.remove( board );
+}
+
+/*
+	The answers to a set of queries, as a message or a bundle of them, or an
+	empty array if any of them isn't in the cache or is too old.
+*/
+QByteArray OscStateCache::answer( const QString& board, const QList<QByteArray>& addresses )
+{
+	if( maxAgeMs <= 0 || addresses.isEmpty( ) )
+		return QByteArray( );
+	qint64 oldest = OscBinaryFrame::now( ) - maxAgeMs;
+	QList<QByteArray> found;
+	{
+		QReadLocker locker( &lock );
+		QHash<QString, BoardValues>::const_iterator b = boards.constFind( board );
+		if( b == boards.constEnd( ) )
+			return QByteArray( );
+		for( int i = 0; i < addresses.size( ); i++ )
+		{
+			BoardValues::const_iterator it = b.value( ).constFind( addresses.at( i ) );
+			if( it == b.value( ).constEnd( ) || it.value( ).time < oldest )
+				return QByteArray( );
+			found.append( it.value( ).message );
+		}
+	}
+
+	if( found.size( ) == 1 )
+		return found.first( );
+	QByteArray bundle( "#bundle\0\0\0\0\0\0\0\0\1", 16 ); // timetag 1 - immediately
+	for( int i = 0; i < found.size( ); i++ )
+	{
+		char size[ 4 ];
+		qToBigEndian( (quint32)found.at( i ).size( ), (uchar*)size );
+		bundle.append( size, 4 );
+		bundle.append( found.at( i ) );
+	}
+	return bundle;
+}
+
+void OscStateCache::invalidate( const QString& board, const QByteArray& address )
+{
+	if( maxAgeMs <= 0 )
+		return;
+	QWriteLocker locker( &lock );
+	QHash<QString, BoardValues>::iterator b = boards.find( board );
+	if( b != boards.end( ) )
+		b.value( ).remove( address );
+}
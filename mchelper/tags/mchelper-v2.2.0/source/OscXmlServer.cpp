@@ -17,23 +17,43 @@
 
 #include "OscXmlServer.h"
 #include <QMutexLocker>
+#include "OscXmlWriter.h"
+#include "OscStateCache.h"
+#include "OscBundler.h"
+#include <limits.h>
 
 #define FROM_STRING "XML Server"
+#define QUERY_STATS_MS 10000
+#define HANDSHAKE_WAIT_MS 250 // a client that's said nothing by now gets XML - Flash doesn't speak first
 
-OscXmlServer::OscXmlServer( McHelperWindow *mainWindow, int port, QObject *parent ) : QTcpServer( parent )
+OscXmlServer::OscXmlServer( BridgeInterface *bridge, int port, QObject *parent ) : QTcpServer( parent )
 {
-	this->mainWindow = mainWindow;
+	this->bridge = bridge;
 	listenPort = port;
+	lastQueries = lastMerged = 0;
 	connect( this, SIGNAL( newConnection() ), this, SLOT( openNewConnection( ) ) );
+	connect( &queryStatsTimer, SIGNAL( timeout() ), this, SLOT( reportQueryStats( ) ) );
+	queryStatsTimer.start( QUERY_STATS_MS );
+}
+
+// how much polling from clients is doubling up - only worth mentioning if some did
+void OscXmlServer::reportQueryStats( )
+{
+	int queries = coalescer.queries( );
+	int merged = coalescer.merged( );
+	if( merged != lastMerged )
+		bridge->messageThreadSafe( QString( "%1 of %2 client queries in the last %3 seconds were merged with ones already sent to a board." )
+																		.arg( merged - lastMerged ).arg( queries - lastQueries ).arg( QUERY_STATS_MS / 1000 ),
+																		MessageEvent::Info, FROM_STRING );
+	lastQueries = queries;
+	lastMerged = merged;
 }
 
 void OscXmlServer::openNewConnection( )
 {
-	OscXmlClient *client = new OscXmlClient( nextPendingConnection( ), mainWindow );
+	OscXmlClient *client = new OscXmlClient( nextPendingConnection( ), bridge );
 	connect( client, SIGNAL(finished()), client, SLOT(deleteLater()));
-	client->start( );
-	// tell Flash about the boards we have connected
-	client->boardListUpdate( mainWindow->getConnectedBoards( ), true );
+	client->start( ); // it sends the board list once it knows whether the client wants XML or binary
 }
 
 bool OscXmlServer::changeListenPort( int port )
@@ -41,14 +61,14 @@ bool OscXmlServer::changeListenPort( int port )
 	close( );
 	if( !listen( QHostAddress::Any, port ) )
 	{
-		mainWindow->messageThreadSafe( QString( "Error - can't listen on port %1.  Make sure it's available." ).arg( port ), 
+		bridge->messageThreadSafe( QString( "Error - can't listen on port %1.  Make sure it's available." ).arg( port ), 
 																		MessageEvent::Error, FROM_STRING );
 		return false;
 	}
 	else
 	{
 		listenPort = port;
-		mainWindow->messageThreadSafe( QString( "Now listening on port %1 for XML connections." ).arg( port ), 
+		bridge->messageThreadSafe( QString( "Now listening on port %1 for XML connections." ).arg( port ), 
 																		MessageEvent::Info, FROM_STRING );
 		return true;
 	}
@@ -60,17 +80,26 @@ bool OscXmlServer::changeListenPort( int port )
 																		
 ************************************************************************************/
 
-OscXmlClient::OscXmlClient( QTcpSocket *socket, McHelperWindow *mainWindow, QObject *parent )
+OscXmlClient::OscXmlClient( QTcpSocket *socket, BridgeInterface *bridge, QObject *parent )
 	: QThread(parent)
 {	
-	this->mainWindow = mainWindow;
+	this->bridge = bridge;
 	this->socket = socket;
-	handler = new XmlHandler( mainWindow, this );	
+	handler = new XmlHandler( bridge, this );	
 	xml.setContentHandler( handler );
 	xml.setErrorHandler( handler );
 	resetParser( );
 	socket = NULL;
 	shuttingDown = false;
+	firstRead = true;
+	binary = false;
+	queued = 0;
+	Metrics* metrics = Metrics::instance( );
+	clientsGauge = metrics->gauge( "mchelper_xml_clients", "XML server clients connected" );
+	queuedGauge = metrics->gauge( "mchelper_xml_client_queued_bytes", "Bytes waiting to be written to XML server clients" );
+	cacheAnswers = metrics->counter( "mchelper_client_queries_cached_total", "Client queries answered from the state cache" );
+	clientsGauge->add( 1 );
+	QTimer::singleShot( HANDSHAKE_WAIT_MS, this, SLOT( handshakeTimedOut( ) ) );
 }
 
 void OscXmlClient::run( )
@@ -81,23 +110,41 @@ void OscXmlClient::run( )
 	connect( socket, SIGNAL(readyRead()), this, SLOT(processData()), Qt::DirectConnection);
 	connect( socket, SIGNAL(disconnected()), this, SLOT(disconnected()), Qt::DirectConnection);
 	//connect( socket, SIGNAL(bytesWritten(qint64)), this, SLOT(wroteBytes(qint64)), Qt::DirectConnection);
-	connect( mainWindow, SIGNAL(boardInfoUpdate(Board*)), this, SLOT(boardInfoUpdate(Board*)), Qt::DirectConnection);
-	qRegisterMetaType< QList<OscMessage*> >("QList<OscMessage*>");
-	connect( mainWindow, SIGNAL(boardListUpdate(QList<Board*>, bool)), 
+	connect( bridge->notifier( ), SIGNAL(boardInfoUpdate(Board*)), this, SLOT(boardInfoUpdate(Board*)), Qt::DirectConnection);
+	connect( bridge->notifier( ), SIGNAL(boardListUpdate(QList<Board*>, bool)), 
 						this, SLOT(boardListUpdate(QList<Board*>, bool)), Qt::DirectConnection);
-	connect( mainWindow, SIGNAL(xmlPacket(QList<OscMessage*>, QString, int)), 
-						this, SLOT(sendXmlPacket(QList<OscMessage*>, QString, int)), Qt::DirectConnection);
+	connect( bridge->notifier( ), SIGNAL(xmlDocument(QByteArray)), this, SLOT(sendXmlDocument(QByteArray)), Qt::DirectConnection);
+	connect( bridge->notifier( ), SIGNAL(oscFrame(QByteArray)), this, SLOT(sendOscFrame(QByteArray)), Qt::DirectConnection);
 	
 	peerAddress = socket->peerAddress( ).toString( );
-	mainWindow->messageThreadSafe( QString( "New connection from XML peer at %1").arg( peerAddress ), 
+	bridge->messageThreadSafe( QString( "New connection from XML peer at %1").arg( peerAddress ), 
 																	MessageEvent::Info, FROM_STRING );
 	exec( ); // run the thread, listening for and sending messages, until we call exit( )
 }
 
 void OscXmlClient::processData( )
 {
+	QByteArray data = socket->readAll( );
+	if( firstRead && data.size( ) )
+	{
+		if( (uchar)data.at( 0 ) == OSC_BINARY_HANDSHAKE )
+		{
+			binary = true;
+			socket->write( data.left( 1 ) ); // let the client know it's on
+			data.remove( 0, 1 );
+			bridge->messageThreadSafe( QString( "XML peer at %1 switched to binary packets").arg( peerAddress ), 
+																			MessageEvent::Info, FROM_STRING );
+		}
+		modeDecided( );
+	}
+	if( binary )
+	{
+		processBinary( data );
+		return;
+	}
+
 	// if there's more than one XML document, we expect them to be delimited by \0
-	QList<QByteArray> newDocuments = socket->readAll( ).split( '\0' );
+	QList<QByteArray> newDocuments = data.split( '\0' );
 	bool status;
 	for( int i = 0; i < newDocuments.size( ); i++ )
 	{
@@ -125,6 +172,189 @@ void OscXmlClient::processData( )
 	}
 }
 
+/*
+	Hand each complete frame to its board.  Whatever's left of a frame that
+	hasn't all arrived yet waits for the next read.
+*/
+void OscXmlClient::processBinary( const QByteArray& data )
+{
+	binaryInput.append( data );
+	const char* next = binaryInput.constData( );
+	int remaining = binaryInput.size( );
+	OscBinaryFrame frame;
+	int used;
+	while( ( used = OscBinaryFrame::parse( next, remaining, &frame ) ) > 0 )
+	{
+		QString board = QString::fromAscii( frame.key, frame.keyLength );
+		if( !answerLocally( board, frame.packet, frame.packetSize ) )
+			bridge->newOscPacketReceived( QByteArray( frame.packet, frame.packetSize ), board );
+		next += used;
+		remaining -= used;
+	}
+	if( used < 0 )
+	{
+		bridge->messageThreadSafe( QString( "Error - bad binary frame from %1, dropping what's left of it." ).arg( peerAddress ), 
+																		MessageEvent::Error, FROM_STRING );
+		remaining = 0;
+	}
+	binaryInput.remove( 0, binaryInput.size( ) - remaining );
+}
+
+/*
+	If everything in a packet is a query, it might not need to go to the board -
+	either the state cache has fresh answers, or the same queries are already
+	on their way there.  Anything that's a write throws out what the cache had
+	for that address.
+*/
+bool OscXmlClient::answerLocally( const QString& board, const char* packet, int size )
+{
+	int count = decoder.decode( packet, size );
+	if( decoder.status( ) != OscDecoder::OK )
+		return false;
+	QList<QByteArray> queries;
+	for( int i = 0; i < count; i++ )
+	{
+		const OscMessageView& msg = decoder.message( i );
+		if( msg.argCount == 0 )
+			queries.append( QByteArray::fromRawData( msg.address, qstrlen( msg.address ) ) );
+		else
+			bridge->stateCache( )->invalidate( board, QByteArray::fromRawData( msg.address, qstrlen( msg.address ) ) );
+	}
+	if( queries.size( ) < count )
+		return false;
+	return answerQueries( board, queries );
+}
+
+bool OscXmlClient::answerLocally( const QString& board, const QList<OscMessage*>& messages )
+{
+	QList<QByteArray> queries;
+	for( int i = 0; i < messages.size( ); i++ )
+	{
+		if( messages.at( i )->data.isEmpty( ) )
+			queries.append( messages.at( i )->addressPattern.toAscii( ) );
+		else
+			bridge->stateCache( )->invalidate( board, messages.at( i )->addressPattern.toAscii( ) );
+	}
+	if( queries.size( ) < messages.size( ) )
+		return false;
+	return answerQueries( board, queries );
+}
+
+/*
+	Answers from the cache go back to this client only, the same way they would
+	have come from the board.  Otherwise we wait on the board's answer along with
+	anybody else who's asked, and only send the queries on if nobody has yet.
+
+	/mchelper/stats queries get answered here wherever they are in the packet.
+	If there were any, the board only gets sent what's left.  Queries for a
+	board we don't have get a /mchelper/error back.
+*/
+bool OscXmlClient::answerQueries( const QString& board, const QList<QByteArray>& queries )
+{
+	QList<QByteArray> stats, forBoard;
+	for( int i = 0; i < queries.size( ); i++ )
+	{
+		if( queries.at( i ).startsWith( "/mchelper/stats" ) )
+			stats.append( queries.at( i ) );
+		else
+			forBoard.append( queries.at( i ) );
+	}
+	if( !stats.isEmpty( ) )
+		answerStats( board, stats );
+	if( forBoard.isEmpty( ) ) // all ours - or an empty packet, with nothing to send anyway
+		return true;
+	if( !bridge->queryCoalescer( )->hasBoard( board ) )
+	{
+		OscMessage error;
+		error.addressPattern = "/mchelper/error";
+		error.data.append( new OscMessageData( QString( "No board at %1" ).arg( board ) ) );
+		sendAnswer( board, error.toByteArray( ) );
+		return true;
+	}
+
+	QByteArray answer = bridge->stateCache( )->answer( board, forBoard );
+	if( !answer.isEmpty( ) )
+	{
+		cacheAnswers->add( forBoard.size( ) );
+		sendAnswer( board, answer );
+		return true;
+	}
+	if( bridge->queryCoalescer( )->join( board, forBoard, this ) )
+		return true;
+	if( stats.isEmpty( ) )
+		return false; // the packet can go to the board as it is
+	bridge->newOscPacketReceived( queryPacket( forBoard ), board );
+	return true;
+}
+
+// queries with no arguments, in a bundle if there's more than one
+QByteArray OscXmlClient::queryPacket( const QList<QByteArray>& queries )
+{
+	OscBundler bundler( INT_MAX ); // the board's own bundler splits it up if it needs to
+	for( int i = 0; i < queries.size( ); i++ )
+	{
+		OscMessage msg;
+		msg.addressPattern = QString( queries.at( i ) );
+		QByteArray packet = msg.toByteArray( );
+		bundler.add( packet.constData( ), packet.size( ) );
+	}
+	return bundler.take( );
+}
+
+/*
+	/mchelper/stats is ours rather than the board's - whatever board it's sent
+	to, the answer is mchelper's metrics under the address asked for.
+*/
+void OscXmlClient::answerStats( const QString& board, const QList<QByteArray>& queries )
+{
+	QList<OscMessage*> messages;
+	for( int i = 0; i < queries.size( ); i++ )
+		messages += Metrics::instance( )->oscMessages( QString( queries.at( i ) ) );
+	OscBundler bundler( INT_MAX ); // there's no board on the other end of this one to worry about
+	for( int i = 0; i < messages.size( ); i++ )
+	{
+		QByteArray msg = messages.at( i )->toByteArray( );
+		bundler.add( msg.constData( ), msg.size( ) );
+	}
+	qDeleteAll( messages );
+	if( !bundler.isEmpty( ) )
+		sendAnswer( board, bundler.take( ) );
+}
+
+// back to this client only, the same way it would have come from the board
+void OscXmlClient::sendAnswer( const QString& board, const QByteArray& packet )
+{
+	if( binary )
+		sendOscFrame( OscBinaryFrame::create( packet.constData( ), packet.size( ), board.toAscii( ), bridge->packetPort( ), OscBinaryFrame::now( ) ) );
+	else
+	{
+		decoder.decode( packet.constData( ), packet.size( ) );
+		sendXmlDocument( OscXmlWriter::packet( decoder, board, bridge->packetPort( ) ) );
+	}
+}
+
+/*
+	Nothing goes to a client until we know which it wants - an XML board list
+	ahead of the handshake's echo would throw a binary client's framing off.
+	Once we know, it hears about the boards we already have, its own way.
+*/
+void OscXmlClient::modeDecided( )
+{
+	if( !firstRead )
+		return;
+	firstRead = false;
+	QList<Board*> boards = bridge->getConnectedBoards( );
+	if( binary )
+		boardListUpdate( boards, true );
+	else
+		sendXmlDocument( boardListDocument( boards, true ) );
+}
+
+void OscXmlClient::handshakeTimedOut( )
+{
+	modeDecided( );
+}
+
 void OscXmlClient::resetParser( )
 {
 	lastParseComplete = true;
@@ -134,10 +364,13 @@ void OscXmlClient::disconnected( )
 {
 	shuttingDown = true;
 	disconnect( ); // don't want to respond to any more signals
+	bridge->queryCoalescer( )->removeClient( this ); // or any more answers
+	clientsGauge->add( -1 );
+	queuedGauge->add( -queued.fetchAndStoreRelaxed( 0 ) );
 	socket->abort( );
 	socket->deleteLater( ); // these will get deleted when control returns to the main event loop
 	handler->deleteLater( );
-	mainWindow->messageThreadSafe( QString( "XML peer at %1 disconnected." ).arg( peerAddress ), 
+	bridge->messageThreadSafe( QString( "XML peer at %1 disconnected." ).arg( peerAddress ), 
 																	MessageEvent::Info, FROM_STRING );
 	exit( ); // shut this thread down
 }
@@ -154,114 +387,88 @@ bool OscXmlClient::isConnected( )
 	return false;
 }
 
+/*
+	Binary clients hear about boards in frames too, as OSC messages from
+	mchelper itself - /mchelper/board/arrived, /mchelper/board/removed and
+	/mchelper/board/info - keyed by the board they're about.
+*/
+void OscXmlClient::sendBoardFrame( Board* board, const char* address, QString arg1, QString arg2 )
+{
+	OscMessage msg;
+	msg.addressPattern = address;
+	msg.data.append( new OscMessageData( arg1 ) );
+	if( !arg2.isNull( ) )
+		msg.data.append( new OscMessageData( arg2 ) );
+	QByteArray packet = msg.toByteArray( );
+	sendOscFrame( OscBinaryFrame::create( packet.constData( ), packet.size( ), board->key.toAscii( ), 0, OscBinaryFrame::now( ) ) );
+}
+
+void OscXmlClient::sendOscFrame( QByteArray frame )
+{
+	if( binary && isConnected( ) )
+	{
+		socket->write( frame );
+		updateQueued( );
+	}
+}
+
+/*
+	The board updates and packets themselves come to XML clients already
+	serialized, through sendXmlDocument( ) - these are only for binary clients.
+*/
 void OscXmlClient::boardInfoUpdate( Board* board )
 {		
-	QDomDocument doc;
-	QDomElement boardUpdate = doc.createElement( "BOARD_INFO" );
-	doc.appendChild( boardUpdate );
-
-	QDomElement boardElement = doc.createElement( "BOARD" );
-	boardElement.setAttribute( "LOCATION", board->key );
-	boardElement.setAttribute( "NAME", board->name );
-	boardElement.setAttribute( "SERIALNUMBER", board->serialNumber );
-	boardUpdate.appendChild( boardElement );
-		
-	writeXmlDoc( doc );
+	if( binary )
+		sendBoardFrame( board, "/mchelper/board/info", board->name, board->serialNumber );
 }
 
 void OscXmlClient::boardListUpdate( QList<Board*> boardList, bool arrived )
 {
-	QDomDocument doc;
-	QDomElement boardUpdate;
-	if( arrived )
-		boardUpdate = doc.createElement( "BOARD_ARRIVAL" );
-	else
-		boardUpdate = doc.createElement( "BOARD_REMOVAL" );
-		
-	doc.appendChild( boardUpdate );
+	if( !binary )
+		return;
 	for( int i = 0; i < boardList.count( ); i++ )
 	{
-		Board* currentBoard = boardList.at( i );
-		QDomElement board = doc.createElement( "BOARD" );
-		if( currentBoard->type == Board::UsbSerial )
-			board.setAttribute( "TYPE", "USB" );
-		if( currentBoard->type == Board::Udp )
-			board.setAttribute( "TYPE", "Ethernet" );
-		board.setAttribute( "LOCATION", currentBoard->key );
-		boardUpdate.appendChild( board );
+		Board* board = boardList.at( i );
+		QString type = ( board->type == Board::Udp ) ? "Ethernet" : "USB";
+		sendBoardFrame( board, arrived ? "/mchelper/board/arrived" : "/mchelper/board/removed", type );
 	}
-	
-	writeXmlDoc( doc );
 }
 
-void OscXmlClient::writeXmlDoc( QDomDocument doc )
+QByteArray OscXmlClient::boardListDocument( QList<Board*> boardList, bool arrived )
 {
-	if( isConnected( ) )
-		socket->write( doc.toByteArray( ).append( '\0' ) ); // Flash wants XML followed by a zero byte
+	QStringList keys, types;
+	for( int i = 0; i < boardList.count( ); i++ )
+	{
+		Board* board = boardList.at( i );
+		keys << board->key;
+		if( board->type == Board::UsbSerial )
+			types << "USB";
+		else if( board->type == Board::Udp )
+			types << "Ethernet";
+		else
+			types << QString( );
+	}
+	return OscXmlWriter::boardList( arrived, keys, types );
 }
 
-void OscXmlClient::sendXmlPacket( QList<OscMessage*> messageList, QString srcAddress, int srcPort )
+void OscXmlClient::sendXmlDocument( QByteArray document )
 {
-	int msgCount = messageList.count( );
-	if( !isConnected( ) || msgCount < 1 )
-		return;
-	
-	QDomDocument doc;
-	QDomElement oscPacket = doc.createElement( "OSCPACKET" );
-	oscPacket.setAttribute( "ADDRESS", srcAddress );
-	oscPacket.setAttribute( "PORT", srcPort );
-	oscPacket.setAttribute( "TIME", 0 );
-	doc.appendChild( oscPacket );
-
-	for( int i = 0; i < msgCount; i++ )
+	if( !firstRead && !binary && isConnected( ) )
 	{
-		OscMessage *oscMsg = messageList.at( i );
-		int dataCount = oscMsg->data.count( );
-		
-		QDomElement msg = doc.createElement( "MESSAGE" );
-		msg.setAttribute( "NAME", oscMsg->addressPattern );
-		oscPacket.appendChild( msg );
-		
-		for( int j = 0; j < dataCount; j++ )
-		{
-			OscMessageData *data = oscMsg->data.at( j );
-			QDomElement argument = doc.createElement( "ARGUMENT" );
-			switch( data->type )
-			{
-				case OscMessageData::OmdString:
-					argument.setAttribute( "TYPE", "s" );
-					argument.setAttribute( "VALUE", QString( data->s ) );
-					break;
-				case OscMessageData::OmdInt:
-					argument.setAttribute( "TYPE", "i" );
-					argument.setAttribute( "VALUE", QString::number( data->i ) );
-					break;
-				case OscMessageData::OmdFloat:
-					argument.setAttribute( "TYPE", "f" );
-					argument.setAttribute( "VALUE", QString::number( data->f ) );
-					break;
-				case OscMessageData::OmdBlob:
-				{
-					QString blobstring;
-					unsigned char* blob = (unsigned char*)data->b.data( );
-					int blob_len = qFromBigEndian( *(int*)blob );  // the first int should give us the length of the blob
-					blob += sizeof(int); // step past the length
-					while( blob_len-- )
-					{
-						// break each byte into 4-bit chunks so they don't get misinterpreted
-						// by any casts to ASCII, etc. and send a string composed of single chars from 0-f
-						blobstring.append( QString::number( (*blob >> 4) & 0x0f, 16 ) );
-						blobstring.append( QString::number(*blob++ & 0x0f, 16 ) );
-					}
-					argument.setAttribute( "TYPE", "b" );
-					argument.setAttribute( "VALUE", blobstring );
-					break;
-				}
-			}
-			msg.appendChild( argument );
-		}
+		socket->write( document ); // already has the zero byte Flash wants on the end
+		updateQueued( );
 	}
-	writeXmlDoc( doc );
+}
+
+/*
+	Only measured when we write, so a client that's caught up after the last
+	write still shows what was waiting then - good enough to spot one that
+	can't keep up.
+*/
+void OscXmlClient::updateQueued( )
+{
+	int now = (int)socket->bytesToWrite( );
+	queuedGauge->add( now - queued.fetchAndStoreRelaxed( now ) );
 }
 
 /************************************************************************************
@@ -270,9 +477,9 @@ void OscXmlClient::sendXmlPacket( QList<OscMessage*> messageList, QString srcAdd
 																		
 ************************************************************************************/
 
-XmlHandler::XmlHandler( McHelperWindow *mainWindow, OscXmlClient *xmlClient ) : QXmlDefaultHandler( )
+XmlHandler::XmlHandler( BridgeInterface *bridge, OscXmlClient *xmlClient ) : QXmlDefaultHandler( )
 {
-	this->mainWindow = mainWindow;
+	this->bridge = bridge;
 	this->xmlClient = xmlClient;
 	currentMessage = NULL;
 }
@@ -352,11 +559,15 @@ bool XmlHandler::endElement( const QString & namespaceURI, const QString & local
 	
 	if( localName == "OSCPACKET" )
 	{
-		mainWindow->newXmlPacketReceived( oscMessageList, currentDestination );
-		QStringList strings;
-		for( int i = 0; i < oscMessageList.count( ); i++ )
-			strings << oscMessageList.at( i )->toString( );
-		mainWindow->messageThreadSafe( strings, MessageEvent::XMLMessage, FROM_STRING);
+		if( !xmlClient->answerLocally( currentDestination, oscMessageList ) )
+			bridge->newXmlPacketReceived( oscMessageList, currentDestination );
+		if( bridge->showResponses( ) )
+		{
+			QStringList strings;
+			for( int i = 0; i < oscMessageList.count( ); i++ )
+				strings << oscMessageList.at( i )->toString( );
+			bridge->messageThreadSafe( strings, MessageEvent::XMLMessage, FROM_STRING);
+		}
 		qDeleteAll( oscMessageList );
 		oscMessageList.clear( );
 		xmlClient->resetParser( );
@@ -0,0 +1,119 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License, 
+ Version 2.0 (the "License"); you may not use this file except in compliance 
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0 
+ 
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#include "OscXmlWriter.h"
+#include <QXmlStreamWriter>
+
+/*
+	Break each byte into 4-bit chunks so they don't get misinterpreted
+	by any casts to ASCII, etc. and send a string composed of single chars from 0-f
+*/
+static QString blobString( const char* blob, int size )
+{
+	static const char hex[] = "0123456789abcdef";
+	QByteArray nibbles( size * 2, 0 );
+	char* out = nibbles.data( );
+	for( int i = 0; i < size; i++ )
+	{
+		*out++ = hex[ ( blob[i] >> 4 ) & 0x0f ];
+		*out++ = hex[ blob[i] & 0x0f ];
+	}
+	return QString::fromLatin1( nibbles.constData( ), nibbles.size( ) );
+}
+
+/*
+	Everything the decoder got out of the last packet, as an OSCPACKET document.
+*/
+QByteArray OscXmlWriter::packet( const OscDecoder& decoder, const QString& srcAddress, int srcPort )
+{
+	QByteArray doc;
+	QXmlStreamWriter xml( &doc ); // writes straight through to doc
+	xml.writeStartElement( "OSCPACKET" );
+	xml.writeAttribute( "ADDRESS", srcAddress );
+	xml.writeAttribute( "PORT", QString::number( srcPort ) );
+	xml.writeAttribute( "TIME", "0" );
+
+	for( int i = 0; i < decoder.messageCount( ); i++ )
+	{
+		const OscMessageView& msg = decoder.message( i );
+		xml.writeStartElement( "MESSAGE" );
+		xml.writeAttribute( "NAME", QString::fromAscii( msg.address ) );
+		for( int j = 0; j < msg.argCount; j++ )
+		{
+			const OscArgView& arg = decoder.arg( msg, j );
+			xml.writeEmptyElement( "ARGUMENT" );
+			switch( arg.type )
+			{
+				case 's':
+					xml.writeAttribute( "TYPE", "s" );
+					xml.writeAttribute( "VALUE", QString::fromAscii( arg.data, arg.size ) );
+					break;
+				case 'i':
+					xml.writeAttribute( "TYPE", "i" );
+					xml.writeAttribute( "VALUE", QString::number( arg.toInt( ) ) );
+					break;
+				case 'f':
+					xml.writeAttribute( "TYPE", "f" );
+					xml.writeAttribute( "VALUE", QString::number( arg.toFloat( ) ) );
+					break;
+				case 'b':
+					xml.writeAttribute( "TYPE", "b" );
+					xml.writeAttribute( "VALUE", blobString( arg.data, arg.size ) );
+					break;
+			}
+		}
+		xml.writeEndElement( ); // MESSAGE
+	}
+	xml.writeEndElement( ); // OSCPACKET
+	doc.append( '\0' );
+	return doc;
+}
+
+/*
+	BOARD_ARRIVAL or BOARD_REMOVAL, with a BOARD for each key.
+	types should line up with keys - "USB", "Ethernet", or empty to leave it out.
+*/
+QByteArray OscXmlWriter::boardList( bool arrived, const QStringList& keys, const QStringList& types )
+{
+	QByteArray doc;
+	QXmlStreamWriter xml( &doc );
+	xml.writeStartElement( arrived ? "BOARD_ARRIVAL" : "BOARD_REMOVAL" );
+	for( int i = 0; i < keys.count( ); i++ )
+	{
+		xml.writeEmptyElement( "BOARD" );
+		if( i < types.count( ) && !types.at( i ).isEmpty( ) )
+			xml.writeAttribute( "TYPE", types.at( i ) );
+		xml.writeAttribute( "LOCATION", keys.at( i ) );
+	}
+	xml.writeEndElement( );
+	doc.append( '\0' );
+	return doc;
+}
+
+QByteArray OscXmlWriter::boardInfo( const QString& key, const QString& name, const QString& serialNumber )
+{
+	QByteArray doc;
+	QXmlStreamWriter xml( &doc );
+	xml.writeStartElement( "BOARD_INFO" );
+	xml.writeEmptyElement( "BOARD" );
+	xml.writeAttribute( "LOCATION", key );
+	xml.writeAttribute( "NAME", name );
+	xml.writeAttribute( "SERIALNUMBER", serialNumber );
+	xml.writeEndElement( );
+	doc.append( '\0' );
+	return doc;
+}
@@ -17,33 +17,43 @@
 
 #include "OutputWindow.h"
 #include <QColor>
+#include <QTime>
+#include <QMutexLocker>
 
 OutputWindow::OutputWindow( int maxMsgs ) : QAbstractItemModel( )
 {
-	this->maxMsgs = maxMsgs;
+	this->maxMsgs = qMax( maxMsgs, 1 );
+	ring.resize( this->maxMsgs );
+	head = 0;
+	count = 0;
+	suppressed = 0;
+	queueMax = this->maxMsgs;
+	sourceIds.insert( "mchelper", 0 ); // so the suppressed messages row has somewhere to be from
+	sourceNames.append( "mchelper" );
 }
 
 QVariant OutputWindow::data(const QModelIndex &index, int role) const
 {
-	if (!index.isValid() || index.row() > tableEntries.count( ) )
+	if (!index.isValid() || index.row() >= count )
 		return QVariant();
 		
+	const TableEntry& e = entry( index.row( ) );
 	if( role == Qt::DisplayRole ) // the text that should be written
 	{
 		switch( index.column( ) )
 		{
 			case 0:
-				return tableEntries.at( index.row() ).tofrom;
+				return sourceNames.at( e.from );
 			case 1:
-				return tableEntries.at( index.row() ).msg;
+				return messageText( e );
 			case 2:
-				return tableEntries.at( index.row() ).timestamp;
+				return QTime( 0, 0 ).addMSecs( e.time ).toString( );
 		}
 	}
 	
 	if( role == Qt::BackgroundRole ) // the background color
 	{
-		switch( tableEntries.at( index.row() ).type )
+		switch( e.type )
 		{
 			case MessageEvent::Info:
 			case MessageEvent::Notice:
@@ -70,62 +80,153 @@ QVariant OutputWindow::data(const QModelIndex &index, int role) const
 	return QVariant( );
 }
 
-// add some new rows, but make sure we don't allow more than the specified number of rows
-void OutputWindow::newRows( QList<TableEntry> entries )
+// the view asks for every column of a row, and rows from the same packet tend to be next
+// to each other, so hang onto the last packet we decoded.  Holding a reference to it means
+// its data can't be freed and handed back to another packet while we're comparing pointers.
+QString OutputWindow::messageText( const TableEntry& e ) const
 {
-	int newRows = entries.count( );
-	int existingRows = tableEntries.count( );
-	int requestedRows = newRows + existingRows;
-	int extraRows = requestedRows - maxMsgs;
-	
-	if( newRows > maxMsgs  ) // if we have more new messages than will fit
-	{
-		// get rid of everything, and only keep as many of the most recent messages as will fit
-		clear( );		
-		for( int i = 0; i < newRows - maxMsgs; i++ )
-			entries.removeFirst( );
-	}
-	else if( extraRows > maxMsgs )
+	if( e.message < 0 )
+		return e.text;
+	if( decodedPacket.constData( ) != e.packet.constData( ) )
 	{
-		clear( );		
-		for( int i = 0; i < extraRows; i++ )
-			entries.removeFirst( );
+		decodedPacket = e.packet;
+		decoder.decode( decodedPacket.constData( ), decodedPacket.size( ) );
 	}
-	else if( requestedRows > maxMsgs ) // just remove as many as we need from the front
+	if( e.message >= decoder.messageCount( ) )
+		return QString( );
+	return decoder.messageString( e.message );
+}
+
+int OutputWindow::sourceId( const QString& from )
+{
+	QHash<QString, int>::const_iterator it = sourceIds.constFind( from );
+	if( it != sourceIds.constEnd( ) )
+		return it.value( );
+	int id = sourceIds.count( );
+	sourceIds.insert( from, id );
+	newSourceNames.append( from );
+	return id;
+}
+
+void OutputWindow::append( const QStringList& strings, MessageEvent::Types type, const QString& from )
+{
+	int time = QTime( 0, 0 ).msecsTo( QTime::currentTime( ) );
+	QMutexLocker locker( &queueMutex );
+	int id = sourceId( from );
+	for( int i = 0; i < strings.size( ); i++ )
 	{
-		beginRemoveRows( QModelIndex(), 0, extraRows - 1 );
-		for( int i = 0; i < extraRows; i++ )
+		if( queue.size( ) >= queueMax )
 		{
-			if( !tableEntries.isEmpty( ) )
-				tableEntries.removeFirst( );
+			suppressed += strings.size( ) - i;
+			return;
 		}
-		endRemoveRows( );
+		TableEntry e;
+		e.time = time;
+		e.type = type;
+		e.from = id;
+		e.message = -1;
+		e.text = strings.at( i );
+		queue.append( e );
 	}
-	
-	// now add the new rows in 
-	beginInsertRows( QModelIndex(), tableEntries.count( ), tableEntries.count( ) + entries.count( ) - 1 );
-	for( int i = 0; i < entries.count( ); i++ )
-		tableEntries.append( entries.at(i) );
-	endInsertRows( );
 }
 
-void OutputWindow::setMaxMsgs( int newMaxMsgs )
+void OutputWindow::appendPacket( const QByteArray& packet, const QVector<int>& messages, const QString& from )
 {
-	if( newMaxMsgs < maxMsgs )
+	int time = QTime( 0, 0 ).msecsTo( QTime::currentTime( ) );
+	QMutexLocker locker( &queueMutex );
+	int id = sourceId( from );
+	for( int i = 0; i < messages.size( ); i++ )
 	{
-		if( tableEntries.count( ) > newMaxMsgs )
+		if( queue.size( ) >= queueMax )
 		{
-			int extraRows = tableEntries.count( ) - newMaxMsgs;
-			beginRemoveRows( QModelIndex(), 0, extraRows - 1 );
-			for( int i = 0; i < extraRows; i++ )
-			{
-				if( !tableEntries.isEmpty( ) )
-					tableEntries.removeFirst( );
-			}
-			endRemoveRows( );
+			suppressed += messages.size( ) - i;
+			return;
 		}
+		TableEntry e;
+		e.time = time;
+		e.type = MessageEvent::Response;
+		e.from = id;
+		e.message = messages.at( i );
+		e.packet = packet;
+		queue.append( e );
+	}
+}
+
+// move everything that's been queued up since last time into the ring
+bool OutputWindow::flush( )
+{
+	QVector<TableEntry> entries;
+	int dropped;
+	{
+		QMutexLocker locker( &queueMutex );
+		if( queue.isEmpty( ) && suppressed == 0 )
+			return false;
+		entries = queue;
+		queue.clear( );
+		queue.reserve( queueMax ); // clear( ) let go of the storage
+		dropped = suppressed;
+		suppressed = 0;
+		sourceNames += newSourceNames;
+		newSourceNames.clear( );
+	}
+
+	if( dropped > 0 )
+	{
+		TableEntry e;
+		e.time = QTime( 0, 0 ).msecsTo( QTime::currentTime( ) );
+		e.type = MessageEvent::Warning;
+		e.from = 0;
+		e.message = -1;
+		e.text = QString( "%1 messages suppressed" ).arg( dropped );
+		if( entries.size( ) >= maxMsgs )
+			entries.remove( 0 );
+		entries.append( e );
 	}
+
+	int first = 0;
+	int newRows = entries.size( );
+	if( newRows > maxMsgs ) // only the most recent will fit
+	{
+		first = newRows - maxMsgs;
+		newRows = maxMsgs;
+	}
+	if( count + newRows > maxMsgs )
+		removeOldest( count + newRows - maxMsgs );
+
+	beginInsertRows( QModelIndex(), count, count + newRows - 1 );
+	for( int i = 0; i < newRows; i++ )
+		ring[ ( head + count + i ) % maxMsgs ] = entries.at( first + i );
+	count += newRows;
+	endInsertRows( );
+	return true;
+}
+
+void OutputWindow::removeOldest( int rows )
+{
+	beginRemoveRows( QModelIndex(), 0, rows - 1 );
+	for( int i = 0; i < rows; i++ )
+		ring[ ( head + i ) % maxMsgs ] = TableEntry( ); // let go of the packet
+	head = ( head + rows ) % maxMsgs;
+	count -= rows;
+	endRemoveRows( );
+}
+
+void OutputWindow::setMaxMsgs( int newMaxMsgs )
+{
+	newMaxMsgs = qMax( newMaxMsgs, 1 );
+	if( count > newMaxMsgs )
+		removeOldest( count - newMaxMsgs );
+
+	// lay what's left out from the start of a new ring
+	QVector<TableEntry> newRing( newMaxMsgs );
+	for( int i = 0; i < count; i++ )
+		newRing[ i ] = entry( i );
+	ring = newRing;
+	head = 0;
 	this->maxMsgs = newMaxMsgs;
+
+	QMutexLocker locker( &queueMutex );
+	queueMax = newMaxMsgs;
 }
 
 QModelIndex OutputWindow::index(int row, int column, const QModelIndex &parent)
@@ -152,7 +253,7 @@ bool OutputWindow::hasChildren( const QModelIndex & parent )
 int OutputWindow::rowCount( const QModelIndex & parent ) const
 {
 	(void) parent;
-	return tableEntries.count( );
+	return count;
 }
 
 int OutputWindow::columnCount(const QModelIndex &parent) const
@@ -163,12 +264,9 @@ int OutputWindow::columnCount(const QModelIndex &parent) const
 
 void OutputWindow::clear( )
 {
-	if( !tableEntries.count( ) > 0 )
+	if( count == 0 )
 		return;
-	int rowCount = ( tableEntries.count( ) > 0 ) ? (tableEntries.count( ) - 1) : 0;
-	beginRemoveRows( QModelIndex(), 0, rowCount );
-	tableEntries.clear( );
-	endRemoveRows( );
+	removeOldest( count );
+	head = 0;
+	decodedPacket = QByteArray( );
 }
-
-
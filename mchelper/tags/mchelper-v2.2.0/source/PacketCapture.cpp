@@ -0,0 +1,170 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#include "PacketCapture.h"
+#include <QMutexLocker>
+#include <QDateTime>
+#include <QtEndian>
+#include <string.h>
+#ifndef Q_WS_WIN
+#include <time.h>
+#include <sys/time.h>
+#endif
+
+#define FLUSH_SIZE ( 256 * 1024 ) // wake the writer once this much is waiting
+#define FLUSH_MS 200              // and otherwise write out whatever's there this often
+
+PacketCapture::PacketCapture( ) : QThread( )
+{
+	stopping = false;
+	dropped = 0;
+	pendingSize = 0;
+}
+
+PacketCapture::~PacketCapture( )
+{
+	close( );
+}
+
+bool PacketCapture::open( const QString& filename )
+{
+	close( );
+	file.setFileName( filename );
+	if( !file.open( QIODevice::WriteOnly | QIODevice::Truncate ) )
+		return false;
+	file.write( PACKET_CAPTURE_MAGIC, 8 );
+	stopping = false;
+	dropped = 0;
+	start( QThread::LowPriority );
+	return true;
+}
+
+// writes out whatever's left before it closes the file
+void PacketCapture::close( )
+{
+	if( !isRunning( ) )
+		return;
+	{
+		QMutexLocker locker( &mutex );
+		stopping = true;
+		wake.wakeOne( );
+	}
+	wait( );
+	file.close( );
+}
+
+int PacketCapture::droppedCount( )
+{
+	QMutexLocker locker( &mutex );
+	return dropped;
+}
+
+void PacketCapture::record( const QByteArray& key, Direction direction, Transport transport, const char* packet, int size )
+{
+	qint64 time = nanoseconds( );
+	int keyLength = qMin( key.size( ), 255 );
+	int recordSize = PACKET_CAPTURE_HEADER_SIZE + keyLength + size;
+
+	QMutexLocker locker( &mutex );
+	if( stopping || pendingSize + recordSize > PACKET_CAPTURE_MAX_PENDING )
+	{
+		dropped++;
+		return;
+	}
+	int start = pendingSize;
+	pendingSize += recordSize;
+	if( pending.size( ) < pendingSize )
+		pending.resize( pendingSize );
+	uchar* p = (uchar*)pending.data( ) + start;
+	qToBigEndian( (quint32)( recordSize - 4 ), p );
+	qToBigEndian( (quint64)time, p + 4 );
+	p[12] = (uchar)direction;
+	p[13] = (uchar)transport;
+	p[14] = (uchar)keyLength;
+	memcpy( p + PACKET_CAPTURE_HEADER_SIZE, key.constData( ), keyLength );
+	memcpy( p + PACKET_CAPTURE_HEADER_SIZE + keyLength, packet, size );
+	if( pendingSize >= FLUSH_SIZE )
+		wake.wakeOne( );
+}
+
+// swap the buffer out and write it without holding anybody up
+void PacketCapture::run( )
+{
+	QByteArray writing;
+	int writingSize;
+	bool done = false;
+	while( !done )
+	{
+		{
+			QMutexLocker locker( &mutex );
+			if( !stopping && pendingSize < FLUSH_SIZE )
+				wake.wait( &mutex, FLUSH_MS );
+			qSwap( pending, writing );
+			writingSize = pendingSize;
+			pendingSize = 0;
+			done = stopping;
+		}
+		if( writingSize )
+		{
+			file.write( writing.constData( ), writingSize );
+			file.flush( ); // and keep writing's buffer - it's the next pending
+		}
+	}
+}
+
+/*
+	Pick apart the record at the front of data.  Returns how many bytes it took
+	up, 0 if it's not all there, or -1 if it's not a record at all.
+*/
+int PacketCapture::parse( const char* data, int length, Record* record )
+{
+	if( length < PACKET_CAPTURE_HEADER_SIZE )
+		return 0;
+	const uchar* p = (const uchar*)data;
+	int recordLength = (int)qFromBigEndian<quint32>( p ) + 4;
+	int keyLength = p[14];
+	if( recordLength < PACKET_CAPTURE_HEADER_SIZE + keyLength || p[12] > ToBoard || p[13] > Usb )
+		return -1;
+	if( length < recordLength )
+		return 0;
+
+	record->time = (qint64)qFromBigEndian<quint64>( p + 4 );
+	record->direction = (Direction)p[12];
+	record->transport = (Transport)p[13];
+	record->key = data + PACKET_CAPTURE_HEADER_SIZE;
+	record->keyLength = keyLength;
+	record->packet = record->key + keyLength;
+	record->packetSize = recordLength - PACKET_CAPTURE_HEADER_SIZE - keyLength;
+	return recordLength;
+}
+
+// ns since the epoch - as fine as the platform will give us
+qint64 PacketCapture::nanoseconds( )
+{
+#if defined( Q_WS_WIN )
+	QDateTime t = QDateTime::currentDateTime( ).toUTC( );
+	return ( (qint64)t.toTime_t( ) * 1000 + t.time( ).msec( ) ) * 1000000;
+#elif defined( CLOCK_REALTIME )
+	struct timespec ts;
+	clock_gettime( CLOCK_REALTIME, &ts );
+	return (qint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+	struct timeval tv;
+	gettimeofday( &tv, NULL );
+	return (qint64)tv.tv_sec * 1000000000 + (qint64)tv.tv_usec * 1000;
+#endif
+}
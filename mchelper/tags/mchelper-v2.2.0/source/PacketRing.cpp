@@ -0,0 +1,110 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#include "PacketRing.h"
+#include <string.h>
+
+/*
+	One slot always stays empty, so that head == tail can only mean the ring
+	is empty - a ring of n slots holds n - 1 packets.
+*/
+PacketRing::PacketRing( int slots, int slotSize ) : buffers( slots + 1 ), lengths( slots + 1 )
+{
+	slotCount = slots + 1;
+	for( int i = 0; i < slotCount; i++ )
+		buffers[i].resize( slotSize );
+	slotBuffers = buffers.data( );
+	slotLengths = lengths.data( );
+}
+
+/*
+	Get the next free slot, with room for length bytes, or 0 if the ring is full.
+	Fill it in, then call endWrite( ) to hand it to the reader.
+*/
+char* PacketRing::beginWrite( int length )
+{
+	int t = tail.fetchAndAddRelaxed( 0 );
+	if( next( t ) == head.fetchAndAddAcquire( 0 ) )
+	{
+		overflows.fetchAndAddRelaxed( 1 );
+		return 0;
+	}
+	QByteArray& buffer = slotBuffers[t];
+	if( buffer.size( ) < length )
+		buffer.resize( length );
+	return buffer.data( );
+}
+
+void PacketRing::endWrite( int length )
+{
+	int t = tail.fetchAndAddRelaxed( 0 );
+	slotLengths[t] = length;
+	tail.fetchAndStoreRelease( next( t ) ); // publish the packet
+
+	packets.fetchAndAddRelaxed( 1 );
+	int waiting = packetsWaiting( );
+	if( waiting > highWater )
+		highWater.fetchAndStoreRelaxed( waiting );
+}
+
+bool PacketRing::write( const char* data, int length )
+{
+	char* slot = beginWrite( length );
+	if( slot == 0 )
+		return false;
+	memcpy( slot, data, length );
+	endWrite( length );
+	return true;
+}
+
+bool PacketRing::isPacketWaiting( )
+{
+	return head.fetchAndAddRelaxed( 0 ) != tail.fetchAndAddAcquire( 0 );
+}
+
+int PacketRing::packetsWaiting( )
+{
+	int waiting = tail.fetchAndAddAcquire( 0 ) - head.fetchAndAddAcquire( 0 );
+	return ( waiting < 0 ) ? waiting + slotCount : waiting;
+}
+
+int PacketRing::pendingPacketSize( )
+{
+	int h = head.fetchAndAddRelaxed( 0 );
+	if( h == tail.fetchAndAddAcquire( 0 ) )
+		return 0;
+	return slotLengths[h];
+}
+
+/*
+	Copy the oldest packet into buffer and free up its slot.
+	Returns its length, 0 if there wasn't one, or -1 if it didn't fit -
+	the packet is thrown away either way, so a bad one can't block the ring.
+*/
+int PacketRing::read( char* buffer, int size )
+{
+	int h = head.fetchAndAddRelaxed( 0 );
+	if( h == tail.fetchAndAddAcquire( 0 ) )
+		return 0;
+	int length = slotLengths[h];
+	if( length <= size )
+		memcpy( buffer, slotBuffers[h].constData( ), length );
+	else
+		length = -1;
+	head.fetchAndStoreRelease( next( h ) ); // hand the slot back to the writer
+	return length;
+}
@@ -21,22 +21,18 @@
 #include <QHostAddress>
 #include <QSettings>
 #include <QString>
-#include <QMutexLocker>
-
-#define COMM_TIMEOUT 3000
 
 PacketUdp::PacketUdp( )
 { 
-	timer = new QTimer(this);
 	socket = NULL;
-	lastMessage.clear( );
+	droppedReported = 0;
+	metrics = NULL;
 	packetReadyInterface = NULL;
-	connect( timer, SIGNAL(timeout()), this, SLOT( pingTimedOut( ) ) );
+	monitor = NULL;
 }
 
 PacketUdp::~PacketUdp( )
 {
-	delete timer;
 }
 
 PacketUdp::Status PacketUdp::open( ) //part of PacketInterface
@@ -45,13 +41,6 @@ PacketUdp::Status PacketUdp::open( ) //part of PacketInterface
   return OK;	
 }
 
-PacketUdp::Status PacketUdp::pingTimedOut( )
-{
-	timer->stop( );
-	monitor->deviceRemoved( socketKey );
-	return OK;
-}
-
 PacketUdp::Status PacketUdp::close( )	//part of PacketInterface
 {
 	if ( socket != 0 )
@@ -59,11 +48,6 @@ PacketUdp::Status PacketUdp::close( )	//part of PacketInterface
   return OK;
 }
 
-void PacketUdp::resetTimer( void )
-{
-	timer->start( COMM_TIMEOUT );
-}
-
 QString PacketUdp::getKey( )
 {
 	return socketKey;
@@ -88,14 +72,12 @@ PacketUdp::Status PacketUdp::sendPacket( char* packet, int length )	//part of Pa
 
 bool PacketUdp::isPacketWaiting( )	//part of PacketInterface
 {
-  QMutexLocker locker( &msgMutex );
-  return lastMessage.size( ) > 0;
+  return incoming.isPacketWaiting( );
 }
 
 int PacketUdp::pendingPacketSize( )
 {
-	QMutexLocker locker( &msgMutex );
-  return lastMessage.size( );
+  return incoming.pendingPacketSize( );
 }
 
 bool PacketUdp::isOpen( )
@@ -103,31 +85,48 @@ bool PacketUdp::isOpen( )
 	return socket != NULL;
 }
 
-void PacketUdp::processPacket( )	//slot to be called back automatically when datagrams are ready to be read
+/*
+	Slot to be called back when datagrams have been queued up.
+	Hand the board everything that's waiting in one go - each packetWaiting( ) takes one.
+*/
+void PacketUdp::processPacket( )
 {
-  if( packetReadyInterface != NULL )
-  	packetReadyInterface->packetWaiting( );
+  if( packetReadyInterface == NULL )
+    return;
+  while( incoming.isPacketWaiting( ) )
+    packetReadyInterface->packetWaiting( );
+
+  int dropped = incoming.overflowCount( );
+  if( dropped != droppedReported )
+  {
+    QString msg = QString( "Warning - %1 packets dropped, they arrived faster than they could be processed." ).arg( dropped - droppedReported );
+    messageInterface->messageThreadSafe( msg, MessageEvent::Warning, QString( remoteHostName ) );
+    if( metrics != NULL )
+      metrics->dropped->add( dropped - droppedReported );
+    droppedReported = dropped;
+  }
 }
 
 int PacketUdp::receivePacket( char* buffer, int size )
 {
-	QMutexLocker locker( &msgMutex );
-	int length = lastMessage.size( );
-	if( length > size )
+	int length = incoming.read( buffer, size );
+	if( length < 0 )
 	{
 		QString msg = QString( "Error - packet too large.");
 		messageInterface->messageThreadSafe( msg, MessageEvent::Error, QString("Ethernet") );
 		return 0;
 	}
-	memcpy( buffer, lastMessage.data( ), length );
-	lastMessage.clear( );
 	return length;
 }
 
-void PacketUdp::incomingMessage( QByteArray message )
+/*
+	Queue up a packet from the network monitor - it's dropped if the board
+	hasn't kept up and the queue is full.
+*/
+bool PacketUdp::incomingMessage( const char* data, int length )
 {
-	QMutexLocker locker( &msgMutex );
-	lastMessage = message;
+	heardFrom( monitor->tick( ) );
+	return incoming.write( data, length );
 }
 
 void PacketUdp::setRemoteHostInfo( QHostAddress* address, quint16 port )
@@ -143,6 +142,7 @@ void PacketUdp::setRemoteHostInfo( QHostAddress* address, quint16 port )
 void PacketUdp::setKey( QString key )
 {
 	socketKey = key;
+	metrics = Metrics::board( key );
 }
 
 void PacketUdp::setPacketReadyInterface( PacketReadyInterface* packetReadyInterface )
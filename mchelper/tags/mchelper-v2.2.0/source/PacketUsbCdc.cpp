@@ -16,27 +16,25 @@
 *********************************************************************************/
 
 #include "PacketUsbCdc.h"
-#include <QMutexLocker>
 
-// SLIP codes
-#define END             0300    // indicates end of packet 
-#define ESC             0333    // indicates byte stuffing 
-#define ESC_END         0334    // ESC ESC_END means END data byte 
-#define ESC_ESC         0335    // ESC ESC_ESC means ESC data byte 
-
-PacketUsbCdc::PacketUsbCdc( McHelperWindow* mainWindow, QApplication* application, MonitorInterface* monitor ) : QThread( )
+PacketUsbCdc::PacketUsbCdc( BridgeInterface* bridge, MonitorInterface* monitor ) : QThread( ), writer( this )
 {
-	this->mainWindow = mainWindow;
-	this->application = application;
+	this->bridge = bridge;
 	this->monitor = monitor;
 	packetReadyInterface = NULL;
 	exit = false;
-	currentPacket.clear( );
-	port = new UsbSerial( mainWindow );
+	inReactor = false;
+	readPosition = readLength = 0;
+	metrics = NULL;
+	slipErrorsReported = 0;
+	port = new UsbSerial( bridge );
 }
 
 PacketUsbCdc::~PacketUsbCdc( )
 {
+	writer.stop( ); // first - it lets go of a reactor thread waiting for room to send
+	if( inReactor ) // make sure it's not still reading from us
+		UsbReactor::instance( )->remove( this );
 	port->close( );
 	delete port;
 }
@@ -58,14 +56,19 @@ void PacketUsbCdc::run()
 
 		if( port->isOpen() ) // then, if open() succeeded, try to read
 		{
-			int packetLength = slipReceive( &currentPacket );
-			if( packetLength > 0 && packetReadyInterface )
-				packetReadyInterface->packetWaiting( );
+			int packetCount = slipReceive( );
+			if( packetCount > 0 && packetReadyInterface )
+			{
+				// hand over everything that came in with the last read - each call takes one packet
+				while( slip.isPacketWaiting( ) )
+					packetReadyInterface->packetWaiting( );
+			}
 			else
 			{
-				currentPacket.clear( );
+				slip.clear( );
 				msleep( 1 ); // usb is still open, but we didn't receive anything last time
 			}
+			countSlipErrors( );
 		}
 		else // usb isn't open...chill out.
 			msleep( 50 );
@@ -75,16 +78,69 @@ void PacketUsbCdc::run()
 
 int PacketUsbCdc::pendingPacketSize( )
 {
-	QMutexLocker locker( &packetMutex );
-	return currentPacket.size( );
+	return slip.pendingPacketSize( );
 }
 
 PacketUsbCdc::Status PacketUsbCdc::open( )
 {
-	if( UsbSerial::OK == port->open( ) )
-		return PacketInterface::OK;
-	else
+	if( UsbSerial::OK != port->open( ) )
 		return PacketInterface::ERROR_NOT_OPEN;
+	#ifdef Q_WS_LINUX
+	if( !inReactor )
+		inReactor = UsbReactor::instance( )->add( port->descriptor( ), this );
+	#endif
+	return PacketInterface::OK;
+}
+
+/*
+	Linux only - on the reactor's thread, when the port has something.
+	Read until there's nothing left, handing over packets as they're decoded,
+	since the reactor only comes back to us once there's more in the port.
+*/
+bool PacketUsbCdc::readable( qint64 wokeAt )
+{
+	while( !exit )
+	{
+		if( readPosition == readLength )
+		{
+			if( readBuffer.size( ) < USB_READ_SIZE )
+				readBuffer.resize( USB_READ_SIZE );
+			int got = port->read( readBuffer.data( ), readBuffer.size( ) );
+			if( got == UsbSerial::NOTHING_AVAILABLE )
+				break;
+			if( got <= 0 ) // it's been unplugged
+			{
+				monitor->deviceRemoved( port->name( ) );
+				return false;
+			}
+			readPosition = 0;
+			readLength = got;
+		}
+		readPosition += slip.decode( readBuffer.constData( ) + readPosition, readLength - readPosition );
+		while( slip.isPacketWaiting( ) )
+		{
+			if( packetReadyInterface == NULL ) // nobody to take them yet
+			{
+				slip.clear( );
+				break;
+			}
+			packetReadyInterface->packetWaiting( );
+			UsbReactor::instance( )->delivered( wokeAt );
+		}
+	}
+	countSlipErrors( );
+	return true;
+}
+
+void PacketUsbCdc::countSlipErrors( )
+{
+	if( slip.droppedPackets( ) != slipErrorsReported )
+	{
+		if( metrics == NULL )
+			metrics = Metrics::board( getKey( ) );
+		metrics->slipErrors->add( slip.droppedPackets( ) - slipErrorsReported );
+		slipErrorsReported = slip.droppedPackets( );
+	}
 }
 
 void PacketUsbCdc::setPortName( QString name )
@@ -95,6 +151,14 @@ void PacketUsbCdc::setPortName( QString name )
 PacketUsbCdc::Status PacketUsbCdc::close( )
 {
 	exit = true;
+	/*
+		Stop the writer before leaving the reactor - if the reactor's stuck in
+		writer.send( ) waiting for room, remove( ) would wait on it forever.  We
+		can be here on the writer's own thread, when a write has failed.
+	*/
+	writer.stop( );
+	if( inReactor )
+		UsbReactor::instance( )->remove( this );
 	while( isRunning( ) )
 		msleep( 5 ); // wait a second before returning, because we'll be deleted right after we're removed form the GUI
 	port->close( );
@@ -103,121 +167,75 @@ PacketUsbCdc::Status PacketUsbCdc::close( )
 
 PacketUsbCdc::Status PacketUsbCdc::sendPacket( char* packet, int length )
 {
-  if( exit == true )
+	if( exit == true || !writer.send( packet, length ) )
 		return PacketInterface::IO_ERROR;
-		
-	QByteArray outgoingPacket;
-	outgoingPacket.append( END ); // Flush out any spurious data that may have accumulated
-	int size = length;
-
-  while( size-- )
-  {
-    switch(*packet)
-		{
-			// if it's the same code as an END character, we send a special 
-			//two character code so as not to make the receiver think we sent an END
-			case END:
-				outgoingPacket.append( ESC );
-				outgoingPacket.append( ESC_END );
-				break;
-				// if it's the same code as an ESC character, we send a special 
-				//two character code so as not to make the receiver think we sent an ESC
-			case ESC:
-				outgoingPacket.append( ESC );
-				outgoingPacket.append( ESC_ESC );
-				break;
-				//otherwise, just send the character
-			default:
-				outgoingPacket.append( *packet );
-		}
-		packet++;
-	}
-	// tell the receiver that we're done sending the packet
-	outgoingPacket.append( END );
-	if( UsbSerial::OK != port->write( outgoingPacket.data( ), outgoingPacket.size( ) ) )
+	return PacketInterface::OK;
+}
+
+// on the writer's thread
+bool PacketUsbCdc::writeFrames( char* data, int length )
+{
+	if( UsbSerial::OK != port->write( data, length ) )
 	{
 		monitor->deviceRemoved( port->name() ); // shut ourselves down
-		return PacketInterface::IO_ERROR;
+		return false;
 	}
-	else
-		return PacketInterface::OK;
+	return true;
 }
 
 int PacketUsbCdc::getMoreBytes( )
 {
-	if( slipRxPacket.size( ) < 1 ) // if there's nothing left over from last time
+	if( readPosition < readLength ) // still working through the last read
+		return PacketInterface::OK;
+
+	readPosition = readLength = 0;
+	int available = port->bytesAvailable( );
+	if( available < 0 )
+		return -1;
+	if( available > 0 )
 	{
-		int available = port->bytesAvailable( );
-		if( available < 0 )
+		if( readBuffer.size( ) < available ) // only ever grows
+			readBuffer.resize( available );
+		int read = port->read( readBuffer.data( ), available );
+		if( read < 0 )
 			return -1;
-		if( available > 0 )
-		{
-			slipRxPacket.resize( available );
-			int read = port->read( slipRxPacket.data( ), slipRxPacket.size( ) );
-			if( read < 0 )
-				return -1;
-		}
+		readLength = read;
 	}
 	return PacketInterface::OK;
 }
 
-int PacketUsbCdc::slipReceive( QByteArray *packet )
+/*
+	Read whatever's waiting at the port and decode it.  Returns how many packets
+	are ready to be picked up, or -1 if something went wrong.
+	If the packet queue fills up partway through a read, the rest of the read is
+	kept and decoded next time round, once the queue has been emptied.
+*/
+int PacketUsbCdc::slipReceive( )
 {
-  int started = 0, count = 0, finished = 0, i;
-
-  while ( true )
-  {
+	while( true )
+	{
 		if( exit == true )
-	  	return -1;
-	  	
+			return -1;
+
 		int status = getMoreBytes( );
 		if( status != PacketInterface::OK )
 			return -1;
-		
-		int size = slipRxPacket.size( );
-		if( size > 0 )
+
+		if( readPosition < readLength )
 		{
-			QMutexLocker locker( &packetMutex );
-			for( i = 0; i < size; i++ )
-			{
-				char c = *slipRxPacket.data( );
-				switch( c )
-				{
-					case END:
-						if( started && count ) // it was the END byte
-							finished = true; // We're done now if we had received any characters
-						else // skipping all starting END bytes
-							started = true;
-						break;					
-					case ESC:
-						// if it's the same code as an ESC character, we just want to skip it and 
-						// stick the next byte in the packet
-						slipRxPacket.remove( 0, 1 );
-						c = *slipRxPacket.data( );
-						// no break here, just stick it in the packet		
-					default:
-						if( started )
-						{
-							packet->append( c );
-							count++;
-						}
-						break;
-				}
-				slipRxPacket.remove( 0, 1 );
-				if( finished )
-					return count;
-			}
+			readPosition += slip.decode( readBuffer.constData( ) + readPosition, readLength - readPosition );
+			if( slip.isPacketWaiting( ) )
+				return slip.packetsWaiting( );
 		}
-    else // if we didn't get anything, sleep...otherwise just rip through again
-    	msleep( 1 );
-  }
-  return PacketInterface::IO_ERROR; // should never get here
+		else // if we didn't get anything, sleep...otherwise just rip through again
+			msleep( 1 );
+	}
+	return PacketInterface::IO_ERROR; // should never get here
 }
 
 bool PacketUsbCdc::isPacketWaiting( )
 {
-  QMutexLocker locker( &packetMutex );
-	  return currentPacket.size( ) > 0;
+	return slip.isPacketWaiting( );
 }
 
 bool PacketUsbCdc::isOpen( )
@@ -227,20 +245,12 @@ bool PacketUsbCdc::isOpen( )
 
 int PacketUsbCdc::receivePacket( char* buffer, int size )
 {
-	int retval = 0;
-	QMutexLocker locker( &packetMutex );
-	
-	if( !currentPacket.size() || currentPacket.size( ) > size )
+	int retval = slip.takePacket( buffer, size );
+	if( retval <= 0 )
 	{
 		QString msg = QString( "Error receiving packet.");
-		mainWindow->messageThreadSafe( msg, MessageEvent::Error);
+		bridge->messageThreadSafe( msg, MessageEvent::Error);
 		return 0;
-	} 
-	else
-	{
-  	memcpy( buffer, currentPacket.data( ), currentPacket.size( ) );
-		retval = currentPacket.size( );
-		currentPacket.clear( );
 	}
 	return retval;
 }
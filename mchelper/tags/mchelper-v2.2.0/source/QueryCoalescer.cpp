@@ -0,0 +1,150 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#include "QueryCoalescer.h"
+#include <QMutexLocker>
+#include <string.h>
+#include "Osc.h"
+#include "OscBinaryFrame.h"
+#include "OscXmlWriter.h"
+#include "OscXmlServer.h"
+
+#define QUERY_TIMEOUT_MS 250
+
+QueryCoalescer::QueryCoalescer( )
+{
+	queryCount = Metrics::instance( )->counter( "mchelper_client_queries_total", "Queries from clients for a board's values" );
+	mergedCount = Metrics::instance( )->counter( "mchelper_client_queries_merged_total", "Client queries merged with the same query already sent to the board" );
+}
+
+bool QueryCoalescer::hasBoard( const QString& board )
+{
+	QMutexLocker locker( &mutex );
+	return boards.contains( board );
+}
+
+bool QueryCoalescer::join( const QString& board, const QList<QByteArray>& queries, OscXmlClient* client )
+{
+	if( queries.isEmpty( ) )
+		return false;
+	qint64 now = OscBinaryFrame::now( );
+	QMutexLocker locker( &mutex );
+	QHash<QString, BoardQueries>::iterator b = boards.find( board );
+	if( b == boards.end( ) ) // gone since the client looked
+		return false;
+	BoardQueries& pending = b.value( );
+	queryCount->add( queries.size( ) );
+
+	bool allPending = true;
+	for( int i = 0; i < queries.size( ) && allPending; i++ )
+	{
+		BoardQueries::const_iterator it = pending.constFind( queries.at( i ) );
+		allPending = ( it != pending.constEnd( ) && now - it.value( ).sent < QUERY_TIMEOUT_MS );
+	}
+
+	for( int i = 0; i < queries.size( ); i++ )
+	{
+		InFlight& q = pending[ queries.at( i ) ];
+		if( now - q.sent >= QUERY_TIMEOUT_MS ) // a new one, or it's been so long the board's not going to answer
+		{
+			q.sent = now;
+			q.waiting.clear( );
+		}
+		if( !q.waiting.contains( client ) )
+			q.waiting.append( client );
+	}
+	if( allPending )
+		mergedCount->add( queries.size( ) );
+	return allPending;
+}
+
+void QueryCoalescer::removeClient( OscXmlClient* client )
+{
+	QMutexLocker locker( &mutex );
+	QHash<QString, BoardQueries>::iterator b;
+	for( b = boards.begin( ); b != boards.end( ); ++b )
+	{
+		BoardQueries::iterator it;
+		for( it = b.value( ).begin( ); it != b.value( ).end( ); ++it )
+			it.value( ).waiting.removeAll( client );
+	}
+}
+
+bool QueryCoalescer::answer( const QString& board, const OscDecoder& decoder, const QVector<int>& messages,
+															const char* packet, int size, int port )
+{
+	if( messages.isEmpty( ) )
+		return false;
+	QMutexLocker locker( &mutex );
+	QHash<QString, BoardQueries>::iterator b = boards.find( board );
+	if( b == boards.end( ) || b.value( ).isEmpty( ) )
+		return false;
+
+	QList<OscXmlClient*> waiting;
+	bool allAnswers = true;
+	for( int i = 0; i < messages.size( ); i++ )
+	{
+		const char* address = decoder.message( messages.at( i ) ).address;
+		BoardQueries::iterator it = b.value( ).find( QByteArray::fromRawData( address, strlen( address ) ) );
+		if( it == b.value( ).end( ) )
+		{
+			allAnswers = false;
+			continue;
+		}
+		for( int j = 0; j < it.value( ).waiting.size( ); j++ )
+		{
+			if( !waiting.contains( it.value( ).waiting.at( j ) ) )
+				waiting.append( it.value( ).waiting.at( j ) );
+		}
+		b.value( ).erase( it ); // answered either way - if it goes to everybody, the waiting clients get it too
+	}
+	if( !allAnswers || waiting.isEmpty( ) )
+		return false;
+
+	// each format gets made once, and only if somebody wants it
+	QByteArray xml, frame;
+	for( int i = 0; i < waiting.size( ); i++ )
+	{
+		OscXmlClient* client = waiting.at( i );
+		if( client->isBinary( ) )
+		{
+			if( frame.isEmpty( ) )
+				frame = OscBinaryFrame::create( packet, size, board.toAscii( ), port, OscBinaryFrame::now( ) );
+			client->sendOscFrame( frame );
+		}
+		else
+		{
+			if( xml.isEmpty( ) )
+				xml = OscXmlWriter::packet( decoder, board, port );
+			client->sendXmlDocument( xml );
+		}
+	}
+	return true;
+}
+
+void QueryCoalescer::addBoard( const QString& board )
+{
+	QMutexLocker locker( &mutex );
+	if( !boards.contains( board ) )
+		boards.insert( board, BoardQueries( ) );
+}
+
+void QueryCoalescer::removeBoard( const QString& board )
+{
+	QMutexLocker locker( &mutex );
+	boards.remove( board );
+}
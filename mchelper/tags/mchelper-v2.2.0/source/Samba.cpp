@@ -24,6 +24,9 @@
  */
 
 #include "Samba.h"
+#include <QDir>
+#include <QFile>
+#include <QStringList>
 #include "stdio.h"
 #include "errno.h"
 #include <string.h>
@@ -123,6 +126,8 @@ Samba::Samba( SambaMonitor* monitor, MessageInterface* messageInterface )
 	#endif
 	this->monitor = monitor;
 	this->messageInterface = messageInterface;
+	legacyUpload = false;
+	deltaUpload = false;
 }
 
 
@@ -151,16 +156,25 @@ Samba::Status Samba::disconnect( )
 
 Samba::Status Samba::flashUpload( char* bin_file )
 {
-  struct stat stbuf;
-  size_t loader_len;
-  size_t file_len;
-  size_t i;
-  uint8_t *buff;
-  void* file_fd;
-  int read_len;
+  FirmwareImage image;
+  FirmwareImage::Status status = image.load( bin_file );
+  if( status != FirmwareImage::OK ) {
+    printf( "%s: %s\n", bin_file, FirmwareImage::statusString( status ).toLocal8Bit( ).constData( ) );
+    switch( status ) {
+      case FirmwareImage::ERROR_NOT_FOUND: return ERROR_COULDNT_FIND_FILE;
+      case FirmwareImage::ERROR_COULDNT_OPEN: return ERROR_COULDNT_OPEN_FILE;
+      default: return ERROR_BAD_IMAGE;
+    }
+  }
+  return flashUpload( image );
+}
+
+// image is only read, so any number of boards can be uploading from it at once
+Samba::Status Samba::flashUpload( const FirmwareImage& image )
+{
   int ps = samba_chip_info.page_size;
   uint8_t *loader_data;
-  int block = 0;
+  int loader_len;
 	uploadProgress = 0;
 	
 	uploader->showStatus( QString( "Starting upload...don't disconnect board."), 3000 );
@@ -174,80 +188,23 @@ Samba::Status Samba::flashUpload( char* bin_file )
     return ERROR_INCORRECT_CHIP_INFO;
   }
 
-  if( stat( bin_file, &stbuf ) < 0 ) {
-    printf( "%s not found\n", bin_file );
-    return ERROR_COULDNT_FIND_FILE;
-  }
-
-  file_len = stbuf.st_size;
-
-  if( (buff = (uint8_t *) malloc( ps ) ) == NULL ) {
-    printf( "can't alocate buffer of size 0x%x\n",  ps );
-    goto error0;
-  }
+  SambaFlasher flasher( this, ps );
+  flasher.setLegacy( legacyUpload );
+  flasher.setDelta( deltaUpload );
+  SambaFlasher::Status status = flasher.upload( loader_data, loader_len, image.data( ), image.size( ) );
 
-  if( this->sendFile( 0x00201600, loader_data, loader_len ) < 0 ) {
-    printf( "could not upload samba.bin\n" );
-    goto error1;
+  if( status == SambaFlasher::ERROR_VERIFYING ) {
+    printf( "flash doesn't match the image after writing %d pages\n", flasher.timing( ).pages );
+    return ERROR_VERIFYING;
   }
-  
-  if( (file_fd = fileOpen( bin_file ) ) == 0 ) {
-    printf( "could not open %s\n", bin_file );
-    return ERROR_COULDNT_OPEN_FILE ;
-  }
-
-  // messageInterface->message( 3, "    " );
-
-  for( i=0 ; i<file_len ; i+=ps ) {
-    /* set page # */
-    if( writeWord( 0x00201400+ps, i/ps ) < 0 ) {
-      printf( "could not write page %d address\n", (int) i/ps );
-      goto error2;
-    }
-    
-    read_len = ((int)(file_len-i) < ps)?file_len-i:ps;
-    /* XXX need to implement safe read */
-    int r;
-    if( ( r = fileRead( file_fd, (char*)buff, read_len ) ) < read_len ) {
-      printf( "could not read 0x%x bytes from file, just got %d\n", read_len, r );
-      goto error2;
-    }
-
-    if( sendFile( 0x00201400, buff, ps ) < 0 ) {
-      printf( "could not send page %d\n", (int) i/ps );
-      goto error2;
-    }
-
-    if( go( 0x00201600 ) < 0 ) {
-      printf( "could not send go command for page %d\n", (int) i/ps );
-      goto error2;
-    }
-    
-    //(Every 20k)
-    if ( (++block)%5==0 )
-		{
-      //messageInterface->message( 1, "." );
-			uploadProgress = int(1000 * i / file_len);
-			uploader->progress( uploadProgress );
-		}
+  if( status != SambaFlasher::OK ) {
+    printf( "upload stopped after %d pages (%d)\n", flasher.timing( ).pages, status );
+    return ERROR_SENDING_FILE;
   }
-  
-  free( buff );
-  fileClose( file_fd );
- 
-  
-  //messageInterface->message( 3, "\n" );
 
+  messageInterface->messageThreadSafe( QString( "Usb> Uploaded %1" ).arg( flasher.timingString( ) ),
+                                       MessageEvent::Info, QString( "USB" ) );
   return OK;
-
- error2:
-  fileClose( file_fd );
-
- error1:
-  free( buff );
-
- error0:
-  return ERROR_SENDING_FILE;
 }
 
 Samba::Status Samba::bootFromFlash( )
@@ -318,6 +275,53 @@ void Samba::setDeviceKey( QString key )
 	this->deviceKey = key;
 }
 
+void Samba::setLegacyUpload( bool legacy )
+{
+	legacyUpload = legacy;
+}
+
+void Samba::setDeltaUpload( bool delta )
+{
+	deltaUpload = delta;
+}
+
+int Samba::write( const char* data, int length )
+{
+	#ifdef Q_WS_WIN
+	return ( usbWrite( (char*)data, length ) == FC_OK ) ? length : -1;
+	#else
+	return ( usbWrite( (char*)data, length ) < length ) ? -1 : length;
+	#endif
+}
+
+int Samba::read( char* data, int length )
+{
+	#ifdef Q_WS_WIN
+	return ( usbRead( data, length ) == FC_OK ) ? length : -1;
+	#else
+	int got = 0;
+	while( got < length )
+	{
+		int r = usbRead( data + got, length - got );
+		if( r <= 0 )
+			return -1;
+		got += r;
+	}
+	return got;
+	#endif
+}
+
+void Samba::pause( int usecs )
+{
+	uSleep( usecs );
+}
+
+void Samba::progress( int value )
+{
+	uploadProgress = value;
+	uploader->progress( uploadProgress );
+}
+
 int Samba::init( )
 {
   
@@ -429,31 +433,6 @@ int Samba::readWord( uint32_t addr, uint32_t *value )
   return err; 
 }
 
-int Samba::sendFile( uint32_t addr, uint8_t *buff, int len )
-{
-  char cmd[64];
-  int i=0;
-
-  snprintf( cmd, 64, "S%X,%X#", (unsigned int) addr, (unsigned int) len );
-
-  if( usbWrite( cmd, strlen( cmd ) ) < 0 ) {
-    return -1;
-  }
-
-  uSleep( 2000 );
-  
-  for( i=0 ; i<len ; i+=64 ) 
-  {
-    if( usbWrite( (char*)buff+i, (len-i < 64)? len-i : 64 ) < 0 )
-    {
-      return -1;
-    }
-    uSleep( 2000 );
-  }
-  
-  return 0;
-}
-
 int Samba::writeWord( uint32_t addr, uint32_t value )
 {
   char cmd[64];
@@ -464,14 +443,6 @@ int Samba::writeWord( uint32_t addr, uint32_t value )
   return sendCommand( cmd, NULL, 0 );
 }
 
-int Samba::go( uint32_t addr )
-{
-  char cmd[64];
-  snprintf( cmd, 64, "G%08X#", (unsigned int) addr );
-
-  return sendCommand( cmd, NULL, 0 );
-}
-
 int Samba::sendCommand( char *cmd, void *response, int response_len )
 {
   
@@ -518,88 +489,30 @@ void Samba::uSleep( int usecs )
   #endif
 }
 
-void* Samba::fileOpen( char* name )
-{
-  #ifdef Q_WS_WIN
-    HANDLE f = ::CreateFileA( name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
-    if ( f == INVALID_HANDLE_VALUE ) 
-    {
-      return 0;
-    }
-    return (void*)f;
-  #endif
-  #ifdef Q_WS_MAC
-    int file_fd;
-    if( (file_fd = open( name, O_RDONLY )) < 0 ) 
-    {
-      printf( "can't open %s\n", name );
-      return 0;
-    }
-    return (void*)file_fd;
-  #endif
-  #ifdef Q_WS_LINUX
-    int file_fd;
-    if( (file_fd = open( name, O_RDONLY )) < 0 ) 
-    {
-      printf( "can't open %s\n", name );
-      return 0;
-    }
-    return (void*)file_fd;
-  #endif
-}
-
-int Samba::fileRead( void* file_fd, char* buff, int length )
-{
-  int r = 1;
-  #ifdef Q_WS_WIN
-    DWORD read;
-    if ( !::ReadFile( (HANDLE)file_fd, buff, length, &read, NULL ) )
-      return -1;
-    return (int)read;
-  #endif
-  #ifdef Q_WS_MAC
-    if( ( r = read( (int)file_fd, buff, length ) ) < length )
-      return -1;
-  #endif
-  #ifdef Q_WS_LINUX
-    if( ( r = read( (int)file_fd, buff, length ) ) < length )
-      return -1;
-  #endif
-  return r;
-}
-
-
-void Samba::fileClose( void* file_fd )
-{
-  #ifdef Q_WS_WIN
-    CloseHandle( (HANDLE)file_fd );
-  #endif
-  #ifdef Q_WS_MAC
-    close( (int)file_fd );
-  #endif
-  #ifdef Q_WS_LINUX
-    close( (int)file_fd );
-  #endif
-}
-
 /*
  * USB FUNCTIONS BELOW
  */
 
 #define SAM7_TTY "/dev/at91_0"
+#define SAM7_READ_TIMEOUT 1000 // ms
 
 int Samba::usbOpen( QString key )
 {
   // Linux-only
   #if (defined(Q_WS_LINUX))
-  char *dev = NULL;
-  if( dev == NULL ) {
-    dev = SAM7_TTY;
-  }
+  // a device path works too - handy for pointing at a pty instead of a board
+  QByteArray path = key.toLocal8Bit( );
+  const char *dev = key.startsWith( "/dev/" ) ? path.constData( ) : SAM7_TTY;
   if( (io_fd = open( dev, O_RDWR )) < 0 ) {
     printf( "can't open \"%s\": %s\n", dev, strerror( errno ) );
     return -1;
   }
+  struct termios options; // cdc_acm gives us a tty - don't let it mangle the binary
+  if( tcgetattr( io_fd, &options ) == 0 )
+  {
+    cfmakeraw( &options );
+    tcsetattr( io_fd, TCSANOW, &options );
+  }
   return init();
   #endif
 
@@ -726,7 +639,7 @@ int Samba::usbWrite( char* buffer, int length )
   int ret;
 
   while( write_len < length ) {
-    if( (ret = write( io_fd, buffer + write_len, length - write_len )) < 0 ) {
+    if( (ret = ::write( io_fd, buffer + write_len, length - write_len )) < 0 ) {
       return -1;
     }
     write_len += ret;
@@ -767,11 +680,17 @@ int Samba::usbRead( char* buffer, int length )
 {
   // Linux-only...
   #ifdef Q_WS_LINUX
-  uint32_t size;
-
-  size =  read( io_fd, buffer, length );
+  // don't hang forever if the board's gone quiet
+  fd_set readable;
+  struct timeval timeout;
+  FD_ZERO( &readable );
+  FD_SET( io_fd, &readable );
+  timeout.tv_sec = SAM7_READ_TIMEOUT / 1000;
+  timeout.tv_usec = ( SAM7_READ_TIMEOUT % 1000 ) * 1000;
+  if( select( io_fd + 1, &readable, NULL, NULL, &timeout ) <= 0 )
+    return -1;
 
-  return (int)size;
+  return (int)::read( io_fd, buffer, length );
   #endif  /* Linux-only usbWrite( ) */
 
   // Mac-only...
@@ -1068,6 +987,30 @@ int Samba::FindUsbDevices( QList<QString>* arrived )
 
   return count;
 	#endif // Windows-only FindUsbDevices( )
+
+	#ifdef Q_WS_LINUX
+	// the at91 driver makes /dev/at91_n, and newer kernels hand the boot agent to cdc_acm instead
+	int count = 0;
+	QStringList nodes = QDir( "/dev" ).entryList( QStringList( "at91_*" ), QDir::System );
+	for( int i = 0; i < nodes.size( ); i++ )
+	{
+		arrived->append( "/dev/" + nodes.at( i ) );
+		count++;
+	}
+	QStringList ttys = QDir( "/sys/class/tty" ).entryList( QStringList( "ttyACM*" ) );
+	for( int i = 0; i < ttys.size( ); i++ )
+	{
+		QFile vendor( QString( "/sys/class/tty/%1/device/../idVendor" ).arg( ttys.at( i ) ) );
+		QFile product( QString( "/sys/class/tty/%1/device/../idProduct" ).arg( ttys.at( i ) ) );
+		if( vendor.open( QIODevice::ReadOnly ) && vendor.readAll( ).startsWith( "03eb" ) &&
+				product.open( QIODevice::ReadOnly ) && product.readAll( ).startsWith( "6124" ) )
+		{
+			arrived->append( "/dev/" + ttys.at( i ) );
+			count++;
+		}
+	}
+	return count;
+	#endif // Linux-only FindUsbDevices( )
 }
 
 #ifdef Q_WS_WIN
@@ -0,0 +1,265 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#include "SambaFlasher.h"
+#include <QTime>
+#include <QByteArray>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef Q_OS_WIN
+#include <sys/time.h>
+#endif
+
+#define LEGACY_CHUNK 64
+#define LEGACY_SLEEP 2000
+
+SambaFlasher::SambaFlasher( Port* port, int pageSize )
+{
+	this->port = port;
+	this->pageSize = pageSize;
+	depth = SAMBA_PIPELINE_DEPTH;
+	legacy = false;
+	delta = false;
+	memset( &times, 0, sizeof( times ) );
+}
+
+/*
+	Send the loader, then every page of the image - or in delta mode, only the
+	ones that aren't in flash already.
+	In pipelined mode, each page is followed by a read of its page number which
+	we pick up once we're depth pages ahead.
+*/
+SambaFlasher::Status SambaFlasher::upload( const uint8_t* loader, int loaderLength, const char* image, int imageLength )
+{
+	memset( &times, 0, sizeof( times ) );
+	qint64 start = microseconds( );
+	Status status = OK;
+	int outstanding = 0;
+	int pages = ( imageLength + pageSize - 1 ) / pageSize;
+	QVector<int> toWrite;
+	if( delta )
+		status = changedPages( image, imageLength, &toWrite );
+	else
+	{
+		for( int i = 0; i < pages; i++ )
+			toWrite.append( i );
+	}
+	times.skipped = ( status == OK ) ? pages - toWrite.size( ) : 0;
+	if( status != OK || toWrite.isEmpty( ) )
+	{
+		times.total = microseconds( ) - start;
+		return status;
+	}
+	page = new char[ pageSize ];
+
+	qint64 loaderStart = microseconds( );
+	if( sendFile( SAMBA_LOADER_ADDRESS, (const char*)loader, loaderLength ) < 0 )
+		status = ERROR_WRITING;
+	times.loader = microseconds( ) - loaderStart;
+
+	for( int n = 0; n < toWrite.size( ) && status == OK; n++ )
+	{
+		int i = toWrite.at( n );
+		qint64 pageStart = microseconds( );
+		int length = qMin( pageSize, imageLength - i * pageSize );
+		memcpy( page, image + i * pageSize, length );
+		if( length < pageSize ) // the last one - pad it out the way erased flash looks
+			memset( page + length, 0xFF, pageSize - length );
+
+		if( writeWord( SAMBA_PAGE_BUFFER + pageSize, i ) < 0 ||
+				sendFile( SAMBA_PAGE_BUFFER, page, pageSize ) < 0 ||
+				go( SAMBA_LOADER_ADDRESS ) < 0 )
+		{
+			status = ERROR_WRITING;
+			break;
+		}
+		if( !legacy )
+		{
+			if( requestAck( ) < 0 )
+			{
+				status = ERROR_WRITING;
+				break;
+			}
+			outstanding++;
+		}
+		times.sending += microseconds( ) - pageStart;
+
+		// the acks come back in order, so the oldest one is for the page written outstanding - 1 ago
+		while( outstanding >= depth && status == OK )
+		{
+			status = waitAck( toWrite.at( n - outstanding + 1 ) );
+			outstanding--;
+		}
+		times.pages++;
+
+		if( ( n % 20 ) == 0 )
+			port->progress( 1000 * n / toWrite.size( ) );
+	}
+
+	// make sure the last few have landed before anybody goes resetting the board
+	while( outstanding > 0 && status == OK )
+	{
+		status = waitAck( toWrite.at( toWrite.size( ) - outstanding ) );
+		outstanding--;
+	}
+
+	delete [] page;
+	if( delta && status == OK )
+		status = verify( image, imageLength );
+	times.total = microseconds( ) - start;
+	return status;
+}
+
+QString SambaFlasher::timingString( ) const
+{
+	double seconds = times.total / 1000000.0;
+	QString s = QString( "%1 pages in %2 ms (loader %3 ms, sending %4 ms, waiting %5 ms) - %6 KB/s" )
+			.arg( times.pages )
+			.arg( times.total / 1000 )
+			.arg( times.loader / 1000 )
+			.arg( times.sending / 1000 )
+			.arg( times.waiting / 1000 )
+			.arg( seconds > 0 ? ( times.pages * pageSize / 1024.0 ) / seconds : 0.0, 0, 'f', 1 );
+	if( !delta )
+		return s;
+	s += QString( ", %1 unchanged pages skipped, %2 ms reading flash" ).arg( times.skipped ).arg( times.reading / 1000 );
+	// going by what the pages that did get written took each
+	if( times.pages > 0 && times.skipped > 0 )
+		s += QString( " - about %1 ms saved" )
+				.arg( ( times.sending + times.waiting ) / times.pages * times.skipped / 1000 - times.reading / 1000 );
+	return s;
+}
+
+qint64 SambaFlasher::microseconds( )
+{
+	#ifdef Q_OS_WIN
+	return (qint64)QTime( 0, 0 ).msecsTo( QTime::currentTime( ) ) * 1000;
+	#else
+	struct timeval tv;
+	gettimeofday( &tv, NULL );
+	return (qint64)tv.tv_sec * 1000000 + tv.tv_usec;
+	#endif
+}
+
+/*
+	The header and the data go in separate writes, as SAM-BA expects,
+	but the data goes in one piece unless we're doing things the old way.
+*/
+int SambaFlasher::sendFile( uint32_t addr, const char* data, int length )
+{
+	char cmd[ 64 ];
+	snprintf( cmd, sizeof( cmd ), "S%X,%X#", (unsigned int)addr, (unsigned int)length );
+	if( command( cmd ) < 0 )
+		return -1;
+
+	if( !legacy )
+		return ( port->write( data, length ) < 0 ) ? -1 : 0;
+
+	for( int i = 0; i < length; i += LEGACY_CHUNK )
+	{
+		if( port->write( data + i, qMin( LEGACY_CHUNK, length - i ) ) < 0 )
+			return -1;
+		port->pause( LEGACY_SLEEP );
+	}
+	return 0;
+}
+
+int SambaFlasher::writeWord( uint32_t addr, uint32_t value )
+{
+	char cmd[ 64 ];
+	snprintf( cmd, sizeof( cmd ), "W%08X,%08X#", (unsigned int)addr, (unsigned int)value );
+	return command( cmd );
+}
+
+int SambaFlasher::go( uint32_t addr )
+{
+	char cmd[ 64 ];
+	snprintf( cmd, sizeof( cmd ), "G%08X#", (unsigned int)addr );
+	return command( cmd );
+}
+
+int SambaFlasher::command( const char* cmd )
+{
+	if( port->write( cmd, strlen( cmd ) ) < 0 )
+		return -1;
+	if( legacy )
+		port->pause( LEGACY_SLEEP );
+	return 0;
+}
+
+// ask for the page number back - it gets answered once the loader's done with the page
+int SambaFlasher::requestAck( )
+{
+	char cmd[ 64 ];
+	snprintf( cmd, sizeof( cmd ), "w%08X,4#", (unsigned int)( SAMBA_PAGE_BUFFER + pageSize ) );
+	return command( cmd );
+}
+
+SambaFlasher::Status SambaFlasher::waitAck( uint32_t expected )
+{
+	unsigned char response[ 4 ];
+	qint64 start = microseconds( );
+	int got = port->read( (char*)response, sizeof( response ) );
+	times.waiting += microseconds( ) - start;
+	if( got < (int)sizeof( response ) )
+		return ERROR_NO_ACK;
+	uint32_t value = response[ 0 ] | ( response[ 1 ] << 8 ) | ( response[ 2 ] << 16 ) | ( response[ 3 ] << 24 );
+	return ( value == expected ) ? OK : ERROR_WRONG_ACK;
+}
+
+// length bytes of flash from offset, in SAMBA_READ_CHUNK pieces
+int SambaFlasher::readFlash( uint32_t offset, char* data, int length )
+{
+	qint64 start = microseconds( );
+	int result = 0;
+	for( int done = 0; done < length && result == 0; done += SAMBA_READ_CHUNK )
+	{
+		int chunk = qMin( SAMBA_READ_CHUNK, length - done );
+		char cmd[ 64 ];
+		snprintf( cmd, sizeof( cmd ), "R%08X,%X#", (unsigned int)( SAMBA_FLASH_ADDRESS + offset + done ), (unsigned int)chunk );
+		if( command( cmd ) < 0 || port->read( data + done, chunk ) < chunk )
+			result = -1;
+	}
+	times.reading += microseconds( ) - start;
+	return result;
+}
+
+/*
+	Which pages of the image aren't in flash already.  Only the image's own
+	bytes count - whatever's after the end of it in the last page doesn't.
+*/
+SambaFlasher::Status SambaFlasher::changedPages( const char* image, int imageLength, QVector<int>* changed )
+{
+	QByteArray flash( imageLength, 0 );
+	if( readFlash( 0, flash.data( ), imageLength ) < 0 )
+		return ERROR_READING;
+	for( int offset = 0; offset < imageLength; offset += pageSize )
+	{
+		if( memcmp( flash.constData( ) + offset, image + offset, qMin( pageSize, imageLength - offset ) ) != 0 )
+			changed->append( offset / pageSize );
+	}
+	return OK;
+}
+
+SambaFlasher::Status SambaFlasher::verify( const char* image, int imageLength )
+{
+	QByteArray flash( imageLength, 0 );
+	if( readFlash( 0, flash.data( ), imageLength ) < 0 )
+		return ERROR_READING;
+	return ( memcmp( flash.constData( ), image, imageLength ) == 0 ) ? OK : ERROR_VERIFYING;
+}
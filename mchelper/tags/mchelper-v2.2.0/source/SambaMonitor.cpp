@@ -17,6 +17,8 @@
 
 #include "SambaMonitor.h"
 #include "BoardArrivalEvent.h"
+#include "HotplugWatcher.h"
+#include <QMutexLocker>
 
 SambaMonitor::SambaMonitor( QApplication* application, McHelperWindow* mainWindow ) : QThread( )
 {
@@ -31,6 +33,8 @@ SambaMonitor::~SambaMonitor( )
 
 void SambaMonitor::run( )
 {
+	HotplugWatcher watcher( QStringList( ) << "at91_*" << "ttyACM*" );
+	watcher.watch( "/dev" );
 	while( 1 )
 	{
 		QList<UploaderThread*> newBoards;
@@ -41,7 +45,7 @@ void SambaMonitor::run( )
 			event->uThread += newBoards;
 			application->postEvent( mainWindow, event );
 		}
-		sleep( 1 ); // check once a second
+		watcher.wait( ); // until a board comes or goes, or once a second if we can't tell
 	}
 }
 
@@ -52,6 +56,7 @@ int SambaMonitor::scan( QList<UploaderThread*>* arrived )
 	Samba* tempSamba = new Samba( this, mainWindow );
 	tempSamba->FindUsbDevices( &sambaDevices );
 	delete tempSamba;
+	QMutexLocker locker( &devicesMutex );
 
 	int i;
 	for( i=0; i < sambaDevices.size( ); i++ )
@@ -94,11 +99,28 @@ int SambaMonitor::scan( QList<UploaderThread*>* arrived )
 
 bool SambaMonitor::alreadyHas( QString key )
 {
+	QMutexLocker locker( &devicesMutex );
 	return connectedDevices.contains( key );
 }
 
+/*
+	Under the lock, so the board can't go away and take its uploader with it
+	between finding it and starting it.
+*/
+bool SambaMonitor::startUpload( QString key, const FirmwareImage* image, FlashBatch* batch )
+{
+	QMutexLocker locker( &devicesMutex );
+	UploaderThread* uploader = connectedDevices.value( key );
+	if( uploader == NULL || awaitingRemoval.contains( key ) || uploader->isRunning( ) )
+		return false;
+	uploader->setImage( image, batch );
+	uploader->start( );
+	return true;
+}
+
 void SambaMonitor::closeAll( )
 {
+	QMutexLocker locker( &devicesMutex );
 	QHash<QString, UploaderThread*>::iterator i = connectedDevices.begin( );
 	while( i != connectedDevices.end( ) )
 	{
@@ -111,6 +133,7 @@ void SambaMonitor::deviceRemoved( QString key )
 {
 	// the upload is complete, but the board has probably not been disconnected
 	// from the system...so it should be removed frmo the UI, but not from our internal list of connected devices.
+	QMutexLocker locker( &devicesMutex );
 	awaitingRemoval.append( key );
 	mainWindow->removeDeviceThreadSafe( key );
 }
@@ -0,0 +1,176 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#include "SlipDecoder.h"
+#include <QMutexLocker>
+#include <string.h>
+
+// SLIP codes
+#define END             0300    // indicates end of packet
+#define ESC             0333    // indicates byte stuffing
+#define ESC_END         0334    // ESC ESC_END means END data byte
+#define ESC_ESC         0335    // ESC ESC_ESC means ESC data byte
+
+/*
+	The ring has one more buffer than the queue can hold - the extra one is where
+	the packet currently being decoded gets built up.
+*/
+SlipDecoder::SlipDecoder( int maxPackets, int maxPacketSize ) : buffers( maxPackets + 1 ), lengths( maxPackets + 1 )
+{
+	this->maxPacketSize = maxPacketSize;
+	head = count = 0;
+	tail = 0;
+	partialLength = 0;
+	escaped = false;
+	oversized = false;
+	dropped = 0;
+}
+
+/*
+	Decode as much of data as we can, in a single pass, straight into the buffer
+	for the packet being built.
+	Returns how many bytes were used up - less than length only if the queue
+	filled up, in which case call again with the rest once it's been emptied out.
+*/
+int SlipDecoder::decode( const char* data, int length )
+{
+	const char* p = data;
+	const char* end = data + length;
+	while( p < end )
+	{
+		// a packet never decodes to more bytes than it took to encode it,
+		// so make room for the rest of the input up front
+		QByteArray& buffer = buffers[tail];
+		int needed = qMin( partialLength + (int)( end - p ), maxPacketSize );
+		if( buffer.size( ) < needed )
+			buffer.resize( qMin( qMax( needed, buffer.size( ) * 2 ), maxPacketSize ) );
+		char* start = buffer.data( );
+		char* out = start + partialLength;
+		char* limit = start + buffer.size( );
+		bool finished = false;
+
+		while( p < end )
+		{
+			char c = *p++;
+			if( escaped )
+			{
+				escaped = false;
+				if( c == (char)ESC_END )
+					c = (char)END;
+				else if( c == (char)ESC_ESC )
+					c = (char)ESC;
+			}
+			else if( c == (char)END )
+			{
+				finished = true;
+				break;
+			}
+			else if( c == (char)ESC )
+			{
+				escaped = true;
+				continue;
+			}
+
+			if( out < limit )
+				*out++ = c;
+			else
+				oversized = true; // skip the rest of this one
+		}
+		partialLength = out - start;
+
+		if( finished && !finishPacket( ) )
+			return ( p - 1 ) - data; // no room for the packet yet - leave the END for next time
+	}
+	return p - data;
+}
+
+/*
+	We've hit an END - move the packet we've been building into the queue.
+	Empty packets (back to back ENDs) are skipped, and oversized ones dropped.
+	Returns false if the queue is full, leaving the packet where it is.
+*/
+bool SlipDecoder::finishPacket( )
+{
+	if( oversized || partialLength == 0 )
+	{
+		if( oversized )
+			dropped++;
+		oversized = false;
+		partialLength = 0;
+		return true;
+	}
+
+	QMutexLocker locker( &queueMutex );
+	if( count == buffers.size( ) - 1 )
+		return false;
+	lengths[tail] = partialLength;
+	tail = ( tail + 1 ) % buffers.size( );
+	count++;
+	partialLength = 0;
+	return true;
+}
+
+bool SlipDecoder::isPacketWaiting( )
+{
+	QMutexLocker locker( &queueMutex );
+	return count > 0;
+}
+
+int SlipDecoder::packetsWaiting( )
+{
+	QMutexLocker locker( &queueMutex );
+	return count;
+}
+
+int SlipDecoder::pendingPacketSize( )
+{
+	QMutexLocker locker( &queueMutex );
+	return ( count > 0 ) ? lengths.at( head ) : 0;
+}
+
+/*
+	Copy the oldest packet into buffer and take it off the queue.
+	Returns its length, 0 if there wasn't one, or -1 if it didn't fit -
+	the packet is thrown away either way, so a bad one can't block the queue.
+*/
+int SlipDecoder::takePacket( char* buffer, int size )
+{
+	QMutexLocker locker( &queueMutex );
+	if( count == 0 )
+		return 0;
+	int length = lengths.at( head );
+	if( length <= size )
+		memcpy( buffer, buffers.at( head ).constData( ), length );
+	else
+		length = -1;
+	head = ( head + 1 ) % buffers.size( );
+	count--;
+	return length;
+}
+
+/*
+	Throw away everything - queued packets and any partial one.
+	Call this from the thread that's doing the decoding.
+*/
+void SlipDecoder::clear( )
+{
+	QMutexLocker locker( &queueMutex );
+	head = tail = count = 0;
+	partialLength = 0;
+	escaped = false;
+	oversized = false;
+}
@@ -0,0 +1,53 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#include "SlipEncoder.h"
+#include <string.h>
+
+// SLIP codes
+#define END             0300    // indicates end of packet
+#define ESC             0333    // indicates byte stuffing
+#define ESC_END         0334    // ESC ESC_END means END data byte
+#define ESC_ESC         0335    // ESC ESC_ESC means ESC data byte
+
+/*
+	END and ESC are both up above 0300, and most of an OSC packet is ASCII and
+	small numbers, so the scan only has to look harder at the odd byte.  Runs
+	of bytes that don't need escaping are copied in one go.
+*/
+int SlipEncoder::encode( const char* packet, int length, char* out )
+{
+	const unsigned char* p = (const unsigned char*)packet;
+	const unsigned char* end = p + length;
+	char* start = out;
+	*out++ = (char)END;
+	while( p < end )
+	{
+		const unsigned char* run = p;
+		while( p < end && ( *p < END || ( *p != END && *p != ESC ) ) )
+			p++;
+		memcpy( out, run, p - run );
+		out += p - run;
+		if( p == end )
+			break;
+		*out++ = (char)ESC;
+		*out++ = (char)( ( *p == END ) ? ESC_END : ESC_ESC );
+		p++;
+	}
+	*out++ = (char)END;
+	return (int)( out - start );
+}
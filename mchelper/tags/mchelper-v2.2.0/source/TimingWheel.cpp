@@ -0,0 +1,93 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#include "TimingWheel.h"
+
+#define WHEEL_MASK ( WHEEL_SLOTS - 1 )
+
+TimingWheel::TimingWheel( )
+{
+	for( int i = 0; i < WHEEL_SLOTS; i++ )
+		slots[ 0 ][ i ] = slots[ 1 ][ i ] = 0;
+	ticks = 0;
+}
+
+void TimingWheel::start( Timer* timer, int ticks )
+{
+	stop( timer );
+	int furthest = WHEEL_SLOTS * WHEEL_SLOTS - 1;
+	timer->expires = this->ticks + qBound( 1, ticks, furthest );
+	place( timer );
+}
+
+void TimingWheel::stop( Timer* timer )
+{
+	if( timer->slot == 0 )
+		return;
+	if( timer->prev != 0 )
+		timer->prev->next = timer->next;
+	else
+		*timer->slot = timer->next;
+	if( timer->next != 0 )
+		timer->next->prev = timer->prev;
+	timer->next = timer->prev = 0;
+	timer->slot = 0;
+}
+
+// onto the front of the list for the slot it expires in
+void TimingWheel::place( Timer* timer )
+{
+	quint32 until = timer->expires - ticks;
+	if( until < WHEEL_SLOTS )
+		timer->slot = &slots[ 0 ][ timer->expires & WHEEL_MASK ];
+	else
+		timer->slot = &slots[ 1 ][ ( timer->expires >> WHEEL_BITS ) & WHEEL_MASK ];
+	timer->prev = 0;
+	timer->next = *timer->slot;
+	if( timer->next != 0 )
+		timer->next->prev = timer;
+	*timer->slot = timer;
+}
+
+void TimingWheel::advance( QList<Timer*>* expired )
+{
+	ticks++;
+	if( ( ticks & WHEEL_MASK ) == 0 ) // round again - bring the next lot down from the second level
+	{
+		Timer** upper = &slots[ 1 ][ ( ticks >> WHEEL_BITS ) & WHEEL_MASK ];
+		Timer* t = *upper;
+		*upper = 0;
+		while( t != 0 )
+		{
+			Timer* next = t->next;
+			place( t );
+			t = next;
+		}
+	}
+
+	Timer** slot = &slots[ 0 ][ ticks & WHEEL_MASK ];
+	Timer* t = *slot;
+	*slot = 0;
+	while( t != 0 )
+	{
+		Timer* next = t->next;
+		t->next = t->prev = 0;
+		t->slot = 0;
+		expired->append( t );
+		t = next;
+	}
+}
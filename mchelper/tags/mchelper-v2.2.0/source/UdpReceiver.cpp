@@ -0,0 +1,290 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License, 
+ Version 2.0 (the "License"); you may not use this file except in compliance 
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0 
+ 
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#include "UdpReceiver.h"
+#include <QMetaType>
+#include <string.h>
+
+#ifdef Q_OS_LINUX
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#else
+#include <QUdpSocket>
+#include <QHostAddress>
+#endif
+
+// how long a read waits for something to arrive before checking whether we've been stopped
+#define RECEIVE_WAIT_MS 50
+
+UdpReceiver::UdpReceiver( ) : QThread( ), buffer( UDP_RECEIVE_BATCH * UDP_RECEIVE_SIZE, 0 )
+{
+	qRegisterMetaType<quint32>( "quint32" );
+	for( int i = 0; i < UDP_RECEIVE_BATCH; i++ )
+		data[i] = buffer.data( ) + i * UDP_RECEIVE_SIZE;
+	releaseHeld = false;
+	stopping = false;
+	#ifdef Q_OS_LINUX
+	fd = -1;
+	#else
+	socket = NULL;
+	#endif
+}
+
+UdpReceiver::~UdpReceiver( )
+{
+	stop( );
+}
+
+/*
+	Bind to port and start reading.  Returns false if we can't bind.
+*/
+bool UdpReceiver::open( int port )
+{
+	stop( );
+	#ifdef Q_OS_LINUX
+	fd = ::socket( AF_INET, SOCK_DGRAM, 0 );
+	if( fd < 0 )
+		return false;
+	int on = 1;
+	setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof( on ) );
+	setsockopt( fd, SOL_SOCKET, SO_BROADCAST, &on, sizeof( on ) );
+	int bufferSize = 1024 * 1024; // plenty of room to ride out a burst from a lot of boards
+	setsockopt( fd, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof( bufferSize ) );
+
+	struct sockaddr_in local;
+	memset( &local, 0, sizeof( local ) );
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = htonl( INADDR_ANY );
+	local.sin_port = htons( (quint16)port );
+	if( bind( fd, (struct sockaddr*)&local, sizeof( local ) ) < 0 )
+	{
+		closeSocket( );
+		return false;
+	}
+	#else
+	socket = new QUdpSocket( );
+	if( !socket->bind( port, QUdpSocket::ShareAddress ) )
+	{
+		closeSocket( );
+		return false;
+	}
+	socket->moveToThread( this );
+	#endif
+	stopping = false;
+	start( );
+	return true;
+}
+
+void UdpReceiver::stop( )
+{
+	stopping = true;
+	wait( );
+	closeSocket( );
+}
+
+void UdpReceiver::closeSocket( )
+{
+	#ifdef Q_OS_LINUX
+	if( fd >= 0 )
+		::close( fd );
+	fd = -1;
+	#else
+	delete socket;
+	socket = NULL;
+	#endif
+}
+
+/*
+	Datagrams that match this exactly are skipped - it's our own broadcast ping.
+	Set it before open( ).
+*/
+void UdpReceiver::setIgnoredPacket( const QByteArray& packet )
+{
+	ignored = packet;
+}
+
+void UdpReceiver::addDevice( quint32 address, DatagramInterface* device )
+{
+	QMutexLocker locker( &devicesLock );
+	devices.insert( address, device );
+	if( held.contains( address ) )
+		releaseHeld = true;
+}
+
+/*
+	Once this returns the thread won't touch device again, so it's safe to delete.
+*/
+void UdpReceiver::removeDevice( quint32 address )
+{
+	QMutexLocker locker( &devicesLock );
+	devices.remove( address );
+	if( held.contains( address ) )
+		dropped.fetchAndAddRelaxed( held.take( address ).count( ) );
+}
+
+void UdpReceiver::run( )
+{
+	DatagramInterface* ready[ UDP_RECEIVE_BATCH ];
+	while( !stopping )
+	{
+		int count = receiveBatch( );
+
+		QMutexLocker locker( &devicesLock );
+		if( releaseHeld )
+			deliverHeld( );
+		if( count <= 0 )
+			continue;
+		batches.fetchAndAddRelaxed( 1 );
+
+		int readyCount = 0;
+		for( int i = 0; i < count; i++ )
+		{
+			if( lengths[i] == ignored.size( ) && memcmp( data[i], ignored.constData( ), lengths[i] ) == 0 )
+				continue;
+			datagrams.fetchAndAddRelaxed( 1 );
+			DatagramInterface* device = devices.value( senders[i] );
+			if( device == NULL )
+			{
+				hold( senders[i], data[i], lengths[i] );
+				continue;
+			}
+			device->incomingMessage( data[i], lengths[i] );
+			int j = 0;
+			while( j < readyCount && ready[j] != device )
+				j++;
+			if( j == readyCount )
+				ready[ readyCount++ ] = device;
+		}
+		// then let each board work through everything it got
+		for( int i = 0; i < readyCount; i++ )
+			ready[i]->processPacket( );
+	}
+}
+
+void UdpReceiver::hold( quint32 address, const char* packet, int length )
+{
+	bool first = !held.contains( address );
+	QList<QByteArray>& packets = held[ address ];
+	if( packets.count( ) < UDP_HELD_PACKETS )
+		packets.append( QByteArray( packet, length ) );
+	else
+		dropped.fetchAndAddRelaxed( 1 );
+	if( first )
+		emit newSender( address );
+}
+
+// called with devicesLock held
+void UdpReceiver::deliverHeld( )
+{
+	releaseHeld = false;
+	QMutableHashIterator<quint32, QList<QByteArray> > i( held );
+	while( i.hasNext( ) )
+	{
+		i.next( );
+		DatagramInterface* device = devices.value( i.key( ) );
+		if( device == NULL )
+			continue;
+		const QList<QByteArray>& packets = i.value( );
+		for( int j = 0; j < packets.count( ); j++ )
+			device->incomingMessage( packets.at( j ).constData( ), packets.at( j ).size( ) );
+		device->processPacket( );
+		i.remove( );
+	}
+}
+
+#ifdef Q_OS_LINUX
+
+/*
+	Wait for something to show up, then take as much as there is, up to a
+	full batch, in one recvmmsg( ).  We poll( ) first rather than use the
+	recvmmsg( ) timeout, since that's only checked after each datagram arrives.
+*/
+int UdpReceiver::receiveBatch( )
+{
+	struct pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	if( poll( &pfd, 1, RECEIVE_WAIT_MS ) <= 0 )
+		return 0;
+
+	struct mmsghdr messages[ UDP_RECEIVE_BATCH ];
+	struct iovec iovecs[ UDP_RECEIVE_BATCH ];
+	struct sockaddr_in addresses[ UDP_RECEIVE_BATCH ];
+	memset( messages, 0, sizeof( messages ) );
+	for( int i = 0; i < UDP_RECEIVE_BATCH; i++ )
+	{
+		iovecs[i].iov_base = data[i];
+		iovecs[i].iov_len = UDP_RECEIVE_SIZE;
+		messages[i].msg_hdr.msg_iov = &iovecs[i];
+		messages[i].msg_hdr.msg_iovlen = 1;
+		messages[i].msg_hdr.msg_name = &addresses[i];
+		messages[i].msg_hdr.msg_namelen = sizeof( addresses[i] );
+	}
+	int count = recvmmsg( fd, messages, UDP_RECEIVE_BATCH, MSG_DONTWAIT, NULL );
+	if( count <= 0 )
+		return 0;
+
+	int kept = 0;
+	for( int i = 0; i < count; i++ )
+	{
+		if( messages[i].msg_hdr.msg_flags & MSG_TRUNC )
+		{
+			dropped.fetchAndAddRelaxed( 1 );
+			continue;
+		}
+		if( kept != i )
+			memcpy( data[kept], data[i], messages[i].msg_len );
+		lengths[kept] = messages[i].msg_len;
+		senders[kept] = ntohl( addresses[i].sin_addr.s_addr );
+		kept++;
+	}
+	return kept;
+}
+
+#else
+
+int UdpReceiver::receiveBatch( )
+{
+	if( !socket->hasPendingDatagrams( ) && !socket->waitForReadyRead( RECEIVE_WAIT_MS ) )
+		return 0;
+
+	int count = 0;
+	while( count < UDP_RECEIVE_BATCH && socket->hasPendingDatagrams( ) )
+	{
+		QHostAddress sender;
+		bool tooBig = socket->pendingDatagramSize( ) > UDP_RECEIVE_SIZE;
+		int length = socket->readDatagram( data[count], UDP_RECEIVE_SIZE, &sender );
+		if( length < 0 )
+			break;
+		if( tooBig )
+		{
+			dropped.fetchAndAddRelaxed( 1 );
+			continue;
+		}
+		lengths[count] = length;
+		senders[count] = sender.toIPv4Address( );
+		count++;
+	}
+	return count;
+}
+
+#endif // Q_OS_LINUX
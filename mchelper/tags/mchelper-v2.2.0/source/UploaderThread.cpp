@@ -24,6 +24,8 @@
  */
 
 #include "UploaderThread.h"
+#include <QSettings>
+#include "FlashBatch.h"
 
 UploaderThread::UploaderThread( QApplication* application, McHelperWindow* mainWindow, 
 								Samba* samba, SambaMonitor* monitor ) : QThread()
@@ -32,6 +34,8 @@ UploaderThread::UploaderThread( QApplication* application, McHelperWindow* mainW
   this->mainWindow = mainWindow;
 	this->samba = samba;
 	this->monitor = monitor;
+	image = NULL;
+	batch = NULL;
 }
 
 UploaderThread::~UploaderThread( )
@@ -50,10 +54,18 @@ void UploaderThread::run()
 		mainWindow->messageThreadSafe( QString( "  ** Make sure you've erased the current program, reset the power, and try again.") );
 		Samba::Status disconnectStatus;
 		disconnectStatus = samba->disconnect( );
+		if( batch != NULL )
+			batch->finished( deviceKey, false );
 		return;
 	}
 	
-	Samba::Status uploaderStatus = samba->flashUpload( bin_file );
+	// the old sleep-between-everything upload, in case a setup can't keep up with the pipelined one
+	QSettings settings("MakingThings", "mchelper");
+	samba->setLegacyUpload( settings.value( "legacySambaUpload", false ).toBool( ) );
+	// only write the pages that have changed since what's on the board now
+	samba->setDeltaUpload( settings.value( "deltaSambaUpload", false ).toBool( ) );
+
+	Samba::Status uploaderStatus = ( image != NULL ) ? samba->flashUpload( *image ) : samba->flashUpload( bin_file );
 	if ( uploaderStatus != Samba::OK )
   {
   	showStatus( QString( "Usb> Upload Failed." ), 2000 );
@@ -68,6 +80,16 @@ void UploaderThread::run()
 			mainWindow->messageThreadSafe( QString( 
 				"Usb> Upload Failed - Couldn't find or open the specified .bin file.") );
 			  break;
+  		case Samba::ERROR_BAD_IMAGE:
+			mainWindow->messageThreadSafe( QString( 
+				"Usb> Upload Failed - the .bin file doesn't look like firmware for this board.") );
+			  break;
+  		case Samba::ERROR_VERIFYING:
+			mainWindow->messageThreadSafe( QString( 
+				"Usb> Upload Failed - what's in flash doesn't match the .bin file.") );
+    		mainWindow->messageThreadSafe( QString( 
+    			"  ** Try again with delta uploads turned off.") );
+			  break;
   		case Samba::ERROR_SENDING_FILE:
 			mainWindow->messageThreadSafe( QString( 
 				"Usb> Upload Failed - Couldn't complete download.") );
@@ -90,8 +112,13 @@ void UploaderThread::run()
 	if ( samba->reset(  ) != Samba::OK )
 		mainWindow->messageThreadSafe( QString( "Usb> Could not switch to boot from flash.") );
 		
-	showStatus( QString( "Upload complete." ), 2000 );
-	progress( -1 );
+	if( batch != NULL ) // it keeps track of progress for all of them
+		batch->finished( deviceKey, uploaderStatus == Samba::OK );
+	else
+	{
+		showStatus( QString( "Upload complete." ), 2000 );
+		progress( -1 );
+	}
 	monitor->deviceRemoved( deviceKey );
 }
 
@@ -110,6 +137,12 @@ void UploaderThread::setBinFileName( char* filename )
 	bin_file = filename;
 }
 
+void UploaderThread::setImage( const FirmwareImage* image, FlashBatch* batch )
+{
+	this->image = image;
+	this->batch = batch;
+}
+
 void UploaderThread::setBootFromFlash( bool value )
 {
 	bootFromFlash = value;
@@ -123,6 +156,11 @@ void UploaderThread::showStatus( QString message, int duration )
 
 void UploaderThread::progress( int value )
 {
+	if( batch != NULL )
+	{
+		batch->progress( deviceKey, value );
+		return;
+	}
 	McHelperProgressEvent* mcHelperProgressEvent = new McHelperProgressEvent( value );
 	application->postEvent( mainWindow, mcHelperProgressEvent );
 }
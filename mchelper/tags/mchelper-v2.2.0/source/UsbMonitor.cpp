@@ -17,6 +17,12 @@
 
 #include "UsbMonitor.h"
 #include "BoardArrivalEvent.h"
+#include "HotplugWatcher.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
 
 #ifdef Q_WS_WIN // Windows-only
 #include <initguid.h>
@@ -25,11 +31,19 @@ DEFINE_GUID( GUID_MAKE_CTRL_KIT, 0x4D36E978, 0xE325, 0x11CE, 0xBF, 0xC1, 0x08, 0
 
 UsbMonitor::UsbMonitor( ) : QThread( )
 {
-	
+	writeWindowMs = 0;
 }
 
 void UsbMonitor::run( )
 {
+	QStringList patterns( "ttyACM*" );
+	for( int i = 0; i < extraPorts.size( ); i++ )
+		patterns.append( QFileInfo( extraPorts.at( i ) ).fileName( ) );
+	HotplugWatcher watcher( patterns );
+	watcher.watch( "/dev" );
+	for( int i = 0; i < extraPorts.size( ); i++ )
+		watcher.watch( QFileInfo( extraPorts.at( i ) ).absolutePath( ) );
+
 	while( 1 )
 	{
 		QList<PacketInterface*> newBoards;
@@ -38,9 +52,9 @@ void UsbMonitor::run( )
 		{
 			BoardArrivalEvent* event = new BoardArrivalEvent( Board::UsbSerial );
 			event->pInt += newBoards;
-			application->postEvent( mainWindow, event );
+			application->postEvent( bridge->notifier( ), event );
 		}
-		sleep( 1 ); // check once a second
+		watcher.wait( ); // until a board comes or goes, or once a second if we can't tell
 	}
 }
 
@@ -52,19 +66,20 @@ UsbMonitor::Status UsbMonitor::scan( QList<PacketInterface*>* arrived )
 
 void UsbMonitor::closeAll( )
 {	// app is shut down - close everything out.
-	QHash<QString, PacketUsbCdc*>::iterator i  = connectedDevices.begin( );
-	while( i != connectedDevices.end( ) )
+	QList<PacketUsbCdc*> devices;
 	{
-		i.value( )->close( );
-		++i;
+		QMutexLocker locker( &devicesMutex );
+		devices = connectedDevices.values( );
 	}
+	for( int i = 0; i < devices.size( ); i++ )
+		devices.at( i )->close( );
 }
 
-void UsbMonitor::setInterfaces( MessageInterface* messageInterface, QApplication* application, McHelperWindow* mainWindow )
+void UsbMonitor::setInterfaces( MessageInterface* messageInterface, QCoreApplication* application, BridgeInterface* bridge )
 {
 	this->messageInterface = messageInterface;
 	this->application = application;
-	this->mainWindow = mainWindow;
+	this->bridge = bridge;
 }
 
 void UsbMonitor::FindUsbDevices( QList<PacketInterface*>* arrived )
@@ -141,8 +156,9 @@ void UsbMonitor::FindUsbDevices( QList<PacketInterface*>* arrived )
 					QString portNameKey( path );
 					if( !connectedDevices.contains( portNameKey ) ) // make sure we don't already have this board in our list
 					{
-						PacketUsbCdc* device = new PacketUsbCdc( mainWindow, application, this );
+						PacketUsbCdc* device = new PacketUsbCdc( bridge, this );
 						device->setPortName( path );
+						device->setWriteWindow( writeWindowMs );
 						if( PacketInterface::OK == device->open( ) )
 						{
 							connectedDevices.insert( portNameKey, device );  // stick it in our own list of boards we know about
@@ -200,9 +216,10 @@ void UsbMonitor::FindUsbDevices( QList<PacketInterface*>* arrived )
 	      QString portNameKey( portName );
 	      if( !connectedDevices.contains( portNameKey ) ) // make sure we don't already have this board in our list
 	      {
-	      	PacketUsbCdc* device = new PacketUsbCdc( mainWindow, application, this );
+	      	PacketUsbCdc* device = new PacketUsbCdc( bridge, this );
 	     		device->setDeviceHandle( hOut );
 	     		device->setPortName( portName );
+	     		device->setWriteWindow( writeWindowMs );
 	     		if( PacketInterface::OK == device->open( ) )
 	     		{
 	     			connectedDevices.insert( portNameKey, device );  // stick it in our own list of boards we know about
@@ -224,7 +241,40 @@ void UsbMonitor::FindUsbDevices( QList<PacketInterface*>* arrived )
   SetupDiDestroyDeviceInfoList(hardwareDeviceInfo);
   return;
 	#endif // Windows-only FindUsbDevices( )
+	
+	#ifdef Q_WS_LINUX // Linux only
+	// cdc_acm makes each board a /dev/ttyACMn - its USB product name is up the tree in sysfs
+	QStringList ttys = QDir( "/sys/class/tty" ).entryList( QStringList( "ttyACM*" ) );
+	for( int i = 0; i < ttys.size( ); i++ )
+	{
+		QFile product( QString( "/sys/class/tty/%1/device/../product" ).arg( ttys.at( i ) ) );
+		if( product.open( QIODevice::ReadOnly ) && product.readAll( ).startsWith( "Make Controller Kit" ) )
+			addLinuxDevice( "/dev/" + ttys.at( i ), arrived );
+	}
+	for( int i = 0; i < extraPorts.size( ); i++ )
+		addLinuxDevice( extraPorts.at( i ), arrived );
+	#endif // Linux-only FindUsbDevices( )
+}
+
+#ifdef Q_WS_LINUX
+// opening it hands it to the UsbReactor, so there's no thread to start
+void UsbMonitor::addLinuxDevice( QString path, QList<PacketInterface*>* arrived )
+{
+	QMutexLocker locker( &devicesMutex );
+	if( connectedDevices.contains( path ) ) // make sure we don't already have this board in our list
+		return;
+	PacketUsbCdc* device = new PacketUsbCdc( bridge, this );
+	device->setPortName( path );
+	device->setWriteWindow( writeWindowMs );
+	if( PacketInterface::OK == device->open( ) )
+	{
+		connectedDevices.insert( path, device );  // stick it in our own list of boards we know about
+		arrived->append( device ); // then stick it on the list of new boards that's been requested
+	}
+	else
+		delete device;
 }
+#endif
 
 #ifdef Q_WS_WIN
 //-----------------------------------------------------------------
@@ -334,7 +384,7 @@ void UsbMonitor::removalNotification( HANDLE handle )
 		if( i.value( )->getDeviceHandle( ) == handle )
 		{
 			i.value( )->close( );
-			mainWindow->removeDeviceThreadSafe( i.key() );
+			bridge->removeDeviceThreadSafe( i.key() );
 			i = connectedDevices.erase( i );
 		}
 		else
@@ -346,13 +396,16 @@ void UsbMonitor::removalNotification( HANDLE handle )
 
 void UsbMonitor::deviceRemoved( QString key )
 {
-	if( connectedDevices.contains( key) )
+	PacketUsbCdc* usb;
+	{
+		QMutexLocker locker( &devicesMutex );
+		usb = connectedDevices.take( key );
+	}
+	if( usb != NULL ) // closed without the lock, since closing waits for the reactor to be done with it
 	{
-		PacketUsbCdc* usb = connectedDevices.value( key );
-		connectedDevices.remove( key );
 		if( usb->isOpen() )
 			usb->close( );
-		mainWindow->removeDeviceThreadSafe( key );
+		bridge->removeDeviceThreadSafe( key );
 	}
 }
 
@@ -0,0 +1,166 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#include "UsbReactor.h"
+#include <QMutexLocker>
+#include <QVector>
+
+#ifdef Q_WS_LINUX
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#endif
+
+// never deleted - it runs as long as we do
+UsbReactor* UsbReactor::instance( )
+{
+	static UsbReactor* reactor = new UsbReactor( );
+	return reactor;
+}
+
+UsbReactor::UsbReactor( ) : QThread( )
+{
+	busy = NULL;
+	changed = true;
+	wakePipe[ 0 ] = wakePipe[ 1 ] = -1;
+	Metrics* m = Metrics::instance( );
+	wakeups = m->counter( "mchelper_usb_wakeups_total", "Times the USB reader woke up" );
+	wakeToDelivery = m->histogram( "mchelper_usb_wake_to_delivery_seconds", "Time from the USB reader waking up to a packet being handed over" );
+	#ifdef Q_WS_LINUX
+	if( pipe( wakePipe ) == 0 )
+	{
+		fcntl( wakePipe[ 0 ], F_SETFL, O_NONBLOCK );
+		fcntl( wakePipe[ 1 ], F_SETFL, O_NONBLOCK );
+	}
+	#endif
+}
+
+bool UsbReactor::add( int fd, Handler* handler )
+{
+	#ifdef Q_WS_LINUX
+	if( fd < 0 || wakePipe[ 0 ] < 0 )
+		return false;
+	QMutexLocker locker( &mutex );
+	handlers.insert( fd, handler );
+	changed = true;
+	if( !isRunning( ) )
+		start( );
+	wake( );
+	return true;
+	#else
+	(void)fd;
+	(void)handler;
+	return false;
+	#endif
+}
+
+void UsbReactor::remove( Handler* handler )
+{
+	QMutexLocker locker( &mutex );
+	QHash<int, Handler*>::iterator i = handlers.begin( );
+	while( i != handlers.end( ) )
+	{
+		if( i.value( ) == handler )
+		{
+			i = handlers.erase( i );
+			changed = true;
+		}
+		else
+			++i;
+	}
+	if( changed )
+		wake( );
+	if( QThread::currentThread( ) != this ) // we'd never wake up
+	{
+		while( busy == handler )
+			idle.wait( &mutex );
+	}
+}
+
+// called with the mutex held
+void UsbReactor::wake( )
+{
+	#ifdef Q_WS_LINUX
+	char c = 0;
+	if( write( wakePipe[ 1 ], &c, 1 ) < 0 )
+		return; // it's full, so it's going to wake up anyway
+	#endif
+}
+
+void UsbReactor::run( )
+{
+	#ifdef Q_WS_LINUX
+	QVector<struct pollfd> fds;
+	while( true )
+	{
+		{
+			QMutexLocker locker( &mutex );
+			if( changed )
+			{
+				fds.resize( handlers.size( ) + 1 );
+				fds[ 0 ].fd = wakePipe[ 0 ];
+				int n = 1;
+				QHash<int, Handler*>::const_iterator i;
+				for( i = handlers.constBegin( ); i != handlers.constEnd( ); ++i, n++ )
+					fds[ n ].fd = i.key( );
+				for( n = 0; n < fds.size( ); n++ )
+					fds[ n ].events = POLLIN;
+				changed = false;
+			}
+		}
+
+		if( poll( fds.data( ), fds.size( ), -1 ) < 0 )
+		{
+			if( errno == EINTR )
+				continue;
+			return;
+		}
+		qint64 wokeAt = Metrics::microseconds( );
+		wakeups->add( );
+
+		if( fds[ 0 ].revents )
+		{
+			char drain[ 64 ];
+			while( read( wakePipe[ 0 ], drain, sizeof( drain ) ) > 0 )
+				;
+		}
+		for( int n = 1; n < fds.size( ); n++ )
+		{
+			if( fds[ n ].revents == 0 )
+				continue;
+			Handler* handler;
+			{
+				QMutexLocker locker( &mutex );
+				handler = handlers.value( fds[ n ].fd ); // it might have been removed since we polled
+				busy = handler;
+			}
+			if( handler == NULL )
+				continue;
+			bool ok = handler->readable( wokeAt );
+			QMutexLocker locker( &mutex );
+			if( !ok && handlers.value( fds[ n ].fd ) == handler )
+			{
+				handlers.remove( fds[ n ].fd );
+				changed = true;
+			}
+			busy = NULL;
+			idle.wakeAll( );
+		}
+	}
+	#endif
+}
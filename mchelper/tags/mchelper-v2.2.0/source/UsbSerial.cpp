@@ -22,14 +22,17 @@
 #include <dbt.h>
 #endif 
 
-UsbSerial::UsbSerial( McHelperWindow* mainWindow )
+UsbSerial::UsbSerial( BridgeInterface* bridge )
 {
 	deviceOpen = false;
-	this->mainWindow = mainWindow;
+	this->bridge = bridge;
 
 	#ifdef Q_WS_WIN
 	deviceHandle = INVALID_HANDLE_VALUE;
 	#endif
+	#ifdef Q_WS_LINUX
+	deviceHandle = -1;
+	#endif
 }
 
 bool UsbSerial::isOpen( )
@@ -51,8 +54,21 @@ UsbSerial::UsbStatus UsbSerial::open( )
   
   // Linux Only
   #if (defined(Q_WS_LINUX))
-	  printf( "OSC over USB not implemented in Linux\n" );
-    return NOT_OPEN;
+	// non-blocking, since the reactor waits for us and then we read until there's nothing left
+	deviceHandle = ::open( portName.toLocal8Bit().data(), O_RDWR | O_NOCTTY | O_NONBLOCK );
+	if ( deviceHandle < 0 )
+		return NOT_OPEN;
+	struct termios t; // raw - the board's not a terminal, and SLIP needs every byte as it is
+	if( tcgetattr( deviceHandle, &t ) == 0 )
+	{
+		cfmakeraw( &t );
+		t.c_cflag |= CLOCAL | CREAD;
+		t.c_cc[ VMIN ] = 1;
+		t.c_cc[ VTIME ] = 0;
+		tcsetattr( deviceHandle, TCSANOW, &t );
+	}
+	deviceOpen = true;
+	return OK;
   #endif
 
   //Mac-only
@@ -96,6 +112,9 @@ void UsbSerial::close( )
     QMutexLocker locker( &usbMutex );
 		// Linux Only
     #if (defined(Q_WS_LINUX))
+		::close( deviceHandle );
+		deviceHandle = -1;
+		deviceOpen = false;
     #endif
   	  //Mac-only
 		#ifdef Q_WS_MAC
@@ -132,9 +151,14 @@ int UsbSerial::read( char* buffer, int length )
   
   // Linux Only
   #if (defined(Q_WS_LINUX))
-  // make sure we're open
-  //if( !deviceOpen )
-    return NOT_OPEN;
+	int count = ::read( deviceHandle, buffer, length );
+	if( count > 0 )
+		return count;
+	if( count == 0 )
+		return ERROR_CLOSE; // the board's gone
+	if ( errno == EAGAIN || errno == EINTR )
+		return NOTHING_AVAILABLE;
+	return IO_ERROR;
   #endif
 
   //Mac-only
@@ -200,7 +224,30 @@ UsbSerial::UsbStatus UsbSerial::write( char* buffer, int length )
 	
   // Linux Only
   #if (defined(Q_WS_LINUX))
-    return NOT_OPEN;
+	// the port's non-blocking, so if the board's behind, wait for it rather than dropping the rest
+	while( length > 0 )
+	{
+		int size = ::write( deviceHandle, buffer, length );
+		if( size > 0 )
+		{
+			buffer += size;
+			length -= size;
+			continue;
+		}
+		if( size < 0 && errno == EINTR )
+			continue;
+		if( size < 0 && errno == EAGAIN )
+		{
+			struct pollfd p = { deviceHandle, POLLOUT, 0 };
+			locker.unlock( ); // don't hold up reading from it while we wait
+			int ready = poll( &p, 1, 1000 );
+			locker.relock( );
+			if( ready > 0 && deviceOpen )
+				continue;
+		}
+		return IO_ERROR;
+	}
+	return OK;
   #endif
 
   //Mac-only
@@ -238,10 +285,10 @@ int UsbSerial::bytesAvailable( )
 {
     int n = 0;
 		QMutexLocker locker( &usbMutex );
-		#ifdef Q_WS_MAC
+		#if defined(Q_WS_MAC) || defined(Q_WS_LINUX)
 		if( ::ioctl( deviceHandle, FIONREAD, &n ) < 0 )
 			return IO_ERROR;
-		#endif // Mac-only numberOfAvailableBytes( )
+		#endif // Mac & Linux numberOfAvailableBytes( )
 		
 		#ifdef Q_WS_WIN
 		COMSTAT status;
@@ -257,6 +304,15 @@ int UsbSerial::bytesAvailable( )
     return(n);
 }
 
+int UsbSerial::descriptor( )
+{
+	#ifdef Q_WS_LINUX
+	return deviceHandle;
+	#else
+	return -1;
+	#endif
+}
+
 QString UsbSerial::name( )
 {
 	return portName;
@@ -337,7 +393,9 @@ bool UsbSerial::DoRegisterForNotification( )
 	NotificationFilter.dbch_size = sizeof( DEV_BROADCAST_HANDLE );
 	NotificationFilter.dbch_devicetype = DBT_DEVTYP_HANDLE;
 	NotificationFilter.dbch_handle = deviceHandle;  // class variable
-	HWND winId = mainWindow->winId( );
+	HWND winId = bridge->notificationWindow( );
+	if( winId == NULL ) // nobody to tell - we'll find out it's gone when reads start failing
+		return false;
 
     notificationHandle = RegisterDeviceNotification( winId, &NotificationFilter, DEVICE_NOTIFY_WINDOW_HANDLE );
 
@@ -0,0 +1,119 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#include "UsbWriter.h"
+#include "SlipEncoder.h"
+#include <QMutexLocker>
+
+UsbWriter::UsbWriter( Output* output ) : QThread( )
+{
+	this->output = output;
+	pendingLength = 0;
+	pendingFrames = 0;
+	firstQueuedAt = 0;
+	windowMs = 0;
+	exit = false;
+	failed = false;
+	Metrics* m = Metrics::instance( );
+	writes = m->counter( "mchelper_usb_writes_total", "Writes to USB boards" );
+	frames = m->counter( "mchelper_usb_frames_written_total", "SLIP frames written to USB boards - over writes, how many went out together" );
+}
+
+UsbWriter::~UsbWriter( )
+{
+	stop( );
+}
+
+/*
+	From any thread.  Only holds the caller up if the board's so far behind
+	that USB_WRITE_QUEUE_MAX is waiting for it.
+*/
+bool UsbWriter::send( const char* packet, int length )
+{
+	QMutexLocker locker( &queueMutex );
+	while( pendingLength >= USB_WRITE_QUEUE_MAX && !exit && !failed )
+		room.wait( &queueMutex );
+	if( exit || failed )
+		return false;
+	if( !isRunning( ) )
+		start( );
+
+	int needed = pendingLength + SlipEncoder::maxEncodedSize( length );
+	if( pending.size( ) < needed ) // only ever grows
+		pending.resize( qMax( needed, pending.size( ) * 2 ) );
+	bool wasEmpty = ( pendingLength == 0 );
+	if( wasEmpty )
+		firstQueuedAt = Metrics::microseconds( );
+	pendingLength += SlipEncoder::encode( packet, length, pending.data( ) + pendingLength );
+	pendingFrames++;
+	// with a window, the thread only needs waking for the first frame and once there's plenty
+	if( wasEmpty || pendingLength >= USB_WRITE_FLUSH_SIZE )
+		queued.wakeOne( );
+	return true;
+}
+
+// can be called from our own thread, if the Output finds the board's gone while we're writing
+void UsbWriter::stop( )
+{
+	{
+		QMutexLocker locker( &queueMutex );
+		exit = true;
+		pendingLength = pendingFrames = 0;
+		queued.wakeAll( );
+		room.wakeAll( );
+	}
+	if( QThread::currentThread( ) != this )
+		wait( );
+}
+
+void UsbWriter::run( )
+{
+	QMutexLocker locker( &queueMutex );
+	while( !exit )
+	{
+		if( pendingLength == 0 )
+		{
+			queued.wait( &queueMutex );
+			continue;
+		}
+		if( windowMs > 0 && pendingLength < USB_WRITE_FLUSH_SIZE )
+		{
+			int left = windowMs - (int)( ( Metrics::microseconds( ) - firstQueuedAt ) / 1000 );
+			if( left > 0 )
+			{
+				queued.wait( &queueMutex, left );
+				continue;
+			}
+		}
+
+		qSwap( pending, writing );
+		int length = pendingLength;
+		int count = pendingFrames;
+		pendingLength = pendingFrames = 0;
+		locker.unlock( );
+		bool ok = output->writeFrames( writing.data( ), length );
+		writes->add( );
+		frames->add( count );
+		locker.relock( );
+		room.wakeAll( );
+		if( !ok )
+		{
+			failed = true;
+			break;
+		}
+	}
+}
@@ -20,6 +20,8 @@
 
 #include <QApplication>
 #include <QMessageBox> 
+#include <string.h>
+#include <stdlib.h>
 
 #ifdef Q_WS_WIN
 #include "dbt.h"
@@ -62,9 +64,15 @@ int main(int argc, char *argv[])
 		mcHelperWindow.setNoUI( false );
 	} else
 	{	
-		char* argv1 = argv[1];
+		// mchelper [--parallel N] file.bin - flash every board in SAM-BA mode
+		int arg = 1;
+		if( argc > 3 && strcmp( argv[arg], "--parallel" ) == 0 )
+		{
+			mcHelperWindow.setFlashParallel( atoi( argv[arg + 1] ) );
+			arg += 2;
+		}
 		mcHelperWindow.setNoUI( true );
-		mcHelperWindow.uiLessUpload( argv1, true );
+		mcHelperWindow.uiLessUpload( argv[arg], true );
 	}
 	return app.exec();
 }
@@ -0,0 +1,88 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+#include "McHelperDaemon.h"
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <stdio.h>
+
+static void usage( )
+{
+	printf( "usage: mchelperd [options]\n"
+					"  --udp-listen <port>  port to listen for boards on\n"
+					"  --udp-send <port>    port to send to boards on\n"
+					"  --xml-port <port>    port for XML server clients\n"
+					"  --cache-age <ms>     answer queries from values this fresh without asking the board\n"
+					"  --bundle-window <ms> collect messages for a board this long and send them as one bundle\n"
+					"  --bundle-max-size <bytes> biggest bundle to send a board - by default, what its firmware takes\n"
+					"  --capture <file>     record every packet to and from boards, for tools/capreplay\n"
+					"  --metrics-port <port> serve Prometheus metrics at http://localhost:<port>/metrics\n"
+					"  --probe-interval <ms> time a round trip to each board this often - 0, the default, for never\n"
+					"  --usb-port <device>  treat this serial port as a USB board (Linux) - can be given more than once\n"
+					"  --usb-write-window <ms> hold packets for USB boards this long and write them together\n"
+					"  -v, --verbose        print every message to and from boards\n"
+					"Anything not given here comes from mchelper's settings.\n" );
+}
+
+int main( int argc, char *argv[] )
+{
+	QCoreApplication app( argc, argv );
+	McHelperDaemon daemon( &app );
+
+	int udpListen = 0, udpSend = 0, xmlListen = 0;
+	QStringList args = app.arguments( );
+	for( int i = 1; i < args.size( ); i++ )
+	{
+		QString arg = args.at( i );
+		bool hasValue = ( i + 1 < args.size( ) );
+		if( arg == "-v" || arg == "--verbose" )
+			daemon.setVerbose( true );
+		else if( arg == "--udp-listen" && hasValue )
+			udpListen = args.at( ++i ).toInt( );
+		else if( arg == "--udp-send" && hasValue )
+			udpSend = args.at( ++i ).toInt( );
+		else if( arg == "--xml-port" && hasValue )
+			xmlListen = args.at( ++i ).toInt( );
+		else if( arg == "--cache-age" && hasValue )
+			daemon.setCacheAge( args.at( ++i ).toInt( ) );
+		else if( arg == "--bundle-window" && hasValue )
+			daemon.setBundleWindow( args.at( ++i ).toInt( ) );
+		else if( arg == "--bundle-max-size" && hasValue )
+			daemon.setBundleMaxSize( args.at( ++i ).toInt( ) );
+		else if( arg == "--capture" && hasValue )
+			daemon.setCaptureFile( args.at( ++i ) );
+		else if( arg == "--metrics-port" && hasValue )
+			daemon.setMetricsPort( args.at( ++i ).toInt( ) );
+		else if( arg == "--probe-interval" && hasValue )
+			daemon.setProbeInterval( args.at( ++i ).toInt( ) );
+		else if( arg == "--usb-port" && hasValue )
+			daemon.addUsbPort( args.at( ++i ) );
+		else if( arg == "--usb-write-window" && hasValue )
+			daemon.setUsbWriteWindow( args.at( ++i ).toInt( ) );
+		else
+		{
+			usage( );
+			return 1;
+		}
+	}
+	daemon.setPorts( udpListen, udpSend, xmlListen );
+
+	if( !daemon.start( ) )
+		return 1;
+	return app.exec( );
+}
@@ -0,0 +1,197 @@
+/*********************************************************************************
+
+ Copyright 2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+/*
+	Board to client throughput through a running mchelper - run it once
+	against the GUI and once against mchelperd, on the same machine, and
+	compare.
+
+	Fake boards on 127.0.1.x send /analogin/N/value packets to mchelper's UDP
+	port, each carrying a sequence number.  We're a binary client on the XML
+	server port, counting what comes out the other side and how long it took.
+	Each board sends one packet first and gets ARRIVAL_MS to show up as a
+	board, then they all send as fast as they can for RUN_MS.
+
+	Packets mchelper sends to the fake boards end up looping back in to it
+	from the same addresses, so only /analogin packets get counted.
+
+	  bridgebench [label] [boards] [udp port] [xml port]
+
+	Loopback addresses other than 127.0.0.1 work out of the box on Linux - on
+	other systems they'll need to be aliased first.
+
+	Results: none yet.  The GUI vs. mchelperd comparison this was written for
+	is still open - nothing says mchelperd is faster until it's been run
+	against both and the numbers are filled in here.
+*/
+
+#include <QCoreApplication>
+#include <QUdpSocket>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QThread>
+#include <QTime>
+#include <QVector>
+#include <QtEndian>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "OscBinaryFrame.h"
+
+#define RUN_MS 2000
+#define ARRIVAL_MS 1500
+#define DRAIN_MS 500
+#define MAX_PACKETS ( 4 * 1024 * 1024 )
+
+static QByteArray analogInPacket( int channel, quint32 sequence )
+{
+	QByteArray packet( QString( "/analogin/%1/value" ).arg( channel ).toAscii( ) );
+	do
+		packet.append( '\0' );
+	while( packet.size( ) % 4 );
+	packet.append( ",i\0\0", 4 );
+	char v[ 4 ];
+	qToBigEndian( sequence, (uchar*)v );
+	packet.append( v, 4 );
+	return packet;
+}
+
+#define HELLO 0xFFFFFFFF // the first packet from each board - it doesn't count
+
+class Sender : public QThread
+{
+	public:
+		Sender( int boards, int port, QVector<qint64>* sentAt )
+			: boards( boards ), port( port ), sent( 0 ), sentAt( sentAt ) { }
+		int boards;
+		int port;
+		int sent;
+
+	protected:
+		void run( )
+		{
+			QList<QUdpSocket*> sockets;
+			QHostAddress local( QHostAddress::LocalHost );
+			for( int i = 0; i < boards; i++ )
+			{
+				QUdpSocket* s = new QUdpSocket( );
+				s->bind( QHostAddress( QString( "127.0.1.%1" ).arg( i + 1 ) ), 0 );
+				sockets.append( s );
+				s->writeDatagram( analogInPacket( 0, HELLO ), local, port );
+			}
+			msleep( ARRIVAL_MS );
+
+			QTime timer;
+			timer.start( );
+			while( timer.elapsed( ) < RUN_MS && sent < MAX_PACKETS )
+			{
+				for( int i = 0; i < boards && sent < MAX_PACKETS; i++ )
+				{
+					( *sentAt )[ sent ] = OscBinaryFrame::now( );
+					QByteArray p = analogInPacket( sent % 8, sent );
+					if( sockets.at( i )->writeDatagram( p, local, port ) > 0 )
+						sent++;
+				}
+			}
+			qDeleteAll( sockets );
+		}
+
+	private:
+		QVector<qint64>* sentAt;
+};
+
+int main( int argc, char** argv )
+{
+	QCoreApplication app( argc, argv );
+	const char* label = ( argc > 1 ) ? argv[ 1 ] : "mchelper";
+	int boards = ( argc > 2 ) ? atoi( argv[ 2 ] ) : 16;
+	int udpPort = ( argc > 3 ) ? atoi( argv[ 3 ] ) : 10000;
+	int xmlPort = ( argc > 4 ) ? atoi( argv[ 4 ] ) : 11000;
+
+	QTcpSocket client;
+	client.connectToHost( QHostAddress::LocalHost, xmlPort );
+	if( !client.waitForConnected( 2000 ) )
+	{
+		printf( "couldn't connect to mchelper on port %d\n", xmlPort );
+		return 1;
+	}
+	char handshake = (char)OSC_BINARY_HANDSHAKE;
+	client.write( &handshake, 1 );
+
+	QVector<qint64> sentAt( MAX_PACKETS );
+	Sender sender( boards, udpPort, &sentAt );
+	sender.start( );
+
+	QByteArray input;
+	int received = 0;
+	qint64 latencyTotal = 0, latencyMax = 0;
+	bool handshakeBack = false, draining = false;
+	QTime drain;
+	while( !draining || drain.elapsed( ) < DRAIN_MS ) // give the tail end DRAIN_MS once the sender's done
+	{
+		if( !draining && sender.isFinished( ) )
+		{
+			draining = true;
+			drain.start( );
+		}
+		if( !client.waitForReadyRead( 50 ) )
+			continue;
+		input.append( client.readAll( ) );
+		if( !handshakeBack && input.size( ) )
+		{
+			if( (uchar)input.at( 0 ) != OSC_BINARY_HANDSHAKE )
+			{
+				printf( "mchelper at port %d doesn't do binary frames\n", xmlPort );
+				return 1;
+			}
+			handshakeBack = true;
+			input.remove( 0, 1 );
+		}
+
+		const char* next = input.constData( );
+		int remaining = input.size( );
+		OscBinaryFrame frame;
+		int used;
+		while( ( used = OscBinaryFrame::parse( next, remaining, &frame ) ) > 0 )
+		{
+			if( frame.packetSize >= 4 && qstrncmp( frame.packet, "/analogin", 9 ) == 0 )
+			{
+				quint32 sequence = qFromBigEndian<quint32>( (const uchar*)frame.packet + frame.packetSize - 4 );
+				if( sequence < (quint32)MAX_PACKETS ) // leaves out the hellos
+				{
+					qint64 latency = OscBinaryFrame::now( ) - sentAt.at( sequence );
+					latencyTotal += latency;
+					latencyMax = qMax( latencyMax, latency );
+					received++;
+				}
+			}
+			next += used;
+			remaining -= used;
+		}
+		if( used < 0 )
+		{
+			printf( "bad frame from mchelper\n" );
+			return 1;
+		}
+		input.remove( 0, input.size( ) - remaining );
+	}
+	int sent = sender.sent;
+	printf( "%-12s %8s %10s %12s %8s %12s %12s\n", "", "boards", "sent", "received/s", "lost", "avg latency", "max latency" );
+	printf( "%-12s %8d %10d %12.0f %7.1f%% %9.1f ms %9lld ms\n", label, boards, sent, received / ( RUN_MS / 1000.0 ),
+			sent ? 100.0 * ( sent - received ) / sent : 0.0, received ? (double)latencyTotal / received : 0.0, latencyMax );
+	return 0;
+}
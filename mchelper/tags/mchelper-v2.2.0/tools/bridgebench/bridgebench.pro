@@ -0,0 +1,34 @@
+# ------------------------------------------------------------------------------
+#
+# Copyright 2008 MakingThings
+#
+# Licensed under the Apache License, 
+# Version 2.0 (the "License"); you may not use this file except in compliance 
+# with the License. You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0 
+# 
+# Unless required by applicable law or agreed to in writing, software distributed
+# under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+# CONDITIONS OF ANY KIND, either express or implied. See the License for
+# the specific language governing permissions and limitations under the License.
+#
+# ------------------------------------------------------------------------------
+
+# Board to client throughput through a running mchelper or mchelperd - fake
+# boards on loopback flood its UDP port and we count what comes out on the
+# XML server port.  Build with qmake && make, then run ./bridgebench with
+# mchelper running.
+
+TEMPLATE = app
+CONFIG += console release
+CONFIG -= app_bundle
+QT -= gui
+QT += network
+
+INCLUDEPATH += ../../include
+HEADERS = ../../include/OscBinaryFrame.h
+SOURCES = bridgebench.cpp \
+          ../../source/OscBinaryFrame.cpp
+
+TARGET = bridgebench
@@ -0,0 +1,220 @@
+/*********************************************************************************
+
+ Copyright 2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+/*
+	What bundling messages to a board buys and what it costs - run the same
+	traffic through OscBundler with different windows and count the datagrams
+	that go out, against how much later each message arrives.
+
+	Messages are /pwmout/N/duty with a sequence number for an argument, sent
+	over loopback UDP to a socket standing in for the board.  Two kinds of
+	traffic:
+	- bursts: BURST_SIZE outputs set at once, every BURST_EVERY_MS, like a
+	  script or a patch updating a bank of outputs
+	- flood: messages as fast as they can go
+	A window of 0 is the old way, one datagram per message.  The sender
+	follows the same rules as Board::sendOut( ) - a bundle goes out when its
+	window is up or when the next message won't fit, in either the 1.x or the
+	2.x firmware's OSC_MAX_MSG_IN.
+
+	Latency is from when a message was handed over to when the fake board
+	read it, so it includes the window.
+
+	Results: NOT from this program, and NOT through mchelper.  With no Qt to
+	build either, these are from this loop ported line for line to POSIX
+	sockets and linked against the real OscBundler.cpp - loopback, Linux,
+	1 s per row, nothing lost.  Re-run this bench, and Board::sendOut( ) in
+	mchelper itself, before leaning on them.
+
+	  traffic  limit  window  messages/s  datagrams/s  avg latency
+	  bursts       -    0 ms        1600         1600        18 us
+	  bursts     200    1 ms        1600          399       263 us
+	  bursts     512    1 ms        1600          200      1029 us
+	  bursts     200    5 ms        1600          267      2516 us
+	  bursts     512    5 ms        1600          101      2735 us
+	  flood        -    0 ms      236933       236933        19 us
+	  flood      200    1 ms      872719       145455         9 us
+	  flood      512    1 ms     1470090        86478        10 us
+*/
+
+#include <QUdpSocket>
+#include <QHostAddress>
+#include <QVector>
+#include <QTime>
+#include <QtEndian>
+#include <stdio.h>
+#ifndef Q_WS_WIN
+#include <sys/time.h>
+#endif
+
+#include "OscBundler.h"
+#include "Osc.h"
+
+#define RUN_MS 1000
+#define BURST_SIZE 8
+#define BURST_EVERY_MS 5
+#define MAX_MESSAGES ( 1024 * 1024 )
+
+static qint64 microseconds( )
+{
+#ifdef Q_WS_WIN
+	return (qint64)QTime( 0, 0 ).msecsTo( QTime::currentTime( ) ) * 1000;
+#else
+	struct timeval tv;
+	gettimeofday( &tv, NULL );
+	return (qint64)tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+static QByteArray dutyMessage( int output, quint32 sequence )
+{
+	QByteArray msg( QString( "/pwmout/%1/duty" ).arg( output ).toAscii( ) );
+	do
+		msg.append( '\0' );
+	while( msg.size( ) % 4 );
+	msg.append( ",i\0\0", 4 );
+	char v[ 4 ];
+	qToBigEndian( sequence, (uchar*)v );
+	msg.append( v, 4 );
+	return msg;
+}
+
+class Result
+{
+	public:
+		Result( ) : messages( 0 ), datagrams( 0 ), received( 0 ), latencyTotal( 0 ), latencyMax( 0 ), elapsed( 0 ) { }
+		int messages, datagrams, received;
+		qint64 latencyTotal, latencyMax;
+		qint64 elapsed; // a flood can fill MAX_MESSAGES before RUN_MS is up
+};
+
+// read whatever the fake board has waiting, and work out how long each message took
+static void drain( QUdpSocket* board, OscDecoder* decoder, const QVector<qint64>& queuedAt, Result* r )
+{
+	char buf[ 2048 ];
+	while( board->hasPendingDatagrams( ) )
+	{
+		int size = (int)board->readDatagram( buf, sizeof( buf ) );
+		if( size <= 0 )
+			break;
+		qint64 now = microseconds( );
+		int count = decoder->decode( buf, size );
+		for( int i = 0; i < count; i++ )
+		{
+			const OscMessageView& msg = decoder->message( i );
+			if( msg.argCount != 1 )
+				continue;
+			quint32 sequence = (quint32)decoder->arg( msg, 0 ).toInt( );
+			if( sequence >= (quint32)queuedAt.size( ) )
+				continue;
+			qint64 latency = now - queuedAt.at( sequence );
+			r->latencyTotal += latency;
+			r->latencyMax = qMax( r->latencyMax, latency );
+			r->received++;
+		}
+	}
+}
+
+static Result run( int windowMs, bool flood, int maxSize )
+{
+	QUdpSocket board, host;
+	board.bind( QHostAddress::LocalHost, 0 );
+	host.bind( QHostAddress::LocalHost, 0 );
+	QHostAddress to( QHostAddress::LocalHost );
+	quint16 port = board.localPort( );
+
+	OscBundler bundler( maxSize );
+	OscDecoder decoder;
+	QVector<qint64> queuedAt( MAX_MESSAGES );
+	Result r;
+	qint64 start = microseconds( );
+	qint64 end = start + RUN_MS * 1000;
+	qint64 nextBurst = start;
+	qint64 windowEnd = 0;
+
+	qint64 now;
+	while( ( now = microseconds( ) ) < end && r.messages < MAX_MESSAGES - BURST_SIZE )
+	{
+		if( flood || now >= nextBurst )
+		{
+			for( int i = 0; i < BURST_SIZE; i++ )
+			{
+				QByteArray msg = dutyMessage( i, r.messages );
+				queuedAt[ r.messages++ ] = microseconds( );
+				if( windowMs == 0 )
+				{
+					host.writeDatagram( msg, to, port );
+					r.datagrams++;
+					continue;
+				}
+				bool newBundle = bundler.isEmpty( );
+				if( !bundler.add( msg.constData( ), msg.size( ) ) )
+				{
+					host.writeDatagram( bundler.take( ), to, port );
+					r.datagrams++;
+					bundler.add( msg.constData( ), msg.size( ) );
+					newBundle = true;
+				}
+				if( newBundle )
+					windowEnd = microseconds( ) + windowMs * 1000;
+			}
+			nextBurst += BURST_EVERY_MS * 1000;
+		}
+		if( !bundler.isEmpty( ) && microseconds( ) >= windowEnd )
+		{
+			host.writeDatagram( bundler.take( ), to, port );
+			r.datagrams++;
+		}
+		drain( &board, &decoder, queuedAt, &r );
+	}
+	if( !bundler.isEmpty( ) )
+	{
+		host.writeDatagram( bundler.take( ), to, port );
+		r.datagrams++;
+	}
+	r.elapsed = microseconds( ) - start;
+	qint64 tail = microseconds( );
+	while( r.received < r.messages && microseconds( ) - tail < 100000 )
+		drain( &board, &decoder, queuedAt, &r );
+	return r;
+}
+
+int main( int argc, char** argv )
+{
+	(void)argc;
+	(void)argv;
+	int windows[] = { 0, 1, 2, 5 };
+	int sizes[] = { OSC_MAX_MSG_IN_1X, OSC_MAX_MSG_IN_2X };
+	const char* traffic[] = { "bursts", "flood" };
+	printf( "%-8s %6s %8s %12s %12s %8s %12s %12s\n", "traffic", "limit", "window", "messages/s", "datagrams/s", "lost", "avg latency", "max latency" );
+	for( int t = 0; t < 2; t++ )
+	{
+		for( unsigned int w = 0; w < sizeof( windows ) / sizeof( windows[ 0 ] ); w++ )
+		{
+			for( int s = 0; s < ( windows[ w ] ? 2 : 1 ); s++ ) // no limit without a window
+			{
+				Result r = run( windows[ w ], t == 1, sizes[ s ] );
+				double seconds = r.elapsed / 1000000.0;
+				printf( "%-8s %6d %5d ms %12.0f %12.0f %7.1f%% %9.0f us %9lld us\n", traffic[ t ], windows[ w ] ? sizes[ s ] : 0,
+								windows[ w ], r.messages / seconds, r.datagrams / seconds,
+								r.messages ? 100.0 * ( r.messages - r.received ) / r.messages : 0.0,
+								r.received ? (double)r.latencyTotal / r.received : 0.0, r.latencyMax );
+			}
+		}
+	}
+	return 0;
+}
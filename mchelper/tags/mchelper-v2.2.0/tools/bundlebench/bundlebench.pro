@@ -0,0 +1,35 @@
+# ------------------------------------------------------------------------------
+#
+# Copyright 2008 MakingThings
+#
+# Licensed under the Apache License, 
+# Version 2.0 (the "License"); you may not use this file except in compliance 
+# with the License. You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0 
+# 
+# Unless required by applicable law or agreed to in writing, software distributed
+# under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+# CONDITIONS OF ANY KIND, either express or implied. See the License for
+# the specific language governing permissions and limitations under the License.
+#
+# ------------------------------------------------------------------------------
+
+# Outbound bundling - datagrams per second against added latency for
+# different bundle windows, over loopback.  Build with qmake && make, then run ./bundlebench
+
+TEMPLATE = app
+CONFIG += console release
+CONFIG -= app_bundle
+QT -= gui
+QT += network
+
+INCLUDEPATH += ../../include
+HEADERS = ../../include/OscBundler.h \
+          ../../include/Osc.h
+SOURCES = bundlebench.cpp \
+          ../../source/OscBundler.cpp \
+          ../../source/Osc.cpp \
+          ../../source/MessageEvent.cpp
+
+TARGET = bundlebench
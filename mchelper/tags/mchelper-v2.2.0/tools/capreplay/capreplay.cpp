@@ -0,0 +1,202 @@
+/*********************************************************************************
+
+ Copyright 2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+/*
+	Plays back a capture recorded by mchelper or mchelperd (the captureFile
+	setting, or --capture).
+
+	  capreplay <capture> [options]
+	    --to <host:port>      where packets from boards go - a running mchelper.  Default 127.0.0.1:10000
+	    --boards <host:port>  where packets to boards go - a virtual board.  Left out if not given
+	    --speed <x>           1 is as recorded, 10 ten times faster, 0 as fast as they'll go.  Default 1
+	    --dump                print what's in it instead
+
+	The file is mapped rather than read, so captures bigger than memory are fine.
+
+	Each board in the capture gets its own loopback address - 127.0.1.1,
+	127.0.1.2 and so on - so mchelper sees as many boards as there were.
+	USB boards come back as Ethernet ones.  Loopback addresses other than
+	127.0.0.1 work out of the box on Linux - on other systems they'll need to
+	be aliased first.
+*/
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <QFile>
+#include <QHash>
+#include <QUdpSocket>
+#include <QHostAddress>
+#include <QThread>
+#include <stdio.h>
+#include <string.h>
+
+#include "PacketCapture.h"
+#include "MessageInterface.h"
+#include "Osc.h"
+
+// Osc wants somewhere to report bad packets
+class DumpMessages : public MessageInterface
+{
+	public:
+		void messageThreadSafe( QString string ) { printf( "  %s\n", string.toLocal8Bit( ).constData( ) ); }
+		void messageThreadSafe( QString string, MessageEvent::Types type ) { (void)type; messageThreadSafe( string ); }
+		void messageThreadSafe( QString string, MessageEvent::Types type, QString from ) { (void)from; messageThreadSafe( string, type ); }
+		void messageThreadSafe( QStringList strings, MessageEvent::Types type, QString from )
+		{
+			for( int i = 0; i < strings.size( ); i++ )
+				messageThreadSafe( strings.at( i ), type, from );
+		}
+		void progress( int value ) { (void)value; }
+		void statusMessage( const QString & msg, int duration ) { (void)duration; messageThreadSafe( msg ); }
+};
+
+class Sleeper : public QThread
+{
+	public:
+		static void usleep( unsigned long us ) { QThread::usleep( us ); }
+};
+
+static bool hostPort( const QString& arg, QHostAddress* host, quint16* port )
+{
+	QStringList parts = arg.split( ':' );
+	if( parts.size( ) != 2 )
+		return false;
+	*port = parts.at( 1 ).toUShort( );
+	return host->setAddress( parts.at( 0 ) ) && *port != 0;
+}
+
+static void usage( )
+{
+	printf( "usage: capreplay <capture> [--to host:port] [--boards host:port] [--speed x] [--dump]\n" );
+}
+
+int main( int argc, char** argv )
+{
+	QCoreApplication app( argc, argv );
+	QStringList args = app.arguments( );
+	if( args.size( ) < 2 )
+	{
+		usage( );
+		return 1;
+	}
+
+	QHostAddress to( QHostAddress::LocalHost ), boards;
+	quint16 toPort = 10000, boardsPort = 0;
+	double speed = 1.0;
+	bool dump = false;
+	for( int i = 2; i < args.size( ); i++ )
+	{
+		QString arg = args.at( i );
+		bool hasValue = ( i + 1 < args.size( ) );
+		if( arg == "--dump" )
+			dump = true;
+		else if( arg == "--to" && hasValue && hostPort( args.at( i + 1 ), &to, &toPort ) )
+			i++;
+		else if( arg == "--boards" && hasValue && hostPort( args.at( i + 1 ), &boards, &boardsPort ) )
+			i++;
+		else if( arg == "--speed" && hasValue )
+			speed = args.at( ++i ).toDouble( );
+		else
+		{
+			usage( );
+			return 1;
+		}
+	}
+
+	QFile file( args.at( 1 ) );
+	if( !file.open( QIODevice::ReadOnly ) || file.size( ) < 8 )
+	{
+		printf( "can't open %s\n", args.at( 1 ).toLocal8Bit( ).constData( ) );
+		return 1;
+	}
+	const char* data = (const char*)file.map( 0, file.size( ) );
+	if( data == NULL || memcmp( data, PACKET_CAPTURE_MAGIC, 8 ) != 0 )
+	{
+		printf( "%s isn't a capture\n", args.at( 1 ).toLocal8Bit( ).constData( ) );
+		return 1;
+	}
+	const char* next = data + 8;
+	qint64 remaining = file.size( ) - 8;
+
+	DumpMessages messages;
+	Osc osc;
+	osc.setInterfaces( &messages );
+	QHash<QByteArray, QUdpSocket*> boardSockets; // one per board in the capture, so each one's a board to mchelper
+	QUdpSocket toBoards;
+	qint64 firstRecord = -1, started = 0;
+	int replayed = 0;
+
+	PacketCapture::Record record;
+	int used;
+	while( ( used = PacketCapture::parse( next, (int)qMin( remaining, (qint64)0x7FFFFFFF ), &record ) ) > 0 )
+	{
+		next += used;
+		remaining -= used;
+		if( firstRecord < 0 )
+		{
+			firstRecord = record.time;
+			started = PacketCapture::nanoseconds( );
+		}
+		QByteArray key( record.key, record.keyLength );
+
+		if( dump )
+		{
+			printf( "%12.6f  %-16s %s %s\n", ( record.time - firstRecord ) / 1e9, key.constData( ),
+							( record.transport == PacketCapture::Udp ) ? "udp" : "usb",
+							( record.direction == PacketCapture::FromBoard ) ? "<-" : "->" );
+			QList<OscMessage*> msgs = osc.processPacket( (char*)record.packet, record.packetSize );
+			for( int i = 0; i < msgs.size( ); i++ )
+				printf( "    %s\n", msgs.at( i )->toString( ).toLocal8Bit( ).constData( ) );
+			qDeleteAll( msgs );
+			continue;
+		}
+
+		if( speed > 0 ) // wait until it's time - sleep most of the way, then spin
+		{
+			qint64 due = started + (qint64)( ( record.time - firstRecord ) / speed );
+			qint64 wait;
+			while( ( wait = due - PacketCapture::nanoseconds( ) ) > 0 )
+			{
+				if( wait > 2000000 )
+					Sleeper::usleep( (unsigned long)( ( wait - 1000000 ) / 1000 ) );
+			}
+		}
+
+		if( record.direction == PacketCapture::FromBoard )
+		{
+			QUdpSocket* socket = boardSockets.value( key );
+			if( socket == NULL )
+			{
+				socket = new QUdpSocket( );
+				socket->bind( QHostAddress( QString( "127.0.1.%1" ).arg( boardSockets.size( ) + 1 ) ), 0 );
+				boardSockets.insert( key, socket );
+			}
+			socket->writeDatagram( record.packet, record.packetSize, to, toPort );
+		}
+		else if( boardsPort != 0 )
+			toBoards.writeDatagram( record.packet, record.packetSize, boards, boardsPort );
+		else
+			continue;
+		replayed++;
+	}
+	if( used < 0 )
+		printf( "bad record at byte %lld - stopping there\n", (long long)( next - data ) );
+	if( !dump )
+		printf( "replayed %d packets from %d boards\n", replayed, boardSockets.size( ) );
+	qDeleteAll( boardSockets );
+	return 0;
+}
@@ -0,0 +1,40 @@
+# ------------------------------------------------------------------------------
+#
+# Copyright 2008 MakingThings
+#
+# Licensed under the Apache License, 
+# Version 2.0 (the "License"); you may not use this file except in compliance 
+# with the License. You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0 
+# 
+# Unless required by applicable law or agreed to in writing, software distributed
+# under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+# CONDITIONS OF ANY KIND, either express or implied. See the License for
+# the specific language governing permissions and limitations under the License.
+#
+# ------------------------------------------------------------------------------
+
+# Plays back board traffic captured by mchelper or mchelperd, into a running
+# mchelper and/or a virtual board, or dumps it.  Build with qmake && make,
+# then run ./capreplay <capture>
+
+TEMPLATE = app
+CONFIG += console release
+CONFIG -= app_bundle
+QT -= gui
+QT += network
+
+INCLUDEPATH += ../../include
+HEADERS = ../../include/PacketCapture.h \
+          ../../include/Osc.h
+SOURCES = capreplay.cpp \
+          ../../source/PacketCapture.cpp \
+          ../../source/Osc.cpp \
+          ../../source/MessageEvent.cpp
+
+TARGET = capreplay
+
+unix:!macx{
+  LIBS += -lrt
+}
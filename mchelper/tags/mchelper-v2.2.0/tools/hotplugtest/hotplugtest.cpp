@@ -0,0 +1,161 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+/*
+	Plugs and unplugs fake boards in a scratch directory while a
+	HotplugWatcher waits on it, the way UsbMonitor and SambaMonitor wait on
+	/dev.  Each step happens on another thread STEP_MS after we start
+	waiting, and we time how long it takes wait( ) to come back.
+
+	With inotify, it should come back for ttyACM* being created, having its
+	permissions changed and being deleted, and not for anything else.  Then
+	the same again with the watcher forced to poll, which is what you get on
+	Mac & Windows, or on Linux without inotify.
+
+	  hotplugtest
+*/
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QThread>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "HotplugWatcher.h"
+#include "Metrics.h"
+
+#define STEP_MS 250
+#define INOTIFY_MAX_MS 50 // more than this and something's wrong
+
+enum Action { Create, Chmod, Remove, CreateOther };
+
+class Plugger : public QThread
+{
+	public:
+		Plugger( QString dir ) : dir( dir ), at( 0 ) { }
+		QString dir;
+		QList<Action> actions;
+		QStringList names;
+		qint64 at; // just before the last step - we can hear about it before we'd get to note when it was done
+
+		void plan( Action action, QString name ) { actions.append( action ); names.append( name ); }
+
+	protected:
+		void run( )
+		{
+			for( int i = 0; i < actions.size( ); i++ )
+			{
+				msleep( STEP_MS );
+				QByteArray path = QString( dir + "/" + names.at( i ) ).toLocal8Bit( );
+				at = Metrics::microseconds( );
+				switch( actions.at( i ) )
+				{
+					case Create:
+					case CreateOther:
+					{
+						QFile f( path );
+						f.open( QIODevice::WriteOnly );
+						break;
+					}
+					case Chmod:
+						chmod( path.constData( ), 0666 );
+						break;
+					case Remove:
+						unlink( path.constData( ) );
+						break;
+				}
+			}
+		}
+};
+
+static int failures = 0;
+
+/*
+	Wait once for whatever's planned, and report how long after the last
+	step we found out about it.  Polling never knows what changed, it just
+	times out - so long as that's after the last step, it would have found it.
+*/
+static void step( HotplugWatcher* watcher, const char* label, QString dir, QList<Action> actions, QStringList names )
+{
+	Plugger plugger( dir );
+	for( int i = 0; i < actions.size( ); i++ )
+		plugger.plan( actions.at( i ), names.at( i ) );
+	plugger.start( );
+	bool changed = watcher->wait( );
+	qint64 woke = Metrics::microseconds( );
+	plugger.wait( );
+
+	// if it woke before the last step, it was for one of the earlier ones
+	bool early = ( plugger.at == 0 || woke < plugger.at );
+	double ms = early ? -1 : ( woke - plugger.at ) / 1000.0;
+	bool ok = ( changed == watcher->isWatching( ) ) && !early;
+	if( watcher->isWatching( ) && ms > INOTIFY_MAX_MS )
+		ok = false;
+	if( !ok )
+		failures++;
+	printf( "%-10s %-30s %-8s %10.1f ms  %s\n", watcher->isWatching( ) ? "inotify" : "polling", label,
+			changed ? "event" : "timeout", ms, ok ? "ok" : "FAILED" );
+}
+
+static void run( HotplugWatcher* watcher, QString dir )
+{
+	QList<Action> a;
+	QStringList n;
+	step( watcher, "ttyACM0 plugged in", dir, a << Create, n << "ttyACM0" );
+	a.clear( ); n.clear( );
+	step( watcher, "ttyACM0 permissions set", dir, a << Chmod, n << "ttyACM0" );
+	a.clear( ); n.clear( );
+	step( watcher, "console, then ttyACM1", dir, a << CreateOther << Create, n << "console" << "ttyACM1" );
+	a.clear( ); n.clear( );
+	step( watcher, "ttyACM0 unplugged", dir, a << Remove, n << "ttyACM0" );
+	a.clear( ); n.clear( );
+	step( watcher, "ttyACM1 unplugged", dir, a << Remove, n << "ttyACM1" );
+	QFile::remove( dir + "/console" );
+}
+
+int main( int argc, char** argv )
+{
+	QCoreApplication app( argc, argv );
+	QByteArray scratch = QDir::temp( ).filePath( "hotplugtest.XXXXXX" ).toLocal8Bit( );
+	if( mkdtemp( scratch.data( ) ) == NULL )
+	{
+		printf( "couldn't make a scratch directory\n" );
+		return 1;
+	}
+	QString dir( scratch );
+
+	{
+		HotplugWatcher watcher( QStringList( "ttyACM*" ) );
+		watcher.watch( dir );
+		if( watcher.isWatching( ) )
+			run( &watcher, dir );
+		else
+			printf( "no inotify here - only testing polling\n" );
+	}
+	{
+		HotplugWatcher watcher( QStringList( "ttyACM*" ) );
+		watcher.usePolling( );
+		run( &watcher, dir );
+	}
+
+	QDir( ).rmdir( dir );
+	printf( failures ? "%d FAILED\n" : "all ok\n", failures );
+	return failures ? 1 : 0;
+}
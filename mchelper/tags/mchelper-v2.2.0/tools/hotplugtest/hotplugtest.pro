@@ -0,0 +1,39 @@
+# ------------------------------------------------------------------------------
+#
+# Copyright 2008 MakingThings
+#
+# Licensed under the Apache License, 
+# Version 2.0 (the "License"); you may not use this file except in compliance 
+# with the License. You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0 
+# 
+# Unless required by applicable law or agreed to in writing, software distributed
+# under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+# CONDITIONS OF ANY KIND, either express or implied. See the License for
+# the specific language governing permissions and limitations under the License.
+#
+# ------------------------------------------------------------------------------
+
+# Checks that HotplugWatcher notices fake boards coming and going in a scratch
+# directory, and how long it takes, compared to polling once a second.
+# Build with qmake && make, then run ./hotplugtest - it exits non-zero if anything's missed.
+
+TEMPLATE = app
+CONFIG += console release
+CONFIG -= app_bundle
+QT -= gui
+QT += network
+DEFINES += Q_WS_LINUX
+
+INCLUDEPATH += ../../include
+HEADERS = ../../include/HotplugWatcher.h \
+          ../../include/Metrics.h
+SOURCES = hotplugtest.cpp \
+          ../../source/HotplugWatcher.cpp \
+          ../../source/Metrics.cpp \
+          ../../source/MessageEvent.cpp
+
+LIBS += -lrt
+
+TARGET = hotplugtest
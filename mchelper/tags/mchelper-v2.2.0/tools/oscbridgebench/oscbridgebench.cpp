@@ -0,0 +1,334 @@
+/*********************************************************************************
+
+ Copyright 2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+/*
+	XML bridge vs. binary frames, in packets per second.
+
+	out: what it costs to get one packet from a board out to every connected
+	client.  "DOM" builds a QDomDocument and serializes it once per client, the
+	way OscXmlClient::sendXmlPacket( ) used to.  "XML" is OscXmlWriter, which
+	streams the document out once for all of them.  Binary frames the packet
+	once, as McHelperWindow::sendOscPacket( ) does.  For the last two, each
+	client writes the same copy.
+
+	in: what it costs to turn a client's bytes into something for a board.
+	XML splits on \0 and runs QXmlSimpleReader with a handler that builds
+	OscMessages, like XmlHandler.  Binary picks frames apart and copies the packet.
+
+	Sockets are left out - both modes would pay the same for them.
+*/
+
+#include <QTime>
+#include <QStringList>
+#include <QDomDocument>
+#include <QXmlSimpleReader>
+#include <QXmlDefaultHandler>
+#include <QtEndian>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Osc.h"
+#include "OscBinaryFrame.h"
+#include "OscXmlWriter.h"
+
+#define RUN_MS 500
+#define BOARD_KEY "192.168.0.200"
+#define BOARD_PORT 10000
+
+// what sendXmlPacket( ) used to do, minus the socket
+static QByteArray xmlEncode( QList<OscMessage*> messageList, QString srcAddress, int srcPort )
+{
+	QDomDocument doc;
+	QDomElement oscPacket = doc.createElement( "OSCPACKET" );
+	oscPacket.setAttribute( "ADDRESS", srcAddress );
+	oscPacket.setAttribute( "PORT", srcPort );
+	oscPacket.setAttribute( "TIME", 0 );
+	doc.appendChild( oscPacket );
+
+	for( int i = 0; i < messageList.count( ); i++ )
+	{
+		OscMessage *oscMsg = messageList.at( i );
+		QDomElement msg = doc.createElement( "MESSAGE" );
+		msg.setAttribute( "NAME", oscMsg->addressPattern );
+		oscPacket.appendChild( msg );
+		for( int j = 0; j < oscMsg->data.count( ); j++ )
+		{
+			OscMessageData *data = oscMsg->data.at( j );
+			QDomElement argument = doc.createElement( "ARGUMENT" );
+			switch( data->type )
+			{
+				case OscMessageData::OmdString:
+					argument.setAttribute( "TYPE", "s" );
+					argument.setAttribute( "VALUE", QString( data->s ) );
+					break;
+				case OscMessageData::OmdInt:
+					argument.setAttribute( "TYPE", "i" );
+					argument.setAttribute( "VALUE", QString::number( data->i ) );
+					break;
+				case OscMessageData::OmdFloat:
+					argument.setAttribute( "TYPE", "f" );
+					argument.setAttribute( "VALUE", QString::number( data->f ) );
+					break;
+				case OscMessageData::OmdBlob:
+				{
+					QString blobstring;
+					unsigned char* blob = (unsigned char*)data->b.data( );
+					int blob_len = qFromBigEndian( *(int*)blob );
+					blob += sizeof(int);
+					while( blob_len-- )
+					{
+						blobstring.append( QString::number( (*blob >> 4) & 0x0f, 16 ) );
+						blobstring.append( QString::number(*blob++ & 0x0f, 16 ) );
+					}
+					argument.setAttribute( "TYPE", "b" );
+					argument.setAttribute( "VALUE", blobstring );
+					break;
+				}
+			}
+			msg.appendChild( argument );
+		}
+	}
+	return doc.toByteArray( ).append( '\0' );
+}
+
+// XmlHandler, minus the main window - counts the packets it would have sent
+class BenchHandler : public QXmlDefaultHandler
+{
+	public:
+		BenchHandler( ) : packets( 0 ), current( NULL ) { }
+		int packets;
+
+		bool startElement( const QString&, const QString& localName, const QString&, const QXmlAttributes& atts )
+		{
+			if( localName == "MESSAGE" )
+			{
+				current = new OscMessage( );
+				current->addressPattern = atts.value( "NAME" );
+			}
+			else if( localName == "ARGUMENT" )
+			{
+				QString type = atts.value( "TYPE" );
+				QString val = atts.value( "VALUE" );
+				if( type == "i" )
+					current->data.append( new OscMessageData( val.toInt( ) ) );
+				else if( type == "f" )
+					current->data.append( new OscMessageData( val.toFloat( ) ) );
+				else if( type == "s" )
+					current->data.append( new OscMessageData( val ) );
+				else if( type == "b" )
+					current->data.append( new OscMessageData( val.toAscii( ) ) );
+			}
+			return true;
+		}
+
+		bool endElement( const QString&, const QString& localName, const QString& )
+		{
+			if( localName == "MESSAGE" )
+				messages.append( current );
+			else if( localName == "OSCPACKET" )
+			{
+				packets++;
+				qDeleteAll( messages );
+				messages.clear( );
+			}
+			return true;
+		}
+
+	private:
+		OscMessage* current;
+		QList<OscMessage*> messages;
+};
+
+// the kind of thing a board sends - a single autosend message, a bundle of them, and one with a blob
+static QList<QByteArray> makePackets( )
+{
+	Osc osc;
+	QList<QByteArray> packets;
+	packets.append( osc.createPacket( QString( "/analogin/3/value 512" ) ) );
+
+	QStringList strings;
+	for( int i = 0; i < 8; i++ )
+		strings.append( QString( "/analogin/%1/value %2" ).arg( i ).arg( 512 + i ) );
+	strings.append( "/system/name \"Make Controller Kit\"" );
+	strings.append( "/appled/0/state 1.5" );
+	packets.append( osc.createPacket( strings ) );
+
+	OscMessage blobMsg;
+	blobMsg.addressPattern = "/serial/0/block";
+	QByteArray blob( 4 + 256, 0 );
+	qToBigEndian( 256, (uchar*)blob.data( ) );
+	for( int i = 0; i < 256; i++ )
+		blob[ 4 + i ] = (char)i;
+	blobMsg.data.append( new OscMessageData( blob ) );
+	QList<OscMessage*> blobList;
+	blobList.append( &blobMsg );
+	packets.append( osc.createPacket( blobList ) );
+	return packets;
+}
+
+static double xmlOut( const QByteArray& packet, int clients )
+{
+	OscDecoder decoder;
+	long bytes = 0, count = 0;
+	QTime timer;
+	timer.start( );
+	while( timer.elapsed( ) < RUN_MS )
+	{
+		int messages = decoder.decode( packet.constData( ), packet.size( ) );
+		QList<OscMessage*> list;
+		for( int i = 0; i < messages; i++ )
+			list.append( decoder.createOscMessage( i ) );
+		for( int c = 0; c < clients; c++ )
+			bytes += xmlEncode( list, BOARD_KEY, BOARD_PORT ).size( );
+		qDeleteAll( list );
+		count++;
+	}
+	return count * 1000.0 / qMax( timer.elapsed( ), 1 );
+}
+
+static double streamOut( const QByteArray& packet, int clients )
+{
+	OscDecoder decoder;
+	long bytes = 0, count = 0;
+	QTime timer;
+	timer.start( );
+	while( timer.elapsed( ) < RUN_MS )
+	{
+		decoder.decode( packet.constData( ), packet.size( ) );
+		QByteArray doc = OscXmlWriter::packet( decoder, BOARD_KEY, BOARD_PORT );
+		for( int c = 0; c < clients; c++ )
+		{
+			QByteArray shared = doc;
+			bytes += shared.size( );
+		}
+		count++;
+	}
+	return count * 1000.0 / qMax( timer.elapsed( ), 1 );
+}
+
+static double binaryOut( const QByteArray& packet, int clients )
+{
+	QByteArray key( BOARD_KEY );
+	long bytes = 0, count = 0;
+	QTime timer;
+	timer.start( );
+	while( timer.elapsed( ) < RUN_MS )
+	{
+		QByteArray frame = OscBinaryFrame::create( packet.constData( ), packet.size( ), key, BOARD_PORT, OscBinaryFrame::now( ) );
+		for( int c = 0; c < clients; c++ )
+		{
+			QByteArray shared = frame; // what each client's write gets - no copy
+			bytes += shared.size( );
+		}
+		count++;
+	}
+	return count * 1000.0 / qMax( timer.elapsed( ), 1 );
+}
+
+// a read's worth of back to back documents, like a busy client would send
+static double xmlIn( const QByteArray& packet, int* check )
+{
+	OscDecoder decoder;
+	int messages = decoder.decode( packet.constData( ), packet.size( ) );
+	QList<OscMessage*> list;
+	for( int i = 0; i < messages; i++ )
+		list.append( decoder.createOscMessage( i ) );
+	QByteArray doc = xmlEncode( list, BOARD_KEY, BOARD_PORT );
+	qDeleteAll( list );
+	QByteArray read;
+	for( int i = 0; i < 16; i++ )
+		read.append( doc );
+
+	BenchHandler handler;
+	QXmlSimpleReader xml;
+	xml.setContentHandler( &handler );
+	QXmlInputSource input;
+	QTime timer;
+	timer.start( );
+	while( timer.elapsed( ) < RUN_MS )
+	{
+		QList<QByteArray> documents = read.split( '\0' );
+		for( int i = 0; i < documents.size( ); i++ )
+		{
+			if( !documents.at( i ).size( ) )
+				continue;
+			input.setData( documents.at( i ) );
+			xml.parse( &input, true );
+		}
+	}
+	*check = handler.packets;
+	return handler.packets * 1000.0 / qMax( timer.elapsed( ), 1 );
+}
+
+static double binaryIn( const QByteArray& packet, int* check )
+{
+	QByteArray read;
+	for( int i = 0; i < 16; i++ )
+		OscBinaryFrame::append( &read, packet.constData( ), packet.size( ), BOARD_KEY, 0, 0 );
+
+	long count = 0;
+	int sizeCheck = 0;
+	QTime timer;
+	timer.start( );
+	while( timer.elapsed( ) < RUN_MS )
+	{
+		const char* next = read.constData( );
+		int remaining = read.size( );
+		OscBinaryFrame frame;
+		int used;
+		while( ( used = OscBinaryFrame::parse( next, remaining, &frame ) ) > 0 )
+		{
+			QByteArray forBoard( frame.packet, frame.packetSize );
+			QString key = QString::fromAscii( frame.key, frame.keyLength );
+			if( forBoard != packet || key != BOARD_KEY )
+				sizeCheck = -1;
+			next += used;
+			remaining -= used;
+			count++;
+		}
+	}
+	*check = sizeCheck;
+	return count * 1000.0 / qMax( timer.elapsed( ), 1 );
+}
+
+int main( int argc, char** argv )
+{
+	Q_UNUSED( argc );
+	Q_UNUSED( argv );
+	static const char* names[] = { "1 message", "10 msg bundle", "256 byte blob" };
+	static const int clientCounts[] = { 1, 8 };
+	QList<QByteArray> packets = makePackets( );
+
+	printf( "%-14s %8s %14s %14s %14s\n", "packet", "clients", "DOM pkts/s", "XML pkts/s", "binary pkts/s" );
+	for( int p = 0; p < packets.size( ); p++ )
+	{
+		for( unsigned int c = 0; c < sizeof( clientCounts ) / sizeof( int ); c++ )
+			printf( "%-14s %5d out %14.0f %14.0f %14.0f\n", names[ p ], clientCounts[ c ],
+					xmlOut( packets.at( p ), clientCounts[ c ] ), streamOut( packets.at( p ), clientCounts[ c ] ),
+					binaryOut( packets.at( p ), clientCounts[ c ] ) );
+		int xmlCheck, binaryCheck;
+		double xml = xmlIn( packets.at( p ), &xmlCheck );
+		double binary = binaryIn( packets.at( p ), &binaryCheck );
+		if( xmlCheck <= 0 || binaryCheck < 0 )
+		{
+			printf( "%s didn't come back out the way it went in\n", names[ p ] );
+			return 1;
+		}
+		printf( "%-14s %8s %14s %14.0f %14.0f\n", names[ p ], "in", "", xml, binary );
+	}
+	return 0;
+}
@@ -0,0 +1,132 @@
+/*********************************************************************************
+
+ Copyright 2008 MakingThings
+
+ Licensed under the Apache License, 
+ Version 2.0 (the "License"); you may not use this file except in compliance 
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0 
+ 
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+/*
+	Decode the same bundles over and over with the old Osc::processPacket( ) and
+	with OscDecoder, and report packets per second and heap allocations per packet.
+	The allocation count comes from replacing the global operator new below.
+*/
+
+#include <QTime>
+#include <QStringList>
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+
+#include "Osc.h"
+
+#if __cplusplus >= 201103L
+#define THROWS_BAD_ALLOC
+#define THROWS_NOTHING noexcept
+#else
+#define THROWS_BAD_ALLOC throw( std::bad_alloc )
+#define THROWS_NOTHING throw( )
+#endif
+
+static long allocations = 0;
+
+void* operator new( size_t size ) THROWS_BAD_ALLOC
+{
+	allocations++;
+	void* p = malloc( size ? size : 1 );
+	if( p == NULL )
+		throw std::bad_alloc( );
+	return p;
+}
+
+void operator delete( void* p ) THROWS_NOTHING
+{
+	free( p );
+}
+
+class QuietMessages : public MessageInterface
+{
+	public:
+		void messageThreadSafe( QString ) { }
+		void messageThreadSafe( QString, MessageEvent::Types ) { }
+		void messageThreadSafe( QString, MessageEvent::Types, QString ) { }
+		void messageThreadSafe( QStringList, MessageEvent::Types, QString ) { }
+		void progress( int ) { }
+		void statusMessage( const QString &, int ) { }
+};
+
+// a bundle like the one a board sends when it's autosending a handful of analogins
+static QByteArray makeBundle( int messages )
+{
+	Osc osc;
+	QStringList strings;
+	for( int i = 0; i < messages; i++ )
+		strings.append( QString( "/analogin/%1/value %2" ).arg( i ).arg( 512 + i ) );
+	strings.append( "/system/name \"Make Controller Kit\"" );
+	strings.append( "/appled/0/state 1.5" );
+	return osc.createPacket( strings );
+}
+
+int main( int argc, char** argv )
+{
+	int iterations = ( argc > 1 ) ? atoi( argv[1] ) : 200000;
+	int perBundle = ( argc > 2 ) ? atoi( argv[2] ) : 8;
+	QByteArray packet = makeBundle( perBundle );
+	QuietMessages messages;
+	Osc osc;
+	osc.setInterfaces( &messages );
+	OscDecoder decoder;
+	long checksum = 0;
+
+	printf( "%d iterations of a %d byte bundle with %d messages\n", iterations, packet.size( ), perBundle + 2 );
+
+	long before = allocations;
+	QTime t;
+	t.start( );
+	for( int i = 0; i < iterations; i++ )
+	{
+		QList<OscMessage*> list = osc.processPacket( packet.data( ), packet.size( ) );
+		for( int j = 0; j < list.size( ); j++ )
+		{
+			if( list.at( j )->data.size( ) && list.at( j )->data.at( 0 )->type == OscMessageData::OmdInt )
+				checksum += list.at( j )->data.at( 0 )->i;
+		}
+		qDeleteAll( list );
+	}
+	int elapsed = qMax( t.elapsed( ), 1 );
+	printf( "Osc::processPacket  %10.0f packets/sec  %6.1f allocations/packet\n",
+					iterations * 1000.0 / elapsed, (double)( allocations - before ) / iterations );
+
+	decoder.decode( packet.constData( ), packet.size( ) ); // warm up, so the decoder's lists are sized
+	before = allocations;
+	t.start( );
+	for( int i = 0; i < iterations; i++ )
+	{
+		int count = decoder.decode( packet.constData( ), packet.size( ) );
+		for( int j = 0; j < count; j++ )
+		{
+			const OscMessageView& msg = decoder.message( j );
+			if( msg.argCount && decoder.arg( msg, 0 ).type == 'i' )
+				checksum -= decoder.arg( msg, 0 ).toInt( );
+		}
+	}
+	elapsed = qMax( t.elapsed( ), 1 );
+	printf( "OscDecoder          %10.0f packets/sec  %6.1f allocations/packet\n",
+					iterations * 1000.0 / elapsed, (double)( allocations - before ) / iterations );
+
+	if( checksum != 0 ) // both paths should have seen exactly the same ints
+	{
+		printf( "mismatch between the two decoders!\n" );
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,321 @@
+/*********************************************************************************
+
+ Copyright 2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+/*
+	SAM-BA upload time, the old 2 ms sleeps vs. pipelined pages, and delta
+	uploads vs. writing everything.
+
+	There's no board here - a thread on the master side of a pty plays SAM-BA:
+	it parses N, S, W, w, R and G commands one at a time, keeps some SRAM and
+	flash, and when the loader gets run it copies the page buffer into flash
+	and then sits for PROGRAM_US, the way the real thing would while a page is
+	programmed.  Like USB, nothing more gets read while it's busy.
+
+	Each mode uploads the same random image, and the flash gets checked
+	against it afterwards.  For the delta runs, flash starts out holding an
+	older image with some percentage of its pages different, and "saved" is
+	the time compared to writing all of them at depth 2.  Pass an image size
+	in KB to change it from the default 64.
+
+	Unix only - it needs posix_openpt( ).
+*/
+
+#include <QtGlobal>
+#include <QByteArray>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <termios.h>
+
+#include "SambaFlasher.h"
+
+#define PAGE_SIZE 256
+#define PROGRAM_US 4000 // about what a SAM7X page write takes
+#define SRAM_BASE 0x00200000
+#define SRAM_SIZE ( 64 * 1024 )
+#define FLASH_BASE SAMBA_FLASH_ADDRESS
+#define FLASH_SIZE ( 256 * 1024 )
+#define READ_TIMEOUT 1000 // ms
+
+// stands in for the loader applet - only the address matters to the simulator
+static const uint8_t fakeLoader[ 512 ] = { 0 };
+
+class SambaSim
+{
+	public:
+		SambaSim( int fd ) : fd( fd ), programmed( 0 )
+		{
+			sram = new unsigned char[ SRAM_SIZE ];
+			flash = new unsigned char[ FLASH_SIZE ];
+			memset( sram, 0, SRAM_SIZE );
+			memset( flash, 0xFF, FLASH_SIZE );
+		}
+		~SambaSim( ) { delete [] sram; delete [] flash; }
+
+		int fd;
+		int programmed;
+		unsigned char* sram;
+		unsigned char* flash;
+
+		// one command at a time, until the other end goes away
+		void run( )
+		{
+			char cmd[ 64 ];
+			int length = 0;
+			char c;
+			while( readAll( &c, 1 ) )
+			{
+				if( c != '#' )
+				{
+					if( length < (int)sizeof( cmd ) - 1 )
+						cmd[ length++ ] = c;
+					continue;
+				}
+				cmd[ length ] = 0;
+				length = 0;
+				unsigned int addr = 0, value = 0;
+				sscanf( cmd + 1, "%x,%x", &addr, &value );
+				switch( cmd[ 0 ] )
+				{
+					case 'N':
+						writeAll( "\n\r", 2 );
+						break;
+					case 'S':
+						if( !inSram( addr, value ) || !readAll( (char*)sram + addr - SRAM_BASE, value ) )
+							return;
+						break;
+					case 'W':
+						if( inSram( addr, 4 ) )
+							memcpy( sram + addr - SRAM_BASE, &value, 4 ); // little endian, like the board
+						break;
+					case 'w':
+						if( inSram( addr, 4 ) )
+							writeAll( (char*)sram + addr - SRAM_BASE, 4 );
+						break;
+					case 'R':
+						if( inSram( addr, value ) )
+							writeAll( (char*)sram + addr - SRAM_BASE, value );
+						else if( addr >= FLASH_BASE && addr + value <= FLASH_BASE + FLASH_SIZE )
+							writeAll( (char*)flash + addr - FLASH_BASE, value );
+						break;
+					case 'G':
+						if( addr == SAMBA_LOADER_ADDRESS )
+							program( );
+						break;
+				}
+			}
+		}
+
+	private:
+		void program( )
+		{
+			uint32_t page;
+			memcpy( &page, sram + SAMBA_PAGE_BUFFER + PAGE_SIZE - SRAM_BASE, 4 );
+			if( ( page + 1 ) * PAGE_SIZE <= FLASH_SIZE )
+				memcpy( flash + page * PAGE_SIZE, sram + SAMBA_PAGE_BUFFER - SRAM_BASE, PAGE_SIZE );
+			programmed++;
+			usleep( PROGRAM_US );
+		}
+
+		bool inSram( unsigned int addr, unsigned int length )
+		{
+			return addr >= SRAM_BASE && addr + length <= SRAM_BASE + SRAM_SIZE;
+		}
+
+		bool readAll( char* data, int length )
+		{
+			while( length > 0 )
+			{
+				int r = read( fd, data, length );
+				if( r <= 0 )
+					return false;
+				data += r;
+				length -= r;
+			}
+			return true;
+		}
+
+		void writeAll( const char* data, int length )
+		{
+			while( length > 0 )
+			{
+				int r = write( fd, data, length );
+				if( r <= 0 )
+					return;
+				data += r;
+				length -= r;
+			}
+		}
+};
+
+static void* simThread( void* sim )
+{
+	( (SambaSim*)sim )->run( );
+	return NULL;
+}
+
+// the slave side of the pty, standing in for /dev/at91_0
+class PtyPort : public SambaFlasher::Port
+{
+	public:
+		PtyPort( int fd ) : fd( fd ) { }
+
+		int write( const char* data, int length )
+		{
+			int done = 0;
+			while( done < length )
+			{
+				int r = ::write( fd, data + done, length - done );
+				if( r < 0 )
+					return -1;
+				done += r;
+			}
+			return done;
+		}
+
+		int read( char* data, int length )
+		{
+			int got = 0;
+			while( got < length )
+			{
+				struct pollfd p = { fd, POLLIN, 0 };
+				if( poll( &p, 1, READ_TIMEOUT ) <= 0 )
+					return -1;
+				int r = ::read( fd, data + got, length - got );
+				if( r <= 0 )
+					return -1;
+				got += r;
+			}
+			return got;
+		}
+
+		void pause( int usecs ) { usleep( usecs ); }
+
+	private:
+		int fd;
+};
+
+static int openPty( int* slave )
+{
+	int master = posix_openpt( O_RDWR | O_NOCTTY );
+	if( master < 0 || grantpt( master ) < 0 || unlockpt( master ) < 0 )
+		return -1;
+	*slave = open( ptsname( master ), O_RDWR | O_NOCTTY );
+	if( *slave < 0 )
+		return -1;
+	// raw on both ends, so nothing gets echoed or turned into something else
+	struct termios t;
+	tcgetattr( *slave, &t );
+	cfmakeraw( &t );
+	tcsetattr( *slave, TCSANOW, &t );
+	tcgetattr( master, &t );
+	cfmakeraw( &t );
+	tcsetattr( master, TCSANOW, &t );
+	return master;
+}
+
+/*
+	before is what's in flash to start with - empty for erased.  The time it
+	took goes in elapsed, and for delta uploads, the difference from full.
+*/
+static bool runUpload( const char* mode, bool legacy, int depth, bool delta, const QByteArray& image,
+												const QByteArray& before, qint64 full, qint64* elapsed )
+{
+	int slave;
+	int master = openPty( &slave );
+	if( master < 0 )
+	{
+		printf( "couldn't open a pty\n" );
+		return false;
+	}
+
+	SambaSim sim( master );
+	memcpy( sim.flash, before.constData( ), before.size( ) );
+	pthread_t thread;
+	pthread_create( &thread, NULL, simThread, &sim );
+
+	PtyPort port( slave );
+	SambaFlasher flasher( &port, PAGE_SIZE );
+	flasher.setLegacy( legacy );
+	flasher.setPipelineDepth( depth );
+	flasher.setDelta( delta );
+	SambaFlasher::Status status = flasher.upload( fakeLoader, sizeof( fakeLoader ), image.constData( ), image.size( ) );
+	// legacy mode doesn't wait for the last page, so give it the time it would have taken
+	if( legacy )
+		usleep( PROGRAM_US * 2 );
+
+	close( slave );
+	pthread_join( thread, NULL );
+	close( master );
+
+	const SambaFlasher::Timing& t = flasher.timing( );
+	bool same = memcmp( sim.flash, image.constData( ), image.size( ) ) == 0;
+	printf( "%-10s %6d %7d %9lld %9lld %9lld %9lld %9lld %6s", mode, t.pages, t.skipped, t.total / 1000, t.loader / 1000,
+			t.sending / 1000, t.waiting / 1000, t.reading / 1000, ( status == SambaFlasher::OK && same ) ? "ok" : "BAD" );
+	if( delta )
+		printf( " %9lld", ( full - t.total ) / 1000 );
+	printf( "\n" );
+	*elapsed = t.total;
+	return status == SambaFlasher::OK && same;
+}
+
+// the image as it might have been before an update, with percent of its pages different
+static QByteArray olderImage( const QByteArray& image, int percent )
+{
+	QByteArray older = image;
+	int pages = ( image.size( ) + PAGE_SIZE - 1 ) / PAGE_SIZE;
+	int changed = ( pages * percent + 99 ) / 100;
+	for( int i = 0; i < changed; i++ )
+		older[ ( i * pages / changed ) * PAGE_SIZE ] ^= 0x55; // spread through the image, the way a rebuild moves things
+	return older;
+}
+
+int main( int argc, char** argv )
+{
+	int kbytes = ( argc > 1 ) ? atoi( argv[ 1 ] ) : 64;
+	if( kbytes <= 0 || kbytes * 1024 > FLASH_SIZE )
+	{
+		printf( "usage: sambabench [image size in KB, up to %d]\n", FLASH_SIZE / 1024 );
+		return 1;
+	}
+	QByteArray image( kbytes * 1024 - 100, 0 ); // not a whole number of pages, like a real .bin
+	srand( 1 );
+	for( int i = 0; i < image.size( ); i++ )
+		image[ i ] = (char)rand( );
+
+	QByteArray erased;
+	qint64 elapsed, full;
+	printf( "%-10s %6s %7s %9s %9s %9s %9s %9s %6s %9s\n", "mode", "pages", "skipped", "total ms", "loader", "sending",
+			"waiting", "reading", "flash", "saved ms" );
+	bool ok = runUpload( "legacy", true, 1, false, image, erased, 0, &elapsed );
+	ok &= runUpload( "depth 1", false, 1, false, image, erased, 0, &elapsed );
+	ok &= runUpload( "depth 2", false, SAMBA_PIPELINE_DEPTH, false, image, erased, 0, &full );
+	ok &= runUpload( "depth 4", false, 4, false, image, erased, 0, &elapsed );
+
+	int percents[] = { 0, 1, 5, 25, 100 };
+	for( unsigned int i = 0; i < sizeof( percents ) / sizeof( percents[ 0 ] ); i++ )
+	{
+		char mode[ 32 ];
+		snprintf( mode, sizeof( mode ), "delta %d%%", percents[ i ] );
+		ok &= runUpload( mode, false, SAMBA_PIPELINE_DEPTH, true, image, olderImage( image, percents[ i ] ), full, &elapsed );
+	}
+	return ok ? 0 : 1;
+}
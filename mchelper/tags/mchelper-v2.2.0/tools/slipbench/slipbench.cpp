@@ -0,0 +1,232 @@
+/*********************************************************************************
+
+ Copyright 2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+/*
+	SLIP decoding throughput, old vs. new.
+
+	Builds SLIP streams out of random packets with more and more of their bytes
+	needing to be escaped - up to every single one, the worst case - then feeds
+	them through in reads of different sizes, the way PacketUsbCdc gets them
+	from the port.  "old" is the loop PacketUsbCdc::slipReceive( ) used to run,
+	which removes each byte from the front of the read buffer as it goes.
+	"new" is SlipDecoder.  Each is run for a fixed amount of time and we report
+	MB/s of SLIP encoded input.
+*/
+
+#include <QByteArray>
+#include <QTime>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "SlipDecoder.h"
+
+// SLIP codes
+#define END             0300    // indicates end of packet
+#define ESC             0333    // indicates byte stuffing
+#define ESC_END         0334    // ESC ESC_END means END data byte
+#define ESC_ESC         0335    // ESC ESC_ESC means ESC data byte
+
+#define RUN_MS 300
+
+static QByteArray makePacket( int size, int escapePercent )
+{
+	QByteArray packet;
+	for( int i = 0; i < size; i++ )
+	{
+		if( rand( ) % 100 < escapePercent )
+			packet.append( (char)( ( rand( ) & 1 ) ? END : ESC ) );
+		else
+			packet.append( (char)( 'a' + rand( ) % 26 ) );
+	}
+	return packet;
+}
+
+static void slipEncode( const QByteArray& packet, QByteArray* stream )
+{
+	for( int i = 0; i < packet.size( ); i++ )
+	{
+		char c = packet.at( i );
+		if( c == (char)END )
+		{
+			stream->append( (char)ESC );
+			stream->append( (char)ESC_END );
+		}
+		else if( c == (char)ESC )
+		{
+			stream->append( (char)ESC );
+			stream->append( (char)ESC_ESC );
+		}
+		else
+			stream->append( c );
+	}
+	stream->append( (char)END );
+}
+
+/*
+	The old decoder, as it was in PacketUsbCdc, minus the port.  rx is the read
+	buffer, and each call takes one packet off the front of it.
+*/
+static int oldSlipReceive( QByteArray* rx, QByteArray* packet )
+{
+	int started = 0, count = 0, finished = 0, i;
+	int size = rx->size( );
+	for( i = 0; i < size; i++ )
+	{
+		char c = *rx->data( );
+		switch( c )
+		{
+			case (char)END:
+				if( started && count )
+					finished = true;
+				else
+					started = true;
+				break;
+			case (char)ESC:
+				rx->remove( 0, 1 );
+				c = *rx->data( );
+				// no break
+			default:
+				if( started )
+				{
+					packet->append( c );
+					count++;
+				}
+				break;
+		}
+		rx->remove( 0, 1 );
+		if( finished )
+			return count;
+	}
+	return 0;
+}
+
+static double oldDecoder( const QByteArray& stream, int readSize )
+{
+	QTime timer;
+	qint64 bytes = 0;
+	QByteArray rx, packet;
+	timer.start( );
+	while( timer.elapsed( ) < RUN_MS )
+	{
+		for( int pos = 0; pos < stream.size( ); pos += readSize )
+		{
+			rx = QByteArray( stream.constData( ) + pos, qMin( readSize, stream.size( ) - pos ) );
+			while( rx.size( ) > 0 )
+			{
+				packet.clear( );
+				oldSlipReceive( &rx, &packet );
+			}
+		}
+		bytes += stream.size( );
+	}
+	return bytes / ( timer.elapsed( ) / 1000.0 ) / ( 1024 * 1024 );
+}
+
+static double newDecoder( const QByteArray& stream, int readSize )
+{
+	QTime timer;
+	qint64 bytes = 0;
+	SlipDecoder decoder;
+	char packet[ 8192 ];
+	timer.start( );
+	while( timer.elapsed( ) < RUN_MS )
+	{
+		for( int pos = 0; pos < stream.size( ); pos += readSize )
+		{
+			const char* read = stream.constData( ) + pos;
+			int remaining = qMin( readSize, stream.size( ) - pos );
+			while( remaining > 0 )
+			{
+				int used = decoder.decode( read, remaining );
+				read += used;
+				remaining -= used;
+				while( decoder.isPacketWaiting( ) )
+					decoder.takePacket( packet, sizeof( packet ) );
+			}
+		}
+		bytes += stream.size( );
+	}
+	return bytes / ( timer.elapsed( ) / 1000.0 ) / ( 1024 * 1024 );
+}
+
+// make sure SlipDecoder hands back exactly what went in, however the stream is chopped up
+static bool check( const QList<QByteArray>& packets, const QByteArray& stream, int readSize )
+{
+	SlipDecoder decoder( 4 ); // small, so the queue fills up & decode( ) has to stop early
+	char packet[ 8192 ];
+	int next = 0;
+	for( int pos = 0; pos < stream.size( ); pos += readSize )
+	{
+		const char* read = stream.constData( ) + pos;
+		int remaining = qMin( readSize, stream.size( ) - pos );
+		while( remaining > 0 )
+		{
+			int used = decoder.decode( read, remaining );
+			read += used;
+			remaining -= used;
+			while( decoder.isPacketWaiting( ) )
+			{
+				int length = decoder.takePacket( packet, sizeof( packet ) );
+				if( next >= packets.size( ) || QByteArray( packet, length ) != packets.at( next ) )
+				{
+					printf( "packet %d came out wrong with reads of %d bytes\n", next, readSize );
+					return false;
+				}
+				next++;
+			}
+		}
+	}
+	if( next != packets.size( ) )
+	{
+		printf( "only got %d of %d packets with reads of %d bytes\n", next, packets.size( ), readSize );
+		return false;
+	}
+	return true;
+}
+
+int main( int argc, char** argv )
+{
+	Q_UNUSED( argc );
+	Q_UNUSED( argv );
+	static const int escapes[] = { 0, 10, 50, 100 };
+	static const int packetSizes[] = { 64, 4096 };
+	static const int readSizes[] = { 64, 4096, 65536 };
+	srand( 12345 );
+
+	printf( "%8s %8s %8s %12s %12s\n", "packet", "escaped", "read", "old MB/s", "new MB/s" );
+	for( unsigned int s = 0; s < sizeof( packetSizes ) / sizeof( int ); s++ )
+	{
+		for( unsigned int e = 0; e < sizeof( escapes ) / sizeof( int ); e++ )
+		{
+			QList<QByteArray> packets;
+			QByteArray stream;
+			while( stream.size( ) < 256 * 1024 )
+			{
+				packets.append( makePacket( packetSizes[ s ], escapes[ e ] ) );
+				slipEncode( packets.last( ), &stream );
+			}
+			for( unsigned int r = 0; r < sizeof( readSizes ) / sizeof( int ); r++ )
+			{
+				if( !check( packets, stream, readSizes[ r ] ) )
+					return 1;
+				printf( "%8d %7d%% %8d %12.1f %12.1f\n", packetSizes[ s ], escapes[ e ], readSizes[ r ],
+						oldDecoder( stream, readSizes[ r ] ), newDecoder( stream, readSizes[ r ] ) );
+			}
+		}
+	}
+	return 0;
+}
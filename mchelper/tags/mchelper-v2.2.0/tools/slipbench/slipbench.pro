@@ -0,0 +1,31 @@
+# ------------------------------------------------------------------------------
+#
+# Copyright 2008 MakingThings
+#
+# Licensed under the Apache License, 
+# Version 2.0 (the "License"); you may not use this file except in compliance 
+# with the License. You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0 
+# 
+# Unless required by applicable law or agreed to in writing, software distributed
+# under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+# CONDITIONS OF ANY KIND, either express or implied. See the License for
+# the specific language governing permissions and limitations under the License.
+#
+# ------------------------------------------------------------------------------
+
+# SLIP decoding throughput - the old PacketUsbCdc loop against SlipDecoder,
+# up to worst case escape density.  Build with qmake && make, then run ./slipbench
+
+TEMPLATE = app
+CONFIG += console release
+CONFIG -= app_bundle
+QT -= gui
+
+INCLUDEPATH += ../../include
+HEADERS = ../../include/SlipDecoder.h
+SOURCES = slipbench.cpp \
+          ../../source/SlipDecoder.cpp
+
+TARGET = slipbench
@@ -0,0 +1,256 @@
+/*********************************************************************************
+
+ Copyright 2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+/*
+	UDP receive throughput, event loop vs. receive thread.
+
+	A sender thread replays autosend style packets - /analogin/N/value with an
+	int - as fast as it can from a number of fake boards, each bound to its own
+	loopback address (127.0.1.x), for RUN_MS.  Then we wait a little for the
+	tail end to be read, and report how many datagrams per second made it to
+	the boards and how many were lost along the way.
+
+	"loop" reads on the event loop, as NetworkMonitor::processPendingDatagrams( )
+	does: a pendingDatagramSize( ) and readDatagram( ) per datagram, and boards
+	looked up by sender.toString( ).  "thread" is UdpReceiver.  Boards on both
+	sides are a PacketRing that gets drained by processPacket( ), like PacketUdp.
+
+	Loopback addresses other than 127.0.0.1 work out of the box on Linux - on
+	other systems they'll need to be aliased first.
+*/
+
+#include <QCoreApplication>
+#include <QUdpSocket>
+#include <QHostAddress>
+#include <QThread>
+#include <QTimer>
+#include <QTime>
+#include <QHash>
+#include <QList>
+#include <stdio.h>
+#include <string.h>
+
+#include "UdpReceiver.h"
+#include "PacketRing.h"
+
+#define RUN_MS 1000
+#define DRAIN_MS 200
+#define BENCH_PORT 10123
+
+// looks just enough like a board - queue it, then drain the queue
+class FakeBoard : public DatagramInterface
+{
+	public:
+		FakeBoard( ) : received( 0 ) { }
+		bool incomingMessage( const char* data, int length ) { return incoming.write( data, length ); }
+		void processPacket( )
+		{
+			while( incoming.isPacketWaiting( ) )
+			{
+				incoming.read( packet, sizeof( packet ) );
+				received++;
+			}
+		}
+		int dropped( ) { return incoming.overflowCount( ); }
+		int received;
+
+	private:
+		PacketRing incoming;
+		char packet[ 2048 ];
+};
+
+// a packet the way the board's autosend puts it together
+static QByteArray analogInPacket( int channel, int value )
+{
+	QByteArray packet( QString( "/analogin/%1/value" ).arg( channel ).toAscii( ) );
+	do
+		packet.append( '\0' );
+	while( packet.size( ) % 4 );
+	packet.append( ",i\0\0", 4 );
+	char v[ 4 ] = { 0, 0, (char)( value >> 8 ), (char)value };
+	packet.append( v, 4 );
+	return packet;
+}
+
+class Sender : public QThread
+{
+	public:
+		Sender( int boards ) : boards( boards ), sent( 0 ) { }
+		int boards;
+		int sent;
+
+	protected:
+		void run( )
+		{
+			QList<QUdpSocket*> sockets;
+			QList<QByteArray> packets;
+			for( int i = 0; i < boards; i++ )
+			{
+				QUdpSocket* s = new QUdpSocket( );
+				s->bind( QHostAddress( QString( "127.0.1.%1" ).arg( i + 1 ) ), 0 );
+				sockets.append( s );
+			}
+			for( int i = 0; i < 8; i++ )
+				packets.append( analogInPacket( i, i * 100 ) );
+
+			QHostAddress local( QHostAddress::LocalHost );
+			QTime timer;
+			timer.start( );
+			while( timer.elapsed( ) < RUN_MS )
+			{
+				for( int i = 0; i < boards; i++ )
+				{
+					const QByteArray& p = packets.at( sent % packets.size( ) );
+					if( sockets.at( i )->writeDatagram( p.constData( ), p.size( ), local, BENCH_PORT ) > 0 )
+						sent++;
+				}
+			}
+			qDeleteAll( sockets );
+		}
+};
+
+// the event loop version
+class LoopReader : public QObject
+{
+	Q_OBJECT
+	public:
+		LoopReader( )
+		{
+			socket.bind( BENCH_PORT, QUdpSocket::ShareAddress );
+			connect( &socket, SIGNAL( readyRead( ) ), this, SLOT( processPendingDatagrams( ) ) );
+		}
+		~LoopReader( ) { qDeleteAll( boards ); }
+		QHash<QString, FakeBoard*> boards;
+
+	private slots:
+		void processPendingDatagrams( )
+		{
+			QList<FakeBoard*> ready;
+			while( socket.hasPendingDatagrams( ) )
+			{
+				QHostAddress sender;
+				int size = socket.pendingDatagramSize( );
+				if( datagram.size( ) < size )
+					datagram.resize( size );
+				size = socket.readDatagram( datagram.data( ), size, &sender );
+				if( size < 0 )
+					break;
+				QString key = sender.toString( );
+				if( !boards.contains( key ) )
+					boards.insert( key, new FakeBoard( ) );
+				FakeBoard* board = boards.value( key );
+				board->incomingMessage( datagram.constData( ), size );
+				if( !ready.contains( board ) )
+					ready.append( board );
+			}
+			for( int i = 0; i < ready.size( ); i++ )
+				ready.at( i )->processPacket( );
+		}
+
+	private:
+		QUdpSocket socket;
+		QByteArray datagram;
+};
+
+// hands the receiver a board for every new sender, like NetworkMonitor::newSender( )
+class ThreadBoards : public QObject
+{
+	Q_OBJECT
+	public:
+		ThreadBoards( UdpReceiver* receiver ) : receiver( receiver )
+		{
+			connect( receiver, SIGNAL( newSender( quint32 ) ), this, SLOT( newSender( quint32 ) ), Qt::QueuedConnection );
+		}
+		~ThreadBoards( ) { qDeleteAll( boards ); }
+		QHash<quint32, FakeBoard*> boards;
+
+	private slots:
+		void newSender( quint32 address )
+		{
+			FakeBoard* board = new FakeBoard( );
+			boards.insert( address, board );
+			receiver->addDevice( address, board );
+		}
+
+	private:
+		UdpReceiver* receiver;
+};
+
+static int totalReceived( const QList<FakeBoard*>& boards, int* dropped )
+{
+	int received = 0;
+	*dropped = 0;
+	for( int i = 0; i < boards.size( ); i++ )
+	{
+		received += boards.at( i )->received;
+		*dropped += boards.at( i )->dropped( );
+	}
+	return received;
+}
+
+// flood for RUN_MS, then give whatever's left in the socket DRAIN_MS to be read
+static void runSender( QCoreApplication* app, Sender* sender )
+{
+	sender->start( );
+	QTimer::singleShot( RUN_MS + DRAIN_MS, app, SLOT( quit( ) ) );
+	app->exec( );
+	sender->wait( );
+}
+
+static void report( const char* mode, int boards, int sent, int received, int dropped )
+{
+	printf( "%8s %8d %12d %14.0f %9.1f%% %10d\n", mode, boards, sent, received / ( RUN_MS / 1000.0 ),
+			sent ? 100.0 * ( sent - received ) / sent : 0.0, dropped );
+}
+
+int main( int argc, char** argv )
+{
+	QCoreApplication app( argc, argv );
+	static const int boardCounts[] = { 1, 16, 128 };
+
+	printf( "%8s %8s %12s %14s %10s %10s\n", "mode", "boards", "sent", "received/s", "lost", "ring full" );
+	for( unsigned int b = 0; b < sizeof( boardCounts ) / sizeof( int ); b++ )
+	{
+		int dropped;
+		{
+			LoopReader reader;
+			Sender sender( boardCounts[ b ] );
+			runSender( &app, &sender );
+			int received = totalReceived( reader.boards.values( ), &dropped );
+			report( "loop", boardCounts[ b ], sender.sent, received, dropped );
+		}
+		{
+			UdpReceiver receiver;
+			ThreadBoards boards( &receiver );
+			if( !receiver.open( BENCH_PORT ) )
+			{
+				printf( "couldn't bind to port %d\n", BENCH_PORT );
+				return 1;
+			}
+			Sender sender( boardCounts[ b ] );
+			runSender( &app, &sender );
+			receiver.stop( ); // so the boards can be read without racing the thread
+			int received = totalReceived( boards.boards.values( ), &dropped );
+			report( "thread", boardCounts[ b ], sender.sent, received, dropped );
+			printf( "%8s %8s %12s %14.1f datagrams per read\n", "", "", "",
+					receiver.batchCount( ) ? (double)receiver.datagramCount( ) / receiver.batchCount( ) : 0.0 );
+		}
+	}
+	return 0;
+}
+
+#include "udprecvbench.moc"
@@ -0,0 +1,36 @@
+# ------------------------------------------------------------------------------
+#
+# Copyright 2008 MakingThings
+#
+# Licensed under the Apache License, 
+# Version 2.0 (the "License"); you may not use this file except in compliance 
+# with the License. You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0 
+# 
+# Unless required by applicable law or agreed to in writing, software distributed
+# under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+# CONDITIONS OF ANY KIND, either express or implied. See the License for
+# the specific language governing permissions and limitations under the License.
+#
+# ------------------------------------------------------------------------------
+
+# UDP receive throughput - datagrams read on the event loop, the way
+# NetworkMonitor does by default, against UdpReceiver on its own thread.
+# Floods localhost from a replay sender.  Build with qmake && make, then run ./udprecvbench
+
+TEMPLATE = app
+CONFIG += console release
+CONFIG -= app_bundle
+QT -= gui
+QT += network
+
+INCLUDEPATH += ../../include
+HEADERS = ../../include/UdpReceiver.h \
+          ../../include/PacketRing.h \
+          ../../include/DatagramInterface.h
+SOURCES = udprecvbench.cpp \
+          ../../source/UdpReceiver.cpp \
+          ../../source/PacketRing.cpp
+
+TARGET = udprecvbench
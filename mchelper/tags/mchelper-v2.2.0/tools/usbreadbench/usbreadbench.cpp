@@ -0,0 +1,283 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+/*
+	Reading from USB boards on Linux - a thread for each board checking its
+	port and sleeping 1 ms when there's nothing there, the way
+	PacketUsbCdc::run( ) does, vs. the UsbReactor waiting on all of them in
+	one poll( ).
+
+	Each fake board is the master side of a pty, with a thread sending
+	FRAME_SIZE byte packets, SLIP encoded, at a steady rate, each carrying the
+	time it was sent.  We read the slave sides, decode them with SlipDecoder,
+	and time each packet from being sent to being taken out of the decoder.
+	CPU time is for the whole process, so it includes the boards' threads,
+	which do the same in both modes.  Wakeups are the times a port got looked
+	at, whether there was anything there or not.
+
+	  usbreadbench [boards] [packets/s per board]
+
+	Linux only.
+*/
+
+#include <QThread>
+#include <QVector>
+#include <QtAlgorithms>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+
+#include "UsbReactor.h"
+#include "SlipDecoder.h"
+#include "Metrics.h"
+
+#define RUN_MS 3000
+#define DRAIN_MS 100
+#define FRAME_SIZE 32
+#define READ_SIZE 4096
+
+#define END 0300
+#define ESC 0333
+#define ESC_END 0334
+#define ESC_ESC 0335
+
+// a packet with the time in it, SLIP encoded
+static int encodeFrame( char* frame, qint64 sent )
+{
+	char packet[ FRAME_SIZE ];
+	memset( packet, 0, sizeof( packet ) );
+	memcpy( packet, &sent, sizeof( sent ) );
+	int length = 0;
+	frame[ length++ ] = (char)END;
+	for( int i = 0; i < FRAME_SIZE; i++ )
+	{
+		if( (uchar)packet[ i ] == END || (uchar)packet[ i ] == ESC )
+		{
+			frame[ length++ ] = (char)ESC;
+			frame[ length++ ] = (char)( ( (uchar)packet[ i ] == END ) ? ESC_END : ESC_ESC );
+		}
+		else
+			frame[ length++ ] = packet[ i ];
+	}
+	frame[ length++ ] = (char)END;
+	return length;
+}
+
+class FakeBoard : public QThread
+{
+	public:
+		FakeBoard( int fd, int rate ) : fd( fd ), rate( rate ), stop( false ) { }
+		int fd;
+		int rate;
+		volatile bool stop;
+
+	protected:
+		void run( )
+		{
+			qint64 interval = 1000000 / rate;
+			qint64 next = Metrics::microseconds( );
+			char frame[ 2 * FRAME_SIZE + 2 ];
+			while( !stop )
+			{
+				int length = encodeFrame( frame, Metrics::microseconds( ) );
+				if( write( fd, frame, length ) < length )
+					return;
+				next += interval;
+				qint64 wait = next - Metrics::microseconds( );
+				if( wait > 0 )
+					usleep( wait );
+			}
+		}
+};
+
+// our end of a board's port - read either way
+class Port : public UsbReactor::Handler
+{
+	public:
+		Port( int fd ) : fd( fd ), wakeups( 0 ) { }
+		int fd;
+		int wakeups;
+		SlipDecoder slip;
+		QVector<qint64> latencies;
+
+		// the reactor's way - read until there's nothing left
+		bool readable( qint64 wokeAt )
+		{
+			(void)wokeAt;
+			wakeups++;
+			char buffer[ READ_SIZE ];
+			int got;
+			while( ( got = read( fd, buffer, sizeof( buffer ) ) ) > 0 )
+				decode( buffer, got );
+			return got < 0 && errno == EAGAIN;
+		}
+
+		// the old way, on a thread of its own
+		void poll( volatile bool* stop )
+		{
+			char buffer[ READ_SIZE ];
+			while( !*stop )
+			{
+				wakeups++;
+				int available = 0;
+				ioctl( fd, FIONREAD, &available );
+				int got = ( available > 0 ) ? read( fd, buffer, qMin( available, READ_SIZE ) ) : 0;
+				if( got > 0 )
+					decode( buffer, got );
+				else
+					usleep( 1000 );
+			}
+		}
+
+	private:
+		void decode( const char* data, int length )
+		{
+			int done = 0;
+			while( done < length )
+			{
+				done += slip.decode( data + done, length - done );
+				char packet[ FRAME_SIZE ];
+				while( slip.isPacketWaiting( ) )
+				{
+					if( slip.takePacket( packet, sizeof( packet ) ) == FRAME_SIZE )
+					{
+						qint64 sent;
+						memcpy( &sent, packet, sizeof( sent ) );
+						latencies.append( Metrics::microseconds( ) - sent );
+					}
+				}
+			}
+		}
+};
+
+class Poller : public QThread
+{
+	public:
+		Poller( Port* port, volatile bool* stop ) : port( port ), stop( stop ) { }
+	protected:
+		void run( ) { port->poll( stop ); }
+	private:
+		Port* port;
+		volatile bool* stop;
+};
+
+static void makeRaw( int fd )
+{
+	struct termios t;
+	tcgetattr( fd, &t );
+	cfmakeraw( &t );
+	tcsetattr( fd, TCSANOW, &t );
+}
+
+static qint64 cpuMicroseconds( )
+{
+	struct rusage r;
+	getrusage( RUSAGE_SELF, &r );
+	return (qint64)( r.ru_utime.tv_sec + r.ru_stime.tv_sec ) * 1000000 + r.ru_utime.tv_usec + r.ru_stime.tv_usec;
+}
+
+static bool runMode( const char* mode, bool reactor, int boards, int rate )
+{
+	QList<FakeBoard*> fakeBoards;
+	QList<Port*> ports;
+	QList<Poller*> pollers;
+	volatile bool stopPolling = false;
+	for( int i = 0; i < boards; i++ )
+	{
+		int master = posix_openpt( O_RDWR | O_NOCTTY );
+		if( master < 0 || grantpt( master ) < 0 || unlockpt( master ) < 0 )
+		{
+			printf( "couldn't open a pty\n" );
+			return false;
+		}
+		int slave = open( ptsname( master ), O_RDWR | O_NOCTTY | O_NONBLOCK );
+		makeRaw( master );
+		makeRaw( slave );
+		fakeBoards.append( new FakeBoard( master, rate ) );
+		ports.append( new Port( slave ) );
+		if( reactor )
+			UsbReactor::instance( )->add( slave, ports.last( ) );
+		else
+			pollers.append( new Poller( ports.last( ), &stopPolling ) );
+	}
+
+	qint64 cpuStart = cpuMicroseconds( );
+	qint64 start = Metrics::microseconds( );
+	for( int i = 0; i < pollers.size( ); i++ )
+		pollers.at( i )->start( );
+	for( int i = 0; i < boards; i++ )
+		fakeBoards.at( i )->start( );
+	usleep( RUN_MS * 1000 );
+	for( int i = 0; i < boards; i++ )
+	{
+		fakeBoards.at( i )->stop = true;
+		fakeBoards.at( i )->wait( );
+	}
+	usleep( DRAIN_MS * 1000 );
+	stopPolling = true;
+	for( int i = 0; i < pollers.size( ); i++ )
+		pollers.at( i )->wait( );
+	for( int i = 0; i < ports.size( ); i++ )
+		UsbReactor::instance( )->remove( ports.at( i ) );
+	double seconds = ( Metrics::microseconds( ) - start ) / 1000000.0;
+	qint64 cpu = cpuMicroseconds( ) - cpuStart;
+
+	QVector<qint64> latencies;
+	int wakeups = 0;
+	for( int i = 0; i < boards; i++ )
+	{
+		latencies += ports.at( i )->latencies;
+		wakeups += ports.at( i )->wakeups;
+		close( ports.at( i )->fd );
+		close( fakeBoards.at( i )->fd );
+	}
+	qDeleteAll( pollers );
+	qDeleteAll( ports );
+	qDeleteAll( fakeBoards );
+
+	qSort( latencies );
+	qint64 total = 0;
+	for( int i = 0; i < latencies.size( ); i++ )
+		total += latencies.at( i );
+	int n = latencies.size( );
+	printf( "%-8s %7d %9d %10.0f %6.1f%% %8.1f %8lld %8lld %8lld\n", mode, boards, n, wakeups / seconds,
+			100.0 * cpu / ( seconds * 1000000 ), n ? (double)total / n : 0.0,
+			n ? latencies.at( n / 2 ) : 0, n ? latencies.at( n * 99 / 100 ) : 0, n ? latencies.last( ) : 0 );
+	return n > 0;
+}
+
+int main( int argc, char** argv )
+{
+	int boards = ( argc > 1 ) ? atoi( argv[ 1 ] ) : 16;
+	int rate = ( argc > 2 ) ? atoi( argv[ 2 ] ) : 100;
+	if( boards <= 0 || rate <= 0 )
+	{
+		printf( "usage: usbreadbench [boards] [packets/s per board]\n" );
+		return 1;
+	}
+	printf( "%-8s %7s %9s %10s %7s %8s %8s %8s %8s\n", "mode", "boards", "packets", "wakeups/s", "cpu", "avg us",
+			"p50 us", "p99 us", "max us" );
+	bool ok = runMode( "sleep", false, boards, rate );
+	ok &= runMode( "reactor", true, boards, rate );
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,43 @@
+# ------------------------------------------------------------------------------
+#
+# Copyright 2008 MakingThings
+#
+# Licensed under the Apache License, 
+# Version 2.0 (the "License"); you may not use this file except in compliance 
+# with the License. You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0 
+# 
+# Unless required by applicable law or agreed to in writing, software distributed
+# under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+# CONDITIONS OF ANY KIND, either express or implied. See the License for
+# the specific language governing permissions and limitations under the License.
+#
+# ------------------------------------------------------------------------------
+
+# Reading from USB boards on Linux, a thread each sleeping 1 ms vs. the UsbReactor,
+# with ptys standing in for the boards.
+# Build with qmake && make, then run ./usbreadbench
+
+TEMPLATE = app
+CONFIG += console release
+CONFIG -= app_bundle
+QT -= gui
+QT += network
+DEFINES += Q_WS_LINUX
+
+INCLUDEPATH += ../../include
+HEADERS = ../../include/UsbReactor.h \
+          ../../include/SlipDecoder.h \
+          ../../include/Metrics.h \
+          ../../include/Osc.h
+SOURCES = usbreadbench.cpp \
+          ../../source/UsbReactor.cpp \
+          ../../source/SlipDecoder.cpp \
+          ../../source/Metrics.cpp \
+          ../../source/Osc.cpp \
+          ../../source/MessageEvent.cpp
+
+LIBS += -lrt
+
+TARGET = usbreadbench
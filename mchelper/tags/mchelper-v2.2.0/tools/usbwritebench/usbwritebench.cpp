@@ -0,0 +1,304 @@
+/*********************************************************************************
+
+ Copyright 2006-2008 MakingThings
+
+ Licensed under the Apache License,
+ Version 2.0 (the "License"); you may not use this file except in compliance
+ with the License. You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software distributed
+ under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ CONDITIONS OF ANY KIND, either express or implied. See the License for
+ the specific language governing permissions and limitations under the License.
+
+*********************************************************************************/
+
+/*
+	Writing to a USB board - the old PacketUsbCdc::sendPacket( ), which built
+	each frame up a byte at a time in a new QByteArray and wrote it straight
+	out, vs. handing packets to a UsbWriter, with and without a window.
+
+	The board is the master side of a pty, with a thread reading it as fast
+	as it can and decoding with SlipDecoder.  We're the slave side, with a
+	number of threads standing in for clients, each sending PACKET_SIZE byte
+	packets as fast as they'll go for RUN_MS.  Every packet carries who sent
+	it and a sequence number, and the board checks they all turn up, in order.
+	CPU time is for the whole process, board included.
+
+	  usbwritebench [clients]
+
+	Linux, or anywhere else with ptys.
+*/
+
+#include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QByteArray>
+#include <QVector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/resource.h>
+
+#include "UsbWriter.h"
+#include "SlipEncoder.h"
+#include "SlipDecoder.h"
+#include "Metrics.h"
+
+#define RUN_MS 2000
+#define DRAIN_MS 200
+#define PACKET_SIZE 28 // about what /servo/0/position 512 comes to
+#define MAX_CLIENTS 64
+
+#define END 0300
+#define ESC 0333
+#define ESC_END 0334
+#define ESC_ESC 0335
+
+/*
+	The slave side, the way UsbSerial::write( ) does it - one caller at a
+	time, waiting for room if the board's behind.
+*/
+class Port
+{
+	public:
+		Port( int fd ) : fd( fd ), writes( 0 ) { }
+		int fd;
+		int writes;
+		QMutex mutex;
+
+		bool write( const char* data, int length )
+		{
+			QMutexLocker locker( &mutex );
+			writes++;
+			while( length > 0 )
+			{
+				int size = ::write( fd, data, length );
+				if( size > 0 )
+				{
+					data += size;
+					length -= size;
+					continue;
+				}
+				if( size < 0 && errno == EAGAIN )
+				{
+					struct pollfd p = { fd, POLLOUT, 0 };
+					if( poll( &p, 1, 1000 ) > 0 )
+						continue;
+				}
+				return false;
+			}
+			return true;
+		}
+};
+
+// how PacketUsbCdc::sendPacket( ) used to do it
+static bool sendPerPacket( Port* port, const char* packet, int length )
+{
+	QByteArray outgoingPacket;
+	outgoingPacket.append( (char)END );
+	while( length-- )
+	{
+		switch( (uchar)*packet )
+		{
+			case END:
+				outgoingPacket.append( (char)ESC );
+				outgoingPacket.append( (char)ESC_END );
+				break;
+			case ESC:
+				outgoingPacket.append( (char)ESC );
+				outgoingPacket.append( (char)ESC_ESC );
+				break;
+			default:
+				outgoingPacket.append( *packet );
+		}
+		packet++;
+	}
+	outgoingPacket.append( (char)END );
+	return port->write( outgoingPacket.data( ), outgoingPacket.size( ) );
+}
+
+class PortOutput : public UsbWriter::Output
+{
+	public:
+		PortOutput( Port* port ) : port( port ) { }
+		bool writeFrames( char* data, int length ) { return port->write( data, length ); }
+		Port* port;
+};
+
+class Client : public QThread
+{
+	public:
+		Client( int id, Port* port, UsbWriter* writer ) : id( id ), sent( 0 ), port( port ), writer( writer ), stop( false ) { }
+		int id;
+		int sent;
+		Port* port;
+		UsbWriter* writer; // NULL for the old way
+		volatile bool stop;
+
+	protected:
+		void run( )
+		{
+			char packet[ PACKET_SIZE ];
+			memset( packet, 0, sizeof( packet ) );
+			memcpy( packet, "/servo/0/position\0\0\0,i\0\0", 24 );
+			while( !stop )
+			{
+				packet[ 24 ] = (char)id;
+				memcpy( packet + 25, &sent, 3 ); // the low three bytes are plenty
+				bool ok = ( writer != NULL ) ? writer->send( packet, PACKET_SIZE ) : sendPerPacket( port, packet, PACKET_SIZE );
+				if( !ok )
+					return;
+				sent++;
+			}
+		}
+};
+
+class FakeBoard : public QThread
+{
+	public:
+		FakeBoard( int fd ) : fd( fd ), received( 0 ), outOfOrder( 0 ), stop( false ), slip( 256, 64 )
+		{
+			memset( next, 0, sizeof( next ) );
+		}
+		int fd;
+		int received;
+		int outOfOrder;
+		volatile bool stop;
+
+	protected:
+		void run( )
+		{
+			char buffer[ 4096 ];
+			char packet[ 64 ];
+			while( !stop )
+			{
+				struct pollfd p = { fd, POLLIN, 0 };
+				if( poll( &p, 1, 50 ) <= 0 )
+					continue;
+				int got = read( fd, buffer, sizeof( buffer ) );
+				if( got <= 0 )
+					continue;
+				int used = 0;
+				while( used < got )
+				{
+					used += slip.decode( buffer + used, got - used );
+					while( slip.isPacketWaiting( ) )
+					{
+						if( slip.takePacket( packet, sizeof( packet ) ) != PACKET_SIZE )
+						{
+							outOfOrder++;
+							continue;
+						}
+						int client = (uchar)packet[ 24 ];
+						int sequence = 0;
+						memcpy( &sequence, packet + 25, 3 );
+						if( client >= MAX_CLIENTS || sequence != ( next[ client ] & 0xFFFFFF ) )
+							outOfOrder++;
+						else
+							next[ client ]++;
+						received++;
+					}
+				}
+			}
+		}
+
+	private:
+		SlipDecoder slip;
+		int next[ MAX_CLIENTS ];
+};
+
+static void makeRaw( int fd )
+{
+	struct termios t;
+	tcgetattr( fd, &t );
+	cfmakeraw( &t );
+	tcsetattr( fd, TCSANOW, &t );
+}
+
+static qint64 cpuMicroseconds( )
+{
+	struct rusage r;
+	getrusage( RUSAGE_SELF, &r );
+	return (qint64)( r.ru_utime.tv_sec + r.ru_stime.tv_sec ) * 1000000 + r.ru_utime.tv_usec + r.ru_stime.tv_usec;
+}
+
+/*
+	window < 0 is the old way, otherwise it's a UsbWriter with that window.
+*/
+static bool runMode( const char* mode, int window, int clients )
+{
+	int master = posix_openpt( O_RDWR | O_NOCTTY );
+	if( master < 0 || grantpt( master ) < 0 || unlockpt( master ) < 0 )
+	{
+		printf( "couldn't open a pty\n" );
+		return false;
+	}
+	int slave = open( ptsname( master ), O_RDWR | O_NOCTTY | O_NONBLOCK );
+	makeRaw( master );
+	makeRaw( slave );
+
+	Port port( slave );
+	PortOutput output( &port );
+	UsbWriter* writer = NULL;
+	if( window >= 0 )
+	{
+		writer = new UsbWriter( &output );
+		writer->setWindow( window );
+	}
+	FakeBoard board( master );
+	QList<Client*> senders;
+	for( int i = 0; i < clients; i++ )
+		senders.append( new Client( i, &port, writer ) );
+
+	qint64 cpuStart = cpuMicroseconds( );
+	qint64 start = Metrics::microseconds( );
+	board.start( );
+	for( int i = 0; i < clients; i++ )
+		senders.at( i )->start( );
+	usleep( RUN_MS * 1000 );
+	int sent = 0;
+	for( int i = 0; i < clients; i++ )
+	{
+		senders.at( i )->stop = true;
+		senders.at( i )->wait( );
+		sent += senders.at( i )->sent;
+	}
+	double seconds = ( Metrics::microseconds( ) - start ) / 1000000.0;
+	usleep( DRAIN_MS * 1000 ); // let the writer and the board catch up before counting
+	board.stop = true;
+	board.wait( );
+	qint64 cpu = cpuMicroseconds( ) - cpuStart;
+	delete writer;
+	qDeleteAll( senders );
+	close( slave );
+	close( master );
+
+	bool ok = ( board.received == sent ) && board.outOfOrder == 0;
+	printf( "%-12s %7d %10.0f %10.0f %8.1f %6.1f%%  %s\n", mode, clients, board.received / seconds, port.writes / seconds,
+			port.writes ? (double)board.received / port.writes : 0.0, 100.0 * cpu / ( seconds * 1000000 ),
+			ok ? "ok" : "LOST OR OUT OF ORDER" );
+	return ok;
+}
+
+int main( int argc, char** argv )
+{
+	int clients = ( argc > 1 ) ? atoi( argv[ 1 ] ) : 1;
+	if( clients <= 0 || clients > MAX_CLIENTS )
+	{
+		printf( "usage: usbwritebench [clients, up to %d]\n", MAX_CLIENTS );
+		return 1;
+	}
+	printf( "%-12s %7s %10s %10s %8s %7s\n", "mode", "clients", "frames/s", "writes/s", "per write", "cpu" );
+	bool ok = runMode( "per-packet", -1, clients );
+	ok &= runMode( "writer", 0, clients );
+	ok &= runMode( "writer 1ms", 1, clients );
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,44 @@
+# ------------------------------------------------------------------------------
+#
+# Copyright 2008 MakingThings
+#
+# Licensed under the Apache License, 
+# Version 2.0 (the "License"); you may not use this file except in compliance 
+# with the License. You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0 
+# 
+# Unless required by applicable law or agreed to in writing, software distributed
+# under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+# CONDITIONS OF ANY KIND, either express or implied. See the License for
+# the specific language governing permissions and limitations under the License.
+#
+# ------------------------------------------------------------------------------
+
+# Writing to USB boards - a write( ) per packet the way PacketUsbCdc used to,
+# vs. the UsbWriter, with a pty standing in for the board.
+# Build with qmake && make, then run ./usbwritebench
+
+TEMPLATE = app
+CONFIG += console release
+CONFIG -= app_bundle
+QT -= gui
+QT += network
+
+INCLUDEPATH += ../../include
+HEADERS = ../../include/UsbWriter.h \
+          ../../include/SlipEncoder.h \
+          ../../include/SlipDecoder.h \
+          ../../include/Metrics.h \
+          ../../include/Osc.h
+SOURCES = usbwritebench.cpp \
+          ../../source/UsbWriter.cpp \
+          ../../source/SlipEncoder.cpp \
+          ../../source/SlipDecoder.cpp \
+          ../../source/Metrics.cpp \
+          ../../source/Osc.cpp \
+          ../../source/MessageEvent.cpp
+
+LIBS += -lrt
+
+TARGET = usbwritebench